@@ -1,19 +1,25 @@
 const path = require('path');
 const fs = require('fs');
+const { pathToFileURL } = require('url');
+const { Worker } = require('worker_threads');
 const {
   app,
   BrowserWindow,
   ipcMain,
   desktopCapturer,
+  net,
+  protocol,
   session,
   webContents,
 } = require('electron');
 
+// The addon runs in a worker thread (systemAudioWorker.cjs) that owns the
+// capture sessions; this thread only forwards their chunks to the windows.
 const systemAudioState = {
-  addon: null,
-  callbackInstalled: false,
-  started: false,
-  subscribers: new Set(),
+  worker: null,
+  // Request id -> { resolve, reject } for calls awaiting the worker's reply.
+  pending: new Map(),
+  nextRequestId: 1,
 };
 
 function resolveSystemAudioAddonPath() {
@@ -63,9 +69,28 @@ function resolveSystemAudioAddonPath() {
   return null;
 }
 
-function loadSystemAudioAddon() {
-  if (systemAudioState.addon) {
-    return systemAudioState.addon;
+// The worklet's WebAssembly jitter buffer ships next to the addon (inside
+// the asar, which fs reads transparently); without it the worklet queues in
+// JavaScript.
+function readJitterBufferWasm() {
+  try {
+    return fs.readFileSync(path.join(__dirname, 'native', 'jitter_buffer.wasm'));
+  } catch (_err) {
+    return null;
+  }
+}
+
+// Worker scripts are run from disk, so a packaged app starts the copy
+// unpacked next to the asar.
+function resolveSystemAudioWorkerPath() {
+  return path
+    .join(__dirname, 'systemAudioWorker.cjs')
+    .replace(/app\.asar([\\/])/, 'app.asar.unpacked$1');
+}
+
+function getSystemAudioWorker() {
+  if (systemAudioState.worker) {
+    return systemAudioState.worker;
   }
 
   const addonPath = resolveSystemAudioAddonPath();
@@ -73,90 +98,213 @@ function loadSystemAudioAddon() {
     throw new Error('System audio addon not found. Run `npm run build:native` before Electron.');
   }
 
-  // eslint-disable-next-line global-require, import/no-dynamic-require
-  systemAudioState.addon = require(addonPath);
-  return systemAudioState.addon;
+  const worker = new Worker(resolveSystemAudioWorkerPath(), { workerData: { addonPath } });
+  worker.on('message', handleSystemAudioWorkerMessage);
+  worker.on('error', (err) => failSystemAudioWorker(worker, err));
+  worker.on('exit', (code) => {
+    failSystemAudioWorker(worker, new Error(`System audio worker exited with code ${code}.`));
+  });
+  systemAudioState.worker = worker;
+  return worker;
 }
 
-function toArrayBuffer(value) {
-  if (!value) return null;
-  const bytes = Buffer.isBuffer(value)
-    ? value
-    : value instanceof Uint8Array
-      ? Buffer.from(value)
-      : Buffer.from(value);
-  return bytes.buffer.slice(bytes.byteOffset, bytes.byteOffset + bytes.byteLength);
+// Rejects every call the worker will no longer answer; the next call starts
+// a fresh one.
+function failSystemAudioWorker(worker, error) {
+  if (systemAudioState.worker !== worker) return;
+  systemAudioState.worker = null;
+  for (const { reject } of systemAudioState.pending.values()) {
+    reject(error);
+  }
+  systemAudioState.pending.clear();
 }
 
-function broadcastSystemAudioChunk(chunk) {
-  const pcm = toArrayBuffer(chunk?.pcm);
-  if (!pcm) return;
-
-  const payload = {
-    pcm,
-    sampleRate: chunk.sampleRate,
-    channels: chunk.channels,
-    frameCount: chunk.frameCount,
-    sequence: chunk.sequence,
-    timestampMs: chunk.timestampMs,
-  };
-
-  for (const id of Array.from(systemAudioState.subscribers)) {
-    const target = webContents.fromId(id);
-    if (!target || target.isDestroyed()) {
-      systemAudioState.subscribers.delete(id);
-      continue;
-    }
-    try {
-      target.send('system-audio:chunk', payload);
-    } catch (_err) {
-      systemAudioState.subscribers.delete(id);
-    }
+function callSystemAudioWorker(type, fields = {}) {
+  let worker;
+  try {
+    worker = getSystemAudioWorker();
+  } catch (err) {
+    return Promise.reject(err);
   }
+  const id = systemAudioState.nextRequestId;
+  systemAudioState.nextRequestId += 1;
+  return new Promise((resolve, reject) => {
+    systemAudioState.pending.set(id, { resolve, reject });
+    worker.postMessage({ id, type, ...fields });
+  });
 }
 
-function ensureSystemAudioCallbackInstalled() {
-  const addon = loadSystemAudioAddon();
-  if (systemAudioState.callbackInstalled) {
+function handleSystemAudioWorkerMessage(message) {
+  if (message.type === 'chunks') {
+    sendSystemAudioChunks(message.webContentsId, message.payloads);
     return;
   }
 
-  addon.setChunkCallback((chunk) => {
-    broadcastSystemAudioChunk(chunk);
-  });
-  systemAudioState.callbackInstalled = true;
+  const request = systemAudioState.pending.get(message.id);
+  if (!request) return;
+  systemAudioState.pending.delete(message.id);
+  if (message.error) {
+    request.reject(new Error(message.error));
+  } else {
+    request.resolve(message.result);
+  }
 }
 
-function maybeStopSystemAudio() {
-  if (systemAudioState.subscribers.size > 0 || !systemAudioState.started) {
-    return;
-  }
+function createIdleLatencySummary() {
+  return { count: 0, p50Us: 0, p99Us: 0, p999Us: 0, maxUs: 0 };
+}
 
-  if (!systemAudioState.addon) {
-    systemAudioState.started = false;
+function createIdleSystemAudioStats() {
+  return {
+    running: false,
+    standby: false,
+    warmStart: false,
+    startToFirstChunkMs: 0,
+    backend: '',
+    encoding: 'pcm',
+    sampleFormat: 's16',
+    sessionId: 0,
+    sharedSessions: 0,
+    capturedInputFrames: 0,
+    emittedOutputFrames: 0,
+    emittedChunks: 0,
+    droppedChunks: 0,
+    dropReasons: {
+      noCallback: 0,
+      encoderBusy: 0,
+      poolExhausted: 0,
+      queueFull: 0,
+      evictedOldest: 0,
+      blockTimeout: 0,
+    },
+    silentInputFrames: 0,
+    suppressedChunks: 0,
+    silenceMarkers: 0,
+    discontinuities: 0,
+    concealedFrames: 0,
+    droppedInputFrames: 0,
+    queueOverruns: 0,
+    inputSampleRate: 0,
+    inputChannels: 0,
+    inputChannelMask: 0,
+    outputSampleRate: 0,
+    outputChannels: 0,
+    chunkFrameMs: 0,
+    encodedPackets: 0,
+    encodedBytes: 0,
+    encoderDroppedFrames: 0,
+    encodeTimeAvgUs: 0,
+    encodeTimeMaxUs: 0,
+    lastError: '',
+    drift: { correctionPpm: 0, estimatePpm: 0, reportedQueueMs: 0, reports: 0 },
+    levels: { windowMs: 0, peakDbfs: [], rmsDbfs: [] },
+    scheduling: {
+      policy: 'normal',
+      mechanism: 'none',
+      priority: 0,
+      error: '',
+      wakeupJitter: createIdleLatencySummary(),
+    },
+    latency: {
+      deviceToCapture: createIdleLatencySummary(),
+      captureToEmit: createIdleLatencySummary(),
+      emitToDispatch: createIdleLatencySummary(),
+      dispatchToReturn: createIdleLatencySummary(),
+    },
+    deliveryPolicy: 'drop-oldest',
+    deliveryQueued: 0,
+    deliveryQueueHighWater: 0,
+    deliveryBatches: 0,
+    deliveryAvgBatch: 0,
+    deliveryMaxBatch: 0,
+    deliveryDispatchFailures: 0,
+    poolSize: 0,
+    poolInUse: 0,
+    poolHighWater: 0,
+    poolExhausted: 0,
+    poolWrappedChunks: 0,
+    poolCopiedChunks: 0,
+  };
+}
+
+// Payloads arrive from the worker ready to send, one batch per message.
+function sendSystemAudioChunks(webContentsId, payloads) {
+  const target = webContents.fromId(webContentsId);
+  if (!target || target.isDestroyed()) {
+    stopSystemAudioSession(webContentsId);
     return;
   }
-
   try {
-    systemAudioState.addon.stop();
+    target.send('system-audio:chunk', payloads);
   } catch (_err) {
-    // Ignore stop errors during cleanup.
+    stopSystemAudioSession(webContentsId);
   }
-  systemAudioState.started = false;
 }
 
-function registerSystemAudioSubscriber(webContentsId) {
-  if (typeof webContentsId !== 'number') return;
-  systemAudioState.subscribers.add(webContentsId);
+function toSystemAudioSessionOptions(options) {
+  return {
+    targetSampleRate: options.targetSampleRate || 48000,
+    channels: options.channels || 2,
+    frameMs: options.frameMs || 20,
+    resamplerQuality: options.resamplerQuality || 'high-fidelity',
+    dither: options.dither === true,
+    downmixMatrix: Array.isArray(options.downmixMatrix) ? options.downmixMatrix : undefined,
+    encoding: options.encoding === 'opus' ? 'opus' : 'pcm',
+    // Float chunks are PCM only; Opus always encodes int16.
+    sampleFormat:
+      options.encoding !== 'opus' &&
+      ['f32-planar', 'f32-interleaved'].includes(options.sampleFormat)
+        ? options.sampleFormat
+        : 's16',
+    opus: options.opus && typeof options.opus === 'object' ? options.opus : undefined,
+    source: options.source && typeof options.source === 'object' ? options.source : undefined,
+    driftCompensation:
+      options.driftCompensation && typeof options.driftCompensation === 'object'
+        ? options.driftCompensation
+        : options.driftCompensation === true,
+    silenceSuppression:
+      options.silenceSuppression && typeof options.silenceSuppression === 'object'
+        ? options.silenceSuppression
+        : options.silenceSuppression === true,
+    schedulingPolicy: options.schedulingPolicy || 'pro-audio',
+    batch: true,
+    maxBatch: 16,
+    queuePolicy: 'drop-oldest',
+  };
 }
 
-function unregisterSystemAudioSubscriber(webContentsId) {
-  if (typeof webContentsId !== 'number') return;
-  systemAudioState.subscribers.delete(webContentsId);
-  maybeStopSystemAudio();
+async function getSystemAudioSessionStats(webContentsId) {
+  if (!systemAudioState.worker) return createIdleSystemAudioStats();
+  const stats = await callSystemAudioWorker('stats', { webContentsId });
+  return stats || createIdleSystemAudioStats();
+}
+
+async function stopSystemAudioSession(webContentsId) {
+  if (!systemAudioState.worker) return createIdleSystemAudioStats();
+  try {
+    const stats = await callSystemAudioWorker('stop', { webContentsId });
+    return stats || createIdleSystemAudioStats();
+  } catch (_err) {
+    // Ignore stop errors during cleanup.
+    return createIdleSystemAudioStats();
+  }
+}
+
+// Stops every session and closes the device; the worker stays up for the
+// next session.
+async function shutdownSystemAudio() {
+  if (!systemAudioState.worker) return;
+  try {
+    await callSystemAudioWorker('shutdown');
+  } catch (_err) {
+    // Ignore shutdown errors during cleanup.
+  }
 }
 
 function createMainWindow() {
+  // The preload loads the addon too, to feed the worklet's shared ring from
+  // the capture thread without going through this process.
+  const addonPath = resolveSystemAudioAddonPath();
   const win = new BrowserWindow({
     width: 1400,
     height: 900,
@@ -168,6 +316,7 @@ function createMainWindow() {
       contextIsolation: true,
       nodeIntegration: false,
       sandbox: false,
+      additionalArguments: addonPath ? [`--system-audio-addon=${addonPath}`] : [],
     },
   });
   const wcId = win.webContents.id;
@@ -177,17 +326,108 @@ function createMainWindow() {
     win.loadURL(devServerUrl);
     win.webContents.openDevTools({ mode: 'detach' });
     win.on('closed', () => {
-      unregisterSystemAudioSubscriber(wcId);
+      stopSystemAudioSession(wcId);
     });
     return;
   }
 
-  win.loadFile(path.join(__dirname, '..', 'dist', 'index.html'));
+  win.loadURL(`${APP_SCHEME}://${APP_HOST}/index.html`);
   win.on('closed', () => {
-    unregisterSystemAudioSubscriber(wcId);
+    stopSystemAudioSession(wcId);
   });
 }
 
+// The renderer hands system audio to its AudioWorklet through a
+// SharedArrayBuffer ring, which needs a cross-origin isolated page. A file://
+// page never is, so the build is served from a standard, secure scheme with
+// COOP/COEP, and the dev server's pages get the same headers. COEP is
+// credentialless: cross-origin subresources such as the web font stylesheet
+// load without cookies instead of having to send CORP themselves.
+const APP_SCHEME = 'app';
+const APP_HOST = 'bundle';
+const ISOLATION_HEADERS = {
+  'Cross-Origin-Opener-Policy': 'same-origin',
+  'Cross-Origin-Embedder-Policy': 'credentialless',
+};
+// An empty page on the app:// origin, for migrateFileOriginStorage().
+const STORAGE_MIGRATION_PATH = '/__storage-migration';
+
+protocol.registerSchemesAsPrivileged([
+  { scheme: APP_SCHEME, privileges: { standard: true, secure: true, supportFetchAPI: true } },
+]);
+
+function registerAppProtocol() {
+  const distDir = path.join(__dirname, '..', 'dist');
+  protocol.handle(APP_SCHEME, async (request) => {
+    const { pathname } = new URL(request.url);
+    if (pathname === STORAGE_MIGRATION_PATH) {
+      return new Response('', { headers: { 'Content-Type': 'text/html' } });
+    }
+
+    const filePath = path.join(distDir, decodeURIComponent(pathname));
+    const relative = path.relative(distDir, filePath);
+    if (relative.startsWith('..') || path.isAbsolute(relative)) {
+      return new Response(null, { status: 404 });
+    }
+
+    const response = await net.fetch(pathToFileURL(filePath).toString());
+    const headers = new Headers(response.headers);
+    for (const [name, value] of Object.entries(ISOLATION_HEADERS)) {
+      headers.set(name, value);
+    }
+    // The bundle is only for this origin's own pages.
+    headers.set('Cross-Origin-Resource-Policy', 'same-origin');
+    return new Response(response.body, { status: response.status, headers });
+  });
+}
+
+// Dev-server documents get the isolation headers the app:// handler sends;
+// nothing else is touched.
+function setupCrossOriginIsolation(devServerUrl) {
+  const devOrigin = new URL(devServerUrl).origin;
+  session.defaultSession.webRequest.onHeadersReceived((details, callback) => {
+    const isDocument = details.resourceType === 'mainFrame' || details.resourceType === 'subFrame';
+    if (!isDocument || new URL(details.url).origin !== devOrigin) {
+      callback({});
+      return;
+    }
+    const responseHeaders = { ...details.responseHeaders };
+    for (const [name, value] of Object.entries(ISOLATION_HEADERS)) {
+      responseHeaders[name] = [value];
+    }
+    callback({ responseHeaders });
+  });
+}
+
+// Builds before the app:// scheme loaded from file://, so their localStorage
+// (the profile name, the language) belongs to that origin. Copies it over
+// once, without overwriting anything the app:// origin already has.
+let migratingStorage = false;
+async function migrateFileOriginStorage() {
+  const marker = path.join(app.getPath('userData'), 'file-origin-storage-migrated');
+  if (fs.existsSync(marker)) return;
+
+  migratingStorage = true;
+  const win = new BrowserWindow({ show: false, webPreferences: { sandbox: true } });
+  try {
+    await win.loadFile(path.join(__dirname, 'blank.html'));
+    const entries = await win.webContents.executeJavaScript('Object.entries(localStorage)');
+    if (entries.length > 0) {
+      await win.loadURL(`${APP_SCHEME}://${APP_HOST}${STORAGE_MIGRATION_PATH}`);
+      await win.webContents.executeJavaScript(
+        `for (const [key, value] of ${JSON.stringify(entries)}) {
+          if (localStorage.getItem(key) === null) localStorage.setItem(key, value);
+        }`
+      );
+    }
+    fs.writeFileSync(marker, '');
+  } catch (_err) {
+    // Left for the next launch; the app starts with defaults meanwhile.
+  } finally {
+    win.destroy();
+  }
+}
+
 function setupPermissions() {
   session.defaultSession.setPermissionRequestHandler((_wc, permission, callback) => {
     if (permission === 'media' || permission === 'display-capture') {
@@ -229,81 +469,60 @@ function setupIpc() {
     }));
   });
 
+  // Opens the device ahead of the first start so sharing only has to start
+  // the stream. Sessions must then ask for the same source and scheduling.
+  ipcMain.handle('system-audio:prepare', async (_event, options = {}) => {
+    return callSystemAudioWorker('prepare', { options: toSystemAudioSessionOptions(options) });
+  });
+
+  // Starts the device for the first session, opening it unless it was
+  // prepared, and settles once audio arrives or with the device error; later
+  // sessions attach to the running stream.
   ipcMain.handle('system-audio:start', async (event, options = {}) => {
-    registerSystemAudioSubscriber(event.sender.id);
-    try {
-      const addon = loadSystemAudioAddon();
-      ensureSystemAudioCallbackInstalled();
-
-      if (!systemAudioState.started) {
-        addon.start({
-          targetSampleRate: options.targetSampleRate || 48000,
-          channels: options.channels || 2,
-          frameMs: options.frameMs || 20,
-        });
-
-        await new Promise((resolve) => setTimeout(resolve, 100));
-        const stats = addon.getStats();
-        if (!stats.running && stats.lastError) {
-          throw new Error(stats.lastError);
-        }
+    const stats = await callSystemAudioWorker('start', {
+      webContentsId: event.sender.id,
+      options: toSystemAudioSessionOptions(options),
+    });
+    return stats || createIdleSystemAudioStats();
+  });
 
-        systemAudioState.started = true;
-      }
+  ipcMain.handle('system-audio:jitter-buffer-wasm', async () => readJitterBufferWasm());
 
-      return addon.getStats();
-    } catch (error) {
-      unregisterSystemAudioSubscriber(event.sender.id);
-      throw error;
-    }
-  });
+  ipcMain.handle('system-audio:stop', async (event) => stopSystemAudioSession(event.sender.id));
 
-  ipcMain.handle('system-audio:stop', async (event) => {
-    unregisterSystemAudioSubscriber(event.sender.id);
-    if (systemAudioState.addon) {
-      return systemAudioState.addon.getStats();
-    }
+  ipcMain.handle('system-audio:stats', async (event) =>
+    getSystemAudioSessionStats(event.sender.id),
+  );
 
-    return {
-      running: false,
-      capturedInputFrames: 0,
-      emittedOutputFrames: 0,
-      emittedChunks: 0,
-      droppedChunks: 0,
-      silentInputFrames: 0,
-      inputSampleRate: 0,
-      outputSampleRate: 0,
-      outputChannels: 0,
-      chunkFrameMs: 0,
-      lastError: '',
-    };
+  // Fire-and-forget feedback from the renderer's worklet, ~10 per second.
+  ipcMain.on('system-audio:queue-level', (event, queueMs) => {
+    const { worker } = systemAudioState;
+    if (!worker || typeof queueMs !== 'number' || !Number.isFinite(queueMs)) return;
+    worker.postMessage({ type: 'queueLevel', webContentsId: event.sender.id, queueMs });
   });
 
-  ipcMain.handle('system-audio:stats', async () => {
-    if (!systemAudioState.addon) {
-      return {
-        running: false,
-        capturedInputFrames: 0,
-        emittedOutputFrames: 0,
-        emittedChunks: 0,
-        droppedChunks: 0,
-        silentInputFrames: 0,
-        inputSampleRate: 0,
-        outputSampleRate: 0,
-        outputChannels: 0,
-        chunkFrameMs: 0,
-        lastError: '',
-      };
+  ipcMain.handle('system-audio:reset-latency', async (event) => {
+    if (!systemAudioState.worker) {
+      return createIdleSystemAudioStats();
     }
 
-    return systemAudioState.addon.getStats();
+    const stats = await callSystemAudioWorker('resetLatency', { webContentsId: event.sender.id });
+    return stats || createIdleSystemAudioStats();
   });
 }
 
-app.whenReady().then(() => {
+app.whenReady().then(async () => {
+  const devServerUrl = process.env.VITE_DEV_SERVER_URL;
+  if (devServerUrl) {
+    setupCrossOriginIsolation(devServerUrl);
+  } else {
+    registerAppProtocol();
+    await migrateFileOriginStorage();
+  }
   setupPermissions();
   setupIpc();
   createMainWindow();
+  migratingStorage = false;
 
   app.on('activate', () => {
     if (BrowserWindow.getAllWindows().length === 0) {
@@ -313,13 +532,25 @@ app.whenReady().then(() => {
 });
 
 app.on('window-all-closed', () => {
-  maybeStopSystemAudio();
+  // Closing the hidden migration window is not the user quitting.
+  if (migratingStorage || BrowserWindow.getAllWindows().length > 0) return;
   if (process.platform !== 'darwin') {
     app.quit();
+    return;
   }
+  shutdownSystemAudio();
 });
 
-app.on('before-quit', () => {
-  systemAudioState.subscribers.clear();
-  maybeStopSystemAudio();
+// Quitting waits for the worker to stop the device, then ends the worker.
+let systemAudioShutDown = false;
+app.on('before-quit', (event) => {
+  const { worker } = systemAudioState;
+  if (systemAudioShutDown || !worker) return;
+  event.preventDefault();
+  shutdownSystemAudio()
+    .then(() => worker.terminate())
+    .finally(() => {
+      systemAudioShutDown = true;
+      app.quit();
+    });
 });
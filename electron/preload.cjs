@@ -1,17 +1,96 @@
 const { contextBridge, ipcRenderer } = require('electron');
 
+// Main passes the addon's path; loading it here lets the capture thread
+// write PCM straight into the worklet's SharedArrayBuffer ring, with no IPC
+// or JavaScript per chunk. This renderer then owns its own device stream.
+const addonArgument = process.argv.find((arg) => arg.startsWith('--system-audio-addon='));
+let systemAudioAddon;
+
+function getSystemAudioAddon() {
+  if (systemAudioAddon === undefined) {
+    systemAudioAddon = null;
+    if (addonArgument) {
+      try {
+        systemAudioAddon = require(addonArgument.slice(addonArgument.indexOf('=') + 1));
+      } catch (_err) {
+        // The ring is then fed through main, like the message transport.
+      }
+    }
+  }
+  return systemAudioAddon;
+}
+
+// contextBridge cannot carry a SharedArrayBuffer, so the page posts the
+// ring's buffer to its own window, where this isolated world receives it.
+const RING_MESSAGE = 'system-audio:ring';
+const RING_MESSAGE_TIMEOUT_MS = 1000;
+
+function receiveRingBuffer(id) {
+  return new Promise((resolve, reject) => {
+    const onMessage = (event) => {
+      const data = event.data;
+      if (event.source !== window || data?.type !== RING_MESSAGE || data.id !== id) return;
+      window.removeEventListener('message', onMessage);
+      clearTimeout(timer);
+      resolve(data.buffer);
+    };
+    const timer = setTimeout(() => {
+      window.removeEventListener('message', onMessage);
+      reject(new Error('The shared ring buffer never arrived.'));
+    }, RING_MESSAGE_TIMEOUT_MS);
+    window.addEventListener('message', onMessage);
+  });
+}
+
+const systemAudioRing = {
+  isAvailable: () => getSystemAudioAddon() !== null,
+  prepare: (options = {}) => getSystemAudioAddon().prepare(options).then(() => true),
+  // Call, then post { type: 'system-audio:ring', id, buffer } to the window.
+  start: async (id, options = {}) => {
+    const addon = getSystemAudioAddon();
+    const buffer = await receiveRingBuffer(id);
+    addon.attachSharedRing(new Int32Array(buffer));
+    try {
+      return await addon.start(options);
+    } catch (err) {
+      addon.detachSharedRing();
+      throw err;
+    }
+  },
+  stop: async () => {
+    const addon = getSystemAudioAddon();
+    const stats = await addon.stop();
+    addon.detachSharedRing();
+    return stats;
+  },
+  getStats: () => getSystemAudioAddon().getStats(),
+  reportQueueLevel: (queueMs) => getSystemAudioAddon().reportQueueLevel(queueMs),
+};
+
 contextBridge.exposeInMainWorld('electronAPI', {
   isElectron: true,
   getSources: () => ipcRenderer.invoke('desktop:getSources'),
+  prepareSystemAudio: (options = {}) => ipcRenderer.invoke('system-audio:prepare', options),
   startSystemAudio: (options = {}) => ipcRenderer.invoke('system-audio:start', options),
   stopSystemAudio: () => ipcRenderer.invoke('system-audio:stop'),
   getSystemAudioStats: () => ipcRenderer.invoke('system-audio:stats'),
+  resetSystemAudioLatencyStats: () => ipcRenderer.invoke('system-audio:reset-latency'),
+  getJitterBufferWasm: () => ipcRenderer.invoke('system-audio:jitter-buffer-wasm'),
+  reportSystemAudioQueueLevel: (queueMs) => ipcRenderer.send('system-audio:queue-level', queueMs),
+  systemAudioRing,
   onAudioChunk: (callback) => {
     if (typeof callback !== 'function') {
       return () => {};
     }
 
-    const listener = (_event, payload) => callback(payload);
+    // Main batches chunks that queued up during a stall into one message.
+    const listener = (_event, payload) => {
+      if (Array.isArray(payload)) {
+        for (const chunk of payload) callback(chunk);
+      } else {
+        callback(payload);
+      }
+    };
     ipcRenderer.on('system-audio:chunk', listener);
     return () => {
       ipcRenderer.removeListener('system-audio:chunk', listener);
@@ -0,0 +1,153 @@
+// Runs the system audio addon on its own thread. Capture, conversion, Opus
+// encoding and the per-window fan-out already run on native threads; this
+// keeps their JS half (turning chunks into payloads, batching, stats) off
+// the main process's event loop, which only forwards finished payloads to
+// their windows. The addon keeps separate state for this thread, and
+// terminating the worker stops its capture through the addon's cleanup hook.
+const { parentPort, workerData } = require('worker_threads');
+
+// eslint-disable-next-line import/no-dynamic-require
+const addon = require(workerData.addonPath);
+
+// webContents id -> { ready, session }. Every window gets its own session in
+// its own format; the addon shares one device stream among them. `ready`
+// settles with the session once the addon has started it, and `session` is
+// set from then on.
+const sessions = new Map();
+
+function toSystemAudioPayload(chunk, transfer) {
+  // The addon's buffer goes as-is. Under Electron the addon already copied
+  // it out of its slab into an ArrayBuffer of its own (`transferable`), so
+  // it moves to the main thread instead of being cloned; IPC serialization
+  // to the window is then the only other copy. A buffer that still wraps a
+  // slab is cloned, as detaching it would pull the slab out from under the
+  // pool.
+  const encoding = chunk?.encoding || 'pcm';
+  const data = encoding === 'opus' ? chunk?.packet : chunk?.pcm;
+  if (encoding !== 'silence' && (!data || !data.byteLength)) return null;
+
+  const payload = {
+    encoding,
+    sampleFormat: chunk.sampleFormat || 's16',
+    sampleRate: chunk.sampleRate,
+    channels: chunk.channels,
+    frameCount: chunk.frameCount,
+    sequence: chunk.sequence,
+    samplePosition: chunk.samplePosition,
+    timestampMs: chunk.timestampMs,
+    captureTimeMs: chunk.captureTimeMs,
+  };
+  if (encoding === 'opus') {
+    payload.packet = data;
+  } else if (encoding === 'pcm') {
+    payload.pcm = data;
+  }
+  if (data && chunk.transferable && data.byteLength === data.buffer.byteLength) {
+    transfer.push(data.buffer);
+  }
+  return payload;
+}
+
+function postChunks(webContentsId, chunks) {
+  // The addon coalesces chunks that queued up while this thread was busy;
+  // they go to the window as one message so a stall is caught up in one send.
+  const payloads = [];
+  const transfer = [];
+  for (const chunk of chunks) {
+    const payload = toSystemAudioPayload(chunk, transfer);
+    if (payload) payloads.push(payload);
+  }
+  if (payloads.length === 0) return;
+  parentPort.postMessage({ type: 'chunks', webContentsId, payloads }, transfer);
+}
+
+function getSessionStats(webContentsId) {
+  const entry = sessions.get(webContentsId);
+  return entry && entry.session ? entry.session.getStats() : null;
+}
+
+async function startSession(webContentsId, options) {
+  const existing = sessions.get(webContentsId);
+  if (existing) {
+    await existing.ready;
+    return getSessionStats(webContentsId);
+  }
+
+  // Starts the device for the first session, opening it unless it was
+  // prepared, and settles once audio arrives or with the device error;
+  // later sessions attach to the running stream.
+  const entry = { ready: null, session: null };
+  entry.ready = addon
+    .createSession(options, (chunks) => postChunks(webContentsId, chunks))
+    .then((captureSession) => {
+      entry.session = captureSession;
+      return captureSession;
+    });
+  sessions.set(webContentsId, entry);
+  try {
+    await entry.ready;
+  } catch (err) {
+    if (sessions.get(webContentsId) === entry) {
+      sessions.delete(webContentsId);
+    }
+    throw err;
+  }
+  // Stopped while it was starting.
+  if (sessions.get(webContentsId) !== entry) {
+    return null;
+  }
+  return entry.session.getStats();
+}
+
+// A session still starting is stopped once it has started.
+async function stopSession(webContentsId) {
+  const entry = sessions.get(webContentsId);
+  if (!entry) return null;
+
+  sessions.delete(webContentsId);
+  try {
+    const captureSession = await entry.ready;
+    return (await captureSession.stop()) || null;
+  } catch (_err) {
+    // A session that failed to start has nothing to stop.
+    return null;
+  }
+}
+
+async function shutdown() {
+  await Promise.all(Array.from(sessions.keys(), (id) => stopSession(id)));
+  await addon.releaseSessions();
+  return null;
+}
+
+const handlers = {
+  prepare: (message) => addon.prepareSessions(message.options).then(() => true),
+  start: (message) => startSession(message.webContentsId, message.options),
+  stop: (message) => stopSession(message.webContentsId),
+  stats: (message) => getSessionStats(message.webContentsId),
+  resetLatency: (message) => {
+    addon.resetLatencyStats();
+    return getSessionStats(message.webContentsId);
+  },
+  shutdown,
+};
+
+parentPort.on('message', (message) => {
+  // Fire-and-forget feedback from the renderer's worklet, ~10 per second.
+  if (message.type === 'queueLevel') {
+    const entry = sessions.get(message.webContentsId);
+    if (entry && entry.session) entry.session.reportQueueLevel(message.queueMs);
+    return;
+  }
+
+  const handler = handlers[message.type];
+  Promise.resolve()
+    .then(() => {
+      if (!handler) throw new Error(`Unknown system audio request: ${message.type}`);
+      return handler(message);
+    })
+    .then(
+      (result) => parentPort.postMessage({ id: message.id, result }),
+      (err) => parentPort.postMessage({ id: message.id, error: err?.message || String(err) }),
+    );
+});
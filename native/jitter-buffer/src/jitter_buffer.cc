@@ -0,0 +1,214 @@
+#include "jitter_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+namespace {
+
+constexpr float kInt16Scale = 1.0f / 32768.0f;
+
+// Splits interleaved stereo int16 into two float planes, four frames per
+// step when built with -msimd128.
+void DeinterleaveStereo(const int16_t* source, uint32_t frames, float* left, float* right) {
+  uint32_t frame = 0;
+#if defined(__wasm_simd128__)
+  const v128_t scale = wasm_f32x4_splat(kInt16Scale);
+  for (; frame + 4 <= frames; frame += 4) {
+    const v128_t pairs = wasm_v128_load(source + frame * 2);
+    const v128_t planar = wasm_i16x8_shuffle(pairs, pairs, 0, 2, 4, 6, 1, 3, 5, 7);
+    const v128_t lefts = wasm_f32x4_convert_i32x4(wasm_i32x4_extend_low_i16x8(planar));
+    const v128_t rights = wasm_f32x4_convert_i32x4(wasm_i32x4_extend_high_i16x8(planar));
+    wasm_v128_store(left + frame, wasm_f32x4_mul(lefts, scale));
+    wasm_v128_store(right + frame, wasm_f32x4_mul(rights, scale));
+  }
+#endif
+  for (; frame < frames; ++frame) {
+    left[frame] = source[frame * 2] * kInt16Scale;
+    right[frame] = source[frame * 2 + 1] * kInt16Scale;
+  }
+}
+
+}  // namespace
+
+void JitterBuffer::Configure(uint32_t max_queue_frames) {
+  max_queue_frames_ =
+      std::min(std::max(max_queue_frames, kMaxRenderFrames), kCapacityFrames - kMaxRenderFrames);
+  write_ = 0;
+  read_ = 0;
+  silence_begin_ = 0;
+  silence_end_ = 0;
+  playing_silence_ = false;
+  silence_debt_frames_ = 0;
+  last_left_ = 0.0f;
+  last_right_ = 0.0f;
+  conceal_gain_ = 0.0f;
+  fade_in_frames_ = 0;
+  frames_rendered_ = 0;
+  frames_underrun_ = 0;
+  frames_concealed_ = 0;
+  frames_dropped_ = 0;
+  frames_silent_ = 0;
+}
+
+void JitterBuffer::Flush() {
+  read_ = write_;
+  silence_begin_ = silence_end_ = write_;
+  playing_silence_ = false;
+  silence_debt_frames_ = 0;
+  conceal_gain_ = 0.0f;
+  fade_in_frames_ = 0;
+}
+
+void JitterBuffer::MakeRoom(uint32_t frames) {
+  const uint32_t queued = queued_frames();
+  if (queued + frames <= kCapacityFrames) return;
+  const uint32_t evicted = queued + frames - kCapacityFrames;
+  read_ += evicted;
+  frames_dropped_ += evicted;
+}
+
+uint32_t JitterBuffer::Push(const int16_t* samples, uint32_t frames, uint32_t channels) {
+  if (!samples || frames == 0 || channels == 0) return 0;
+  silence_debt_frames_ = 0;
+
+  // Only the newest ring's worth can survive anyway.
+  if (frames > kCapacityFrames) {
+    samples += static_cast<size_t>(frames - kCapacityFrames) * channels;
+    frames = kCapacityFrames;
+  }
+  MakeRoom(frames);
+
+  uint32_t done = 0;
+  while (done < frames) {
+    const uint32_t offset = static_cast<uint32_t>(write_ & (kCapacityFrames - 1));
+    const uint32_t run = std::min(frames - done, kCapacityFrames - offset);
+    int16_t* destination = FrameAt(write_);
+    const int16_t* source = samples + static_cast<size_t>(done) * channels;
+    if (channels == kChannels) {
+      std::memcpy(destination, source, static_cast<size_t>(run) * kChannels * sizeof(int16_t));
+    } else {
+      const uint32_t right_channel = channels > 1 ? 1 : 0;
+      for (uint32_t frame = 0; frame < run; ++frame) {
+        destination[frame * 2] = source[frame * channels];
+        destination[frame * 2 + 1] = source[frame * channels + right_channel];
+      }
+    }
+    write_ += run;
+    done += run;
+  }
+  return frames;
+}
+
+void JitterBuffer::PushSilence(uint32_t frames) {
+  const uint32_t owed = std::min(silence_debt_frames_, frames);
+  silence_debt_frames_ -= owed;
+  frames = std::min(frames - owed, kCapacityFrames);
+  if (frames == 0) return;
+  MakeRoom(frames);
+
+  if (silence_end_ != write_) silence_begin_ = write_;
+  uint32_t done = 0;
+  while (done < frames) {
+    const uint32_t offset = static_cast<uint32_t>(write_ & (kCapacityFrames - 1));
+    const uint32_t run = std::min(frames - done, kCapacityFrames - offset);
+    std::memset(FrameAt(write_), 0, static_cast<size_t>(run) * kChannels * sizeof(int16_t));
+    write_ += run;
+    done += run;
+  }
+  silence_end_ = write_;
+}
+
+void JitterBuffer::Convert(uint64_t position, uint32_t frames, float* left, float* right) {
+  while (frames > 0) {
+    const uint32_t offset = static_cast<uint32_t>(position & (kCapacityFrames - 1));
+    const uint32_t run = std::min(frames, kCapacityFrames - offset);
+    DeinterleaveStereo(FrameAt(position), run, left, right);
+    position += run;
+    left += run;
+    right += run;
+    frames -= run;
+  }
+}
+
+void JitterBuffer::Conceal(float* left, float* right, uint32_t frames) {
+  const float step = 1.0f / kFadeFrames;
+  for (uint32_t frame = 0; frame < frames; ++frame) {
+    if (conceal_gain_ > 0.0f) {
+      conceal_gain_ = std::max(conceal_gain_ - step, 0.0f);
+      ++frames_concealed_;
+    }
+    left[frame] = last_left_ * conceal_gain_;
+    right[frame] = last_right_ * conceal_gain_;
+  }
+}
+
+uint32_t JitterBuffer::SilentFramesIn(uint64_t begin, uint64_t end) const {
+  const uint64_t overlap_begin = std::max(begin, silence_begin_);
+  const uint64_t overlap_end = std::min(end, silence_end_);
+  return overlap_end > overlap_begin ? static_cast<uint32_t>(overlap_end - overlap_begin) : 0;
+}
+
+void JitterBuffer::Render(float* left, float* right, uint32_t frames) {
+  frames = std::min(frames, kMaxRenderFrames);
+
+  uint32_t available = queued_frames();
+  uint64_t trimmed_from = read_;
+  uint32_t crossfade = 0;
+  if (available > max_queue_frames_) {
+    const uint32_t skipped = available - max_queue_frames_;
+    read_ += skipped;
+    available = max_queue_frames_;
+    frames_dropped_ += skipped;
+    crossfade = std::min(kFadeFrames, frames);
+  }
+
+  const uint32_t count = std::min(available, frames);
+  if (count > 0) {
+    Convert(read_, count, left, right);
+
+    if (crossfade > 0) {
+      // Nothing is pushed during Render(), so the skipped frames are intact.
+      float old_left[kFadeFrames];
+      float old_right[kFadeFrames];
+      crossfade = std::min(crossfade, count);
+      Convert(trimmed_from, crossfade, old_left, old_right);
+      for (uint32_t frame = 0; frame < crossfade; ++frame) {
+        const float weight = static_cast<float>(frame + 1) / (crossfade + 1);
+        left[frame] = old_left[frame] + (left[frame] - old_left[frame]) * weight;
+        right[frame] = old_right[frame] + (right[frame] - old_right[frame]) * weight;
+      }
+    }
+
+    for (uint32_t frame = 0; frame < count && fade_in_frames_ > 0; ++frame, --fade_in_frames_) {
+      const float gain = static_cast<float>(kFadeFrames - fade_in_frames_ + 1) / kFadeFrames;
+      left[frame] *= gain;
+      right[frame] *= gain;
+    }
+
+    frames_silent_ += SilentFramesIn(read_, read_ + count);
+    playing_silence_ = SilentFramesIn(read_ + count - 1, read_ + count) != 0;
+    read_ += count;
+    last_left_ = left[count - 1];
+    last_right_ = right[count - 1];
+    conceal_gain_ = 1.0f;
+  }
+
+  if (count < frames) {
+    const uint32_t missing = frames - count;
+    if (playing_silence_) {
+      silence_debt_frames_ += missing;
+      std::fill(left + count, left + frames, 0.0f);
+      std::fill(right + count, right + frames, 0.0f);
+    } else {
+      frames_underrun_ += missing;
+      Conceal(left + count, right + count, missing);
+      fade_in_frames_ = kFadeFrames;
+    }
+  }
+
+  frames_rendered_ += frames;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Playout queue behind the system audio AudioWorklet. Chunks of interleaved
+// int16 go in as they arrive; Render() hands out one render quantum at a
+// time as planar float. Storage is a fixed stereo ring, so nothing on the
+// render path allocates.
+//
+// When the queue runs dry the last frame fades out instead of stopping
+// dead, and playback fades back in once audio arrives. When it grows past
+// the configured maximum the excess is skipped with a short crossfade.
+// Silence pushed with PushSilence() is played as zeros; underruns while
+// silence is playing are owed against the next silence push rather than
+// counted, since a silence marker describes time that has already passed.
+//
+// Not thread-safe: the worklet pushes and renders on the audio thread.
+class JitterBuffer {
+ public:
+  static constexpr uint32_t kChannels = 2;
+  static constexpr uint32_t kCapacityFrames = 1u << 18;
+  static constexpr uint32_t kMaxRenderFrames = 1024;
+  // Length of the underrun fade-out, the fade-in after it and the trim
+  // crossfade.
+  static constexpr uint32_t kFadeFrames = 64;
+
+  // Clears the queue and counters. `max_queue_frames` is clamped to what the
+  // ring can hold.
+  void Configure(uint32_t max_queue_frames);
+  // Drops whatever is queued; counters are kept.
+  void Flush();
+
+  // `samples` holds `frames` interleaved frames of `channels` channels. Mono
+  // is duplicated to both sides and channels past the second are ignored.
+  // Returns the frames queued; frames the ring cannot hold evict the oldest.
+  uint32_t Push(const int16_t* samples, uint32_t frames, uint32_t channels);
+  void PushSilence(uint32_t frames);
+
+  // Fills `frames` (at most kMaxRenderFrames) frames of each plane.
+  void Render(float* left, float* right, uint32_t frames);
+
+  uint32_t queued_frames() const { return static_cast<uint32_t>(write_ - read_); }
+  bool playing_silence() const { return playing_silence_; }
+  uint64_t frames_rendered() const { return frames_rendered_; }
+  uint64_t frames_underrun() const { return frames_underrun_; }
+  uint64_t frames_concealed() const { return frames_concealed_; }
+  uint64_t frames_dropped() const { return frames_dropped_; }
+  uint64_t frames_silent() const { return frames_silent_; }
+
+ private:
+  int16_t* FrameAt(uint64_t position) {
+    return ring_ + (position & (kCapacityFrames - 1)) * kChannels;
+  }
+  void MakeRoom(uint32_t frames);
+  // Converts `frames` queued frames starting at `position`, across the wrap.
+  void Convert(uint64_t position, uint32_t frames, float* left, float* right);
+  void Conceal(float* left, float* right, uint32_t frames);
+  uint32_t SilentFramesIn(uint64_t begin, uint64_t end) const;
+
+  int16_t ring_[kCapacityFrames * kChannels];
+  uint64_t write_ = 0;
+  uint64_t read_ = 0;
+  uint32_t max_queue_frames_ = kCapacityFrames - kMaxRenderFrames;
+
+  // The most recent run of pushed silence, as ring positions.
+  uint64_t silence_begin_ = 0;
+  uint64_t silence_end_ = 0;
+  bool playing_silence_ = false;
+  uint32_t silence_debt_frames_ = 0;
+
+  float last_left_ = 0.0f;
+  float last_right_ = 0.0f;
+  float conceal_gain_ = 0.0f;
+  uint32_t fade_in_frames_ = 0;
+
+  uint64_t frames_rendered_ = 0;
+  uint64_t frames_underrun_ = 0;
+  uint64_t frames_concealed_ = 0;
+  uint64_t frames_dropped_ = 0;
+  uint64_t frames_silent_ = 0;
+};
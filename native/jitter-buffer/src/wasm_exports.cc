@@ -0,0 +1,96 @@
+// C entry points for the WebAssembly build. Each module instance holds one
+// jitter buffer; JavaScript copies chunks into the input area, calls
+// jb_push(), and reads each rendered quantum from the two output planes.
+// All storage is static, so the module needs no allocator and imports
+// nothing.
+
+#include <emscripten/emscripten.h>
+
+#include "jitter_buffer.h"
+
+namespace {
+
+constexpr uint32_t kInputSamples = 16384;
+
+JitterBuffer g_buffer;
+int16_t g_input[kInputSamples];
+float g_output_left[JitterBuffer::kMaxRenderFrames];
+float g_output_right[JitterBuffer::kMaxRenderFrames];
+
+}  // namespace
+
+extern "C" {
+
+EMSCRIPTEN_KEEPALIVE int16_t* jb_input_buffer() {
+  return g_input;
+}
+
+EMSCRIPTEN_KEEPALIVE uint32_t jb_input_samples() {
+  return kInputSamples;
+}
+
+EMSCRIPTEN_KEEPALIVE float* jb_output_left() {
+  return g_output_left;
+}
+
+EMSCRIPTEN_KEEPALIVE float* jb_output_right() {
+  return g_output_right;
+}
+
+EMSCRIPTEN_KEEPALIVE uint32_t jb_max_render_frames() {
+  return JitterBuffer::kMaxRenderFrames;
+}
+
+EMSCRIPTEN_KEEPALIVE void jb_configure(uint32_t max_queue_frames) {
+  g_buffer.Configure(max_queue_frames);
+}
+
+EMSCRIPTEN_KEEPALIVE void jb_flush() {
+  g_buffer.Flush();
+}
+
+// Queues `frames` frames of `channels` channels from the input area.
+EMSCRIPTEN_KEEPALIVE uint32_t jb_push(uint32_t frames, uint32_t channels) {
+  if (channels == 0 || static_cast<uint64_t>(frames) * channels > kInputSamples) return 0;
+  return g_buffer.Push(g_input, frames, channels);
+}
+
+EMSCRIPTEN_KEEPALIVE void jb_push_silence(uint32_t frames) {
+  g_buffer.PushSilence(frames);
+}
+
+EMSCRIPTEN_KEEPALIVE void jb_render(uint32_t frames) {
+  g_buffer.Render(g_output_left, g_output_right, frames);
+}
+
+EMSCRIPTEN_KEEPALIVE uint32_t jb_queued_frames() {
+  return g_buffer.queued_frames();
+}
+
+EMSCRIPTEN_KEEPALIVE int jb_playing_silence() {
+  return g_buffer.playing_silence() ? 1 : 0;
+}
+
+// Counters go out as doubles; JavaScript numbers hold them exactly well past
+// any realistic session length.
+EMSCRIPTEN_KEEPALIVE double jb_frames_rendered() {
+  return static_cast<double>(g_buffer.frames_rendered());
+}
+
+EMSCRIPTEN_KEEPALIVE double jb_frames_underrun() {
+  return static_cast<double>(g_buffer.frames_underrun());
+}
+
+EMSCRIPTEN_KEEPALIVE double jb_frames_concealed() {
+  return static_cast<double>(g_buffer.frames_concealed());
+}
+
+EMSCRIPTEN_KEEPALIVE double jb_frames_dropped() {
+  return static_cast<double>(g_buffer.frames_dropped());
+}
+
+EMSCRIPTEN_KEEPALIVE double jb_frames_silent() {
+  return static_cast<double>(g_buffer.frames_silent());
+}
+
+}  // extern "C"
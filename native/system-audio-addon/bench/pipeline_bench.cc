@@ -0,0 +1,391 @@
+// Microbenchmarks for the capture DSP path on Google Benchmark, built with
+// CMake outside node-gyp so they run without Node or an audio device. Every
+// case counts device (input) frames: `items_per_second` is frames/s and
+// `frame_time` the time per frame, so stages can be compared against each
+// other and against the real-time budget of one frame per 1/rate seconds.
+//
+//   npm run bench:native -- [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>]
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "capture_config.h"
+#include "channel_mixer.h"
+#include "chunk_pool.h"
+#include "level_meter.h"
+#include "polyphase_resampler.h"
+#include "sample_convert.h"
+#include "spsc_ring_buffer.h"
+#include "system_audio_capture.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kBlockFrames = 512;
+
+// How long each end-to-end iteration lets the synthetic source run.
+constexpr double kPipelineWindowS = 0.25;
+
+// Makes the memory behind `data` observable so the optimizer cannot drop
+// the stores that produced it.
+template <typename T>
+void Consume(const T* data) {
+  benchmark::DoNotOptimize(data);
+  benchmark::ClobberMemory();
+}
+
+// Counts `frames` device frames per iteration.
+void CountFrames(benchmark::State& state, size_t frames) {
+  const double total = static_cast<double>(state.iterations()) * static_cast<double>(frames);
+  state.SetItemsProcessed(static_cast<int64_t>(total));
+  state.counters["frame_time"] =
+      benchmark::Counter(total, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+template <typename Fn>
+void Register(const std::string& name, Fn&& fn) {
+  benchmark::RegisterBenchmark(name.c_str(), std::forward<Fn>(fn));
+}
+
+// A device packet of a 997 Hz tone in `format`, so decoders see realistic
+// sign and magnitude patterns.
+std::vector<uint8_t> MakeDevicePacket(SampleFormat format, uint32_t channels, size_t frames) {
+  const size_t bytes = BytesPerSample(format);
+  std::vector<uint8_t> packet(frames * channels * bytes);
+  for (size_t frame = 0; frame < frames; ++frame) {
+    const double value = 0.5 * std::sin(2.0 * 3.14159265358979 * 997.0 * frame / 48000.0);
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+      uint8_t* out = packet.data() + (frame * channels + channel) * bytes;
+      switch (format) {
+        case SampleFormat::kFloat32: {
+          const float sample = static_cast<float>(value);
+          std::memcpy(out, &sample, sizeof(sample));
+          break;
+        }
+        case SampleFormat::kInt16: {
+          const int16_t sample = static_cast<int16_t>(value * 32767.0);
+          std::memcpy(out, &sample, sizeof(sample));
+          break;
+        }
+        case SampleFormat::kInt24: {
+          const int32_t sample = static_cast<int32_t>(value * 8388607.0);
+          out[0] = static_cast<uint8_t>(sample);
+          out[1] = static_cast<uint8_t>(sample >> 8);
+          out[2] = static_cast<uint8_t>(sample >> 16);
+          break;
+        }
+        default: {
+          const int32_t sample = static_cast<int32_t>(value * 2147483647.0);
+          std::memcpy(out, &sample, sizeof(sample));
+          break;
+        }
+      }
+    }
+  }
+  return packet;
+}
+
+std::vector<float> MakeFloatFrames(uint32_t channels, size_t frames) {
+  std::vector<float> samples(frames * channels);
+  for (size_t index = 0; index < samples.size(); ++index) {
+    samples[index] = 0.5f * std::sin(static_cast<float>(index) * 0.01f);
+  }
+  return samples;
+}
+
+std::string Label(const char* stage, const std::string& detail) {
+  return std::string(stage) + "/" + detail;
+}
+
+void RegisterDecode() {
+  const SampleFormat formats[] = {SampleFormat::kFloat32, SampleFormat::kInt16,
+                                  SampleFormat::kInt24, SampleFormat::kInt24In32,
+                                  SampleFormat::kInt32};
+  for (SampleFormat format : formats) {
+    for (uint32_t channels : {2u, 6u, 8u}) {
+      const std::string detail =
+          std::string(SampleFormatName(format)) + "/" + std::to_string(channels) + "ch";
+
+      Register(Label("decode_to_f32", detail), [format, channels](benchmark::State& state) {
+        const std::vector<uint8_t> packet = MakeDevicePacket(format, channels, kBlockFrames);
+        const FloatDecodeFn to_float = SelectFloatDecoder(format, channels, channels);
+        std::vector<float> floats(kBlockFrames * channels);
+        for (auto _ : state) {
+          to_float(packet.data(), kBlockFrames, channels, channels, floats.data());
+          Consume(floats.data());
+        }
+        CountFrames(state, kBlockFrames);
+      });
+
+      // The direct path taken when no mixing or resampling is needed.
+      Register(Label("decode_to_s16", detail), [format, channels](benchmark::State& state) {
+        const std::vector<uint8_t> packet = MakeDevicePacket(format, channels, kBlockFrames);
+        const Int16DecodeFn to_int16 = SelectInt16Decoder(format, channels, channels);
+        std::vector<int16_t> ints(kBlockFrames * channels);
+        TpdfDither dither;
+        for (auto _ : state) {
+          to_int16(packet.data(), kBlockFrames, channels, channels, ints.data(), &dither);
+          Consume(ints.data());
+        }
+        CountFrames(state, kBlockFrames);
+      });
+    }
+  }
+}
+
+void RegisterDownmix() {
+  for (uint32_t input_channels : {2u, 6u, 8u}) {
+    for (uint32_t output_channels : {1u, 2u}) {
+      if (input_channels == output_channels) continue;
+      const std::string detail =
+          std::to_string(input_channels) + "to" + std::to_string(output_channels);
+      Register(Label("downmix", detail), [input_channels,
+                                          output_channels](benchmark::State& state) {
+        ChannelMixer mixer;
+        std::string error;
+        if (!mixer.Configure(input_channels, DefaultChannelMask(input_channels),
+                             output_channels, {}, &error)) {
+          state.SkipWithError(error.c_str());
+          return;
+        }
+        const std::vector<float> input = MakeFloatFrames(input_channels, kBlockFrames);
+        std::vector<float> output(kBlockFrames * output_channels);
+        for (auto _ : state) {
+          mixer.Process(input.data(), kBlockFrames, output.data());
+          Consume(output.data());
+        }
+        CountFrames(state, kBlockFrames);
+      });
+    }
+  }
+}
+
+void RegisterResample() {
+  for (uint32_t input_rate : {44100u, 48000u, 96000u}) {
+    for (ResamplerQuality quality :
+         {ResamplerQuality::kLowLatency, ResamplerQuality::kHighFidelity}) {
+      for (uint32_t channels : {1u, 2u}) {
+        const uint32_t output_rate = input_rate == 48000 ? 44100 : 48000;
+        const std::string detail = std::to_string(input_rate) + "to" +
+                                   std::to_string(output_rate) + "/" +
+                                   ResamplerQualityName(quality) + "/" +
+                                   std::to_string(channels) + "ch";
+        Register(Label("resample", detail), [input_rate, output_rate, quality,
+                                             channels](benchmark::State& state) {
+          PolyphaseResampler resampler;
+          std::string error;
+          if (!resampler.Configure(input_rate, output_rate, channels, quality, &error)) {
+            state.SkipWithError(error.c_str());
+            return;
+          }
+          const std::vector<float> input = MakeFloatFrames(channels, kBlockFrames);
+          const size_t max_output = resampler.MaxOutputFrames(kBlockFrames);
+          std::vector<float> output(max_output * channels);
+          for (auto _ : state) {
+            resampler.Process(input.data(), kBlockFrames, output.data(), max_output);
+            Consume(output.data());
+          }
+          CountFrames(state, kBlockFrames);
+        });
+      }
+    }
+  }
+}
+
+void RegisterQuantize() {
+  for (bool dithered : {false, true}) {
+    Register(Label("to_int16", dithered ? "2ch/tpdf" : "2ch"),
+             [dithered](benchmark::State& state) {
+               const std::vector<float> input = MakeFloatFrames(2, kBlockFrames);
+               std::vector<int16_t> output(kBlockFrames * 2);
+               TpdfDither dither;
+               dither.enabled = dithered;
+               for (auto _ : state) {
+                 FloatToInt16(input.data(), input.size(), output.data(), &dither);
+                 Consume(output.data());
+               }
+               CountFrames(state, kBlockFrames);
+             });
+  }
+}
+
+// Per-channel peak and RMS as every chunk is cut, for both output formats.
+void RegisterLevels() {
+  for (uint32_t channels : {2u, 6u, 8u}) {
+    const std::string detail = std::to_string(channels) + "ch";
+    Register(Label("levels_s16", detail), [channels](benchmark::State& state) {
+      const std::vector<float> floats = MakeFloatFrames(channels, kBlockFrames);
+      std::vector<int16_t> ints(floats.size());
+      for (size_t index = 0; index < floats.size(); ++index) {
+        ints[index] = static_cast<int16_t>(floats[index] * 32767.0f);
+      }
+      LevelMeter meter;
+      meter.Configure(channels, kBlockFrames * 4);
+      for (auto _ : state) {
+        Consume(&meter.reading());
+        meter.Measure(ints.data(), kBlockFrames);
+      }
+      CountFrames(state, kBlockFrames);
+    });
+    Register(Label("levels_f32", detail), [channels](benchmark::State& state) {
+      const std::vector<float> floats = MakeFloatFrames(channels, kBlockFrames);
+      LevelMeter meter;
+      meter.Configure(channels, kBlockFrames * 4);
+      for (auto _ : state) {
+        Consume(&meter.reading());
+        meter.Measure(floats.data(), kBlockFrames);
+      }
+      CountFrames(state, kBlockFrames);
+    });
+  }
+}
+
+// The pending-sample ring the pipeline chunks through, then the copy into a
+// pooled slab that the addon hands to JS.
+void RegisterChunking() {
+  for (uint32_t frame_ms : {10u, 20u, 40u}) {
+    CaptureConfig config;
+    config.frame_ms = frame_ms;
+    const size_t chunk_samples = ChunkSampleCount(NormalizeCaptureConfig(config));
+
+    Register(Label("chunk", std::to_string(frame_ms) + "ms"),
+             [chunk_samples](benchmark::State& state) {
+               std::vector<int16_t> block(kBlockFrames * 2, 1);
+               SpscRingBuffer<int16_t> pending(chunk_samples * 4, chunk_samples);
+               for (auto _ : state) {
+                 size_t remaining = block.size();
+                 const int16_t* samples = block.data();
+                 while (remaining > 0) {
+                   const size_t written = pending.Write(samples, remaining);
+                   samples += written;
+                   remaining -= written;
+                   while (const int16_t* chunk = pending.Peek(chunk_samples)) {
+                     Consume(chunk);
+                     pending.Consume(chunk_samples);
+                   }
+                 }
+               }
+               CountFrames(state, kBlockFrames);
+             });
+
+    Register(Label("payload", std::to_string(frame_ms) + "ms"),
+             [chunk_samples](benchmark::State& state) {
+               std::shared_ptr<ChunkPool> pool = ChunkPool::Create(8, chunk_samples);
+               const std::vector<int16_t> chunk(chunk_samples, 1);
+               for (auto _ : state) {
+                 ChunkSlab* slab = pool->Acquire();
+                 std::copy(chunk.begin(), chunk.end(), slab->samples.data());
+                 slab->sample_count = chunk_samples;
+                 Consume(slab->samples.data());
+                 pool->Recycle(slab);
+               }
+               CountFrames(state, chunk_samples / 2);
+             });
+  }
+}
+
+// The whole engine on the synthetic backend in as-fast-as-possible mode:
+// decode, mix, resample, quantize, chunk and deliver, across the device,
+// conversion and delivery threads. Each iteration runs the source for
+// kPipelineWindowS of wall time and counts what it captured. Includes
+// generating the test signal, so read it as an upper bound.
+void RegisterEndToEnd() {
+  struct Case {
+    SampleFormat format;
+    uint32_t rate;
+    uint32_t channels;
+    uint32_t frame_ms;
+    PcmSampleFormat output = PcmSampleFormat::kInt16;
+  };
+  const Case cases[] = {
+      {SampleFormat::kFloat32, 48000, 2, 20},
+      {SampleFormat::kFloat32, 44100, 2, 20},
+      {SampleFormat::kFloat32, 48000, 8, 20},
+      {SampleFormat::kInt16, 48000, 2, 20},
+      {SampleFormat::kInt24, 96000, 6, 20},
+      {SampleFormat::kFloat32, 48000, 2, 10},
+      {SampleFormat::kFloat32, 48000, 2, 20, PcmSampleFormat::kFloat32Interleaved},
+      {SampleFormat::kFloat32, 48000, 2, 20, PcmSampleFormat::kFloat32Planar},
+      {SampleFormat::kFloat32, 44100, 2, 20, PcmSampleFormat::kFloat32Planar},
+  };
+  for (const Case& test : cases) {
+    std::string label = std::string(SampleFormatName(test.format)) + "/" +
+                        std::to_string(test.rate) + "/" + std::to_string(test.channels) + "ch/" +
+                        std::to_string(test.frame_ms) + "ms";
+    if (test.output != PcmSampleFormat::kInt16) {
+      label += std::string("/") + PcmSampleFormatName(test.output);
+    }
+
+    CaptureConfig config;
+    config.frame_ms = test.frame_ms;
+    config.pcm_format = test.output;
+    config.source.backend = "synthetic";
+    config.source.sample_format = test.format;
+    config.source.sample_rate = test.rate;
+    config.source.channels = test.channels;
+    config.source.realtime = false;
+
+    auto run = [config](benchmark::State& state) {
+      uint64_t frames = 0;
+      for (auto _ : state) {
+        SystemAudioCapture capture;
+        capture.SetChunkCallback([](const AudioChunk& chunk) {
+          Consume(chunk.samples);
+          Consume(chunk.float_samples);
+        });
+
+        std::string error;
+        const Clock::time_point started = Clock::now();
+        if (!capture.Start(config, &error)) {
+          state.SkipWithError(error.c_str());
+          return;
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(kPipelineWindowS));
+        capture.Stop();
+        state.SetIterationTime(std::chrono::duration<double>(Clock::now() - started).count());
+        const CaptureStats stats = capture.GetStats();
+        if (!stats.last_error.empty()) {
+          state.SkipWithError(stats.last_error.c_str());
+          return;
+        }
+        frames += stats.captured_input_frames;
+      }
+      state.SetItemsProcessed(static_cast<int64_t>(frames));
+      state.counters["frame_time"] = benchmark::Counter(
+          static_cast<double>(frames), benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    };
+    benchmark::RegisterBenchmark(Label("pipeline", label).c_str(), run)
+        ->UseManualTime()
+        ->Unit(benchmark::kMillisecond);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  RegisterDecode();
+  RegisterDownmix();
+  RegisterResample();
+  RegisterQuantize();
+  RegisterLevels();
+  RegisterChunking();
+  RegisterEndToEnd();
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 2;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -1,10 +1,29 @@
 {
+  "variables": {
+    "with_opus%": "<!(node -p \"process.env.SYSTEM_AUDIO_WITH_OPUS === '1' ? 'true' : 'false'\")",
+    "opus_dir%": "<!(node -p \"process.env.OPUS_DIR || ''\")"
+  },
   "targets": [
     {
       "target_name": "system_audio",
       "sources": [
+        "src/adaptive_resampler.cc",
         "src/addon.cc",
-        "src/wasapi_loopback.cc"
+        "src/audio_recorder.cc",
+        "src/capture_backend.cc",
+        "src/capture_config.cc",
+        "src/capture_hub.cc",
+        "src/channel_mixer.cc",
+        "src/chunk_converter.cc",
+        "src/level_meter.cc",
+        "src/opus_chunk_encoder.cc",
+        "src/polyphase_resampler.cc",
+        "src/sample_convert.cc",
+        "src/simd_support.cc",
+        "src/synthetic_backend.cc",
+        "src/system_audio_capture.cc",
+        "src/thread_scheduling.cc",
+        "src/wav_file_backend.cc"
       ],
       "include_dirs": [
         "<!@(node -p \"require('node-addon-api').include\")"
@@ -13,24 +32,95 @@
         "<!(node -p \"require('node-addon-api').gyp\")"
       ],
       "defines": [
-        "NAPI_CPP_EXCEPTIONS",
-        "WIN32_LEAN_AND_MEAN",
-        "UNICODE",
-        "_UNICODE"
+        "NAPI_CPP_EXCEPTIONS"
       ],
-      "libraries": [
-        "ole32.lib",
-        "uuid.lib",
-        "avrt.lib"
+      "cflags!": [
+        "-fno-exceptions"
       ],
-      "msvs_settings": {
-        "VCCLCompilerTool": {
-          "ExceptionHandling": 1,
-          "AdditionalOptions": [
-            "/EHsc"
-          ]
-        }
-      }
+      "cflags_cc!": [
+        "-fno-exceptions"
+      ],
+      "xcode_settings": {
+        "GCC_ENABLE_CPP_EXCEPTIONS": "YES"
+      },
+      "conditions": [
+        [
+          "OS=='win'",
+          {
+            "sources": [
+              "src/wasapi_loopback.cc"
+            ],
+            "defines": [
+              "WIN32_LEAN_AND_MEAN",
+              "UNICODE",
+              "_UNICODE"
+            ],
+            "libraries": [
+              "ole32.lib",
+              "uuid.lib",
+              "avrt.lib"
+            ],
+            "msvs_settings": {
+              "VCCLCompilerTool": {
+                "ExceptionHandling": 1,
+                "AdditionalOptions": [
+                  "/EHsc"
+                ]
+              }
+            }
+          }
+        ],
+        [
+          "OS=='linux'",
+          {
+            "sources": [
+              "src/pulse_monitor_backend.cc"
+            ],
+            "defines": [
+              "SYSTEM_AUDIO_WITH_PULSEAUDIO"
+            ],
+            "libraries": [
+              "-lpulse-simple",
+              "-lpulse",
+              "-ldl"
+            ]
+          }
+        ],
+        [
+          "with_opus=='true'",
+          {
+            "defines": [
+              "SYSTEM_AUDIO_WITH_OPUS"
+            ],
+            "conditions": [
+              [
+                "OS=='win'",
+                {
+                  "include_dirs": [
+                    "<(opus_dir)/include/opus"
+                  ],
+                  "libraries": [
+                    "<(opus_dir)/lib/opus.lib"
+                  ]
+                },
+                {
+                  "cflags": [
+                    "<!@(pkg-config --cflags opus)"
+                  ],
+                  "xcode_settings": {
+                    "OTHER_CFLAGS": [
+                      "<!@(pkg-config --cflags opus)"
+                    ]
+                  },
+                  "libraries": [
+                    "<!@(pkg-config --libs opus)"
+                  ]
+                }
+              ]
+            ]
+          }
+        ]
+      ]
     }
   ]
 }
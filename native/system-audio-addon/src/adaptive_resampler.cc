@@ -0,0 +1,120 @@
+#include "adaptive_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+// Same passband and stopband as the high-fidelity polyphase filter.
+constexpr double kKaiserBeta = 10.0;
+constexpr double kPassbandRolloff = 0.92;
+
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  const double half_x = x / 2.0;
+  for (int k = 1; k < 64; ++k) {
+    term *= (half_x / k) * (half_x / k);
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+  return sum;
+}
+
+}  // namespace
+
+void AdaptiveResampler::Configure(uint32_t channels) {
+  channels_ = channels;
+
+  const double center = static_cast<double>(kTaps) / 2.0 - 1.0;
+  const double half_width = static_cast<double>(kTaps) / 2.0;
+  const double beta_norm = BesselI0(kKaiserBeta);
+  kernels_.assign(static_cast<size_t>(kPhases + 1) * kTaps, 0.0f);
+  std::vector<double> taps(kTaps);
+  for (uint32_t phase = 0; phase <= kPhases; ++phase) {
+    const double fraction = static_cast<double>(phase) / kPhases;
+    float* row = kernels_.data() + static_cast<size_t>(phase) * kTaps;
+    double sum = 0.0;
+    for (uint32_t tap = 0; tap < kTaps; ++tap) {
+      const double t = static_cast<double>(tap) - center - fraction;
+      const double x = kPassbandRolloff * t;
+      const double sinc = std::abs(x) < 1e-12 ? 1.0 : std::sin(kPi * x) / (kPi * x);
+      const double ratio = t / half_width;
+      const double window =
+          BesselI0(kKaiserBeta * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) / beta_norm;
+      taps[tap] = sinc * window;
+      sum += taps[tap];
+    }
+    // Unity DC gain for every phase, so the ratio never modulates the level.
+    for (uint32_t tap = 0; tap < kTaps; ++tap) {
+      row[tap] = static_cast<float>(taps[tap] / sum);
+    }
+  }
+
+  history_.assign(static_cast<size_t>(channels_) * kTaps * 2, 0.0f);
+  blended_.assign(kTaps, 0.0f);
+  Reset();
+}
+
+void AdaptiveResampler::Reset() {
+  std::fill(history_.begin(), history_.end(), 0.0f);
+  history_position_ = 0;
+  position_ = 0.0;
+}
+
+size_t AdaptiveResampler::MaxOutputFrames(size_t input_frames) const {
+  return static_cast<size_t>(
+             std::ceil(static_cast<double>(input_frames) / (1.0 - kMaxRatioDeviation))) +
+         1;
+}
+
+size_t AdaptiveResampler::Process(const float* input,
+                                  size_t input_frames,
+                                  double ratio,
+                                  float* output,
+                                  size_t output_capacity) {
+  if (!input || !output || channels_ == 0) return 0;
+  ratio = std::clamp(ratio, 1.0 - kMaxRatioDeviation, 1.0 + kMaxRatioDeviation);
+
+  const size_t history_stride = static_cast<size_t>(kTaps) * 2;
+  size_t produced = 0;
+
+  for (size_t frame = 0; frame < input_frames; ++frame) {
+    const float* samples = input + frame * channels_;
+    for (uint32_t channel = 0; channel < channels_; ++channel) {
+      float* history = history_.data() + channel * history_stride;
+      history[history_position_] = samples[channel];
+      history[history_position_ + kTaps] = samples[channel];
+    }
+    history_position_ = history_position_ + 1 == kTaps ? 0 : history_position_ + 1;
+
+    while (position_ < 1.0) {
+      if (produced < output_capacity) {
+        const double scaled = position_ * kPhases;
+        const uint32_t phase = std::min(static_cast<uint32_t>(scaled), kPhases - 1);
+        const float blend = static_cast<float>(scaled - phase);
+        const float* low = kernels_.data() + static_cast<size_t>(phase) * kTaps;
+        const float* high = low + kTaps;
+        for (uint32_t tap = 0; tap < kTaps; ++tap) {
+          blended_[tap] = low[tap] + (high[tap] - low[tap]) * blend;
+        }
+
+        float* out = output + produced * channels_;
+        for (uint32_t channel = 0; channel < channels_; ++channel) {
+          const float* window = history_.data() + channel * history_stride + history_position_;
+          float sum = 0.0f;
+          for (uint32_t tap = 0; tap < kTaps; ++tap) {
+            sum += window[tap] * blended_[tap];
+          }
+          out[channel] = sum;
+        }
+        ++produced;
+      }
+      position_ += ratio;
+    }
+    position_ -= 1.0;
+  }
+
+  return produced;
+}
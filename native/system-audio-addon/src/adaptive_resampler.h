@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Variable-ratio resampler for small, continuously changing rate offsets,
+// such as trimming a stream by a few hundred ppm to follow another clock.
+// Each output sample is a windowed-sinc interpolation at an arbitrary
+// fractional position, with the kernel linearly interpolated between a fixed
+// table of phases. The ratio may change on every Process() call without
+// clicks; the cost is a 32-tap dot product per output sample and channel.
+class AdaptiveResampler {
+ public:
+  void Configure(uint32_t channels);
+  void Reset();
+
+  // Upper bound on frames produced by one Process() call for `input_frames`
+  // while the ratio stays within kMaxRatioDeviation of 1.
+  size_t MaxOutputFrames(size_t input_frames) const;
+
+  // Consumes interleaved float frames, advancing `ratio` input frames per
+  // output frame (above 1 shortens the stream). Returns the number of frames
+  // written; size `output` with MaxOutputFrames.
+  size_t Process(const float* input,
+                 size_t input_frames,
+                 double ratio,
+                 float* output,
+                 size_t output_capacity);
+
+  // Group delay of the filter, in input frames.
+  uint32_t latency_frames() const { return kTaps / 2; }
+
+  static constexpr double kMaxRatioDeviation = 0.01;
+
+ private:
+  static constexpr uint32_t kTaps = 32;
+  static constexpr uint32_t kPhases = 256;
+
+  uint32_t channels_ = 0;
+  // kPhases + 1 rows of kTaps, each ordered oldest-to-newest input sample;
+  // row p interpolates at fraction p / kPhases past the center tap.
+  std::vector<float> kernels_;
+  // Per channel, kTaps samples stored twice so the window is contiguous.
+  std::vector<float> history_;
+  uint32_t history_position_ = 0;
+  // Position of the next output between the two center taps, in input frames.
+  double position_ = 0.0;
+  std::vector<float> blended_;
+};
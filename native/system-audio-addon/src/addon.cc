@@ -1,38 +1,345 @@
 #include <napi.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
-#include "wasapi_loopback.h"
+#include "capture_hub.h"
+#include "chunk_delivery_queue.h"
+#include "chunk_pool.h"
+#include "latency_histogram.h"
+#include "shared_pcm_ring.h"
+#include "system_audio_capture.h"
 
 namespace {
 
-struct ChunkPayload {
-  std::vector<int16_t> samples;
-  uint32_t sample_rate = 48000;
-  uint32_t channels = 2;
-  uint64_t sequence = 0;
-  uint64_t timestamp_ms = 0;
+// Enough slabs for ~1.3 s of 20 ms chunks queued towards JS.
+constexpr uint32_t kChunkPoolSlabs = 64;
+
+// Everything between an engine chunk callback and one JS function: the slab
+// pool, the queue towards the JS thread and the ThreadSafeFunction draining
+// it. The start() API of each environment has one; every session gets its
+// own.
+struct ChunkChannel {
+  ChunkChannel() : queue(kChunkPoolSlabs) {}
+
+  // Guards tsf and pool.
+  std::mutex mutex;
+  std::shared_ptr<Napi::ThreadSafeFunction> tsf;
+  std::shared_ptr<ChunkPool> pool;
+  // Chunks waiting for the JS thread. Never replaced, so emitters and pending
+  // drains can use it without taking the mutex.
+  ChunkDeliveryQueue queue;
+
+  // The two hops the engine cannot see: emit to the drain picking the chunk
+  // up on the JS thread, and the JS callback itself.
+  LatencyHistogram emit_to_dispatch;
+  LatencyHistogram dispatch_to_return;
+
+  // JS thread only: chunks handed over by wrapping their slab, and chunks
+  // copied out of it because the runtime forbids external buffers.
+  uint64_t wrapped_chunks = 0;
+  uint64_t copied_chunks = 0;
+};
+
+struct SessionBinding {
+  std::shared_ptr<CaptureSession> session;
+  std::shared_ptr<ChunkChannel> channel;
+};
+
+// A start()/stop()-style call. Opening, starting and stopping a device wait
+// on the device thread, so that part runs on the libuv thread pool and the
+// call returns a Promise; the JS thread never waits on device I/O.
+struct ControlStep {
+  enum class Begin { kRun, kSkip, kFail };
+
+  // JS thread, when the step's turn comes: run `work`, settle straight away
+  // with `finish` (kSkip), or reject with the error (kFail). Optional.
+  std::function<Begin(Napi::Env, std::string* error)> begin;
+  // Thread pool. False rejects with the error, or with `failure`.
+  std::function<bool(std::string* error)> work;
+  // JS thread, after `work` succeeded or was skipped: what the Promise
+  // resolves with.
+  std::function<Napi::Value(Napi::Env)> finish;
+  // JS thread, after `begin` or `work` failed. Optional.
+  std::function<void()> cleanup;
+  std::string failure;
+};
+
+// Runs the steps given to it one at a time, in call order: the engine
+// serializes control calls anyway, and a stop() issued right after start()
+// has to stop that start rather than race it. JS thread only, but for
+// Close().
+class ControlQueue : public std::enable_shared_from_this<ControlQueue> {
+ public:
+  Napi::Value Run(Napi::Env env, ControlStep step) {
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    Napi::Promise promise = deferred.Promise();
+    pending_.push_back(Pending{std::move(step), std::move(deferred)});
+    if (!busy_) RunNext(env);
+    return promise;
+  }
+
+  // A step is queued or running on the thread pool.
+  bool busy() const { return busy_ || !pending_.empty(); }
+
+  // Any thread. Waits for the step running on the thread pool, if any, and
+  // makes every later one fail instead of touching the device.
+  void Close() {
+    std::lock_guard<std::mutex> lock(work_mutex_);
+    closed_ = true;
+  }
+
+ private:
+  struct Pending {
+    ControlStep step;
+    Napi::Promise::Deferred deferred;
+  };
+
+  class Worker : public Napi::AsyncWorker {
+   public:
+    Worker(Napi::Env env, std::shared_ptr<ControlQueue> queue, Pending pending)
+        : Napi::AsyncWorker(env, "SystemAudioControl"),
+          queue_(std::move(queue)),
+          pending_(std::move(pending)) {}
+
+    void Execute() override {
+      std::lock_guard<std::mutex> lock(queue_->work_mutex_);
+      std::string error;
+      if (queue_->closed_) {
+        SetError("The addon's JavaScript environment is shutting down.");
+      } else if (!pending_.step.work(&error)) {
+        SetError(error.empty() ? pending_.step.failure : error);
+      }
+    }
+
+    void OnOK() override {
+      Settle(Env(), &pending_, "");
+      queue_->RunNext(Env());
+    }
+
+    void OnError(const Napi::Error& error) override {
+      Settle(Env(), &pending_, error.Message());
+      queue_->RunNext(Env());
+    }
+
+   private:
+    const std::shared_ptr<ControlQueue> queue_;
+    Pending pending_;
+  };
+
+  // Resolves `pending` when `error` is empty, rejects it otherwise.
+  static void Settle(Napi::Env env, Pending* pending, const std::string& error) {
+    if (error.empty()) {
+      pending->deferred.Resolve(pending->step.finish(env));
+      return;
+    }
+    if (pending->step.cleanup) pending->step.cleanup();
+    pending->deferred.Reject(Napi::Error::New(env, error).Value());
+  }
+
+  void RunNext(Napi::Env env) {
+    busy_ = false;
+    while (!pending_.empty()) {
+      Pending next = std::move(pending_.front());
+      pending_.pop_front();
+      std::string error;
+      const ControlStep::Begin begin =
+          next.step.begin ? next.step.begin(env, &error) : ControlStep::Begin::kRun;
+      if (begin == ControlStep::Begin::kRun) {
+        busy_ = true;
+        (new Worker(env, shared_from_this(), std::move(next)))->Queue();
+        return;
+      }
+      if (begin == ControlStep::Begin::kFail && error.empty()) error = next.step.failure;
+      Settle(env, &next, begin == ControlStep::Begin::kSkip ? "" : error);
+    }
+  }
+
+  bool busy_ = false;
+  std::deque<Pending> pending_;
+  // Held while a step's work runs.
+  std::mutex work_mutex_;
+  bool closed_ = false;
+};
+
+// Everything the addon keeps for one JS environment: the main thread and
+// every worker_thread that loads it get their own capture, shared-capture
+// sessions and chunk channels, so a worker can own capture outright and
+// never share a callback with the thread that spawned it. Held as the
+// environment's instance data; steps still running on the thread pool keep
+// it alive through their own reference.
+struct AddonState {
+  // JS thread, from the environment's cleanup hook: stops every device and
+  // conversion thread, so nothing calls into the environment as it goes away.
+  void Shutdown();
+
+  // One device per environment: start() is a session on the same hub as
+  // every createSession().
+  const std::shared_ptr<CaptureHub> hub = std::make_shared<CaptureHub>();
+  const std::unique_ptr<SystemAudioCapture> capture = std::make_unique<SystemAudioCapture>(hub);
+  const std::shared_ptr<ChunkChannel> channel = std::make_shared<ChunkChannel>();
+
+  std::mutex sessions_mutex;
+  std::map<uint64_t, SessionBinding> sessions;
+  // Every createSession() binding whose ThreadSafeFunction is still live,
+  // from the call until its stop() settles: sessions still starting or
+  // stopping are missing from `sessions`.
+  std::vector<std::shared_ptr<SessionBinding>> live_bindings;
+  // Whether prepareSessions() holds the hub's standby. Touched only by
+  // sessions_control steps and, once that queue is closed, Shutdown().
+  bool sessions_prepared = false;
+
+  std::mutex callback_mutex;
+  // Set by attachSharedRing(): chunks go into the caller's SharedArrayBuffer
+  // instead of through the ThreadSafeFunction. The reference keeps the buffer
+  // alive while the capture thread may write to it.
+  std::shared_ptr<SharedPcmRingWriter> shared_ring;
+  Napi::ObjectReference shared_ring_buffer;
+
+  // One queue for the start() capture, one for the shared capture's sessions.
+  const std::shared_ptr<ControlQueue> capture_control = std::make_shared<ControlQueue>();
+  const std::shared_ptr<ControlQueue> sessions_control = std::make_shared<ControlQueue>();
 };
 
-std::mutex g_capture_mutex;
-std::unique_ptr<WasapiLoopbackCapture> g_capture;
+// Releases the channel's ThreadSafeFunction, once nothing emits into it any
+// more. Safe to call again.
+void ReleaseChannel(ChunkChannel& channel) {
+  std::lock_guard<std::mutex> lock(channel.mutex);
+  if (channel.tsf) {
+    channel.tsf->Release();
+    channel.tsf.reset();
+  }
+}
+
+void AddonState::Shutdown() {
+  // Once closed, no step touches the device or a binding any more, so the
+  // bindings below are final.
+  capture_control->Close();
+  sessions_control->Close();
+  capture->Release();
+  std::vector<std::shared_ptr<SessionBinding>> bindings;
+  {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    sessions.clear();
+    bindings.swap(live_bindings);
+  }
+  for (const std::shared_ptr<SessionBinding>& binding : bindings) {
+    hub->RemoveSession(binding->session);
+  }
+  if (sessions_prepared) {
+    sessions_prepared = false;
+    hub->Release();
+  }
+  // Every capture and conversion thread is joined, so no bridge calls the
+  // ThreadSafeFunctions; releasing them now rather than leaving them to the
+  // environment's teardown lets it finalize their callbacks in order.
+  ReleaseChannel(*channel);
+  for (const std::shared_ptr<SessionBinding>& binding : bindings) {
+    ReleaseChannel(*binding->channel);
+  }
+  // Nothing writes to the ring any more.
+  {
+    std::lock_guard<std::mutex> lock(callback_mutex);
+    shared_ring.reset();
+  }
+  shared_ring_buffer.Reset();
+}
+
+std::shared_ptr<AddonState> GetState(Napi::Env env) {
+  return *env.GetInstanceData<std::shared_ptr<AddonState>>();
+}
+
+// Reads the string option `key` through `parse`; throws a TypeError naming
+// the value and returns false when it is not one of `expected`.
+template <typename T>
+bool ParseNamedOption(Napi::Env env,
+                      const Napi::Object& options,
+                      const char* key,
+                      bool (*parse)(const std::string&, T*),
+                      const char* expected,
+                      T* value) {
+  if (!options.Has(key) || !options.Get(key).IsString()) return true;
+  const std::string name = options.Get(key).As<Napi::String>().Utf8Value();
+  if (parse(name, value)) return true;
+  Napi::TypeError::New(env, std::string(key) + " must be " + expected + ", not '" + name + "'.")
+      .ThrowAsJavaScriptException();
+  return false;
+}
 
-std::mutex g_callback_mutex;
-std::shared_ptr<Napi::ThreadSafeFunction> g_chunk_tsf;
+// Throws and returns false on an unknown sample format.
+bool ParseSourceConfig(Napi::Env env, const Napi::Object& options, SourceConfig* source) {
+  if (options.Has("backend") && options.Get("backend").IsString()) {
+    source->backend = options.Get("backend").As<Napi::String>().Utf8Value();
+  }
+  if (options.Has("device") && options.Get("device").IsString()) {
+    source->device = options.Get("device").As<Napi::String>().Utf8Value();
+  }
+  if (options.Has("signal") && options.Get("signal").IsString()) {
+    source->signal = options.Get("signal").As<Napi::String>().Utf8Value();
+  }
+  if (options.Has("toneHz") && options.Get("toneHz").IsNumber()) {
+    source->tone_hz = options.Get("toneHz").As<Napi::Number>().DoubleValue();
+  }
+  if (options.Has("amplitude") && options.Get("amplitude").IsNumber()) {
+    source->amplitude = options.Get("amplitude").As<Napi::Number>().DoubleValue();
+  }
+  if (options.Has("sampleRate") && options.Get("sampleRate").IsNumber()) {
+    source->sample_rate = options.Get("sampleRate").As<Napi::Number>().Uint32Value();
+  }
+  if (options.Has("channels") && options.Get("channels").IsNumber()) {
+    source->channels = options.Get("channels").As<Napi::Number>().Uint32Value();
+  }
+  if (!ParseNamedOption(env, options, "sampleFormat", ParseSampleFormat,
+                        "'f32', 's16', 's24', 's24-32' or 's32'", &source->sample_format)) {
+    return false;
+  }
+  if (options.Has("path") && options.Get("path").IsString()) {
+    source->wav_path = options.Get("path").As<Napi::String>().Utf8Value();
+  }
+  if (options.Has("loop") && options.Get("loop").IsBoolean()) {
+    source->loop = options.Get("loop").As<Napi::Boolean>().Value();
+  }
+  if (options.Has("realtime") && options.Get("realtime").IsBoolean()) {
+    source->realtime = options.Get("realtime").As<Napi::Boolean>().Value();
+  }
+  if (options.Has("packetMs") && options.Get("packetMs").IsNumber()) {
+    source->packet_ms = options.Get("packetMs").As<Napi::Number>().Uint32Value();
+  }
+  return true;
+}
 
-WasapiLoopbackCapture* EnsureCapture() {
-  std::lock_guard<std::mutex> lock(g_capture_mutex);
-  if (!g_capture) {
-    g_capture = std::make_unique<WasapiLoopbackCapture>();
+void ParseOpusConfig(const Napi::Object& opus, OpusEncoderConfig* config) {
+  if (opus.Has("bitrate") && opus.Get("bitrate").IsNumber()) {
+    config->bitrate = opus.Get("bitrate").As<Napi::Number>().Uint32Value();
+  }
+  if (opus.Has("complexity") && opus.Get("complexity").IsNumber()) {
+    config->complexity = opus.Get("complexity").As<Napi::Number>().Uint32Value();
+  }
+  if (opus.Has("fec") && opus.Get("fec").IsBoolean()) {
+    config->fec = opus.Get("fec").As<Napi::Boolean>().Value();
+  }
+  if (opus.Has("expectedLossPercent") && opus.Get("expectedLossPercent").IsNumber()) {
+    config->expected_loss_percent =
+        opus.Get("expectedLossPercent").As<Napi::Number>().Uint32Value();
+  }
+  if (opus.Has("dtx") && opus.Get("dtx").IsBoolean()) {
+    config->dtx = opus.Get("dtx").As<Napi::Boolean>().Value();
   }
-  return g_capture.get();
 }
 
-CaptureConfig ParseConfig(const Napi::Object& options) {
-  CaptureConfig config;
+// Fills `config` from start(), prepare() or createSession() options; throws
+// and returns false on an unknown named option such as a mistyped encoding.
+bool ParseConfig(Napi::Env env, const Napi::Object& options, CaptureConfig* out) {
+  CaptureConfig& config = *out;
   if (options.Has("targetSampleRate") && options.Get("targetSampleRate").IsNumber()) {
     config.target_sample_rate =
         options.Get("targetSampleRate").As<Napi::Number>().Uint32Value();
@@ -43,80 +350,540 @@ CaptureConfig ParseConfig(const Napi::Object& options) {
   if (options.Has("frameMs") && options.Get("frameMs").IsNumber()) {
     config.frame_ms = options.Get("frameMs").As<Napi::Number>().Uint32Value();
   }
-  return config;
+  if (!ParseNamedOption(env, options, "resamplerQuality", ParseResamplerQuality,
+                        "'high-fidelity' or 'low-latency'", &config.resampler_quality) ||
+      !ParseNamedOption(env, options, "schedulingPolicy", ParseSchedulingPolicy,
+                        "'normal', 'pro-audio' or 'realtime'", &config.scheduling)) {
+    return false;
+  }
+  if (options.Has("dither") && options.Get("dither").IsBoolean()) {
+    config.dither = options.Get("dither").As<Napi::Boolean>().Value();
+  }
+  if (options.Has("downmixMatrix") && options.Get("downmixMatrix").IsArray()) {
+    const Napi::Array rows = options.Get("downmixMatrix").As<Napi::Array>();
+    for (uint32_t row_index = 0; row_index < rows.Length(); ++row_index) {
+      const Napi::Value row = rows.Get(row_index);
+      if (!row.IsArray()) continue;
+      const Napi::Array coefficients = row.As<Napi::Array>();
+      for (uint32_t index = 0; index < coefficients.Length(); ++index) {
+        const Napi::Value value = coefficients.Get(index);
+        config.downmix_matrix.push_back(
+            value.IsNumber() ? value.As<Napi::Number>().FloatValue() : 0.0f);
+      }
+    }
+  }
+  if (!ParseNamedOption(env, options, "encoding", ParseChunkEncoding, "'pcm' or 'opus'",
+                        &config.encoding) ||
+      !ParseNamedOption(env, options, "sampleFormat", ParsePcmSampleFormat,
+                        "'s16', 'f32-interleaved' or 'f32-planar'", &config.pcm_format)) {
+    return false;
+  }
+  if (options.Has("opus") && options.Get("opus").IsObject()) {
+    ParseOpusConfig(options.Get("opus").As<Napi::Object>(), &config.opus);
+  }
+  if (options.Has("driftCompensation")) {
+    const Napi::Value drift_value = options.Get("driftCompensation");
+    if (drift_value.IsBoolean()) {
+      config.drift.enabled = drift_value.As<Napi::Boolean>().Value();
+    } else if (drift_value.IsObject()) {
+      const Napi::Object drift = drift_value.As<Napi::Object>();
+      config.drift.enabled = true;
+      if (drift.Has("targetQueueMs") && drift.Get("targetQueueMs").IsNumber()) {
+        config.drift.target_queue_ms =
+            drift.Get("targetQueueMs").As<Napi::Number>().DoubleValue();
+      }
+      if (drift.Has("maxPpm") && drift.Get("maxPpm").IsNumber()) {
+        config.drift.max_ppm = drift.Get("maxPpm").As<Napi::Number>().DoubleValue();
+      }
+    }
+  }
+  if (options.Has("silenceSuppression")) {
+    const Napi::Value silence_value = options.Get("silenceSuppression");
+    if (silence_value.IsBoolean()) {
+      config.silence.enabled = silence_value.As<Napi::Boolean>().Value();
+    } else if (silence_value.IsObject()) {
+      const Napi::Object silence = silence_value.As<Napi::Object>();
+      config.silence.enabled = true;
+      if (silence.Has("thresholdDbfs") && silence.Get("thresholdDbfs").IsNumber()) {
+        config.silence.threshold_dbfs =
+            silence.Get("thresholdDbfs").As<Napi::Number>().DoubleValue();
+      }
+      if (silence.Has("hangoverMs") && silence.Get("hangoverMs").IsNumber()) {
+        config.silence.hangover_ms = silence.Get("hangoverMs").As<Napi::Number>().Uint32Value();
+      }
+      if (silence.Has("markerMs") && silence.Get("markerMs").IsNumber()) {
+        config.silence.marker_ms = silence.Get("markerMs").As<Napi::Number>().Uint32Value();
+      }
+    }
+  }
+  if (options.Has("source") && options.Get("source").IsObject()) {
+    return ParseSourceConfig(env, options.Get("source").As<Napi::Object>(), &config.source);
+  }
+  return true;
+}
+
+// Parses the setChunkCallback() and createSession() delivery options; throws
+// and returns false on an unknown queue policy.
+bool ParseDeliveryOptions(Napi::Env env,
+                          const Napi::Object& options,
+                          DeliveryOptions* delivery) {
+  if (options.Has("batch") && options.Get("batch").IsBoolean()) {
+    delivery->batch = options.Get("batch").As<Napi::Boolean>().Value();
+  }
+  if (options.Has("maxBatch") && options.Get("maxBatch").IsNumber()) {
+    delivery->max_batch = options.Get("maxBatch").As<Napi::Number>().Uint32Value();
+  }
+  if (options.Has("maxQueuedChunks") && options.Get("maxQueuedChunks").IsNumber()) {
+    delivery->max_queued = options.Get("maxQueuedChunks").As<Napi::Number>().Uint32Value();
+  }
+  if (options.Has("blockMs") && options.Get("blockMs").IsNumber()) {
+    delivery->block_ms = options.Get("blockMs").As<Napi::Number>().Uint32Value();
+  }
+  if (options.Has("queuePolicy") && options.Get("queuePolicy").IsString()) {
+    const std::string policy = options.Get("queuePolicy").As<Napi::String>().Utf8Value();
+    if (!ParseQueueFullPolicy(policy, &delivery->policy)) {
+      Napi::TypeError::New(env,
+                           "queuePolicy must be 'drop-oldest', 'drop-newest' or 'block'.")
+          .ThrowAsJavaScriptException();
+      return false;
+    }
+  }
+  return true;
+}
+
+Napi::Object ToLatencyObject(Napi::Env env, const LatencySummary& summary) {
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("count", Napi::Number::New(env, static_cast<double>(summary.count)));
+  result.Set("p50Us", Napi::Number::New(env, summary.p50_us));
+  result.Set("p99Us", Napi::Number::New(env, summary.p99_us));
+  result.Set("p999Us", Napi::Number::New(env, summary.p999_us));
+  result.Set("maxUs", Napi::Number::New(env, summary.max_us));
+  return result;
+}
+
+// Linear level to dBFS, floored so silence stays a finite number.
+double ToDbfs(float level) {
+  constexpr double kFloorDbfs = -100.0;
+  return level > 0.0f ? std::max(kFloorDbfs, 20.0 * std::log10(level)) : kFloorDbfs;
+}
+
+Napi::Object ToLevelsObject(Napi::Env env, const CaptureStats& stats) {
+  const LevelReading& reading = stats.levels;
+  Napi::Array peak = Napi::Array::New(env, reading.channels);
+  Napi::Array rms = Napi::Array::New(env, reading.channels);
+  for (uint32_t channel = 0; channel < reading.channels; ++channel) {
+    peak.Set(channel, Napi::Number::New(env, ToDbfs(reading.peak[channel])));
+    rms.Set(channel, Napi::Number::New(env, ToDbfs(reading.rms[channel])));
+  }
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("windowMs", Napi::Number::New(env, stats.output_sample_rate == 0
+                                                    ? 0.0
+                                                    : reading.window_frames * 1000.0 /
+                                                          stats.output_sample_rate));
+  result.Set("peakDbfs", peak);
+  result.Set("rmsDbfs", rms);
+  return result;
 }
 
-Napi::Object ToStatsObject(Napi::Env env, const CaptureStats& stats) {
+Napi::Object ToRecordingObject(Napi::Env env, const RecordingStats& stats) {
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("active", Napi::Boolean::New(env, stats.active));
+  result.Set("path", Napi::String::New(env, stats.path));
+  result.Set("format", Napi::String::New(env, RecordingFormatName(stats.format)));
+  result.Set("recordedFrames",
+             Napi::Number::New(env, static_cast<double>(stats.recorded_frames)));
+  result.Set("bytesWritten", Napi::Number::New(env, static_cast<double>(stats.bytes_written)));
+  result.Set("droppedFrames", Napi::Number::New(env, static_cast<double>(stats.dropped_frames)));
+  result.Set("error", Napi::String::New(env, stats.error));
+  return result;
+}
+
+Napi::Object ToStatsObject(Napi::Env env, const CaptureStats& stats, ChunkChannel& channel) {
   Napi::Object result = Napi::Object::New(env);
   result.Set("running", Napi::Boolean::New(env, stats.running));
+  result.Set("standby", Napi::Boolean::New(env, stats.standby));
+  result.Set("warmStart", Napi::Boolean::New(env, stats.warm_start));
+  result.Set("startToFirstChunkMs", Napi::Number::New(env, stats.start_to_first_chunk_ms));
+  result.Set("backend", Napi::String::New(env, stats.backend));
+  result.Set("encoding", Napi::String::New(env, stats.encoding));
+  result.Set("sampleFormat", Napi::String::New(env, stats.sample_format));
   result.Set("capturedInputFrames",
              Napi::Number::New(env, static_cast<double>(stats.captured_input_frames)));
   result.Set("emittedOutputFrames",
              Napi::Number::New(env, static_cast<double>(stats.emitted_output_frames)));
   result.Set("emittedChunks",
              Napi::Number::New(env, static_cast<double>(stats.emitted_chunks)));
-  result.Set("droppedChunks",
-             Napi::Number::New(env, static_cast<double>(stats.dropped_chunks)));
+  // Chunks lost anywhere between the device and the JS callback.
+  const DeliveryStats delivery = channel.queue.GetStats();
+  const uint64_t dropped_chunks = stats.dropped_chunks + delivery.dropped_total();
+  result.Set("droppedChunks", Napi::Number::New(env, static_cast<double>(dropped_chunks)));
+  Napi::Object drop_reasons = Napi::Object::New(env);
+  drop_reasons.Set("noCallback",
+                   Napi::Number::New(env, static_cast<double>(stats.dropped_no_callback +
+                                                              delivery.dropped_no_callback)));
+  drop_reasons.Set("encoderBusy",
+                   Napi::Number::New(env, static_cast<double>(stats.dropped_encoder_busy)));
+  drop_reasons.Set("poolExhausted",
+                   Napi::Number::New(env, static_cast<double>(delivery.dropped_pool_exhausted)));
+  drop_reasons.Set("queueFull",
+                   Napi::Number::New(env, static_cast<double>(delivery.dropped_queue_full)));
+  drop_reasons.Set("evictedOldest",
+                   Napi::Number::New(env, static_cast<double>(delivery.dropped_evicted)));
+  drop_reasons.Set("blockTimeout",
+                   Napi::Number::New(env, static_cast<double>(delivery.dropped_block_timeout)));
+  result.Set("dropReasons", drop_reasons);
   result.Set("silentInputFrames",
              Napi::Number::New(env, static_cast<double>(stats.silent_input_frames)));
+  result.Set("suppressedChunks",
+             Napi::Number::New(env, static_cast<double>(stats.suppressed_chunks)));
+  result.Set("silenceMarkers",
+             Napi::Number::New(env, static_cast<double>(stats.silence_markers)));
+  result.Set("discontinuities",
+             Napi::Number::New(env, static_cast<double>(stats.discontinuities)));
+  result.Set("concealedFrames",
+             Napi::Number::New(env, static_cast<double>(stats.concealed_frames)));
+  result.Set("droppedInputFrames",
+             Napi::Number::New(env, static_cast<double>(stats.dropped_input_frames)));
+  result.Set("queueOverruns",
+             Napi::Number::New(env, static_cast<double>(stats.queue_overruns)));
   result.Set("inputSampleRate", Napi::Number::New(env, stats.input_sample_rate));
+  result.Set("inputChannels", Napi::Number::New(env, stats.input_channels));
+  result.Set("inputChannelMask", Napi::Number::New(env, stats.input_channel_mask));
   result.Set("outputSampleRate", Napi::Number::New(env, stats.output_sample_rate));
   result.Set("outputChannels", Napi::Number::New(env, stats.output_channels));
   result.Set("chunkFrameMs", Napi::Number::New(env, stats.chunk_frame_ms));
+  result.Set("encodedPackets",
+             Napi::Number::New(env, static_cast<double>(stats.encoded_packets)));
+  result.Set("encodedBytes", Napi::Number::New(env, static_cast<double>(stats.encoded_bytes)));
+  result.Set("encoderDroppedFrames",
+             Napi::Number::New(env, static_cast<double>(stats.encoder_dropped_frames)));
+  result.Set("encodeTimeAvgUs", Napi::Number::New(env, stats.encode_time_avg_us));
+  result.Set("encodeTimeMaxUs", Napi::Number::New(env, stats.encode_time_max_us));
   result.Set("lastError", Napi::String::New(env, stats.last_error));
+
+  Napi::Object drift = Napi::Object::New(env);
+  drift.Set("correctionPpm", Napi::Number::New(env, stats.drift_correction_ppm));
+  drift.Set("estimatePpm", Napi::Number::New(env, stats.drift_estimate_ppm));
+  drift.Set("reportedQueueMs", Napi::Number::New(env, stats.reported_queue_ms));
+  drift.Set("reports", Napi::Number::New(env, static_cast<double>(stats.queue_level_reports)));
+  result.Set("drift", drift);
+  result.Set("levels", ToLevelsObject(env, stats));
+
+  Napi::Object scheduling = Napi::Object::New(env);
+  scheduling.Set("policy", Napi::String::New(env, SchedulingPolicyName(stats.scheduling.policy)));
+  scheduling.Set("mechanism", Napi::String::New(env, stats.scheduling.mechanism));
+  scheduling.Set("priority", Napi::Number::New(env, stats.scheduling.priority));
+  scheduling.Set("error", Napi::String::New(env, stats.scheduling.error));
+  scheduling.Set("wakeupJitter", ToLatencyObject(env, stats.wakeup_jitter));
+  result.Set("scheduling", scheduling);
+
+  Napi::Object latency = Napi::Object::New(env);
+  latency.Set("deviceToCapture", ToLatencyObject(env, stats.device_to_capture));
+  latency.Set("captureToEmit", ToLatencyObject(env, stats.capture_to_emit));
+  latency.Set("emitToDispatch", ToLatencyObject(env, channel.emit_to_dispatch.Summarize()));
+  latency.Set("dispatchToReturn", ToLatencyObject(env, channel.dispatch_to_return.Summarize()));
+  result.Set("latency", latency);
+
+  ChunkPoolStats pool_stats;
+  {
+    std::lock_guard<std::mutex> lock(channel.mutex);
+    if (channel.pool) {
+      pool_stats = channel.pool->GetStats();
+    }
+  }
+  // The shared ring belongs to the start() capture only.
+  const std::shared_ptr<AddonState> state = GetState(env);
+  SharedRingStats ring_stats;
+  if (&channel == state->channel.get()) {
+    std::lock_guard<std::mutex> lock(state->callback_mutex);
+    if (state->shared_ring) {
+      ring_stats = state->shared_ring->GetStats();
+    }
+  }
+  // So is recording.
+  if (&channel == state->channel.get()) {
+    result.Set("recording", ToRecordingObject(env, state->capture->GetRecordingStats()));
+  }
+  result.Set("sharedRingCapacityFrames", Napi::Number::New(env, ring_stats.capacity_frames));
+  result.Set("sharedRingOccupancyFrames", Napi::Number::New(env, ring_stats.occupancy_frames));
+  result.Set("sharedRingOverrunFrames", Napi::Number::New(env, ring_stats.overrun_frames));
+  result.Set("sharedRingUnderrunFrames", Napi::Number::New(env, ring_stats.underrun_frames));
+
+  result.Set("deliveryPolicy",
+             Napi::String::New(env, QueueFullPolicyName(channel.queue.options().policy)));
+  result.Set("deliveryQueued", Napi::Number::New(env, delivery.queued));
+  result.Set("deliveryQueueHighWater", Napi::Number::New(env, delivery.high_water));
+  result.Set("deliveryBatches", Napi::Number::New(env, static_cast<double>(delivery.batches)));
+  result.Set("deliveryAvgBatch",
+             Napi::Number::New(env, delivery.batches == 0
+                                        ? 0.0
+                                        : static_cast<double>(delivery.batched_chunks) /
+                                              static_cast<double>(delivery.batches)));
+  result.Set("deliveryMaxBatch", Napi::Number::New(env, delivery.largest_batch));
+  result.Set("deliveryDispatchFailures",
+             Napi::Number::New(env, static_cast<double>(delivery.dispatch_failures)));
+
+  result.Set("poolSize", Napi::Number::New(env, pool_stats.size));
+  result.Set("poolInUse", Napi::Number::New(env, pool_stats.in_use));
+  result.Set("poolHighWater", Napi::Number::New(env, pool_stats.high_water));
+  result.Set("poolExhausted",
+             Napi::Number::New(env, static_cast<double>(pool_stats.exhausted)));
+  result.Set("poolWrappedChunks",
+             Napi::Number::New(env, static_cast<double>(channel.wrapped_chunks)));
+  result.Set("poolCopiedChunks",
+             Napi::Number::New(env, static_cast<double>(channel.copied_chunks)));
   return result;
 }
 
-void InstallChunkBridge(WasapiLoopbackCapture* capture) {
-  capture->SetChunkCallback([](const int16_t* samples,
-                               size_t sample_count,
-                               uint32_t sample_rate,
-                               uint32_t channels,
-                               uint64_t sequence,
-                               uint64_t timestamp_ms) {
+// Creates the slab pool before capture starts so the capture thread never
+// allocates; an existing pool is kept when its slabs are already big enough.
+void EnsureChunkPool(ChunkChannel& channel, const CaptureConfig& config) {
+  size_t slab_samples = ChunkSampleCount(NormalizeCaptureConfig(config));
+  if (IsFloatFormat(config.pcm_format)) {
+    slab_samples *= sizeof(float) / sizeof(int16_t);
+  }
+  if (config.encoding == ChunkEncoding::kOpus) {
+    slab_samples = std::max(slab_samples, (kOpusMaxPacketBytes + 1) / sizeof(int16_t));
+  }
+  std::lock_guard<std::mutex> lock(channel.mutex);
+  if (!channel.pool || channel.pool->slab_samples() < slab_samples) {
+    // Undelivered chunks from the last run would be recycled into the new
+    // pool otherwise.
+    channel.queue.Flush([](ChunkSlab* slab) { ChunkPool::Release(slab); });
+    channel.pool = ChunkPool::Create(kChunkPoolSlabs, slab_samples);
+  }
+}
+
+void ScheduleDrain(const std::shared_ptr<ChunkChannel>& channel,
+                   const std::shared_ptr<Napi::ThreadSafeFunction>& tsf);
+
+// Wraps `length` elements of the slab's storage without copying; the
+// finalizer hands the slab back to the pool. Runtimes that forbid external
+// buffers (Electron's V8 sandbox) get a copy and the slab is released right
+// away. A copy owns its whole ArrayBuffer, so the message says the consumer
+// may transfer it on instead of cloning it again.
+template <typename T>
+Napi::Buffer<T> ToChunkBuffer(Napi::Env env,
+                              ChunkChannel& channel,
+                              ChunkSlab* chunk,
+                              size_t length,
+                              Napi::Object message) {
+  T* data = reinterpret_cast<T*>(chunk->samples.data());
+  auto buffer = Napi::Buffer<T>::NewOrCopy(
+      env, data, length,
+      [](Napi::Env /*env*/, T* /*data*/, ChunkSlab* released) { ChunkPool::Release(released); },
+      chunk);
+  const bool copied = buffer.Data() != data;
+  if (copied) {
+    ++channel.copied_chunks;
+  } else {
+    ++channel.wrapped_chunks;
+  }
+  message.Set("transferable", Napi::Boolean::New(env, copied));
+  return buffer;
+}
+
+Napi::Object ToChunkMessage(Napi::Env env, ChunkChannel& channel, ChunkSlab* chunk) {
+  Napi::Object message = Napi::Object::New(env);
+  if (chunk->silence) {
+    message.Set("encoding", Napi::String::New(env, "silence"));
+  } else if (chunk->encoded) {
+    message.Set("encoding", Napi::String::New(env, "opus"));
+    message.Set("packet",
+                ToChunkBuffer<uint8_t>(env, channel, chunk, chunk->encoded_bytes, message));
+  } else if (IsFloatFormat(chunk->sample_format)) {
+    message.Set("encoding", Napi::String::New(env, "pcm"));
+    message.Set("sampleFormat", Napi::String::New(env, PcmSampleFormatName(chunk->sample_format)));
+    message.Set("pcm", ToChunkBuffer<float>(env, channel, chunk, chunk->sample_count, message));
+  } else {
+    message.Set("encoding", Napi::String::New(env, "pcm"));
+    message.Set("sampleFormat", Napi::String::New(env, "s16"));
+    message.Set("pcm", ToChunkBuffer<int16_t>(env, channel, chunk, chunk->sample_count, message));
+  }
+  message.Set("sampleRate", Napi::Number::New(env, chunk->sample_rate));
+  message.Set("channels", Napi::Number::New(env, chunk->channels));
+  message.Set("frameCount", Napi::Number::New(env, chunk->frame_count));
+  message.Set("sequence", Napi::Number::New(env, static_cast<double>(chunk->sequence)));
+  message.Set("samplePosition",
+              Napi::Number::New(env, static_cast<double>(chunk->sample_position)));
+  message.Set("timestampMs", Napi::Number::New(env, static_cast<double>(chunk->timestamp_ms)));
+  message.Set("captureTimeMs",
+              Napi::Number::New(env, static_cast<double>(chunk->capture_time_ns) / 1e6));
+  if (chunk->silence) {
+    // No buffer holds the slab, so it goes straight back.
+    ChunkPool::Release(chunk);
+  }
+  return message;
+}
+
+// Runs on the JS thread: takes whatever has queued up since the last drain
+// and hands it to the callback, then schedules another drain if the batch
+// limit left chunks behind.
+void DrainChunks(Napi::Env env,
+                 Napi::Function callback,
+                 const std::shared_ptr<ChunkChannel>& channel,
+                 const std::shared_ptr<Napi::ThreadSafeFunction>& tsf) {
+  ChunkSlab* slabs[kChunkPoolSlabs];
+  bool more = false;
+  const size_t count = channel->queue.PopBatch(slabs, kChunkPoolSlabs, &more);
+  if (more) {
+    ScheduleDrain(channel, tsf);
+  }
+  if (count == 0) {
+    return;
+  }
+
+  const uint64_t dispatch_ns = MonotonicNowNs();
+  for (size_t index = 0; index < count; ++index) {
+    channel->emit_to_dispatch.RecordInterval(slabs[index]->emit_time_ns, dispatch_ns);
+  }
+
+  // Every slab is owned by a JS buffer before the callback runs, so a throwing
+  // callback cannot leak the rest of the batch.
+  Napi::Array messages = Napi::Array::New(env, count);
+  for (size_t index = 0; index < count; ++index) {
+    messages.Set(static_cast<uint32_t>(index), ToChunkMessage(env, *channel, slabs[index]));
+  }
+
+  if (channel->queue.options().batch) {
+    callback.Call({messages});
+    channel->dispatch_to_return.RecordInterval(dispatch_ns, MonotonicNowNs());
+    return;
+  }
+  for (uint32_t index = 0; index < count; ++index) {
+    const uint64_t call_ns = MonotonicNowNs();
+    callback.Call({messages.Get(index)});
+    channel->dispatch_to_return.RecordInterval(call_ns, MonotonicNowNs());
+  }
+}
+
+void ScheduleDrain(const std::shared_ptr<ChunkChannel>& channel,
+                   const std::shared_ptr<Napi::ThreadSafeFunction>& tsf) {
+  if (!channel->queue.ClaimDrain()) {
+    return;
+  }
+  const napi_status status =
+      tsf->NonBlockingCall([channel, tsf](Napi::Env env, Napi::Function callback) {
+        DrainChunks(env, callback, channel, tsf);
+      });
+  if (status != napi_ok) {
+    // The chunks stay queued; the next one pushed retries the call and the
+    // queue-full policy accounts for anything that no longer fits.
+    channel->queue.CountDispatchFailure();
+    channel->queue.CancelDrain();
+  }
+}
+
+// Copies each chunk into a pool slab and queues it towards `channel`'s JS
+// function.
+ChunkCallback MakeChunkBridge(std::shared_ptr<ChunkChannel> channel) {
+  return [channel](const AudioChunk& chunk) {
     std::shared_ptr<Napi::ThreadSafeFunction> tsf;
+    std::shared_ptr<ChunkPool> pool;
     {
-      std::lock_guard<std::mutex> lock(g_callback_mutex);
-      tsf = g_chunk_tsf;
+      std::lock_guard<std::mutex> lock(channel->mutex);
+      tsf = channel->tsf;
+      pool = channel->pool;
     }
 
-    if (!tsf || !samples || sample_count == 0) {
+    if (!tsf || !pool) {
+      channel->queue.CountNoCallback();
+      return;
+    }
+    const bool silence = chunk.encoding == ChunkEncoding::kSilence;
+    const bool encoded = chunk.encoding == ChunkEncoding::kOpus;
+    const bool is_float = !silence && !encoded && IsFloatFormat(chunk.sample_format);
+    const size_t slab_bytes = pool->slab_samples() * sizeof(int16_t);
+    if (silence ? chunk.frame_count == 0
+        : encoded  ? !chunk.payload || chunk.payload_bytes > slab_bytes
+        : is_float ? !chunk.float_samples || chunk.sample_count == 0 ||
+                         chunk.sample_count * sizeof(float) > slab_bytes
+                   : !chunk.samples || chunk.sample_count == 0 ||
+                         chunk.sample_count > pool->slab_samples()) {
       return;
     }
 
-    auto* payload = new ChunkPayload();
-    payload->samples.assign(samples, samples + sample_count);
-    payload->sample_rate = sample_rate;
-    payload->channels = channels;
-    payload->sequence = sequence;
-    payload->timestamp_ms = timestamp_ms;
-
-    const napi_status status = tsf->NonBlockingCall(
-        payload, [](Napi::Env env, Napi::Function callback, ChunkPayload* chunk) {
-          Napi::Object message = Napi::Object::New(env);
-          auto pcm_buffer =
-              Napi::Buffer<int16_t>::Copy(env, chunk->samples.data(), chunk->samples.size());
-          message.Set("pcm", pcm_buffer);
-          message.Set("sampleRate", Napi::Number::New(env, chunk->sample_rate));
-          message.Set("channels", Napi::Number::New(env, chunk->channels));
-          const uint32_t frame_count =
-              chunk->channels == 0
-                  ? 0
-                  : static_cast<uint32_t>(chunk->samples.size() / chunk->channels);
-          message.Set("frameCount", Napi::Number::New(env, frame_count));
-          message.Set("sequence", Napi::Number::New(env, static_cast<double>(chunk->sequence)));
-          message.Set("timestampMs",
-                      Napi::Number::New(env, static_cast<double>(chunk->timestamp_ms)));
-          callback.Call({message});
-          delete chunk;
-        });
-
-    if (status != napi_ok) {
-      delete payload;
+    ChunkSlab* slab = pool->Acquire();
+    if (!slab) {
+      channel->queue.CountPoolExhausted();
+      return;
+    }
+
+    if (silence) {
+      slab->silence = true;
+    } else if (encoded) {
+      std::memcpy(slab->samples.data(), chunk.payload, chunk.payload_bytes);
+      slab->encoded = true;
+      slab->encoded_bytes = chunk.payload_bytes;
+    } else if (is_float) {
+      std::memcpy(slab->samples.data(), chunk.float_samples, chunk.sample_count * sizeof(float));
+      slab->sample_count = chunk.sample_count;
+      slab->sample_format = chunk.sample_format;
+    } else {
+      std::copy(chunk.samples, chunk.samples + chunk.sample_count, slab->samples.data());
+      slab->sample_count = chunk.sample_count;
+    }
+    slab->frame_count = chunk.frame_count;
+    slab->sample_rate = chunk.sample_rate;
+    slab->channels = chunk.channels;
+    slab->sequence = chunk.sequence;
+    slab->sample_position = chunk.sample_position;
+    slab->timestamp_ms = chunk.timestamp_ms;
+    slab->capture_time_ns = chunk.capture_time_ns;
+    slab->emit_time_ns = chunk.emit_time_ns;
+
+    ChunkSlab* rejected = nullptr;
+    channel->queue.Push(slab, &rejected);
+    if (rejected) {
+      pool->Recycle(rejected);
+    }
+    ScheduleDrain(channel, tsf);
+  };
+}
+
+void InstallChunkBridge(AddonState& state) {
+  state.capture->SetChunkCallback(MakeChunkBridge(state.channel));
+}
+
+// The PCM format start() has to deliver for `ring`.
+PcmSampleFormat SharedRingPcmFormat(const SharedPcmRingWriter& ring) {
+  return ring.format() == kSharedRingFloat32Planar ? PcmSampleFormat::kFloat32Planar
+                                                   : PcmSampleFormat::kInt16;
+}
+
+// Writes PCM chunks straight into the attached shared ring on the capture
+// thread; no JS turn is involved until the reader polls the ring.
+void InstallSharedRingBridge(SystemAudioCapture* capture,
+                             std::shared_ptr<SharedPcmRingWriter> ring) {
+  capture->SetChunkCallback([ring](const AudioChunk& chunk) {
+    // Markers become zeros here: the reader would otherwise see an underrun.
+    const bool silence = chunk.encoding == ChunkEncoding::kSilence;
+    const bool is_float = ring->format() == kSharedRingFloat32Planar;
+    const void* samples = is_float ? static_cast<const void*>(chunk.float_samples)
+                                   : static_cast<const void*>(chunk.samples);
+    if (chunk.channels != ring->channels() ||
+        (!silence && (chunk.encoding != ChunkEncoding::kPcm ||
+                      chunk.sample_format != SharedRingPcmFormat(*ring) || !samples))) {
+      return;
     }
+    ring->SetSampleRate(chunk.sample_rate);
+    ring->Write(silence ? nullptr : samples, chunk.frame_count);
   });
 }
 
+void InstallActiveBridge(AddonState& state) {
+  std::shared_ptr<SharedPcmRingWriter> ring;
+  {
+    std::lock_guard<std::mutex> lock(state.callback_mutex);
+    ring = state.shared_ring;
+  }
+  if (ring) {
+    InstallSharedRingBridge(state.capture.get(), std::move(ring));
+  } else {
+    InstallChunkBridge(state);
+  }
+}
+
 Napi::Value SetChunkCallback(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
   if (info.Length() < 1 || !info[0].IsFunction()) {
@@ -126,74 +893,523 @@ Napi::Value SetChunkCallback(const Napi::CallbackInfo& info) {
   }
 
   const Napi::Function callback = info[0].As<Napi::Function>();
+  DeliveryOptions options;
+  if (info.Length() > 1 && info[1].IsObject() &&
+      !ParseDeliveryOptions(env, info[1].As<Napi::Object>(), &options)) {
+    return env.Undefined();
+  }
+  AddonState& state = *GetState(env);
+  state.channel->queue.Configure(options);
 
+  ReleaseChannel(*state.channel);
   {
-    std::lock_guard<std::mutex> lock(g_callback_mutex);
-    if (g_chunk_tsf) {
-      g_chunk_tsf->Release();
-      g_chunk_tsf.reset();
-    }
+    std::lock_guard<std::mutex> lock(state.channel->mutex);
+    // At most one drain is pending at a time; the chunks themselves wait in
+    // the channel's queue.
+    auto tsf = Napi::ThreadSafeFunction::New(env, callback, "SystemAudioChunk", 4, 1);
+    state.channel->tsf = std::make_shared<Napi::ThreadSafeFunction>(std::move(tsf));
+  }
+
+  InstallActiveBridge(state);
+  return env.Undefined();
+}
+
+// Throws and returns false unless the start() capture is stopped with no
+// start() or stop() still settling, so nothing writes to the ring.
+bool EnsureCaptureStopped(Napi::Env env, AddonState& state, const char* action) {
+  if (!state.capture_control->busy() && !state.capture->IsRunning()) return true;
+  Napi::Error::New(env, std::string("Stop capture before ") + action + ".")
+      .ThrowAsJavaScriptException();
+  return false;
+}
+
+// attachSharedRing(Int32Array): the start() capture writes PCM into the
+// SharedArrayBuffer under the view, laid out as in shared_pcm_ring.h,
+// instead of calling the chunk callback. start() must then ask for the
+// ring's sampleFormat: 's16' or 'f32-planar'.
+Napi::Value AttachSharedRing(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsTypedArray() ||
+      info[0].As<Napi::TypedArray>().TypedArrayType() != napi_int32_array) {
+    Napi::TypeError::New(env, "attachSharedRing expects an Int32Array over the ring's buffer.")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
 
-    auto tsf = Napi::ThreadSafeFunction::New(env, callback, "SystemAudioChunk", 256, 1);
-    g_chunk_tsf = std::make_shared<Napi::ThreadSafeFunction>(std::move(tsf));
+  AddonState& state = *GetState(env);
+  if (!EnsureCaptureStopped(env, state, "attaching a shared ring")) {
+    return env.Undefined();
   }
 
-  InstallChunkBridge(EnsureCapture());
+  const Napi::Int32Array view = info[0].As<Napi::Int32Array>();
+  auto ring = std::make_shared<SharedPcmRingWriter>();
+  if (!ring->Attach(view.Data(), view.ByteLength())) {
+    Napi::Error::New(env, "Shared ring header is missing or does not fit its buffer.")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(state.callback_mutex);
+    state.shared_ring = ring;
+  }
+  state.shared_ring_buffer = Napi::Persistent(view.As<Napi::Object>());
+  // Released by detachSharedRing() or the environment's cleanup hook, while
+  // the environment is still up; never from the state's destructor.
+  state.shared_ring_buffer.SuppressDestruct();
+  InstallSharedRingBridge(state.capture.get(), std::move(ring));
   return env.Undefined();
 }
 
-Napi::Value Start(const Napi::CallbackInfo& info) {
+Napi::Value DetachSharedRing(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
-  WasapiLoopbackCapture* capture = EnsureCapture();
+  AddonState& state = *GetState(env);
+  if (!EnsureCaptureStopped(env, state, "detaching the shared ring")) {
+    return env.Undefined();
+  }
 
   {
-    std::lock_guard<std::mutex> lock(g_callback_mutex);
-    if (!g_chunk_tsf) {
-      Napi::Error::New(env, "Chunk callback is not set. Call setChunkCallback first.")
-          .ThrowAsJavaScriptException();
-      return env.Undefined();
-    }
+    std::lock_guard<std::mutex> lock(state.callback_mutex);
+    state.shared_ring.reset();
   }
+  InstallChunkBridge(state);
+  // Capture has stopped, so nothing can still be writing.
+  state.shared_ring_buffer.Reset();
+  return env.Undefined();
+}
 
-  if (capture->IsRunning()) {
-    return ToStatsObject(env, capture->GetStats());
+// start(options): resolves with the stats once the device has delivered its
+// first packet, or rejects with the error that kept it from starting.
+// Resolves straight away when capture is already running.
+Napi::Value Start(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  const std::shared_ptr<AddonState> state = GetState(env);
+  CaptureConfig config;
+  if (info.Length() > 0 && info[0].IsObject() &&
+      !ParseConfig(env, info[0].As<Napi::Object>(), &config)) {
+    return env.Undefined();
   }
 
+  ControlStep step;
+  step.failure = "Failed to start system audio capture.";
+  step.begin = [state, config](Napi::Env, std::string* error) {
+    std::shared_ptr<SharedPcmRingWriter> shared_ring;
+    bool has_callback = false;
+    {
+      std::lock_guard<std::mutex> lock(state->callback_mutex);
+      shared_ring = state->shared_ring;
+    }
+    {
+      std::lock_guard<std::mutex> lock(state->channel->mutex);
+      has_callback = static_cast<bool>(state->channel->tsf);
+    }
+    if (!has_callback && !shared_ring) {
+      *error = "Chunk callback is not set. Call setChunkCallback or attachSharedRing first.";
+      return ControlStep::Begin::kFail;
+    }
+    if (state->capture->IsRunning()) {
+      return ControlStep::Begin::kSkip;
+    }
+    if (shared_ring && (config.encoding != ChunkEncoding::kPcm ||
+                        config.pcm_format != SharedRingPcmFormat(*shared_ring))) {
+      *error = std::string("The shared ring carries PCM in sampleFormat '") +
+               PcmSampleFormatName(SharedRingPcmFormat(*shared_ring)) + "' only.";
+      return ControlStep::Begin::kFail;
+    }
+    EnsureChunkPool(*state->channel, config);
+    state->channel->queue.ResetStats();
+    state->channel->emit_to_dispatch.Reset();
+    state->channel->dispatch_to_return.Reset();
+    // Chunks flow before Start() returns, so the bridge goes in first.
+    InstallActiveBridge(*state);
+    return ControlStep::Begin::kRun;
+  };
+  step.work = [state, config](std::string* error) { return state->capture->Start(config, error); };
+  step.finish = [state](Napi::Env env) -> Napi::Value {
+    return ToStatsObject(env, state->capture->GetStats(), *state->channel);
+  };
+  return state->capture_control->Run(env, std::move(step));
+}
+
+// prepare(options): opens the device start(options) will read and holds it
+// stopped, so start() only has to start the stream and stop() returns to
+// this standby. Rejects when the device cannot be opened.
+Napi::Value Prepare(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  const std::shared_ptr<AddonState> state = GetState(env);
   CaptureConfig config;
-  if (info.Length() > 0 && info[0].IsObject()) {
-    config = ParseConfig(info[0].As<Napi::Object>());
+  if (info.Length() > 0 && info[0].IsObject() &&
+      !ParseConfig(env, info[0].As<Napi::Object>(), &config)) {
+    return env.Undefined();
   }
 
-  std::string error;
-  const bool started = capture->Start(config, &error);
-  if (!started) {
-    Napi::Error::New(env, error.empty() ? "Failed to start system audio capture." : error)
+  ControlStep step;
+  step.failure = "Failed to prepare system audio capture.";
+  step.work = [state, config](std::string* error) {
+    return state->capture->Prepare(config, error);
+  };
+  step.finish = [state](Napi::Env env) -> Napi::Value {
+    return ToStatsObject(env, state->capture->GetStats(), *state->channel);
+  };
+  return state->capture_control->Run(env, std::move(step));
+}
+
+// Stops capture and gives back the prepare() hold; the device closes unless
+// prepareSessions() holds it too.
+Napi::Value Release(const Napi::CallbackInfo& info) {
+  const std::shared_ptr<AddonState> state = GetState(info.Env());
+  ControlStep step;
+  step.work = [state](std::string*) {
+    state->capture->Release();
+    return true;
+  };
+  step.finish = [state](Napi::Env env) -> Napi::Value {
+    return ToStatsObject(env, state->capture->GetStats(), *state->channel);
+  };
+  return state->capture_control->Run(info.Env(), std::move(step));
+}
+
+// Resolves with the final stats once the device thread has stopped; the
+// device is woken rather than waited out.
+Napi::Value Stop(const Napi::CallbackInfo& info) {
+  const std::shared_ptr<AddonState> state = GetState(info.Env());
+  ControlStep step;
+  step.work = [state](std::string*) {
+    state->capture->Stop();
+    return true;
+  };
+  step.finish = [state](Napi::Env env) -> Napi::Value {
+    return ToStatsObject(env, state->capture->GetStats(), *state->channel);
+  };
+  return state->capture_control->Run(info.Env(), std::move(step));
+}
+
+Napi::Value GetStats(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  const std::shared_ptr<AddonState> state = GetState(env);
+  return ToStatsObject(env, state->capture->GetStats(), *state->channel);
+}
+
+// startRecording(path, { format: 'wav' | 'ogg-opus', opus }): writes the
+// start() capture's chunks to `path` until stopRecording() or stop().
+// Creating the file happens on the recorder's writer thread and the wait
+// for it on the thread pool, queued behind any start() or stop(); resolves
+// with the recording stats, or rejects when the file cannot be created.
+Napi::Value StartRecording(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "startRecording expects a file path.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  const std::string path = info[0].As<Napi::String>().Utf8Value();
+
+  RecordingOptions options;
+  if (info.Length() > 1 && info[1].IsObject()) {
+    const Napi::Object object = info[1].As<Napi::Object>();
+    if (object.Has("format") && object.Get("format").IsString() &&
+        !ParseRecordingFormat(object.Get("format").As<Napi::String>().Utf8Value(),
+                              &options.format)) {
+      Napi::TypeError::New(env, "Recording format must be 'wav' or 'ogg-opus'.")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    if (object.Has("opus") && object.Get("opus").IsObject()) {
+      ParseOpusConfig(object.Get("opus").As<Napi::Object>(), &options.opus);
+    }
+  }
+
+  const std::shared_ptr<AddonState> state = GetState(env);
+  ControlStep step;
+  step.failure = "Failed to start recording.";
+  step.work = [state, path, options](std::string* error) {
+    return state->capture->StartRecording(path, options, error);
+  };
+  step.finish = [state](Napi::Env env) -> Napi::Value {
+    return ToRecordingObject(env, state->capture->GetRecordingStats());
+  };
+  return state->capture_control->Run(env, std::move(step));
+}
+
+// Finishes the file off the JS thread; resolves with the final recording
+// stats.
+Napi::Value StopRecording(const Napi::CallbackInfo& info) {
+  const std::shared_ptr<AddonState> state = GetState(info.Env());
+  ControlStep step;
+  step.work = [state](std::string*) {
+    state->capture->StopRecording();
+    return true;
+  };
+  step.finish = [state](Napi::Env env) -> Napi::Value {
+    return ToRecordingObject(env, state->capture->GetRecordingStats());
+  };
+  return state->capture_control->Run(info.Env(), std::move(step));
+}
+
+// Returns false after throwing when `value` is not a usable queue depth.
+bool ReadQueueLevel(Napi::Env env, const Napi::Value& value, double* queued_ms) {
+  if (!value.IsNumber()) {
+    Napi::TypeError::New(env, "reportQueueLevel expects the consumer's queue depth in ms.")
         .ThrowAsJavaScriptException();
+    return false;
+  }
+  *queued_ms = value.As<Napi::Number>().DoubleValue();
+  return true;
+}
+
+// reportQueueLevel(queuedMs): feedback from the consumer of start() chunks
+// for drift compensation. Cheap enough to call every few render quanta.
+Napi::Value ReportQueueLevel(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  double queued_ms = 0.0;
+  if (!ReadQueueLevel(env, info.Length() > 0 ? info[0] : env.Undefined(), &queued_ms)) {
     return env.Undefined();
   }
+  GetState(env)->capture->ReportQueueLevel(queued_ms);
+  return env.Undefined();
+}
+
+Napi::Value ResetLatencyStats(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  AddonState& state = *GetState(env);
+  state.capture->ResetLatencyStats();
+  state.hub->ResetLatencyStats();
+  std::vector<std::shared_ptr<ChunkChannel>> channels{state.channel};
+  {
+    std::lock_guard<std::mutex> lock(state.sessions_mutex);
+    for (const auto& entry : state.sessions) {
+      channels.push_back(entry.second.channel);
+    }
+  }
+  for (const std::shared_ptr<ChunkChannel>& channel : channels) {
+    channel->emit_to_dispatch.Reset();
+    channel->dispatch_to_return.Reset();
+  }
+  return env.Undefined();
+}
 
-  InstallChunkBridge(capture);
-  return ToStatsObject(env, capture->GetStats());
+Napi::Object ToSessionStatsObject(Napi::Env env, const SessionBinding& binding) {
+  const CaptureStats stats = GetState(env)->hub->GetSessionStats(*binding.session);
+  Napi::Object result = ToStatsObject(env, stats, *binding.channel);
+  result.Set("sessionId", Napi::Number::New(env, static_cast<double>(binding.session->id())));
+  result.Set("sharedSessions", Napi::Number::New(env, stats.shared_sessions));
+  return result;
 }
 
-Napi::Value Stop(const Napi::CallbackInfo& info) {
+// Drops the live binding sharing `binding`'s channel, once its
+// ThreadSafeFunction has been released.
+void ForgetBinding(AddonState& state, const SessionBinding& binding) {
+  std::lock_guard<std::mutex> lock(state.sessions_mutex);
+  auto& bindings = state.live_bindings;
+  bindings.erase(std::remove_if(bindings.begin(), bindings.end(),
+                                [&binding](const std::shared_ptr<SessionBinding>& entry) {
+                                  return entry->channel == binding.channel;
+                                }),
+                 bindings.end());
+}
+
+bool FindSession(AddonState& state, uint64_t id, SessionBinding* binding) {
+  std::lock_guard<std::mutex> lock(state.sessions_mutex);
+  const auto found = state.sessions.find(id);
+  if (found == state.sessions.end()) return false;
+  *binding = found->second;
+  return true;
+}
+
+// Resolves with the session's final stats, or with undefined when it was
+// already stopped.
+Napi::Value StopSession(Napi::Env env, uint64_t id) {
+  const std::shared_ptr<AddonState> state = GetState(env);
+  auto binding = std::make_shared<SessionBinding>();
+  {
+    std::lock_guard<std::mutex> lock(state->sessions_mutex);
+    const auto found = state->sessions.find(id);
+    if (found != state->sessions.end()) {
+      *binding = std::move(found->second);
+      state->sessions.erase(found);
+    }
+  }
+
+  ControlStep step;
+  step.begin = [binding](Napi::Env, std::string*) {
+    return binding->session ? ControlStep::Begin::kRun : ControlStep::Begin::kSkip;
+  };
+  // Returns once the session's conversion thread can no longer call the
+  // bridge.
+  step.work = [state, binding](std::string*) {
+    state->hub->RemoveSession(binding->session);
+    return true;
+  };
+  step.finish = [state, binding](Napi::Env env) -> Napi::Value {
+    if (!binding->session) {
+      return env.Undefined();
+    }
+    Napi::Object stats = ToSessionStatsObject(env, *binding);
+    // Drains run on this thread, so none is in flight; one still queued
+    // finds the queue empty.
+    binding->channel->queue.Flush([](ChunkSlab* slab) { ChunkPool::Release(slab); });
+    ReleaseChannel(*binding->channel);
+    ForgetBinding(*state, *binding);
+    return stats;
+  };
+  return state->sessions_control->Run(env, std::move(step));
+}
+
+// prepareSessions(options): holds the device createSession(options) will
+// share open and stopped, so the first session only starts the stream and
+// the last one to stop returns it to standby. Rejects when the device
+// cannot be opened.
+Napi::Value PrepareSessions(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
-  WasapiLoopbackCapture* capture = EnsureCapture();
-  capture->Stop();
-  return ToStatsObject(env, capture->GetStats());
+  CaptureConfig config;
+  if (info.Length() > 0 && info[0].IsObject() &&
+      !ParseConfig(env, info[0].As<Napi::Object>(), &config)) {
+    return env.Undefined();
+  }
+  const std::shared_ptr<AddonState> state = GetState(env);
+  ControlStep step;
+  step.failure = "Failed to prepare the shared capture.";
+  step.work = [state, config](std::string* error) {
+    if (!state->hub->Prepare(config, error)) return false;
+    // Preparing again keeps the one hold.
+    if (state->sessions_prepared) state->hub->Release();
+    state->sessions_prepared = true;
+    return true;
+  };
+  step.finish = [](Napi::Env env) -> Napi::Value { return env.Undefined(); };
+  return state->sessions_control->Run(env, std::move(step));
 }
 
-Napi::Value GetStats(const Napi::CallbackInfo& info) {
+// Gives back the prepareSessions() hold: the device closes now, or when
+// the last running session stops, unless prepare() holds it too.
+Napi::Value ReleaseSessions(const Napi::CallbackInfo& info) {
+  const std::shared_ptr<AddonState> state = GetState(info.Env());
+  ControlStep step;
+  step.work = [state](std::string*) {
+    if (state->sessions_prepared) {
+      state->sessions_prepared = false;
+      state->hub->Release();
+    }
+    return true;
+  };
+  step.finish = [](Napi::Env env) -> Napi::Value { return env.Undefined(); };
+  return state->sessions_control->Run(info.Env(), std::move(step));
+}
+
+Napi::Object ToSessionHandle(Napi::Env env, uint64_t id) {
+  Napi::Object handle = Napi::Object::New(env);
+  handle.Set("id", Napi::Number::New(env, static_cast<double>(id)));
+  handle.Set("stop", Napi::Function::New(
+                         env, [id](const Napi::CallbackInfo& call) {
+                           return StopSession(call.Env(), id);
+                         },
+                         "stop"));
+  handle.Set("getStats", Napi::Function::New(
+                             env,
+                             [id](const Napi::CallbackInfo& call) -> Napi::Value {
+                               SessionBinding binding;
+                               if (!FindSession(*GetState(call.Env()), id, &binding)) {
+                                 return call.Env().Null();
+                               }
+                               return ToSessionStatsObject(call.Env(), binding);
+                             },
+                             "getStats"));
+  handle.Set("reportQueueLevel",
+             Napi::Function::New(
+                 env,
+                 [id](const Napi::CallbackInfo& call) {
+                   AddonState& state = *GetState(call.Env());
+                   double queued_ms = 0.0;
+                   SessionBinding binding;
+                   if (ReadQueueLevel(call.Env(),
+                                      call.Length() > 0 ? call[0] : call.Env().Undefined(),
+                                      &queued_ms) &&
+                       FindSession(state, id, &binding)) {
+                     state.hub->ReportQueueLevel(*binding.session, queued_ms);
+                   }
+                 },
+                 "reportQueueLevel"));
+  return handle;
+}
+
+// createSession(options, callback): an independent consumer of the shared
+// device capture with its own format, delivery options and stats. Resolves
+// once the shared device delivers audio with
+// { id, stop(), getStats(), reportQueueLevel(queuedMs) }; stop() resolves
+// with the session's final stats.
+Napi::Value CreateSession(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
-  WasapiLoopbackCapture* capture = EnsureCapture();
-  return ToStatsObject(env, capture->GetStats());
+  if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsFunction()) {
+    Napi::TypeError::New(env, "createSession expects an options object and a function.")
+        .ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  const Napi::Object options = info[0].As<Napi::Object>();
+  CaptureConfig config;
+  DeliveryOptions delivery;
+  if (!ParseConfig(env, options, &config) || !ParseDeliveryOptions(env, options, &delivery)) {
+    return env.Undefined();
+  }
+
+  auto binding = std::make_shared<SessionBinding>();
+  binding->channel = std::make_shared<ChunkChannel>();
+  binding->channel->queue.Configure(delivery);
+  EnsureChunkPool(*binding->channel, config);
+  auto tsf = Napi::ThreadSafeFunction::New(env, info[1].As<Napi::Function>(),
+                                           "SystemAudioSessionChunk", 4, 1);
+  binding->channel->tsf = std::make_shared<Napi::ThreadSafeFunction>(std::move(tsf));
+
+  const std::shared_ptr<AddonState> state = GetState(env);
+  {
+    std::lock_guard<std::mutex> lock(state->sessions_mutex);
+    state->live_bindings.push_back(binding);
+  }
+  ControlStep step;
+  step.failure = "Failed to start a capture session.";
+  step.work = [state, binding, config](std::string* error) {
+    binding->session = state->hub->AddSession(config, MakeChunkBridge(binding->channel), error);
+    return binding->session != nullptr;
+  };
+  step.finish = [state, binding](Napi::Env env) -> Napi::Value {
+    const uint64_t id = binding->session->id();
+    {
+      std::lock_guard<std::mutex> lock(state->sessions_mutex);
+      state->sessions[id] = *binding;
+    }
+    return ToSessionHandle(env, id);
+  };
+  step.cleanup = [state, binding]() {
+    ReleaseChannel(*binding->channel);
+    ForgetBinding(*state, *binding);
+  };
+  return state->sessions_control->Run(env, std::move(step));
 }
 
+// Runs once for every environment that loads the addon: the main thread
+// and each worker_thread get their own state, and the cleanup hook stops
+// its threads before the environment is torn down, whether the process is
+// exiting or the worker was terminated.
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+  if (!env.GetInstanceData<std::shared_ptr<AddonState>>()) {
+    auto state = std::make_shared<AddonState>();
+    env.SetInstanceData(new std::shared_ptr<AddonState>(state));
+    env.AddCleanupHook([state]() { state->Shutdown(); });
+  }
   exports.Set("setChunkCallback", Napi::Function::New(env, SetChunkCallback));
+  exports.Set("prepare", Napi::Function::New(env, Prepare));
+  exports.Set("release", Napi::Function::New(env, Release));
   exports.Set("start", Napi::Function::New(env, Start));
   exports.Set("stop", Napi::Function::New(env, Stop));
   exports.Set("getStats", Napi::Function::New(env, GetStats));
+  exports.Set("resetLatencyStats", Napi::Function::New(env, ResetLatencyStats));
+  exports.Set("reportQueueLevel", Napi::Function::New(env, ReportQueueLevel));
+  exports.Set("startRecording", Napi::Function::New(env, StartRecording));
+  exports.Set("stopRecording", Napi::Function::New(env, StopRecording));
+  exports.Set("attachSharedRing", Napi::Function::New(env, AttachSharedRing));
+  exports.Set("detachSharedRing", Napi::Function::New(env, DetachSharedRing));
+  exports.Set("prepareSessions", Napi::Function::New(env, PrepareSessions));
+  exports.Set("releaseSessions", Napi::Function::New(env, ReleaseSessions));
+  exports.Set("createSession", Napi::Function::New(env, CreateSession));
   return exports;
 }
 
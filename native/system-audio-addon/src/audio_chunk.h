@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "capture_config.h"
+
+// One emitted chunk: PCM, or one encoded packet holding the same span of
+// audio. PCM is in `samples` for int16 and in `float_samples` for the float
+// formats; `sample_count` counts either. Pointers are only valid for the
+// duration of the callback.
+struct AudioChunk {
+  ChunkEncoding encoding = ChunkEncoding::kPcm;
+  PcmSampleFormat sample_format = PcmSampleFormat::kInt16;
+  const int16_t* samples = nullptr;
+  const float* float_samples = nullptr;
+  size_t sample_count = 0;
+  const uint8_t* payload = nullptr;
+  size_t payload_bytes = 0;
+  uint32_t frame_count = 0;
+  uint32_t sample_rate = 0;
+  uint32_t channels = 0;
+  uint64_t sequence = 0;
+  // Output frames before this chunk since capture started, counting those
+  // concealed over device gaps, so it advances with the device clock.
+  uint64_t sample_position = 0;
+  uint64_t timestamp_ms = 0;
+  // MonotonicNowNs() times of the first frame: when the device captured it
+  // (the read time if the backend has no device clock) and when the capture
+  // thread read its packet; then when the chunk was handed to the callback.
+  uint64_t capture_time_ns = 0;
+  uint64_t read_time_ns = 0;
+  uint64_t emit_time_ns = 0;
+};
+
+using ChunkCallback = std::function<void(const AudioChunk& chunk)>;
@@ -0,0 +1,623 @@
+#include "audio_recorder.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <random>
+
+#if defined(SYSTEM_AUDIO_WITH_OPUS)
+#include <opus.h>
+#endif
+
+#include "opus_chunk_encoder.h"
+#include "sample_convert.h"
+
+namespace {
+
+// How much audio may wait for the writer before chunks are dropped.
+constexpr uint32_t kQueueMs = 2000;
+constexpr size_t kQueuedBlocks = 512;
+// Bytes handed to the OS per write, and the alignment of the buffer that
+// collects them.
+constexpr size_t kWriteBlockBytes = 256 * 1024;
+constexpr size_t kPageBytes = 4096;
+// The writer polls the queue rather than being woken, so Submit() never
+// touches a lock.
+constexpr auto kPollInterval = std::chrono::milliseconds(50);
+// How often the file is made playable up to what has been written.
+constexpr auto kCheckpointInterval = std::chrono::seconds(1);
+constexpr size_t kZeroFrames = 1024;
+
+void PutLe16(uint8_t* bytes, uint16_t value) {
+  bytes[0] = static_cast<uint8_t>(value);
+  bytes[1] = static_cast<uint8_t>(value >> 8);
+}
+
+void PutLe32(uint8_t* bytes, uint32_t value) {
+  for (int index = 0; index < 4; ++index) {
+    bytes[index] = static_cast<uint8_t>(value >> (8 * index));
+  }
+}
+
+// Collects bytes in a page-aligned block and writes it to the file whole,
+// so the disk sees large sequential writes whatever the chunk size.
+class BlockWriter {
+ public:
+  BlockWriter() : storage_(kWriteBlockBytes + kPageBytes) {
+    const uintptr_t address = reinterpret_cast<uintptr_t>(storage_.data());
+    block_ = storage_.data() + (kPageBytes - address % kPageBytes) % kPageBytes;
+  }
+
+  ~BlockWriter() {
+    if (file_) std::fclose(file_);
+  }
+
+  bool Open(const std::string& path, std::string* error) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+      if (error) *error = "Could not create recording file '" + path + "'.";
+      return false;
+    }
+    // Writes are already block-sized; stdio buffering would only copy them.
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+    return true;
+  }
+
+  bool Put(const void* data, size_t bytes, std::string* error) {
+    const uint8_t* source = static_cast<const uint8_t*>(data);
+    while (bytes > 0) {
+      const size_t count = std::min(bytes, kWriteBlockBytes - used_);
+      std::memcpy(block_ + used_, source, count);
+      used_ += count;
+      source += count;
+      bytes -= count;
+      if (used_ == kWriteBlockBytes && !Flush(error)) return false;
+    }
+    return true;
+  }
+
+  // Writes out a partly filled block.
+  bool Flush(std::string* error) {
+    if (used_ == 0) return true;
+    if (std::fwrite(block_, 1, used_, file_) != used_) {
+      if (error) *error = "Writing the recording failed; the disk may be full.";
+      return false;
+    }
+    written_ += used_;
+    used_ = 0;
+    return true;
+  }
+
+  // Overwrites bytes already flushed, then returns to the end of the file.
+  bool Patch(long offset, const void* data, size_t bytes, std::string* error) {
+    if (std::fseek(file_, offset, SEEK_SET) != 0 || std::fwrite(data, 1, bytes, file_) != bytes ||
+        std::fseek(file_, 0, SEEK_END) != 0) {
+      if (error) *error = "Updating the recording header failed.";
+      return false;
+    }
+    return true;
+  }
+
+  bool Close(std::string* error) {
+    const bool ok = Flush(error);
+    if (std::fclose(file_) != 0 && ok) {
+      if (error) *error = "Closing the recording failed.";
+      file_ = nullptr;
+      return false;
+    }
+    file_ = nullptr;
+    return ok;
+  }
+
+  uint64_t written() const { return written_; }
+
+ private:
+  std::vector<uint8_t> storage_;
+  uint8_t* block_ = nullptr;
+  size_t used_ = 0;
+  std::FILE* file_ = nullptr;
+  uint64_t written_ = 0;
+};
+
+}  // namespace
+
+// A file format: takes interleaved int16 frames on the writer thread.
+class RecordingContainer {
+ public:
+  virtual ~RecordingContainer() = default;
+
+  bool Open(const std::string& path, std::string* error) { return writer_.Open(path, error); }
+  virtual bool Begin(std::string* error) = 0;
+  virtual bool Append(const int16_t* samples, size_t frames, std::string* error) = 0;
+  // Makes everything appended so far playable from the file.
+  virtual bool Checkpoint(std::string* error) = 0;
+  // Completes the stream and closes the file.
+  virtual bool Finish(std::string* error) = 0;
+
+  uint64_t bytes_written() const { return writer_.written(); }
+
+ protected:
+  BlockWriter writer_;
+};
+
+namespace {
+
+class WavContainer : public RecordingContainer {
+ public:
+  WavContainer(uint32_t sample_rate, uint32_t channels)
+      : sample_rate_(sample_rate), channels_(channels) {}
+
+  bool Begin(std::string* error) override {
+    uint8_t header[kHeaderBytes] = {};
+    const uint32_t block_align = channels_ * 2;
+    std::memcpy(header, "RIFF", 4);
+    PutLe32(header + 4, kHeaderBytes - 8);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    PutLe32(header + 16, 16);
+    PutLe16(header + 20, 1);
+    PutLe16(header + 22, static_cast<uint16_t>(channels_));
+    PutLe32(header + 24, sample_rate_);
+    PutLe32(header + 28, sample_rate_ * block_align);
+    PutLe16(header + 32, static_cast<uint16_t>(block_align));
+    PutLe16(header + 34, 16);
+    std::memcpy(header + 36, "data", 4);
+    PutLe32(header + 40, 0);
+    return writer_.Put(header, sizeof(header), error) && writer_.Flush(error);
+  }
+
+  bool Append(const int16_t* samples, size_t frames, std::string* error) override {
+    const uint64_t bytes = uint64_t{frames} * channels_ * sizeof(int16_t);
+    if (data_bytes_ + bytes > kMaxDataBytes) {
+      if (error) *error = "WAV recordings stop at the format's 4 GiB limit.";
+      return false;
+    }
+    data_bytes_ += bytes;
+    // WAV is little-endian, as is every platform the addon builds for.
+    return writer_.Put(samples, static_cast<size_t>(bytes), error);
+  }
+
+  bool Checkpoint(std::string* error) override {
+    if (!writer_.Flush(error)) return false;
+    uint8_t size[4];
+    PutLe32(size, static_cast<uint32_t>(kHeaderBytes - 8 + data_bytes_));
+    if (!writer_.Patch(4, size, sizeof(size), error)) return false;
+    PutLe32(size, static_cast<uint32_t>(data_bytes_));
+    return writer_.Patch(40, size, sizeof(size), error);
+  }
+
+  bool Finish(std::string* error) override {
+    return Checkpoint(error) && writer_.Close(error);
+  }
+
+ private:
+  static constexpr uint32_t kHeaderBytes = 44;
+  static constexpr uint64_t kMaxDataBytes = 0xffffffffull - kHeaderBytes;
+
+  const uint32_t sample_rate_;
+  const uint32_t channels_;
+  uint64_t data_bytes_ = 0;
+};
+
+#if defined(SYSTEM_AUDIO_WITH_OPUS)
+
+void PutLe64(uint8_t* bytes, uint64_t value) {
+  for (int index = 0; index < 8; ++index) {
+    bytes[index] = static_cast<uint8_t>(value >> (8 * index));
+  }
+}
+
+// Opus in Ogg (RFC 7845): a header page, a tags page, then 20 ms packets
+// gathered into pages that are cut at each checkpoint.
+class OggOpusContainer : public RecordingContainer {
+ public:
+  OggOpusContainer(OpusEncoder* encoder, uint32_t sample_rate, uint32_t channels)
+      : encoder_(encoder),
+        sample_rate_(sample_rate),
+        channels_(channels),
+        frame_frames_(sample_rate / 50),
+        pcm_(frame_frames_ * channels),
+        packet_(kOpusMaxPacketBytes) {
+    std::random_device random;
+    serial_ = random();
+    body_.reserve(kMaxSegments * 255);
+  }
+
+  ~OggOpusContainer() override { DestroyOpusEncoder(encoder_); }
+
+  bool Begin(std::string* error) override {
+    opus_int32 lookahead = 0;
+    opus_encoder_ctl(encoder_, OPUS_GET_LOOKAHEAD(&lookahead));
+    // Pre-skip is counted at 48 kHz whatever the input rate.
+    pre_skip_ = static_cast<uint16_t>(lookahead * (48000 / sample_rate_));
+
+    uint8_t head[19] = {};
+    std::memcpy(head, "OpusHead", 8);
+    head[8] = 1;
+    head[9] = static_cast<uint8_t>(channels_);
+    PutLe16(head + 10, pre_skip_);
+    PutLe32(head + 12, sample_rate_);
+    AddPacket(head, sizeof(head));
+    if (!WritePage(kBeginOfStream, 0, error)) return false;
+
+    const char* vendor = opus_get_version_string();
+    const uint32_t vendor_bytes = static_cast<uint32_t>(std::strlen(vendor));
+    std::vector<uint8_t> tags(8 + 4 + vendor_bytes + 4);
+    std::memcpy(tags.data(), "OpusTags", 8);
+    PutLe32(tags.data() + 8, vendor_bytes);
+    std::memcpy(tags.data() + 12, vendor, vendor_bytes);
+    PutLe32(tags.data() + 12 + vendor_bytes, 0);
+    granule_ = pre_skip_;
+    AddPacket(tags.data(), tags.size());
+    return WritePage(0, 0, error) && writer_.Flush(error);
+  }
+
+  bool Append(const int16_t* samples, size_t frames, std::string* error) override {
+    while (frames > 0) {
+      const size_t count = std::min(frames, frame_frames_ - pcm_frames_);
+      std::copy_n(samples, count * channels_, pcm_.data() + pcm_frames_ * channels_);
+      pcm_frames_ += count;
+      samples += count * channels_;
+      frames -= count;
+      input_frames_ += count;
+      if (pcm_frames_ == frame_frames_ && !EncodeFrame(error)) return false;
+    }
+    return true;
+  }
+
+  bool Checkpoint(std::string* error) override {
+    return (lacing_.empty() || WritePage(0, granule_, error)) && writer_.Flush(error);
+  }
+
+  bool Finish(std::string* error) override {
+    if (pcm_frames_ > 0) {
+      std::fill(pcm_.begin() + pcm_frames_ * channels_, pcm_.end(), int16_t{0});
+      pcm_frames_ = frame_frames_;
+      if (!EncodeFrame(error)) return false;
+    }
+    // The last granule position trims the padding of the final frame.
+    const uint64_t end = pre_skip_ + input_frames_ * (48000 / sample_rate_);
+    return WritePage(kEndOfStream, std::min(granule_, end), error) && writer_.Close(error);
+  }
+
+ private:
+  static constexpr uint8_t kBeginOfStream = 0x02;
+  static constexpr uint8_t kEndOfStream = 0x04;
+  static constexpr size_t kMaxSegments = 255;
+
+  bool EncodeFrame(std::string* error) {
+    const opus_int32 bytes =
+        opus_encode(encoder_, pcm_.data(), static_cast<int>(frame_frames_), packet_.data(),
+                    static_cast<opus_int32>(packet_.size()));
+    pcm_frames_ = 0;
+    if (bytes < 0) {
+      if (error) *error = std::string("opus_encode failed: ") + opus_strerror(bytes);
+      return false;
+    }
+    // A packet needs a lacing value per 255 bytes plus a terminating one.
+    if (lacing_.size() + static_cast<size_t>(bytes) / 255 + 1 > kMaxSegments &&
+        !WritePage(0, granule_, error)) {
+      return false;
+    }
+    granule_ += frame_frames_ * (48000 / sample_rate_);
+    AddPacket(packet_.data(), static_cast<size_t>(bytes));
+    return true;
+  }
+
+  void AddPacket(const uint8_t* data, size_t bytes) {
+    for (size_t left = bytes;; left -= 255) {
+      lacing_.push_back(static_cast<uint8_t>(std::min<size_t>(left, 255)));
+      if (left < 255) break;
+    }
+    body_.insert(body_.end(), data, data + bytes);
+  }
+
+  bool WritePage(uint8_t flags, uint64_t granule, std::string* error) {
+    uint8_t header[27 + kMaxSegments];
+    std::memcpy(header, "OggS", 4);
+    header[4] = 0;
+    header[5] = flags;
+    PutLe64(header + 6, granule);
+    PutLe32(header + 14, serial_);
+    PutLe32(header + 18, page_sequence_++);
+    PutLe32(header + 22, 0);
+    header[26] = static_cast<uint8_t>(lacing_.size());
+    std::copy(lacing_.begin(), lacing_.end(), header + 27);
+    const size_t header_bytes = 27 + lacing_.size();
+
+    uint32_t crc = Crc(0, header, header_bytes);
+    crc = Crc(crc, body_.data(), body_.size());
+    PutLe32(header + 22, crc);
+
+    lacing_.clear();
+    const bool ok = writer_.Put(header, header_bytes, error) &&
+                    writer_.Put(body_.data(), body_.size(), error);
+    body_.clear();
+    return ok;
+  }
+
+  // The Ogg CRC: polynomial 0x04c11db7, no reflection, zero initial value.
+  static uint32_t Crc(uint32_t crc, const uint8_t* data, size_t bytes) {
+    static const std::array<uint32_t, 256> table = []() {
+      std::array<uint32_t, 256> entries{};
+      for (uint32_t index = 0; index < 256; ++index) {
+        uint32_t value = index << 24;
+        for (int bit = 0; bit < 8; ++bit) {
+          value = (value & 0x80000000u) ? (value << 1) ^ 0x04c11db7u : value << 1;
+        }
+        entries[index] = value;
+      }
+      return entries;
+    }();
+    for (size_t index = 0; index < bytes; ++index) {
+      crc = (crc << 8) ^ table[((crc >> 24) ^ data[index]) & 0xff];
+    }
+    return crc;
+  }
+
+  OpusEncoder* const encoder_;
+  const uint32_t sample_rate_;
+  const uint32_t channels_;
+  const size_t frame_frames_;
+  std::vector<int16_t> pcm_;
+  size_t pcm_frames_ = 0;
+  std::vector<uint8_t> packet_;
+  std::vector<uint8_t> lacing_;
+  std::vector<uint8_t> body_;
+  uint32_t serial_ = 0;
+  uint32_t page_sequence_ = 0;
+  uint16_t pre_skip_ = 0;
+  uint64_t granule_ = 0;
+  uint64_t input_frames_ = 0;
+};
+
+#endif  // SYSTEM_AUDIO_WITH_OPUS
+
+std::unique_ptr<RecordingContainer> CreateContainer(const RecordingOptions& options,
+                                                    uint32_t sample_rate,
+                                                    uint32_t channels,
+                                                    std::string* error) {
+  if (options.format == RecordingFormat::kWav) {
+    return std::make_unique<WavContainer>(sample_rate, channels);
+  }
+#if defined(SYSTEM_AUDIO_WITH_OPUS)
+  void* encoder = CreateOpusEncoder(sample_rate, channels, options.opus, error);
+  if (!encoder) return nullptr;
+  return std::make_unique<OggOpusContainer>(static_cast<OpusEncoder*>(encoder), sample_rate,
+                                            channels);
+#else
+  (void)sample_rate;
+  (void)channels;
+  if (error) *error = "This build of the system audio addon has no Opus support.";
+  return nullptr;
+#endif
+}
+
+}  // namespace
+
+const char* RecordingFormatName(RecordingFormat format) {
+  switch (format) {
+    case RecordingFormat::kWav:
+      return "wav";
+    case RecordingFormat::kOggOpus:
+      return "ogg-opus";
+  }
+  return "wav";
+}
+
+bool ParseRecordingFormat(const std::string& name, RecordingFormat* format) {
+  if (name == "wav") {
+    *format = RecordingFormat::kWav;
+  } else if (name == "ogg-opus" || name == "opus") {
+    *format = RecordingFormat::kOggOpus;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+AudioRecorder::AudioRecorder() = default;
+
+AudioRecorder::~AudioRecorder() {
+  Stop();
+}
+
+bool AudioRecorder::Start(const std::string& path,
+                          const RecordingOptions& options,
+                          uint32_t sample_rate,
+                          uint32_t channels,
+                          uint32_t chunk_frames,
+                          std::string* error) {
+  Stop();
+  if (sample_rate == 0 || channels == 0 || chunk_frames == 0) {
+    if (error) *error = "Recording needs a running capture.";
+    return false;
+  }
+
+  std::unique_ptr<RecordingContainer> container =
+      CreateContainer(options, sample_rate, channels, error);
+  if (!container) {
+    return false;
+  }
+
+  options_ = options;
+  path_ = path;
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+  const size_t chunk_samples = size_t{chunk_frames} * channels;
+  samples_.Reset(std::max<size_t>(size_t{sample_rate} * kQueueMs / 1000 * channels,
+                                  2 * chunk_samples),
+                 chunk_samples);
+  blocks_.Reset(kQueuedBlocks);
+  pending_dropped_frames_ = 0;
+  interleaved_.assign(chunk_samples, 0.0f);
+  quantized_.assign(chunk_samples, 0);
+  container_ = std::move(container);
+  zeros_.assign(kZeroFrames * channels, 0);
+  failed_ = false;
+  recorded_frames_.store(0);
+  bytes_written_.store(0);
+  dropped_frames_.store(0);
+  {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    error_.clear();
+  }
+
+  stop_requested_ = false;
+  open_finished_ = false;
+  try {
+    writer_ = std::thread([this, path]() { WriterMain(path); });
+  } catch (const std::exception& ex) {
+    container_.reset();
+    if (error) *error = ex.what();
+    return false;
+  }
+
+  bool opened = false;
+  {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    open_done_.wait(lock, [this]() { return open_finished_; });
+    opened = opened_;
+    if (!opened && error) *error = open_error_;
+  }
+  if (!opened) {
+    writer_.join();
+    container_.reset();
+    return false;
+  }
+  active_.store(true);
+  return true;
+}
+
+void AudioRecorder::Stop() {
+  if (!writer_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stop_requested_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  container_.reset();
+  active_.store(false);
+}
+
+void AudioRecorder::Submit(const AudioChunk& chunk) {
+  const bool silent = chunk.encoding == ChunkEncoding::kSilence;
+  if (chunk.encoding == ChunkEncoding::kOpus || chunk.channels != channels_) return;
+  const size_t samples = silent ? 0 : size_t{chunk.frame_count} * channels_;
+  const bool is_float = !silent && IsFloatFormat(chunk.sample_format);
+  const bool has_samples = is_float ? chunk.float_samples && samples <= quantized_.size()
+                                    : chunk.samples != nullptr;
+  if ((!silent && (!has_samples || samples > samples_.max_view())) ||
+      blocks_.WriteAvailable() == 0 || samples_.WriteAvailable() < samples) {
+    pending_dropped_frames_ += chunk.frame_count;
+    dropped_frames_.fetch_add(chunk.frame_count, std::memory_order_relaxed);
+    return;
+  }
+  if (is_float) {
+    // Files are always 16-bit; float chunks are quantized on the way in.
+    const float* interleaved = chunk.float_samples;
+    if (chunk.sample_format == PcmSampleFormat::kFloat32Planar) {
+      InterleaveFloat(chunk.float_samples, chunk.frame_count, channels_, interleaved_.data());
+      interleaved = interleaved_.data();
+    }
+    FloatToInt16(interleaved, samples, quantized_.data(), nullptr);
+    samples_.Write(quantized_.data(), samples);
+  } else if (!silent) {
+    samples_.Write(chunk.samples, samples);
+  }
+  blocks_.Push(Block{chunk.frame_count, silent, pending_dropped_frames_});
+  pending_dropped_frames_ = 0;
+}
+
+RecordingStats AudioRecorder::GetStats() const {
+  RecordingStats stats;
+  stats.active = active_.load();
+  stats.path = path_;
+  stats.format = options_.format;
+  stats.recorded_frames = recorded_frames_.load(std::memory_order_relaxed);
+  stats.bytes_written = bytes_written_.load(std::memory_order_relaxed);
+  stats.dropped_frames = dropped_frames_.load(std::memory_order_relaxed);
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  stats.error = error_;
+  return stats;
+}
+
+void AudioRecorder::WriterMain(const std::string& path) {
+  std::string open_error;
+  const bool opened = container_->Open(path, &open_error) && container_->Begin(&open_error);
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    open_finished_ = true;
+    opened_ = opened;
+    open_error_ = open_error;
+  }
+  open_done_.notify_one();
+  if (!opened) return;
+  bytes_written_.store(container_->bytes_written(), std::memory_order_relaxed);
+
+  auto last_checkpoint = std::chrono::steady_clock::now();
+  for (;;) {
+    bool stopping = false;
+    {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_.wait_for(lock, kPollInterval, [this]() { return stop_requested_; });
+      stopping = stop_requested_;
+    }
+
+    std::string error;
+    bool ok = Drain();
+    const auto now = std::chrono::steady_clock::now();
+    if (stopping) {
+      // Even after a failure, what made it to disk gets a valid header.
+      ok = container_->Finish(&error) && ok;
+    } else if (ok && now - last_checkpoint >= kCheckpointInterval) {
+      ok = container_->Checkpoint(&error);
+      last_checkpoint = now;
+    }
+    if (!ok) {
+      failed_ = true;
+      if (!error.empty()) SetError(error);
+    }
+    bytes_written_.store(container_->bytes_written(), std::memory_order_relaxed);
+    if (stopping) break;
+  }
+}
+
+bool AudioRecorder::Drain() {
+  std::string error;
+  Block block;
+  while (blocks_.Read(&block, 1) == 1) {
+    const size_t samples = block.silent ? 0 : size_t{block.frames} * channels_;
+    if (failed_) {
+      // Keep the queue moving so the producer's counts stay meaningful.
+      samples_.Consume(samples);
+      continue;
+    }
+
+    uint64_t silence = block.dropped_frames + (block.silent ? block.frames : 0);
+    while (silence > 0 && !failed_) {
+      const size_t count = static_cast<size_t>(std::min<uint64_t>(silence, kZeroFrames));
+      failed_ = !container_->Append(zeros_.data(), count, &error);
+      silence -= count;
+      if (!failed_) recorded_frames_.fetch_add(count, std::memory_order_relaxed);
+    }
+    if (samples > 0) {
+      if (!failed_) {
+        failed_ = !container_->Append(samples_.Peek(samples), block.frames, &error);
+        if (!failed_) recorded_frames_.fetch_add(block.frames, std::memory_order_relaxed);
+      }
+      samples_.Consume(samples);
+    }
+    if (failed_) SetError(error);
+  }
+  return !failed_;
+}
+
+void AudioRecorder::SetError(const std::string& message) {
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  if (error_.empty()) error_ = message;
+}
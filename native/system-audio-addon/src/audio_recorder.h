@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_chunk.h"
+#include "capture_config.h"
+#include "spsc_ring_buffer.h"
+
+enum class RecordingFormat {
+  // 16-bit PCM RIFF/WAVE, up to the format's 4 GiB.
+  kWav,
+  // Opus in an Ogg stream (RFC 7845), 20 ms packets.
+  kOggOpus,
+};
+
+const char* RecordingFormatName(RecordingFormat format);
+bool ParseRecordingFormat(const std::string& name, RecordingFormat* format);
+
+struct RecordingOptions {
+  RecordingFormat format = RecordingFormat::kWav;
+  // Ogg Opus only.
+  OpusEncoderConfig opus;
+};
+
+class RecordingContainer;
+
+struct RecordingStats {
+  bool active = false;
+  std::string path;
+  RecordingFormat format = RecordingFormat::kWav;
+  // Frames in the file so far, including silence written for markers and
+  // for chunks the writer fell too far behind to take.
+  uint64_t recorded_frames = 0;
+  uint64_t bytes_written = 0;
+  uint64_t dropped_frames = 0;
+  std::string error;
+};
+
+// Writes a chunk stream to a file on its own thread. The producer only
+// copies each chunk into a bounded queue, so memory stays flat however long
+// the recording runs and the producer never waits on the disk; if the
+// writer falls a queue behind, chunks are dropped and written as silence,
+// which keeps the file in step with the capture. The writer creates the
+// file, drains the queue into a page-aligned block and writes whole blocks,
+// fixing up the container about once a second so a crash leaves a playable
+// file; the disk is only ever touched on its thread.
+class AudioRecorder {
+ public:
+  AudioRecorder();
+  ~AudioRecorder();
+
+  AudioRecorder(const AudioRecorder&) = delete;
+  AudioRecorder& operator=(const AudioRecorder&) = delete;
+
+  // Has the writer create `path` for PCM chunks of `sample_rate` and
+  // `channels`, none longer than `chunk_frames`, and waits for the outcome.
+  bool Start(const std::string& path,
+             const RecordingOptions& options,
+             uint32_t sample_rate,
+             uint32_t channels,
+             uint32_t chunk_frames,
+             std::string* error);
+  // Writes what is queued, finishes the container and closes the file.
+  void Stop();
+
+  // Producer thread. PCM chunks, in any sample format, and silence markers
+  // of the rate and channels given to Start(); encoded chunks are ignored.
+  // Never blocks or allocates.
+  void Submit(const AudioChunk& chunk);
+
+  // Any thread.
+  RecordingStats GetStats() const;
+
+ private:
+  struct Block {
+    uint32_t frames = 0;
+    bool silent = false;
+    // Frames dropped just before this block because the queue was full.
+    uint64_t dropped_frames = 0;
+  };
+
+  void WriterMain(const std::string& path);
+  // Moves everything queued into the container; false once writing failed.
+  bool Drain();
+  void SetError(const std::string& message);
+
+  RecordingOptions options_;
+  std::string path_;
+  uint32_t sample_rate_ = 0;
+  uint32_t channels_ = 0;
+
+  SpscRingBuffer<int16_t> samples_;
+  SpscRingBuffer<Block> blocks_;
+  // Producer only. Float chunks are interleaved and quantized here.
+  uint64_t pending_dropped_frames_ = 0;
+  std::vector<float> interleaved_;
+  std::vector<int16_t> quantized_;
+
+  // Writer thread only, between Start() and Stop().
+  std::unique_ptr<RecordingContainer> container_;
+  std::vector<int16_t> zeros_;
+  bool failed_ = false;
+
+  std::thread writer_;
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool stop_requested_ = false;
+  // Under wake_mutex_: the writer's outcome creating the file, which Start()
+  // waits for on open_done_.
+  std::condition_variable open_done_;
+  bool open_finished_ = false;
+  bool opened_ = false;
+  std::string open_error_;
+
+  std::atomic<bool> active_{false};
+  std::atomic<uint64_t> recorded_frames_{0};
+  std::atomic<uint64_t> bytes_written_{0};
+  std::atomic<uint64_t> dropped_frames_{0};
+  mutable std::mutex error_mutex_;
+  std::string error_;
+};
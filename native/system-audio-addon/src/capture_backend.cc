@@ -0,0 +1,39 @@
+#include "capture_backend.h"
+
+#include "synthetic_backend.h"
+#include "wav_file_backend.h"
+
+#if defined(_WIN32)
+#include "wasapi_loopback.h"
+#endif
+#if defined(SYSTEM_AUDIO_WITH_PULSEAUDIO)
+#include "pulse_monitor_backend.h"
+#endif
+
+std::unique_ptr<CaptureBackend> CreateCaptureBackend(const CaptureConfig& config,
+                                                     std::string* error) {
+  const std::string& backend = config.source.backend;
+  if (backend == "synthetic") {
+    return std::make_unique<SyntheticBackend>();
+  }
+  if (backend == "wav") {
+    return std::make_unique<WavFileBackend>();
+  }
+#if defined(_WIN32)
+  if (backend.empty() || backend == "wasapi") {
+    return std::make_unique<WasapiLoopbackBackend>();
+  }
+#endif
+#if defined(SYSTEM_AUDIO_WITH_PULSEAUDIO)
+  if (backend.empty() || backend == "pulse") {
+    return std::make_unique<PulseMonitorBackend>();
+  }
+#endif
+
+  if (error) {
+    *error = backend.empty()
+                 ? std::string("System audio loopback is not available on this platform.")
+                 : "Capture backend '" + backend + "' is not available on this platform.";
+  }
+  return nullptr;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "capture_config.h"
+#include "sample_convert.h"
+
+// Nanoseconds on the steady clock. On Windows this is the QPC timeline the
+// audio engine stamps packets with; elsewhere it is CLOCK_MONOTONIC.
+inline uint64_t MonotonicNowNs() {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count());
+}
+
+// One device packet, valid until it is handed back with ReleasePacket().
+struct CapturePacket {
+  // Interleaved samples in the format reported by Open(); nullptr when the
+  // packet is flagged silent.
+  const uint8_t* data = nullptr;
+  uint32_t frames = 0;
+  bool silent = false;
+  // Frames were lost between the previous packet and this one (a device
+  // glitch, or a paced backend skipping a stall).
+  bool discontinuity = false;
+  // MonotonicNowNs() time the device captured the first frame, or 0 when
+  // the backend cannot tell.
+  uint64_t device_time_ns = 0;
+  // The device's own count of frames before this packet, when it keeps
+  // one. A jump past the previous packet's end is audio the device lost.
+  bool has_device_position = false;
+  uint64_t device_position = 0;
+};
+
+enum class PacketStatus {
+  kPacket,
+  kEmpty,
+  kEndOfStream,
+  kError,
+};
+
+// A source of device packets driven by SystemAudioCapture. Every method is
+// called on the capture thread: Open, then one or more runs of Start, any
+// number of WaitForData/ReadPacket/ReleasePacket rounds and Stop, then
+// Close. A device can sit open between runs, so Start must not deliver
+// audio from before it was called.
+class CaptureBackend {
+ public:
+  virtual ~CaptureBackend() = default;
+
+  virtual const char* name() const = 0;
+  // False for a source with no clock of its own that produces a packet
+  // whenever asked; the pipeline then waits for processing to catch up
+  // instead of skipping input.
+  virtual bool realtime() const { return true; }
+
+  // Acquires the device and reports the format packets will arrive in.
+  virtual bool Open(const CaptureConfig& config,
+                    InputFormatInfo* format,
+                    std::string* error) = 0;
+  virtual bool Start(std::string* error) = 0;
+
+  // Blocks until packets may be available or `timeout_ms` elapses. Returns
+  // false only on a fatal error.
+  virtual bool WaitForData(uint32_t timeout_ms, std::string* error) = 0;
+  // Any thread, for the backend's whole lifetime. Makes the WaitForData() in
+  // progress, or else the next one, return early, so a stop request does
+  // not wait out the timeout. Backends whose waits are already short can
+  // ignore it.
+  virtual void Wake() {}
+  virtual PacketStatus ReadPacket(CapturePacket* packet, std::string* error) = 0;
+  virtual bool ReleasePacket(const CapturePacket& packet, std::string* error) = 0;
+
+  virtual void Stop() = 0;
+  virtual void Close() = 0;
+};
+
+// Builds the backend named by `config.source.backend`, or the platform
+// loopback backend when it is empty.
+std::unique_ptr<CaptureBackend> CreateCaptureBackend(const CaptureConfig& config,
+                                                     std::string* error);
+
+// How a capture builds its backend; CreateCaptureBackend unless a test
+// supplies its own device.
+using CaptureBackendFactory = std::function<std::unique_ptr<CaptureBackend>(
+    const CaptureConfig& config, std::string* error)>;
@@ -0,0 +1,140 @@
+#include "capture_config.h"
+
+#include <algorithm>
+
+CaptureConfig NormalizeCaptureConfig(CaptureConfig config) {
+  if (config.target_sample_rate == 0) config.target_sample_rate = 48000;
+  if (config.target_channels == 0) config.target_channels = 2;
+  if (config.frame_ms == 0) config.frame_ms = 20;
+  if (config.source.sample_rate == 0) config.source.sample_rate = 48000;
+  if (config.source.channels == 0) config.source.channels = 2;
+  if (config.source.packet_ms == 0) config.source.packet_ms = 10;
+  if (config.drift.target_queue_ms <= 0.0) config.drift.target_queue_ms = 2.0 * config.frame_ms;
+  if (config.drift.max_ppm <= 0.0) config.drift.max_ppm = 500.0;
+  if (config.silence.marker_ms == 0) config.silence.marker_ms = config.frame_ms;
+  return config;
+}
+
+bool SameSource(const SourceConfig& a, const SourceConfig& b) {
+  return a.backend == b.backend && a.device == b.device && a.signal == b.signal &&
+         a.tone_hz == b.tone_hz && a.amplitude == b.amplitude &&
+         a.sample_rate == b.sample_rate && a.channels == b.channels &&
+         a.sample_format == b.sample_format && a.wav_path == b.wav_path && a.loop == b.loop &&
+         a.realtime == b.realtime && a.packet_ms == b.packet_ms;
+}
+
+bool SameDevice(const CaptureConfig& a, const CaptureConfig& b) {
+  return SameSource(a.source, b.source) && a.scheduling == b.scheduling;
+}
+
+bool SameConversion(const CaptureConfig& a, const CaptureConfig& b) {
+  if (a.drift.enabled || b.drift.enabled) return false;
+  const bool same_opus = a.opus.bitrate == b.opus.bitrate &&
+                         a.opus.complexity == b.opus.complexity && a.opus.fec == b.opus.fec &&
+                         a.opus.expected_loss_percent == b.opus.expected_loss_percent &&
+                         a.opus.dtx == b.opus.dtx;
+  return a.target_sample_rate == b.target_sample_rate &&
+         a.target_channels == b.target_channels && a.frame_ms == b.frame_ms &&
+         a.resampler_quality == b.resampler_quality && a.dither == b.dither &&
+         a.downmix_matrix == b.downmix_matrix && a.encoding == b.encoding &&
+         a.pcm_format == b.pcm_format &&
+         (a.encoding != ChunkEncoding::kOpus || same_opus) &&
+         a.silence.enabled == b.silence.enabled &&
+         (!a.silence.enabled || (a.silence.threshold_dbfs == b.silence.threshold_dbfs &&
+                                 a.silence.hangover_ms == b.silence.hangover_ms &&
+                                 a.silence.marker_ms == b.silence.marker_ms));
+}
+
+size_t ChunkSampleCount(const CaptureConfig& config) {
+  uint32_t chunk_frames =
+      std::max<uint32_t>(1, (config.target_sample_rate * config.frame_ms) / 1000);
+  if (IsFloatFormat(config.pcm_format)) {
+    const uint32_t quanta = (chunk_frames + kRenderQuantumFrames / 2) / kRenderQuantumFrames;
+    chunk_frames = std::max<uint32_t>(1, quanta) * kRenderQuantumFrames;
+  }
+  return static_cast<size_t>(chunk_frames) * config.target_channels;
+}
+
+const char* ChunkEncodingName(ChunkEncoding encoding) {
+  switch (encoding) {
+    case ChunkEncoding::kOpus:
+      return "opus";
+    case ChunkEncoding::kSilence:
+      return "silence";
+    case ChunkEncoding::kPcm:
+    default:
+      return "pcm";
+  }
+}
+
+bool ParseChunkEncoding(const std::string& name, ChunkEncoding* encoding) {
+  if (!encoding) return false;
+  if (name == "pcm") {
+    *encoding = ChunkEncoding::kPcm;
+    return true;
+  }
+  if (name == "opus") {
+    *encoding = ChunkEncoding::kOpus;
+    return true;
+  }
+  return false;
+}
+
+const char* PcmSampleFormatName(PcmSampleFormat format) {
+  switch (format) {
+    case PcmSampleFormat::kFloat32Interleaved:
+      return "f32-interleaved";
+    case PcmSampleFormat::kFloat32Planar:
+      return "f32-planar";
+    case PcmSampleFormat::kInt16:
+    default:
+      return "s16";
+  }
+}
+
+bool ParsePcmSampleFormat(const std::string& name, PcmSampleFormat* format) {
+  if (!format) return false;
+  for (PcmSampleFormat candidate : {PcmSampleFormat::kInt16, PcmSampleFormat::kFloat32Interleaved,
+                                    PcmSampleFormat::kFloat32Planar}) {
+    if (name == PcmSampleFormatName(candidate)) {
+      *format = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IsFloatFormat(PcmSampleFormat format) {
+  return format == PcmSampleFormat::kFloat32Interleaved ||
+         format == PcmSampleFormat::kFloat32Planar;
+}
+
+const char* SampleFormatName(SampleFormat format) {
+  switch (format) {
+    case SampleFormat::kFloat32:
+      return "f32";
+    case SampleFormat::kInt16:
+      return "s16";
+    case SampleFormat::kInt24:
+      return "s24";
+    case SampleFormat::kInt24In32:
+      return "s24-32";
+    case SampleFormat::kInt32:
+      return "s32";
+    default:
+      return "unknown";
+  }
+}
+
+bool ParseSampleFormat(const std::string& name, SampleFormat* format) {
+  if (!format) return false;
+  for (SampleFormat candidate : {SampleFormat::kFloat32, SampleFormat::kInt16,
+                                 SampleFormat::kInt24, SampleFormat::kInt24In32,
+                                 SampleFormat::kInt32}) {
+    if (name == SampleFormatName(candidate)) {
+      *format = candidate;
+      return true;
+    }
+  }
+  return false;
+}
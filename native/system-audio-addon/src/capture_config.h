@@ -0,0 +1,219 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "level_meter.h"
+#include "polyphase_resampler.h"
+#include "sample_convert.h"
+#include "thread_scheduling.h"
+
+// Where captured audio comes from. Backends other than the platform
+// loopback exist so the pipeline can be driven deterministically.
+struct SourceConfig {
+  // "wasapi", "pulse", "synthetic" or "wav"; empty picks the platform
+  // loopback.
+  std::string backend;
+  // Loopback device override; for "pulse" a source name, empty meaning the
+  // default sink's monitor.
+  std::string device;
+
+  // Synthetic backend: "tone", "noise" or "silence" at the given device
+  // format.
+  std::string signal = "tone";
+  double tone_hz = 440.0;
+  double amplitude = 0.5;
+  uint32_t sample_rate = 48000;
+  uint32_t channels = 2;
+  SampleFormat sample_format = SampleFormat::kFloat32;
+
+  // WAV replay backend.
+  std::string wav_path;
+  bool loop = false;
+
+  // Synthetic and WAV backends: pace packets in real time, or deliver them
+  // as fast as the pipeline consumes them.
+  bool realtime = true;
+  uint32_t packet_ms = 10;
+};
+
+// What chunks delivered to the callback carry.
+enum class ChunkEncoding {
+  kPcm,      // Samples in the configured PcmSampleFormat.
+  kOpus,     // One Opus packet per chunk.
+  kSilence,  // No payload: frame_count frames of silence. Never configured.
+};
+
+// Sample layout of PCM chunks.
+enum class PcmSampleFormat {
+  kInt16,               // Interleaved int16; half the bytes of float.
+  kFloat32Interleaved,  // Interleaved float32 in [-1, 1], not clipped.
+  kFloat32Planar,       // One contiguous float32 plane per channel, in order.
+};
+
+// Frames per Web Audio render quantum. Float chunks are sized in whole
+// quanta so an AudioWorklet consumes each one in exactly that many calls.
+constexpr uint32_t kRenderQuantumFrames = 128;
+
+struct OpusEncoderConfig {
+  uint32_t bitrate = 96000;
+  // 0-10; 5 keeps a 20 ms stereo frame well under a millisecond to encode.
+  uint32_t complexity = 5;
+  // In-band forward error correction, sized for `expected_loss_percent`.
+  bool fec = false;
+  uint32_t expected_loss_percent = 10;
+  // Discontinuous transmission: near-empty packets during silence.
+  bool dtx = false;
+};
+
+// Trims the output rate by up to `max_ppm` so the consumer's queue, as it
+// reports through ReportQueueLevel(), stays near `target_queue_ms` even
+// though its playout clock drifts from the capture clock.
+struct DriftCompensationConfig {
+  bool enabled = false;
+  // 0 means two chunks.
+  double target_queue_ms = 0.0;
+  double max_ppm = 500.0;
+};
+
+// Replaces runs of silent chunks with compact markers. A chunk is silent
+// when its RMS level is below `threshold_dbfs`; packets the device flags as
+// silent skip conversion entirely once suppression has kicked in. Audio is
+// only suppressed after `hangover_ms` of continuous silence, so decays and
+// short pauses go out as PCM, and markers cover up to `marker_ms` each.
+struct SilenceSuppressionConfig {
+  bool enabled = false;
+  double threshold_dbfs = -70.0;
+  uint32_t hangover_ms = 200;
+  // 0 means one chunk.
+  uint32_t marker_ms = 100;
+};
+
+struct CaptureConfig {
+  uint32_t target_sample_rate = 48000;
+  uint32_t target_channels = 2;
+  uint32_t frame_ms = 20;
+  ResamplerQuality resampler_quality = ResamplerQuality::kHighFidelity;
+  bool dither = false;
+  // Row-major output x device channels; empty means derive a downmix from
+  // the device channel mask.
+  std::vector<float> downmix_matrix;
+  SourceConfig source;
+  ChunkEncoding encoding = ChunkEncoding::kPcm;
+  // PCM only; Opus always encodes int16.
+  PcmSampleFormat pcm_format = PcmSampleFormat::kInt16;
+  OpusEncoderConfig opus;
+  DriftCompensationConfig drift;
+  SilenceSuppressionConfig silence;
+  // Priority of the thread that reads the device. Sessions share the one
+  // the first session asked for.
+  SchedulingPolicy scheduling = SchedulingPolicy::kProAudio;
+};
+
+// Counters owned by the thread that converts device audio, published to
+// GetStats() as one consistent snapshot.
+struct CaptureCounters {
+  uint64_t captured_input_frames = 0;
+  uint64_t silent_input_frames = 0;
+  uint64_t emitted_output_frames = 0;
+  uint64_t emitted_chunks = 0;
+  uint64_t dropped_no_callback = 0;
+  uint64_t dropped_encoder_busy = 0;
+  uint64_t suppressed_chunks = 0;
+  uint64_t silence_markers = 0;
+  uint64_t discontinuities = 0;
+  uint64_t concealed_frames = 0;
+  uint32_t input_sample_rate = 0;
+  uint32_t input_channels = 0;
+  uint32_t input_channel_mask = 0;
+  LevelReading levels;
+};
+
+struct CaptureStats {
+  uint64_t captured_input_frames = 0;
+  uint64_t emitted_output_frames = 0;
+  uint64_t emitted_chunks = 0;
+  // Sum of the per-reason counters below.
+  uint64_t dropped_chunks = 0;
+  uint64_t dropped_no_callback = 0;
+  uint64_t dropped_encoder_busy = 0;
+  uint64_t silent_input_frames = 0;
+  // Silence suppression only: chunks replaced by markers, and markers sent.
+  uint64_t suppressed_chunks = 0;
+  uint64_t silence_markers = 0;
+  // Times the device reported lost frames, and output frames filled in
+  // over device gaps and skipped input to keep chunk positions continuous.
+  uint64_t discontinuities = 0;
+  uint64_t concealed_frames = 0;
+  // Device frames a lagging conversion stage had to skip, and how many
+  // times that happened.
+  uint64_t dropped_input_frames = 0;
+  uint64_t queue_overruns = 0;
+  // Sessions only: how many sessions share the conversion stage.
+  uint32_t shared_sessions = 0;
+  uint32_t input_sample_rate = 0;
+  uint32_t input_channels = 0;
+  uint32_t input_channel_mask = 0;
+  uint32_t output_sample_rate = 0;
+  uint32_t output_channels = 0;
+  uint32_t chunk_frame_ms = 0;
+  bool running = false;
+  // The device is held open between runs, and the last start found it
+  // already open.
+  bool standby = false;
+  bool warm_start = false;
+  // From the start call to the first chunk reaching the consumer; 0 until
+  // it does.
+  double start_to_first_chunk_ms = 0.0;
+  std::string backend;
+  std::string encoding;
+  std::string sample_format;
+  // Opus mode only.
+  uint64_t encoded_packets = 0;
+  uint64_t encoded_bytes = 0;
+  uint64_t encoder_dropped_frames = 0;
+  double encode_time_avg_us = 0.0;
+  double encode_time_max_us = 0.0;
+  // Drift compensation only.
+  double drift_correction_ppm = 0.0;
+  double drift_estimate_ppm = 0.0;
+  double reported_queue_ms = 0.0;
+  uint64_t queue_level_reports = 0;
+  // Output levels over the last ~100 ms.
+  LevelReading levels;
+  LatencySummary device_to_capture;
+  LatencySummary capture_to_emit;
+  // Device thread priority as applied, and how late its wakeups ran.
+  SchedulingResult scheduling;
+  LatencySummary wakeup_jitter;
+  std::string last_error;
+};
+
+// Fills in the defaults Start() applies to zero-valued fields.
+CaptureConfig NormalizeCaptureConfig(CaptureConfig config);
+
+// True when two normalized configs read the same device the same way.
+bool SameSource(const SourceConfig& a, const SourceConfig& b);
+// True when a device opened for `a` can serve `b` as it is: the same source,
+// read by a thread with the same scheduling.
+bool SameDevice(const CaptureConfig& a, const CaptureConfig& b);
+// True when two normalized configs turn device audio into identical chunks.
+// Never true with drift compensation, which follows one consumer's clock.
+bool SameConversion(const CaptureConfig& a, const CaptureConfig& b);
+
+// Number of samples in every chunk emitted for `config`: frame_ms worth,
+// rounded to the nearest whole render quantum for float formats.
+size_t ChunkSampleCount(const CaptureConfig& config);
+
+const char* ChunkEncodingName(ChunkEncoding encoding);
+bool ParseChunkEncoding(const std::string& name, ChunkEncoding* encoding);
+
+const char* PcmSampleFormatName(PcmSampleFormat format);
+bool ParsePcmSampleFormat(const std::string& name, PcmSampleFormat* format);
+bool IsFloatFormat(PcmSampleFormat format);
+
+const char* SampleFormatName(SampleFormat format);
+bool ParseSampleFormat(const std::string& name, SampleFormat* format);
@@ -0,0 +1,726 @@
+#include "capture_hub.h"
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+#include "chunk_converter.h"
+#include "opus_chunk_encoder.h"
+#include "packet_queue.h"
+#include "stats_seqlock.h"
+
+namespace {
+
+// Upper bound on one backend wait; stopping the device also wakes the
+// backend.
+constexpr uint32_t kWaitTimeoutMs = 200;
+
+// How long the first session waits for the device's first packet before
+// starting anyway, as a loopback of a silent output delivers none.
+constexpr uint64_t kFirstPacketWaitNs = 200000000;
+
+// How far a conversion group may fall behind the device before it starts
+// skipping input.
+constexpr uint32_t kGroupQueueMs = 500;
+constexpr size_t kGroupQueuedPieces = 256;
+
+}  // namespace
+
+// Converts the shared device stream to one chunk format on its own thread
+// and hands every chunk to each session that asked for that format.
+class ConversionGroup {
+ public:
+  explicit ConversionGroup(const CaptureConfig& config) : config_(config) {}
+  ~ConversionGroup() { Stop(); }
+
+  ConversionGroup(const ConversionGroup&) = delete;
+  ConversionGroup& operator=(const ConversionGroup&) = delete;
+
+  const CaptureConfig& config() const { return config_; }
+
+  // `realtime_source` is false when the device thread should wait for this
+  // group rather than skip input.
+  bool Start(const InputFormatInfo& input_format, bool realtime_source, std::string* error) {
+    if (!converter_.Configure(input_format, config_,
+                              [this](const AudioChunk& chunk) { Emit(chunk); }, error)) {
+      return false;
+    }
+    if (config_.encoding == ChunkEncoding::kOpus &&
+        !opus_encoder_.Start(
+            config_, [this](const AudioChunk& packet) { Fanout(packet); }, error)) {
+      return false;
+    }
+
+    queue_.Reset(input_format.sample_rate, converter_.block_align(), kGroupQueueMs,
+                 kGroupQueuedPieces, !realtime_source);
+    stopping_.store(false);
+
+    try {
+      worker_ = std::thread([this]() { WorkerMain(); });
+    } catch (const std::exception& ex) {
+      opus_encoder_.Stop();
+      if (error) *error = ex.what();
+      return false;
+    }
+    return true;
+  }
+
+  void Stop() {
+    if (worker_.joinable()) {
+      stopping_.store(true);
+      queue_.Close();
+      worker_.join();
+    }
+    opus_encoder_.Stop();
+    // Nothing fans out any more; the copy would keep the sessions, and
+    // through them this group, alive.
+    fanout_.clear();
+  }
+
+  void AddSession(std::shared_ptr<CaptureSession> session) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    sessions_.push_back(std::move(session));
+    sessions_version_.fetch_add(1, std::memory_order_release);
+  }
+
+  // Returns the sessions left.
+  size_t RemoveSession(const CaptureSession* session) {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    sessions_.erase(std::remove_if(sessions_.begin(), sessions_.end(),
+                                   [session](const std::shared_ptr<CaptureSession>& entry) {
+                                     return entry.get() == session;
+                                   }),
+                    sessions_.end());
+    sessions_version_.fetch_add(1, std::memory_order_release);
+    return sessions_.size();
+  }
+
+  size_t session_count() const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    return sessions_.size();
+  }
+
+  // Device thread. Never blocks for a realtime source: input that does not
+  // fit is skipped and counted, and the group's chunks show the gap. Other
+  // sources wait for the group instead.
+  void PushPacket(const CapturePacket& packet, uint64_t read_time_ns) {
+    queue_.Push(packet, read_time_ns);
+  }
+
+  void FillStats(CaptureStats* stats) const {
+    const CaptureCounters counters = published_counters_.Load();
+    stats->emitted_output_frames = counters.emitted_output_frames;
+    stats->captured_input_frames = counters.captured_input_frames;
+    stats->silent_input_frames = counters.silent_input_frames;
+    stats->suppressed_chunks = counters.suppressed_chunks;
+    stats->silence_markers = counters.silence_markers;
+    stats->dropped_encoder_busy = counters.dropped_encoder_busy;
+    stats->levels = counters.levels;
+    stats->discontinuities = counters.discontinuities;
+    stats->concealed_frames = counters.concealed_frames;
+    stats->dropped_input_frames = queue_.overrun_frames();
+    stats->queue_overruns = queue_.overruns();
+    stats->shared_sessions = static_cast<uint32_t>(session_count());
+    stats->capture_to_emit = capture_to_emit_.Summarize();
+    if (config_.encoding == ChunkEncoding::kOpus) {
+      const OpusEncoderStats encoder_stats = opus_encoder_.GetStats();
+      stats->encoded_packets = encoder_stats.encoded_packets;
+      stats->encoded_bytes = encoder_stats.encoded_bytes;
+      stats->encoder_dropped_frames = encoder_stats.dropped_frames;
+      stats->encode_time_avg_us = encoder_stats.encode_time_avg_us;
+      stats->encode_time_max_us = encoder_stats.encode_time_max_us;
+    }
+    if (config_.drift.enabled) {
+      const DriftStats drift = converter_.drift_stats();
+      stats->drift_correction_ppm = drift.correction_ppm;
+      stats->drift_estimate_ppm = drift.estimate_ppm;
+      stats->reported_queue_ms = drift.reported_queue_ms;
+      stats->queue_level_reports = drift.reports;
+    }
+  }
+
+  void ResetLatencyStats() { capture_to_emit_.Reset(); }
+  void ReportQueueLevel(double queued_ms) { converter_.ReportQueueLevel(queued_ms); }
+
+ private:
+  void WorkerMain() {
+    while (queue_.Wait() && !stopping_.load()) {
+      PacketQueue::Piece piece;
+      const uint8_t* data = nullptr;
+      while (queue_.Front(&piece, &data)) {
+        CountPiece(piece, &counters_);
+        if (piece.lost_frames + piece.skipped_frames > 0) {
+          converter_.ConcealGap(piece.lost_frames + piece.skipped_frames);
+        }
+        converter_.Process(data, piece.frames, piece.device_time_ns, piece.read_time_ns);
+        queue_.Pop(piece);
+        if (converter_.completed_chunks() != published_chunks_) {
+          PublishCounters();
+        }
+      }
+    }
+    queue_.Abandon();
+    PublishCounters();
+  }
+
+  // Worker thread.
+  void PublishCounters() {
+    counters_.emitted_output_frames = converter_.output_frames();
+    counters_.suppressed_chunks = converter_.suppressed_chunks();
+    counters_.silence_markers = converter_.silence_markers();
+    counters_.concealed_frames = converter_.concealed_frames();
+    counters_.levels = converter_.levels();
+    published_chunks_ = converter_.completed_chunks();
+    published_counters_.Store(counters_);
+  }
+
+  // Worker thread.
+  void Emit(const AudioChunk& chunk) {
+    if (config_.encoding == ChunkEncoding::kOpus) {
+      if (!opus_encoder_.Submit(chunk)) {
+        ++counters_.dropped_encoder_busy;
+      }
+      return;
+    }
+    Fanout(chunk);
+  }
+
+  // Worker thread, or the encoder thread in Opus mode. Callbacks run on a
+  // copy of the session list, refreshed only when it changes, so a session
+  // whose callback waits (a 'block' delivery policy) holds up neither stats
+  // nor sessions joining or leaving.
+  void Fanout(const AudioChunk& chunk) {
+    capture_to_emit_.RecordInterval(chunk.read_time_ns, chunk.emit_time_ns);
+    if (sessions_version_.load(std::memory_order_acquire) != fanout_version_) {
+      std::lock_guard<std::mutex> lock(sessions_mutex_);
+      fanout_ = sessions_;
+      fanout_version_ = sessions_version_.load(std::memory_order_relaxed);
+    }
+    for (const std::shared_ptr<CaptureSession>& session : fanout_) {
+      // A removed session may still be in the copy; CaptureHub clears
+      // active_ and then takes this lock, so once it has, nothing follows.
+      std::lock_guard<std::mutex> delivery_lock(session->delivery_mutex_);
+      if (!session->active_.load(std::memory_order_acquire) || !session->callback_) continue;
+      if (session->first_chunk_ns_.load(std::memory_order_relaxed) == 0) {
+        session->first_chunk_ns_.store(MonotonicNowNs(), std::memory_order_relaxed);
+      }
+      session->callback_(chunk);
+      session->delivered_chunks_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  const CaptureConfig config_;
+  ChunkConverter converter_;
+  OpusChunkEncoder opus_encoder_;
+
+  // Producer: device thread. Consumer: worker.
+  PacketQueue queue_;
+  std::atomic<bool> stopping_{false};
+  std::thread worker_;
+
+  mutable std::mutex sessions_mutex_;
+  std::vector<std::shared_ptr<CaptureSession>> sessions_;
+  // Bumped under sessions_mutex_ whenever sessions_ changes.
+  std::atomic<uint64_t> sessions_version_{0};
+  // Fanout() only: the sessions it delivers to, as of fanout_version_.
+  std::vector<std::shared_ptr<CaptureSession>> fanout_;
+  uint64_t fanout_version_ = 0;
+
+  // Worker thread only, published whenever a chunk completes.
+  CaptureCounters counters_;
+  uint64_t published_chunks_ = 0;
+  StatsSeqlock<CaptureCounters> published_counters_;
+  LatencyHistogram capture_to_emit_;
+};
+
+CaptureHub::CaptureHub(CaptureBackendFactory backend_factory)
+    : groups_(std::make_shared<GroupList>()),
+      device_groups_(groups_.get()),
+      backend_factory_(std::move(backend_factory)) {}
+
+CaptureHub::~CaptureHub() {
+  std::vector<std::shared_ptr<CaptureSession>> sessions;
+  {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    sessions = sessions_;
+  }
+  for (const std::shared_ptr<CaptureSession>& session : sessions) {
+    RemoveSession(session);
+  }
+  std::lock_guard<std::mutex> lock(sessions_mutex_);
+  standby_holds_.store(0);
+  CloseDevice();
+}
+
+bool CaptureHub::Prepare(const CaptureConfig& requested, std::string* error) {
+  const CaptureConfig config = NormalizeCaptureConfig(requested);
+  std::lock_guard<std::mutex> lock(sessions_mutex_);
+  ReapDevice();
+  if (device_thread_.joinable() && SameDevice(device_config_, config)) {
+    standby_holds_.fetch_add(1);
+    return true;
+  }
+  if (!sessions_.empty()) {
+    if (error) *error = "Stop the running sessions before preparing a different source.";
+    return false;
+  }
+
+  CloseDevice();
+  if (!OpenDevice(config, error)) {
+    return false;
+  }
+  standby_holds_.fetch_add(1);
+  return true;
+}
+
+void CaptureHub::Release() {
+  std::lock_guard<std::mutex> lock(sessions_mutex_);
+  if (standby_holds_.load() > 0) {
+    standby_holds_.fetch_sub(1);
+  }
+  if (standby_holds_.load() == 0 && sessions_.empty()) {
+    CloseDevice();
+  }
+}
+
+std::shared_ptr<CaptureSession> CaptureHub::AddSession(const CaptureConfig& requested,
+                                                       ChunkCallback callback,
+                                                       std::string* error) {
+  const uint64_t start_time_ns = MonotonicNowNs();
+  const CaptureConfig config = NormalizeCaptureConfig(requested);
+  Retired retired;
+  std::unique_lock<std::mutex> lock(sessions_mutex_);
+
+  bool warm_start = true;
+  if (sessions_.empty()) {
+    if (!ReadyDevice(config, &warm_start, error)) {
+      return nullptr;
+    }
+  } else if (!running_.load()) {
+    if (error) {
+      std::lock_guard<std::mutex> error_lock(error_mutex_);
+      *error = "The shared capture has stopped" +
+               (last_error_.empty() ? std::string(".") : ": " + last_error_) +
+               " Stop the remaining sessions before starting a new one.";
+    }
+    return nullptr;
+  } else if (!SameSource(config.source, device_config_.source)) {
+    if (error) *error = "Sessions share one device; source options must match the running capture.";
+    return nullptr;
+  }
+
+  auto session = std::make_shared<CaptureSession>(next_session_id_++, config, std::move(callback));
+  session->start_time_ns_ = start_time_ns;
+  session->warm_start_ = warm_start;
+
+  for (const std::shared_ptr<ConversionGroup>& group : *groups_) {
+    if (SameConversion(group->config(), config)) {
+      session->group_ = group;
+      break;
+    }
+  }
+
+  if (!session->group_) {
+    auto group = std::make_shared<ConversionGroup>(config);
+    if (!group->Start(input_format_, backend_->realtime(), error)) {
+      if (sessions_.empty()) StopDevice();
+      return nullptr;
+    }
+    auto next = std::make_shared<GroupList>(*groups_);
+    next->push_back(group);
+    PublishGroups(std::move(next), &retired);
+    session->group_ = std::move(group);
+  }
+
+  session->group_->AddSession(session);
+  sessions_.push_back(session);
+
+  // The first session's group is in place before the stream starts, so it
+  // gets the packet the start waits for.
+  if (sessions_.size() == 1 && !StartDevice(error)) {
+    sessions_.clear();
+    // A device that failed to start pushed no packet, so neither a delivery
+    // nor a device read is under way and retiring does not wait.
+    session->active_.store(false, std::memory_order_release);
+    Retire(&retired);
+    DetachSession(session, &retired);
+    Retire(&retired);
+    return nullptr;
+  }
+  lock.unlock();
+  Retire(&retired);
+  return session;
+}
+
+void CaptureHub::RemoveSession(const std::shared_ptr<CaptureSession>& session) {
+  if (!session) return;
+  // Waits out a delivery already under way before taking sessions_mutex_,
+  // so a callback that waits holds up only this call. The group checks
+  // active_ under the same lock, so none follows and the caller may free
+  // what the callback uses.
+  session->active_.store(false, std::memory_order_release);
+  { std::lock_guard<std::mutex> delivery_lock(session->delivery_mutex_); }
+
+  Retired retired;
+  {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    const auto found = std::find(sessions_.begin(), sessions_.end(), session);
+    if (found == sessions_.end()) return;
+    sessions_.erase(found);
+    DetachSession(session, &retired);
+
+    if (sessions_.empty()) {
+      StopDevice();
+    }
+  }
+  Retire(&retired);
+}
+
+void CaptureHub::DetachSession(const std::shared_ptr<CaptureSession>& session,
+                               Retired* retired) {
+  const std::shared_ptr<ConversionGroup> group = session->group_;
+  if (group && group->RemoveSession(session.get()) == 0) {
+    auto next = std::make_shared<GroupList>();
+    for (const std::shared_ptr<ConversionGroup>& entry : *groups_) {
+      if (entry != group) next->push_back(entry);
+    }
+    PublishGroups(std::move(next), retired);
+    retired->group = group;
+  }
+}
+
+void CaptureHub::PublishGroups(std::shared_ptr<const GroupList> groups, Retired* retired) {
+  {
+    std::lock_guard<std::mutex> lock(groups_mutex_);
+    retired->groups = std::move(groups_);
+    groups_ = std::move(groups);
+    device_groups_.store(groups_.get());
+  }
+  // Both sides are sequentially consistent: a device read counted after the
+  // store above loads the new list, so only the one under way now, if the
+  // count is odd, can still hold the previous one.
+  retired->device_reads = device_reads_.load();
+}
+
+void CaptureHub::Retire(Retired* retired) {
+  const uint64_t reads = retired->device_reads;
+  if (reads % 2 != 0) {
+    device_read_waiters_.fetch_add(1);
+    {
+      std::unique_lock<std::mutex> lock(device_read_mutex_);
+      device_read_done_.wait(lock, [this, reads]() { return device_reads_.load() != reads; });
+    }
+    device_read_waiters_.fetch_sub(1);
+  }
+  retired->device_reads = 0;
+  retired->groups.reset();
+  if (retired->group) {
+    retired->group->Stop();
+    retired->group.reset();
+  }
+}
+
+CaptureStats CaptureHub::GetDeviceStats() const {
+  CaptureStats stats;
+  stats.running = running_.load();
+  stats.device_to_capture = device_to_capture_.Summarize();
+  stats.wakeup_jitter = wakeup_jitter_.Summarize();
+  stats.standby = standby_holds_.load() > 0 && device_.state() != DeviceState::kClosed;
+  {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    stats.backend = backend_name_;
+    stats.scheduling = scheduling_;
+    stats.input_sample_rate = input_format_.sample_rate;
+    stats.input_channels = input_format_.channels;
+    stats.input_channel_mask = input_format_.channel_mask;
+  }
+  {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    stats.last_error = last_error_;
+  }
+  return stats;
+}
+
+bool CaptureHub::IsRunning(const CaptureSession& session) const {
+  return running_.load() && session.active();
+}
+
+CaptureStats CaptureHub::GetSessionStats(const CaptureSession& session) const {
+  CaptureStats stats = GetDeviceStats();
+  const CaptureConfig& config = session.config();
+  stats.running = IsRunning(session);
+  stats.warm_start = session.warm_start_;
+  const uint64_t first_chunk_ns = session.first_chunk_ns_.load(std::memory_order_relaxed);
+  if (first_chunk_ns > session.start_time_ns_) {
+    stats.start_to_first_chunk_ms =
+        static_cast<double>(first_chunk_ns - session.start_time_ns_) / 1e6;
+  }
+  stats.output_sample_rate = config.target_sample_rate;
+  stats.output_channels = config.target_channels;
+  stats.chunk_frame_ms = config.frame_ms;
+  stats.encoding = ChunkEncodingName(config.encoding);
+  stats.sample_format = PcmSampleFormatName(config.pcm_format);
+  stats.emitted_chunks = session.delivered_chunks_.load(std::memory_order_relaxed);
+  // Set before AddSession() returned the session, and never changed.
+  if (session.group_) {
+    session.group_->FillStats(&stats);
+  }
+  stats.dropped_chunks = stats.dropped_encoder_busy;
+  return stats;
+}
+
+void CaptureHub::ReportQueueLevel(const CaptureSession& session, double queued_ms) {
+  if (session.group_) {
+    session.group_->ReportQueueLevel(queued_ms);
+  }
+}
+
+void CaptureHub::ResetLatencyStats() {
+  device_to_capture_.Reset();
+  wakeup_jitter_.Reset();
+  std::shared_ptr<const GroupList> groups;
+  {
+    std::lock_guard<std::mutex> lock(groups_mutex_);
+    groups = groups_;
+  }
+  for (const std::shared_ptr<ConversionGroup>& group : *groups) {
+    group->ResetLatencyStats();
+  }
+}
+
+size_t CaptureHub::session_count() const {
+  std::lock_guard<std::mutex> lock(sessions_mutex_);
+  return sessions_.size();
+}
+
+bool CaptureHub::ReadyDevice(const CaptureConfig& config,
+                             bool* warm_start,
+                             std::string* error) {
+  ReapDevice();
+  *warm_start = device_.state() == DeviceState::kStandby && SameDevice(device_config_, config);
+  if (*warm_start) {
+    return true;
+  }
+  CloseDevice();
+  return OpenDevice(config, error);
+}
+
+bool CaptureHub::StartDevice(std::string* error) {
+  device_to_capture_.Reset();
+  wakeup_jitter_.Reset();
+  SetError("");
+  running_.store(true);
+  if (!device_.Start()) {
+    running_.store(false);
+    if (standby_holds_.load() > 0) {
+      ReapDevice();
+    } else {
+      CloseDevice();
+    }
+    if (error) {
+      std::lock_guard<std::mutex> lock(error_mutex_);
+      *error = last_error_;
+    }
+    return false;
+  }
+  return true;
+}
+
+void CaptureHub::StopDevice() {
+  if (standby_holds_.load() == 0) {
+    CloseDevice();
+    return;
+  }
+  running_.store(false);
+  if (backend_) {
+    backend_->Wake();
+  }
+  if (device_.WaitStopped() == DeviceState::kClosed) {
+    ReapDevice();
+  }
+}
+
+bool CaptureHub::OpenDevice(const CaptureConfig& config, std::string* error) {
+  std::string backend_error;
+  backend_ = backend_factory_(config, &backend_error);
+  if (!backend_) {
+    SetError(backend_error);
+    if (error) *error = backend_error;
+    return false;
+  }
+  device_config_ = config;
+  {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    backend_name_ = backend_->name();
+    input_format_ = InputFormatInfo();
+    scheduling_ = SchedulingResult();
+  }
+  SetError("");
+
+  device_.Reset();
+  try {
+    device_thread_ = std::thread([this]() { DeviceThreadMain(); });
+  } catch (const std::exception& ex) {
+    device_.Opened(false);
+    backend_.reset();
+    SetError(ex.what());
+    if (error) *error = ex.what();
+    return false;
+  }
+
+  // Backends open on the thread that reads them (WASAPI wants its COM
+  // apartment there); wait for the outcome so the caller fails
+  // synchronously.
+  if (!device_.WaitOpened()) {
+    device_thread_.join();
+    backend_.reset();
+    if (error) {
+      std::lock_guard<std::mutex> lock(error_mutex_);
+      *error = last_error_;
+    }
+    return false;
+  }
+  return true;
+}
+
+void CaptureHub::CloseDevice() {
+  device_.RequestClose();
+  running_.store(false);
+  if (backend_) {
+    backend_->Wake();
+  }
+  if (device_thread_.joinable()) {
+    device_thread_.join();
+  }
+  backend_.reset();
+}
+
+void CaptureHub::ReapDevice() {
+  if (device_thread_.joinable() && device_.state() == DeviceState::kClosed) {
+    device_thread_.join();
+    backend_.reset();
+  }
+}
+
+void CaptureHub::DeviceThreadMain() {
+  const ScopedThreadScheduling scheduling(device_config_.scheduling);
+  {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    scheduling_ = scheduling.result();
+  }
+
+  std::string error;
+  InputFormatInfo format;
+  bool opened = backend_->Open(device_config_, &format, &error);
+  if (opened && (format.sample_format == SampleFormat::kUnknown || format.channels == 0 ||
+                 format.sample_rate == 0)) {
+    error = std::string("Unsupported ") + backend_->name() + " capture format.";
+    opened = false;
+  }
+  if (!opened) {
+    SetError(error);
+    backend_->Close();
+    device_.Opened(false);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    input_format_ = format;
+  }
+  device_.Opened(true);
+
+  while (device_.WaitForStart()) {
+    wakeup_jitter_.Start(format.sample_rate);
+    if (!backend_->Start(&error)) {
+      SetError(error);
+      device_.Started(false);
+      continue;
+    }
+    // The first session is added once audio flows; PumpPackets() reports
+    // that.
+    start_reported_ = false;
+    first_packet_deadline_ns_ = MonotonicNowNs() + kFirstPacketWaitNs;
+    PumpPackets();
+    // Still set when the source ended or failed rather than being stopped.
+    const bool ended = running_.load();
+    backend_->Stop();
+    if (!start_reported_ && ended) {
+      std::lock_guard<std::mutex> lock(error_mutex_);
+      if (last_error_.empty()) last_error_ = "The capture source ended before delivering audio.";
+    }
+    if (ended) {
+      break;
+    }
+    if (!start_reported_) {
+      device_.Started(false);
+      continue;
+    }
+    device_.Stopped();
+  }
+
+  backend_->Close();
+  running_.store(false);
+  device_.Closed();
+}
+
+void CaptureHub::PumpPackets() {
+  std::string error;
+  while (running_.load()) {
+    if (!backend_->WaitForData(kWaitTimeoutMs, &error)) {
+      SetError(error);
+      return;
+    }
+    const uint64_t wakeup_ns = MonotonicNowNs();
+    wakeup_jitter_.OnWakeup(wakeup_ns);
+    if (!start_reported_ && wakeup_ns >= first_packet_deadline_ns_) {
+      ReportStarted();
+    }
+
+    while (running_.load()) {
+      CapturePacket packet;
+      const PacketStatus status = backend_->ReadPacket(&packet, &error);
+      if (status == PacketStatus::kEmpty) {
+        break;
+      }
+      if (status != PacketStatus::kPacket) {
+        if (status == PacketStatus::kError) SetError(error);
+        return;
+      }
+
+      const uint64_t read_time_ns = MonotonicNowNs();
+      device_to_capture_.RecordInterval(packet.device_time_ns, read_time_ns);
+      wakeup_jitter_.OnPacket(packet.frames);
+
+      // Counted so Retire() knows when it may drop the list PublishGroups()
+      // replaced; no lock and no reference count per packet, and a lock
+      // only when someone waits for the read to end.
+      device_reads_.fetch_add(1);
+      for (const std::shared_ptr<ConversionGroup>& group : *device_groups_.load()) {
+        group->PushPacket(packet, read_time_ns);
+      }
+      device_reads_.fetch_add(1);
+      if (device_read_waiters_.load() != 0) {
+        { std::lock_guard<std::mutex> lock(device_read_mutex_); }
+        device_read_done_.notify_all();
+      }
+      if (!start_reported_) {
+        ReportStarted();
+      }
+
+      if (!backend_->ReleasePacket(packet, &error)) {
+        SetError(error);
+        return;
+      }
+    }
+  }
+}
+
+void CaptureHub::ReportStarted() {
+  start_reported_ = true;
+  device_.Started(true);
+}
+
+void CaptureHub::SetError(const std::string& message) {
+  std::lock_guard<std::mutex> lock(error_mutex_);
+  last_error_ = message;
+}
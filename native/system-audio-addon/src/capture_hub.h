@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_chunk.h"
+#include "capture_backend.h"
+#include "capture_config.h"
+#include "device_lifecycle.h"
+#include "latency_histogram.h"
+#include "thread_scheduling.h"
+
+class ConversionGroup;
+
+// One consumer of the shared device stream, with its own chunk format and
+// callback. Created and ended through CaptureHub.
+class CaptureSession {
+ public:
+  CaptureSession(uint64_t id, const CaptureConfig& config, ChunkCallback callback)
+      : id_(id), config_(config), callback_(std::move(callback)) {}
+
+  uint64_t id() const { return id_; }
+  const CaptureConfig& config() const { return config_; }
+  // False once RemoveSession() has ended delivery.
+  bool active() const { return active_.load(std::memory_order_acquire); }
+
+ private:
+  friend class CaptureHub;
+  friend class ConversionGroup;
+
+  const uint64_t id_;
+  const CaptureConfig config_;
+  const ChunkCallback callback_;
+  std::shared_ptr<ConversionGroup> group_;
+  std::atomic<bool> active_{true};
+  // Held by the group while it runs the callback, so ending the session can
+  // wait out a delivery in progress without stalling other sessions.
+  std::mutex delivery_mutex_;
+  std::atomic<uint64_t> delivered_chunks_{0};
+  // Set by AddSession(): when it was called and whether the device was
+  // already open. The first delivery stamps first_chunk_ns_.
+  uint64_t start_time_ns_ = 0;
+  bool warm_start_ = false;
+  std::atomic<uint64_t> first_chunk_ns_{0};
+};
+
+// Shares one device capture between any number of sessions. The device
+// thread only copies raw packets into each conversion group's queue; every
+// group converts on its own thread and fans its chunks out to all sessions
+// with the same conversion settings, so a 48 kHz stereo Opus session and a
+// 16 kHz mono PCM session never slow each other or the device down, and two
+// identical sessions cost one conversion. SystemAudioCapture is one such
+// session, so every consumer in an environment shares the one device.
+class CaptureHub {
+ public:
+  explicit CaptureHub(CaptureBackendFactory backend_factory = CreateCaptureBackend);
+  ~CaptureHub();
+
+  CaptureHub(const CaptureHub&) = delete;
+  CaptureHub& operator=(const CaptureHub&) = delete;
+
+  // Opens the device `config.source` names and holds it in standby, so the
+  // first session only has to start the stream and the last one returns it
+  // to standby instead of closing it. Every successful call takes a hold
+  // that one Release() gives back; the most recent source is the one held.
+  bool Prepare(const CaptureConfig& config, std::string* error);
+  // Gives back a Prepare() hold. The device closes once no hold is left,
+  // now or when the last session ends.
+  void Release();
+
+  // Starts delivering `config`-shaped chunks to `callback`. The first
+  // session starts the device described by `config.source`, opening it
+  // unless it is prepared; later sessions must name the same source while
+  // it runs.
+  std::shared_ptr<CaptureSession> AddSession(const CaptureConfig& config,
+                                             ChunkCallback callback,
+                                             std::string* error);
+  // Stops delivery to `session`, waiting out a delivery under way without
+  // holding up other control calls; the last session stops the device.
+  void RemoveSession(const std::shared_ptr<CaptureSession>& session);
+
+  CaptureStats GetSessionStats(const CaptureSession& session) const;
+  // The device facts alone, for a capture without a session yet.
+  CaptureStats GetDeviceStats() const;
+  // Whether the device is delivering to `session`.
+  bool IsRunning(const CaptureSession& session) const;
+  // Forwards the consumer's queue depth to the session's drift compensation.
+  // Drift-compensated sessions never share a conversion, so the report
+  // steers this session only.
+  void ReportQueueLevel(const CaptureSession& session, double queued_ms);
+  void ResetLatencyStats();
+  size_t session_count() const;
+
+ private:
+  using GroupList = std::vector<std::shared_ptr<ConversionGroup>>;
+
+  // What a control call replaced or emptied under sessions_mutex_ and lets
+  // go of through Retire() once it no longer holds the lock.
+  struct Retired {
+    std::shared_ptr<const GroupList> groups;
+    uint64_t device_reads = 0;
+    // Left without sessions; stopped once the device thread stops pushing
+    // into it.
+    std::shared_ptr<ConversionGroup> group;
+  };
+
+  // All under sessions_mutex_.
+  // Opens the device for `config` unless it is prepared for it already.
+  bool ReadyDevice(const CaptureConfig& config, bool* warm_start, std::string* error);
+  // Starts the open device and waits for its first packet.
+  bool StartDevice(std::string* error);
+  void StopDevice();
+  // Takes a session out of its conversion group; a group left without
+  // sessions is unpublished into `retired`.
+  void DetachSession(const std::shared_ptr<CaptureSession>& session, Retired* retired);
+  // Swaps in `groups` for the device thread; the previous list goes to
+  // `retired`.
+  void PublishGroups(std::shared_ptr<const GroupList> groups, Retired* retired);
+  // Without sessions_mutex_: waits until the device thread no longer reads
+  // what `retired` holds, then drops it and stops its group.
+  void Retire(Retired* retired);
+  bool OpenDevice(const CaptureConfig& config, std::string* error);
+  void CloseDevice();
+  void ReapDevice();
+
+  void DeviceThreadMain();
+  void PumpPackets();
+  void ReportStarted();
+  void SetError(const std::string& message);
+
+  // Serializes the control calls, which may wait on the device. Stats and
+  // queue level reports never take it.
+  mutable std::mutex sessions_mutex_;
+  std::vector<std::shared_ptr<CaptureSession>> sessions_;
+  uint64_t next_session_id_ = 1;
+
+  // Replaced, never mutated; written under sessions_mutex_ and
+  // groups_mutex_, so either is enough to read it. The device thread reads
+  // the same list through device_groups_ without locking and counts each
+  // read, odd while it is under way, so a writer knows when the previous
+  // list is free to drop and its groups no longer receive packets.
+  mutable std::mutex groups_mutex_;
+  std::shared_ptr<const GroupList> groups_;
+  std::atomic<const GroupList*> device_groups_;
+  std::atomic<uint64_t> device_reads_{0};
+  // Retire() callers waiting for a read to end; the device thread only
+  // takes device_read_mutex_ to wake them.
+  std::atomic<uint32_t> device_read_waiters_{0};
+  std::mutex device_read_mutex_;
+  std::condition_variable device_read_done_;
+
+  const CaptureBackendFactory backend_factory_;
+  CaptureConfig device_config_;
+  std::unique_ptr<CaptureBackend> backend_;
+  // Guards the device facts stats report. scheduling_ and input_format_ are
+  // written by the device thread before it reports the open outcome.
+  mutable std::mutex info_mutex_;
+  std::string backend_name_;
+  InputFormatInfo input_format_;
+  SchedulingResult scheduling_;
+  std::thread device_thread_;
+  std::atomic<bool> running_{false};
+  DeviceLifecycle device_;
+  // Prepare() holds not yet released; the device stays open without
+  // sessions while any is left. Written under sessions_mutex_.
+  std::atomic<uint32_t> standby_holds_{0};
+  // Device thread: whether the first session has been told the device is
+  // running, and when to tell it without a packet.
+  bool start_reported_ = false;
+  uint64_t first_packet_deadline_ns_ = 0;
+
+  mutable std::mutex error_mutex_;
+  std::string last_error_;
+
+  LatencyHistogram device_to_capture_;
+  WakeupJitterMeter wakeup_jitter_;
+};
@@ -0,0 +1,283 @@
+#include "channel_mixer.h"
+
+#include <algorithm>
+
+#include "simd_support.h"
+
+namespace {
+
+constexpr float kMinus3Db = 0.70710678f;
+constexpr float kMinus6Db = 0.5f;
+
+struct StereoGains {
+  uint32_t speaker;
+  float left;
+  float right;
+};
+
+// ITU-R BS.775 style Lo/Ro downmix: center and surrounds at -3 dB, LFE
+// dropped, centered rear/top positions split at -6 dB per side.
+constexpr StereoGains kStereoDownmix[] = {
+    {kSpeakerFrontLeft, 1.0f, 0.0f},
+    {kSpeakerFrontRight, 0.0f, 1.0f},
+    {kSpeakerFrontCenter, kMinus3Db, kMinus3Db},
+    {kSpeakerLowFrequency, 0.0f, 0.0f},
+    {kSpeakerBackLeft, kMinus3Db, 0.0f},
+    {kSpeakerBackRight, 0.0f, kMinus3Db},
+    {kSpeakerFrontLeftOfCenter, kMinus3Db, 0.0f},
+    {kSpeakerFrontRightOfCenter, 0.0f, kMinus3Db},
+    {kSpeakerBackCenter, kMinus6Db, kMinus6Db},
+    {kSpeakerSideLeft, kMinus3Db, 0.0f},
+    {kSpeakerSideRight, 0.0f, kMinus3Db},
+    {0x800, kMinus6Db, kMinus6Db},       // Top center.
+    {0x1000, kMinus3Db, 0.0f},           // Top front left.
+    {0x2000, kMinus6Db, kMinus6Db},      // Top front center.
+    {0x4000, 0.0f, kMinus3Db},           // Top front right.
+    {0x8000, kMinus3Db, 0.0f},           // Top back left.
+    {0x10000, kMinus6Db, kMinus6Db},     // Top back center.
+    {0x20000, 0.0f, kMinus3Db},          // Top back right.
+};
+
+StereoGains GainsForSpeaker(uint32_t speaker) {
+  for (const StereoGains& gains : kStereoDownmix) {
+    if (gains.speaker == speaker) return gains;
+  }
+  return {speaker, 0.0f, 0.0f};
+}
+
+uint32_t CountBits(uint32_t mask) {
+  uint32_t count = 0;
+  for (; mask != 0; mask &= mask - 1) ++count;
+  return count;
+}
+
+// InCh/OutCh of 0 mean "known only at runtime".
+template <uint32_t InCh, uint32_t OutCh>
+void MixGeneric(const float* input,
+                size_t frames,
+                uint32_t input_channels,
+                uint32_t output_channels,
+                const float* matrix,
+                size_t row_stride,
+                float* output) {
+  const uint32_t in_channels = InCh ? InCh : input_channels;
+  const uint32_t out_channels = OutCh ? OutCh : output_channels;
+  for (size_t frame = 0; frame < frames; ++frame) {
+    const float* source = input + frame * in_channels;
+    float* destination = output + frame * out_channels;
+    for (uint32_t out = 0; out < out_channels; ++out) {
+      const float* row = matrix + out * row_stride;
+      float sum = 0.0f;
+      for (uint32_t in = 0; in < in_channels; ++in) {
+        sum += row[in] * source[in];
+      }
+      destination[out] = sum;
+    }
+  }
+}
+
+// 6- and 8-channel to stereo: each frame is two 4-wide multiply-adds per
+// output row plus one shuffle to fold both rows at once.
+template <uint32_t InCh>
+void MixToStereo(const float* input,
+                 size_t frames,
+                 uint32_t /*input_channels*/,
+                 uint32_t /*output_channels*/,
+                 const float* matrix,
+                 size_t row_stride,
+                 float* output) {
+  static_assert(InCh == 6 || InCh == 8, "MixToStereo handles 5.1 and 7.1 input.");
+#if defined(SYSTEM_AUDIO_SIMD_X86)
+  const __m128 left_low = _mm_loadu_ps(matrix);
+  const __m128 left_high = _mm_loadu_ps(matrix + 4);
+  const __m128 right_low = _mm_loadu_ps(matrix + row_stride);
+  const __m128 right_high = _mm_loadu_ps(matrix + row_stride + 4);
+  for (size_t frame = 0; frame < frames; ++frame) {
+    const float* source = input + frame * InCh;
+    const __m128 low = _mm_loadu_ps(source);
+    __m128 high;
+    if constexpr (InCh == 8) {
+      high = _mm_loadu_ps(source + 4);
+    } else {
+      high = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(source + 4));
+    }
+    const __m128 left = _mm_add_ps(_mm_mul_ps(low, left_low), _mm_mul_ps(high, left_high));
+    const __m128 right =
+        _mm_add_ps(_mm_mul_ps(low, right_low), _mm_mul_ps(high, right_high));
+    __m128 folded = _mm_add_ps(_mm_unpacklo_ps(left, right), _mm_unpackhi_ps(left, right));
+    folded = _mm_add_ps(folded, _mm_movehl_ps(folded, folded));
+    _mm_storel_pi(reinterpret_cast<__m64*>(output + frame * 2), folded);
+  }
+#elif defined(SYSTEM_AUDIO_SIMD_NEON)
+  const float32x4_t left_low = vld1q_f32(matrix);
+  const float32x4_t left_high = vld1q_f32(matrix + 4);
+  const float32x4_t right_low = vld1q_f32(matrix + row_stride);
+  const float32x4_t right_high = vld1q_f32(matrix + row_stride + 4);
+  for (size_t frame = 0; frame < frames; ++frame) {
+    const float* source = input + frame * InCh;
+    const float32x4_t low = vld1q_f32(source);
+    float32x4_t high;
+    if constexpr (InCh == 8) {
+      high = vld1q_f32(source + 4);
+    } else {
+      high = vcombine_f32(vld1_f32(source + 4), vdup_n_f32(0.0f));
+    }
+    const float32x4_t left = vmlaq_f32(vmulq_f32(low, left_low), high, left_high);
+    const float32x4_t right = vmlaq_f32(vmulq_f32(low, right_low), high, right_high);
+    const float32x2_t left_pair = vadd_f32(vget_low_f32(left), vget_high_f32(left));
+    const float32x2_t right_pair = vadd_f32(vget_low_f32(right), vget_high_f32(right));
+    vst1_f32(output + frame * 2, vpadd_f32(left_pair, right_pair));
+  }
+#else
+  MixGeneric<InCh, 2>(input, frames, InCh, 2, matrix, row_stride, output);
+#endif
+}
+
+template <uint32_t InCh>
+auto PickMixer(uint32_t output_channels) {
+  using Fn = void (*)(const float*, size_t, uint32_t, uint32_t, const float*, size_t, float*);
+  switch (output_channels) {
+    case 1:
+      return static_cast<Fn>(&MixGeneric<InCh, 1>);
+    case 2:
+      if constexpr (InCh == 6 || InCh == 8) {
+        return static_cast<Fn>(&MixToStereo<InCh>);
+      } else {
+        return static_cast<Fn>(&MixGeneric<InCh, 2>);
+      }
+    default:
+      return static_cast<Fn>(&MixGeneric<InCh, 0>);
+  }
+}
+
+}  // namespace
+
+uint32_t DefaultChannelMask(uint32_t channels) {
+  switch (channels) {
+    case 1:
+      return kSpeakerFrontCenter;
+    case 2:
+      return kSpeakerFrontLeft | kSpeakerFrontRight;
+    case 3:
+      return kSpeakerFrontLeft | kSpeakerFrontRight | kSpeakerFrontCenter;
+    case 4:
+      return kSpeakerFrontLeft | kSpeakerFrontRight | kSpeakerBackLeft | kSpeakerBackRight;
+    case 5:
+      return kSpeakerFrontLeft | kSpeakerFrontRight | kSpeakerFrontCenter | kSpeakerBackLeft |
+             kSpeakerBackRight;
+    case 6:
+      return kSpeakerFrontLeft | kSpeakerFrontRight | kSpeakerFrontCenter |
+             kSpeakerLowFrequency | kSpeakerBackLeft | kSpeakerBackRight;
+    case 7:
+      return kSpeakerFrontLeft | kSpeakerFrontRight | kSpeakerFrontCenter |
+             kSpeakerLowFrequency | kSpeakerBackLeft | kSpeakerBackRight | kSpeakerBackCenter;
+    case 8:
+      return kSpeakerFrontLeft | kSpeakerFrontRight | kSpeakerFrontCenter |
+             kSpeakerLowFrequency | kSpeakerBackLeft | kSpeakerBackRight | kSpeakerSideLeft |
+             kSpeakerSideRight;
+    default:
+      return 0;
+  }
+}
+
+bool ChannelMixer::Configure(uint32_t input_channels,
+                             uint32_t input_channel_mask,
+                             uint32_t output_channels,
+                             const std::vector<float>& custom_matrix,
+                             std::string* error) {
+  if (input_channels == 0 || output_channels == 0) {
+    if (error) *error = "Channel mixer needs non-zero channel counts.";
+    return false;
+  }
+
+  if (!custom_matrix.empty() &&
+      custom_matrix.size() != static_cast<size_t>(input_channels) * output_channels) {
+    if (error) {
+      *error = "Downmix matrix must have " + std::to_string(output_channels) + " rows of " +
+               std::to_string(input_channels) + " coefficients for this device.";
+    }
+    return false;
+  }
+
+  input_channels_ = input_channels;
+  output_channels_ = output_channels;
+  row_stride_ = (static_cast<size_t>(input_channels) + 3) & ~static_cast<size_t>(3);
+  row_stride_ = std::max<size_t>(row_stride_, 8);
+  matrix_.assign(row_stride_ * output_channels, 0.0f);
+
+  auto at = [this](uint32_t out, uint32_t in) -> float& {
+    return matrix_[out * row_stride_ + in];
+  };
+
+  if (!custom_matrix.empty()) {
+    for (uint32_t out = 0; out < output_channels; ++out) {
+      for (uint32_t in = 0; in < input_channels; ++in) {
+        at(out, in) = custom_matrix[static_cast<size_t>(out) * input_channels + in];
+      }
+    }
+  } else if (input_channels == output_channels || output_channels > 2) {
+    // Same layout, or a layout we have no standard downmix for: pass the
+    // leading channels through, repeating the last input channel.
+    for (uint32_t out = 0; out < output_channels; ++out) {
+      at(out, std::min(out, input_channels - 1)) = 1.0f;
+    }
+  } else if (input_channels == 1) {
+    for (uint32_t out = 0; out < output_channels; ++out) {
+      at(out, 0) = 1.0f;
+    }
+  } else {
+    uint32_t mask = input_channel_mask;
+    if (mask == 0 || CountBits(mask) < input_channels) {
+      mask = DefaultChannelMask(input_channels);
+    }
+
+    // Input channels carry the mask's speakers in ascending bit order.
+    uint32_t channel = 0;
+    for (uint32_t bit = 0; bit < 32 && channel < input_channels; ++bit) {
+      const uint32_t speaker = 1u << bit;
+      if ((mask & speaker) == 0) continue;
+      const StereoGains gains = GainsForSpeaker(speaker);
+      if (output_channels == 1) {
+        at(0, channel) = 0.5f * (gains.left + gains.right);
+      } else {
+        at(0, channel) = gains.left;
+        at(1, channel) = gains.right;
+      }
+      ++channel;
+    }
+  }
+
+  identity_ = input_channels == output_channels;
+  for (uint32_t out = 0; identity_ && out < output_channels; ++out) {
+    for (uint32_t in = 0; in < input_channels; ++in) {
+      if (at(out, in) != (in == out ? 1.0f : 0.0f)) {
+        identity_ = false;
+        break;
+      }
+    }
+  }
+
+  switch (input_channels) {
+    case 1:
+      mix_ = PickMixer<1>(output_channels);
+      break;
+    case 2:
+      mix_ = PickMixer<2>(output_channels);
+      break;
+    case 6:
+      mix_ = PickMixer<6>(output_channels);
+      break;
+    case 8:
+      mix_ = PickMixer<8>(output_channels);
+      break;
+    default:
+      mix_ = PickMixer<0>(output_channels);
+      break;
+  }
+  return true;
+}
+
+void ChannelMixer::Process(const float* input, size_t frames, float* output) const {
+  if (!mix_ || !input || !output) return;
+  mix_(input, frames, input_channels_, output_channels_, matrix_.data(), row_stride_, output);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Speaker position bits, identical to the WAVEFORMATEXTENSIBLE dwChannelMask
+// values so device masks can be used as-is.
+constexpr uint32_t kSpeakerFrontLeft = 0x1;
+constexpr uint32_t kSpeakerFrontRight = 0x2;
+constexpr uint32_t kSpeakerFrontCenter = 0x4;
+constexpr uint32_t kSpeakerLowFrequency = 0x8;
+constexpr uint32_t kSpeakerBackLeft = 0x10;
+constexpr uint32_t kSpeakerBackRight = 0x20;
+constexpr uint32_t kSpeakerFrontLeftOfCenter = 0x40;
+constexpr uint32_t kSpeakerFrontRightOfCenter = 0x80;
+constexpr uint32_t kSpeakerBackCenter = 0x100;
+constexpr uint32_t kSpeakerSideLeft = 0x200;
+constexpr uint32_t kSpeakerSideRight = 0x400;
+
+// Mask Windows assumes for a plain WAVEFORMATEX with `channels` channels.
+uint32_t DefaultChannelMask(uint32_t channels);
+
+// Mixes interleaved float frames through an output x input coefficient
+// matrix. The default matrix is an ITU-R BS.775 style downmix derived from
+// the input channel mask; callers may supply their own. Kernels are
+// specialized for the common channel counts and vectorized, so an 8-channel
+// packet costs about as much per frame as the stereo copy it replaces.
+class ChannelMixer {
+ public:
+  // `custom_matrix` is row-major, output_channels rows of input_channels
+  // coefficients; pass an empty vector to derive the matrix from the mask.
+  bool Configure(uint32_t input_channels,
+                 uint32_t input_channel_mask,
+                 uint32_t output_channels,
+                 const std::vector<float>& custom_matrix,
+                 std::string* error);
+
+  // True when output equals input, so callers can skip Process().
+  bool is_identity() const { return identity_; }
+  uint32_t input_channels() const { return input_channels_; }
+  uint32_t output_channels() const { return output_channels_; }
+
+  void Process(const float* input, size_t frames, float* output) const;
+
+ private:
+  using MixFn = void (*)(const float* input,
+                         size_t frames,
+                         uint32_t input_channels,
+                         uint32_t output_channels,
+                         const float* matrix,
+                         size_t row_stride,
+                         float* output);
+
+  uint32_t input_channels_ = 0;
+  uint32_t output_channels_ = 0;
+  bool identity_ = false;
+  // Rows padded to a multiple of four coefficients for the SIMD kernels.
+  size_t row_stride_ = 0;
+  std::vector<float> matrix_;
+  MixFn mix_ = nullptr;
+};
@@ -0,0 +1,377 @@
+#include "chunk_converter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "capture_backend.h"
+
+namespace {
+
+// Packets are converted in blocks of this many frames so scratch buffers are
+// sized once, whatever the device packet size.
+constexpr size_t kConvertBlockFrames = 512;
+
+// Levels are reported over at least this long, so a UI polling a few times
+// a second still sees transients.
+constexpr uint32_t kLevelWindowMs = 100;
+
+// Concealment fades over this long, short enough to sound like a dropout
+// rather than a dip, long enough not to click.
+constexpr uint32_t kConcealFadeMs = 5;
+// Gaps are filled up to this long; a longer one (a suspended machine, a
+// loopback stream that sat idle) would only queue up stale silence.
+constexpr uint64_t kMaxConcealMs = 1000;
+
+// Concealment and fades work in doubles; int16 output rounds them.
+inline void StoreSample(double value, int16_t* out) {
+  *out = static_cast<int16_t>(std::lround(value));
+}
+inline void StoreSample(double value, float* out) { *out = static_cast<float>(value); }
+
+uint64_t NowMs() {
+  const auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(now).count());
+}
+
+}  // namespace
+
+bool ChunkConverter::Configure(const InputFormatInfo& input_format,
+                               const CaptureConfig& config,
+                               ChunkCallback emit,
+                               std::string* error) {
+  if (!mixer_.Configure(input_format.channels, input_format.channel_mask,
+                        config.target_channels, config.downmix_matrix, error)) {
+    return false;
+  }
+
+  needs_resampling_ = input_format.sample_rate != config.target_sample_rate;
+  if (needs_resampling_ &&
+      !resampler_.Configure(input_format.sample_rate, config.target_sample_rate,
+                            config.target_channels, config.resampler_quality, error)) {
+    return false;
+  }
+
+  emit_ = std::move(emit);
+  input_channels_ = input_format.channels;
+  output_channels_ = config.target_channels;
+  output_sample_rate_ = config.target_sample_rate;
+  chunk_samples_ = ChunkSampleCount(config);
+
+  // Converters are picked once for the negotiated format instead of
+  // switching on it for every sample. Packets are decoded with all device
+  // channels and then mixed down, unless the mix is a plain copy.
+  decode_float_ =
+      SelectFloatDecoder(input_format.sample_format, input_channels_, input_channels_);
+  decode_int16_ =
+      SelectInt16Decoder(input_format.sample_format, input_channels_, input_channels_);
+  block_align_ = BytesPerSample(input_format.sample_format) * input_channels_;
+  compensate_drift_ = config.drift.enabled;
+  pcm_format_ =
+      config.encoding == ChunkEncoding::kPcm ? config.pcm_format : PcmSampleFormat::kInt16;
+  float_output_ = IsFloatFormat(pcm_format_);
+  direct_int16_ =
+      !float_output_ && mixer_.is_identity() && !needs_resampling_ && !compensate_drift_;
+  if (compensate_drift_) {
+    drift_resampler_.Configure(output_channels_);
+    drift_controller_.Configure(config.drift.target_queue_ms, config.drift.max_ppm);
+  }
+
+  suppress_silence_ = config.silence.enabled;
+  input_sample_rate_ = input_format.sample_rate;
+  const uint32_t chunk_frames = static_cast<uint32_t>(chunk_samples_ / output_channels_);
+  chunk_frames_ = chunk_frames;
+  const double threshold = 32768.0 * std::pow(10.0, config.silence.threshold_dbfs / 20.0);
+  silence_energy_limit_ = threshold * threshold * static_cast<double>(chunk_samples_);
+  hangover_frames_ = static_cast<uint64_t>(config.silence.hangover_ms) * output_sample_rate_ / 1000;
+  marker_frames_ = std::max(
+      chunk_frames,
+      static_cast<uint32_t>(uint64_t{config.silence.marker_ms} * output_sample_rate_ / 1000) /
+          chunk_frames * chunk_frames);
+  silent_run_frames_ = 0;
+  silent_output_remainder_ = 0;
+  reset_filters_ = false;
+  pending_silence_ = AudioChunk();
+  suppressed_chunks_ = 0;
+  silence_markers_ = 0;
+  level_meter_.Configure(output_channels_, output_sample_rate_ * kLevelWindowMs / 1000);
+  last_frame_.assign(output_channels_, 0.0f);
+  fade_frames_ = std::max<uint32_t>(output_sample_rate_ * kConcealFadeMs / 1000, 1);
+  fade_in_remaining_ = 0;
+  concealed_frames_ = 0;
+  position_offset_ = 0;
+
+  dither_ = TpdfDither();
+  dither_.enabled = config.dither;
+
+  max_block_output_frames_ =
+      needs_resampling_ ? resampler_.MaxOutputFrames(kConvertBlockFrames) : kConvertBlockFrames;
+  decoded_.assign(direct_int16_ ? 0 : kConvertBlockFrames * input_channels_, 0.0f);
+  mixed_.assign(mixer_.is_identity() ? 0 : kConvertBlockFrames * output_channels_, 0.0f);
+  resampled_.assign(needs_resampling_ ? max_block_output_frames_ * output_channels_ : 0, 0.0f);
+  max_drift_output_frames_ = compensate_drift_
+                                 ? drift_resampler_.MaxOutputFrames(max_block_output_frames_)
+                                 : max_block_output_frames_;
+  drifted_.assign(compensate_drift_ ? max_drift_output_frames_ * output_channels_ : 0, 0.0f);
+  const size_t block_samples = max_drift_output_frames_ * output_channels_;
+  quantized_.assign(float_output_ ? 0 : block_samples, 0);
+  float_block_.assign(float_output_ ? block_samples : 0, 0.0f);
+
+  // Sized for a few chunks; chunks are drained as soon as they fill, so the
+  // producer never outruns the consumer.
+  if (float_output_) {
+    pending_float_.Reset(chunk_samples_ * 4, chunk_samples_);
+    pending_samples_.Reset(0);
+  } else {
+    pending_samples_.Reset(chunk_samples_ * 4, chunk_samples_);
+    pending_float_.Reset(0);
+  }
+  planes_.assign(pcm_format_ == PcmSampleFormat::kFloat32Planar ? chunk_samples_ : 0, 0.0f);
+
+  timeline_.Reset(output_sample_rate_);
+  output_frames_pushed_ = 0;
+  next_chunk_frame_ = 0;
+  sequence_ = 0;
+  return true;
+}
+
+void ChunkConverter::Process(const uint8_t* data,
+                             uint32_t frames,
+                             uint64_t device_time_ns,
+                             uint64_t read_time_ns) {
+  timeline_.AddPacket(output_frames_pushed_, device_time_ns, read_time_ns);
+  const double drift_ratio = compensate_drift_ ? drift_controller_.Update(MonotonicNowNs()) : 1.0;
+
+  for (size_t done = 0; done < frames;) {
+    const size_t count = std::min<size_t>(kConvertBlockFrames, frames - done);
+    const uint8_t* block = data ? data + done * block_align_ : nullptr;
+    done += count;
+
+    if (!block && suppress_silence_ && suppressing()) {
+      PushSilentInput(count);
+      continue;
+    }
+    if (reset_filters_) {
+      // Their history would be all zeros by now anyway.
+      reset_filters_ = false;
+      if (needs_resampling_) resampler_.Reset();
+      if (compensate_drift_) drift_resampler_.Reset();
+    }
+
+    if (direct_int16_) {
+      if (block) {
+        decode_int16_(block, count, input_channels_, input_channels_, quantized_.data(),
+                      &dither_);
+      } else {
+        std::fill_n(quantized_.begin(), count * output_channels_, int16_t{0});
+      }
+      PushOutput(quantized_.data(), count);
+      continue;
+    }
+
+    if (block) {
+      decode_float_(block, count, input_channels_, input_channels_, decoded_.data());
+    } else {
+      std::fill_n(decoded_.begin(), count * input_channels_, 0.0f);
+    }
+
+    float* samples = decoded_.data();
+    if (!mixer_.is_identity()) {
+      mixer_.Process(decoded_.data(), count, mixed_.data());
+      samples = mixed_.data();
+    }
+
+    size_t produced = count;
+    if (needs_resampling_) {
+      produced =
+          resampler_.Process(samples, count, resampled_.data(), max_block_output_frames_);
+      samples = resampled_.data();
+    }
+    if (compensate_drift_) {
+      produced = drift_resampler_.Process(samples, produced, drift_ratio, drifted_.data(),
+                                          max_drift_output_frames_);
+      samples = drifted_.data();
+    }
+
+    if (float_output_) {
+      PushOutput(samples, produced);
+    } else {
+      FloatToInt16(samples, produced * output_channels_, quantized_.data(), &dither_);
+      PushOutput(quantized_.data(), produced);
+    }
+  }
+}
+
+void ChunkConverter::ConcealGap(uint64_t input_frames) {
+  uint64_t frames = ToOutputFrames(input_frames);
+  if (frames == 0) return;
+  uint64_t skipped = 0;
+  const uint64_t limit = kMaxConcealMs * output_sample_rate_ / 1000;
+  if (frames > limit) {
+    // Fill out the chunk in progress too, so the jump falls between chunks.
+    uint64_t fill = limit;
+    fill += (chunk_frames_ - (output_frames_pushed_ + fill) % chunk_frames_) % chunk_frames_;
+    fill = std::min(fill, frames);
+    skipped = frames - fill;
+    frames = fill;
+  }
+  concealed_frames_ += frames;
+  // The filters' history ends where the audio broke off.
+  reset_filters_ = true;
+  fade_in_remaining_ = 0;
+
+  // A linear ramp from the last frame pushed down to zero, then silence.
+  const uint64_t fade = std::min<uint64_t>(frames, fade_frames_);
+  auto push_fade = [&](auto* block) {
+    for (uint64_t done = 0; done < frames;) {
+      const size_t count =
+          static_cast<size_t>(std::min<uint64_t>(frames - done, max_drift_output_frames_));
+      auto* out = block;
+      for (size_t frame = 0; frame < count; ++frame, ++done) {
+        const double gain =
+            done < fade ? 1.0 - static_cast<double>(done + 1) / (fade + 1) : 0.0;
+        for (uint32_t channel = 0; channel < output_channels_; ++channel) {
+          StoreSample(last_frame_[channel] * gain, out++);
+        }
+      }
+      PushOutput(block, count);
+    }
+  };
+  if (float_output_) {
+    push_fade(float_block_.data());
+  } else {
+    push_fade(quantized_.data());
+  }
+
+  if (skipped > 0) {
+    // A marker must not span the jump either.
+    FlushSilence();
+    position_offset_ += skipped;
+  }
+  fade_in_remaining_ = fade_frames_;
+}
+
+uint64_t ChunkConverter::ToOutputFrames(uint64_t input_frames) {
+  const uint64_t scaled = input_frames * uint64_t{output_sample_rate_} + silent_output_remainder_;
+  silent_output_remainder_ = scaled % input_sample_rate_;
+  return scaled / input_sample_rate_;
+}
+
+void ChunkConverter::PushSilentInput(size_t input_frames) {
+  size_t frames = static_cast<size_t>(ToOutputFrames(input_frames));
+  reset_filters_ = true;
+
+  while (frames > 0) {
+    const size_t count = std::min(frames, max_drift_output_frames_);
+    if (float_output_) {
+      std::fill_n(float_block_.begin(), count * output_channels_, 0.0f);
+      PushOutput(float_block_.data(), count);
+    } else {
+      std::fill_n(quantized_.begin(), count * output_channels_, int16_t{0});
+      PushOutput(quantized_.data(), count);
+    }
+    frames -= count;
+  }
+}
+
+template <typename T>
+void ChunkConverter::PushOutput(T* samples, size_t frames) {
+  if (frames == 0) return;
+  for (size_t frame = 0; frame < frames && fade_in_remaining_ > 0; ++frame) {
+    const double gain = 1.0 - static_cast<double>(fade_in_remaining_--) / (fade_frames_ + 1);
+    T* out = samples + frame * output_channels_;
+    for (uint32_t channel = 0; channel < output_channels_; ++channel) {
+      StoreSample(out[channel] * gain, out + channel);
+    }
+  }
+  std::copy_n(samples + (frames - 1) * output_channels_, output_channels_, last_frame_.begin());
+
+  SpscRingBuffer<T>& pending_samples = pending(samples);
+  size_t remaining = frames * output_channels_;
+  while (remaining > 0) {
+    const size_t written = pending_samples.Write(samples, remaining);
+    samples += written;
+    remaining -= written;
+
+    while (const T* chunk = pending_samples.Peek(chunk_samples_)) {
+      EmitChunk(chunk);
+      pending_samples.Consume(chunk_samples_);
+    }
+  }
+  output_frames_pushed_ += frames;
+}
+
+void ChunkConverter::EmitChunk(const int16_t* samples) {
+  AudioChunk chunk = BeginChunk();
+  chunk.samples = samples;
+  FinishChunk(chunk, level_meter_.Measure(samples, chunk.frame_count));
+}
+
+void ChunkConverter::EmitChunk(const float* samples) {
+  AudioChunk chunk = BeginChunk();
+  chunk.float_samples = samples;
+  FinishChunk(chunk, level_meter_.Measure(samples, chunk.frame_count));
+}
+
+AudioChunk ChunkConverter::BeginChunk() {
+  const uint64_t chunk_frames = chunk_frames_;
+  const uint64_t first_frame = next_chunk_frame_;
+  next_chunk_frame_ += chunk_frames;
+
+  AudioChunk chunk;
+  chunk.sample_format = pcm_format_;
+  chunk.sample_count = chunk_samples_;
+  chunk.frame_count = static_cast<uint32_t>(chunk_frames);
+  chunk.sample_rate = output_sample_rate_;
+  chunk.channels = output_channels_;
+  chunk.sample_position = first_frame + position_offset_;
+  chunk.timestamp_ms = NowMs();
+  timeline_.Locate(first_frame, &chunk.capture_time_ns, &chunk.read_time_ns);
+  if (chunk.capture_time_ns == 0) {
+    chunk.capture_time_ns = chunk.read_time_ns;
+  }
+  return chunk;
+}
+
+void ChunkConverter::FinishChunk(AudioChunk chunk, double energy) {
+  if (suppress_silence_) {
+    silent_run_frames_ = IsSilent(energy) ? silent_run_frames_ + chunk.frame_count : 0;
+    if (suppressing()) {
+      if (pending_silence_.frame_count == 0) {
+        pending_silence_ = chunk;
+        pending_silence_.encoding = ChunkEncoding::kSilence;
+        pending_silence_.samples = nullptr;
+        pending_silence_.float_samples = nullptr;
+        pending_silence_.sample_count = 0;
+        pending_silence_.frame_count = 0;
+      }
+      pending_silence_.frame_count += chunk.frame_count;
+      ++suppressed_chunks_;
+      if (pending_silence_.frame_count >= marker_frames_) {
+        FlushSilence();
+      }
+      return;
+    }
+    // The marker goes out before the audio that ends the silence.
+    FlushSilence();
+  }
+
+  if (!planes_.empty()) {
+    // Split only what goes out; suppressed chunks never need it.
+    DeinterleaveFloat(chunk.float_samples, chunk.frame_count, output_channels_, planes_.data());
+    chunk.float_samples = planes_.data();
+  }
+  chunk.sequence = ++sequence_;
+  chunk.emit_time_ns = MonotonicNowNs();
+  emit_(chunk);
+}
+
+void ChunkConverter::FlushSilence() {
+  if (pending_silence_.frame_count == 0) return;
+  pending_silence_.sequence = ++sequence_;
+  pending_silence_.emit_time_ns = MonotonicNowNs();
+  ++silence_markers_;
+  emit_(pending_silence_);
+  pending_silence_.frame_count = 0;
+}
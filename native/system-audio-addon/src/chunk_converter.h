@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "adaptive_resampler.h"
+#include "audio_chunk.h"
+#include "capture_config.h"
+#include "channel_mixer.h"
+#include "chunk_timeline.h"
+#include "drift_controller.h"
+#include "level_meter.h"
+#include "polyphase_resampler.h"
+#include "sample_convert.h"
+#include "spsc_ring_buffer.h"
+
+// Turns device packets into fixed-size PCM chunks at the configured rate,
+// channel count and sample format: decode, downmix, resample, trim for
+// clock drift, quantize (int16) or split into planes (f32-planar) and
+// chunk, replacing silent stretches with markers when silence
+// suppression is on and filling device gaps so chunk positions stay
+// continuous. All buffers are sized in Configure(); Process() never
+// allocates. Driven by one thread at a time.
+class ChunkConverter {
+ public:
+  // `config` must already be normalized. Chunks go to `emit` as they fill.
+  bool Configure(const InputFormatInfo& input_format,
+                 const CaptureConfig& config,
+                 ChunkCallback emit,
+                 std::string* error);
+
+  // Converts `frames` device frames; `data` is nullptr for a silent packet.
+  // Times are those of the packet's first frame, as in CapturePacket.
+  void Process(const uint8_t* data,
+               uint32_t frames,
+               uint64_t device_time_ns,
+               uint64_t read_time_ns);
+
+  // Fills a gap of `input_frames` lost or skipped device frames ahead of
+  // the next packet, so chunk positions keep pace with the device: the last
+  // output fades to silence, and the audio after the gap fades back in.
+  // Past kMaxConcealMs only the position moves on.
+  void ConcealGap(uint64_t input_frames);
+
+  // Any thread. Feeds the drift controller; ignored unless drift
+  // compensation is enabled.
+  void ReportQueueLevel(double queued_ms) { drift_controller_.ReportQueueLevel(queued_ms); }
+  DriftStats drift_stats() const { return drift_controller_.GetStats(); }
+  // Processing thread only; owners publish them with their own counters.
+  uint64_t output_frames() const { return output_frames_pushed_; }
+  // Chunks completed, whether emitted or folded into a silence marker.
+  uint64_t completed_chunks() const { return next_chunk_frame_ / chunk_frames_; }
+  uint64_t suppressed_chunks() const { return suppressed_chunks_; }
+  uint64_t silence_markers() const { return silence_markers_; }
+  uint64_t concealed_frames() const { return concealed_frames_; }
+  const LevelReading& levels() const { return level_meter_.reading(); }
+  size_t chunk_samples() const { return chunk_samples_; }
+  size_t block_align() const { return block_align_; }
+
+ private:
+  // Applies any pending fade-in to `samples` before chunking them. T is
+  // int16_t for int16 output and float otherwise.
+  template <typename T>
+  void PushOutput(T* samples, size_t frames);
+  SpscRingBuffer<int16_t>& pending(const int16_t*) { return pending_samples_; }
+  SpscRingBuffer<float>& pending(const float*) { return pending_float_; }
+  // Output frames for `input_frames` device frames, carrying the remainder.
+  uint64_t ToOutputFrames(uint64_t input_frames);
+  // Converts a device-flagged silent block without decoding, mixing or
+  // resampling it. Only valid while suppressing.
+  void PushSilentInput(size_t input_frames);
+  void EmitChunk(const int16_t* samples);
+  void EmitChunk(const float* samples);
+  // The next chunk's metadata; its samples are left to the caller.
+  AudioChunk BeginChunk();
+  // Suppresses `chunk` or hands it to the callback.
+  void FinishChunk(AudioChunk chunk, double energy);
+  bool IsSilent(double energy) const { return energy <= silence_energy_limit_; }
+  void FlushSilence();
+  bool suppressing() const { return silent_run_frames_ > hangover_frames_; }
+
+  ChunkCallback emit_;
+  uint32_t input_channels_ = 0;
+  uint32_t output_channels_ = 0;
+  uint32_t output_sample_rate_ = 0;
+  size_t chunk_samples_ = 0;
+  uint64_t chunk_frames_ = 1;
+  size_t block_align_ = 0;
+  bool needs_resampling_ = false;
+  bool compensate_drift_ = false;
+  bool direct_int16_ = false;
+  PcmSampleFormat pcm_format_ = PcmSampleFormat::kInt16;
+  bool float_output_ = false;
+
+  FloatDecodeFn decode_float_ = nullptr;
+  Int16DecodeFn decode_int16_ = nullptr;
+  ChannelMixer mixer_;
+  PolyphaseResampler resampler_;
+  AdaptiveResampler drift_resampler_;
+  DriftController drift_controller_;
+  TpdfDither dither_;
+
+  size_t max_block_output_frames_ = 0;
+  size_t max_drift_output_frames_ = 0;
+  std::vector<float> decoded_;
+  std::vector<float> mixed_;
+  std::vector<float> resampled_;
+  std::vector<float> drifted_;
+  // Output blocks made here rather than converted: int16, or float in the
+  // float formats.
+  std::vector<int16_t> quantized_;
+  std::vector<float> float_block_;
+  SpscRingBuffer<int16_t> pending_samples_;
+  SpscRingBuffer<float> pending_float_;
+  // f32-planar: the chunk being emitted, split into planes.
+  std::vector<float> planes_;
+
+  bool suppress_silence_ = false;
+  // Sum of squared samples below which a chunk counts as silent.
+  double silence_energy_limit_ = 0.0;
+  uint64_t hangover_frames_ = 0;
+  uint32_t marker_frames_ = 0;
+  uint32_t input_sample_rate_ = 0;
+  uint64_t silent_run_frames_ = 0;
+  // Output frames owed for skipped input, in units of 1 / input rate.
+  uint64_t silent_output_remainder_ = 0;
+  // A flagged block skipped conversion, so filter history is stale.
+  bool reset_filters_ = false;
+  // The marker being built: suppressed frames so far and its first chunk.
+  AudioChunk pending_silence_;
+  uint64_t suppressed_chunks_ = 0;
+  uint64_t silence_markers_ = 0;
+
+  LevelMeter level_meter_;
+
+  // Gap concealment. The last frame pushed (in output sample units), the
+  // fade length, how much of the fade-in is still to apply, and how far
+  // positions have been moved on past gaps too long to fill.
+  std::vector<float> last_frame_;
+  uint32_t fade_frames_ = 0;
+  uint32_t fade_in_remaining_ = 0;
+  uint64_t concealed_frames_ = 0;
+  uint64_t position_offset_ = 0;
+
+  ChunkTimeline timeline_;
+  uint64_t output_frames_pushed_ = 0;
+  uint64_t next_chunk_frame_ = 0;
+  uint64_t sequence_ = 0;
+};
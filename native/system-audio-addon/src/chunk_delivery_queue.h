@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "chunk_pool.h"
+
+// What the producer does when `max_queued` chunks are already waiting for
+// the JS thread.
+enum class QueueFullPolicy {
+  kDropNewest,  // Discard the chunk being queued.
+  kDropOldest,  // Evict the oldest waiting chunk to make room.
+  kBlock,       // Wait up to block_ms for room, then drop the new chunk.
+};
+
+inline const char* QueueFullPolicyName(QueueFullPolicy policy) {
+  switch (policy) {
+    case QueueFullPolicy::kDropNewest:
+      return "drop-newest";
+    case QueueFullPolicy::kBlock:
+      return "block";
+    default:
+      return "drop-oldest";
+  }
+}
+
+inline bool ParseQueueFullPolicy(const std::string& name, QueueFullPolicy* policy) {
+  if (!policy) return false;
+  for (QueueFullPolicy candidate :
+       {QueueFullPolicy::kDropNewest, QueueFullPolicy::kDropOldest, QueueFullPolicy::kBlock}) {
+    if (name == QueueFullPolicyName(candidate)) {
+      *policy = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+struct DeliveryOptions {
+  QueueFullPolicy policy = QueueFullPolicy::kDropOldest;
+  uint32_t block_ms = 5;
+  // Chunks allowed to wait for the JS thread; ~640 ms of 20 ms chunks.
+  uint32_t max_queued = 32;
+  // Most chunks handed to JS in one callback invocation.
+  uint32_t max_batch = 16;
+  // Deliver an array of chunks per invocation instead of one call each.
+  bool batch = false;
+};
+
+struct DeliveryStats {
+  uint32_t queued = 0;
+  uint32_t high_water = 0;
+  uint64_t dropped_no_callback = 0;
+  uint64_t dropped_queue_full = 0;
+  uint64_t dropped_evicted = 0;
+  uint64_t dropped_block_timeout = 0;
+  uint64_t dropped_pool_exhausted = 0;
+  uint64_t dispatch_failures = 0;
+  uint64_t batches = 0;
+  uint64_t batched_chunks = 0;
+  uint32_t largest_batch = 0;
+
+  uint64_t dropped_total() const {
+    return dropped_no_callback + dropped_queue_full + dropped_evicted + dropped_block_timeout + dropped_pool_exhausted;
+  }
+};
+
+// Bounded handoff of filled slabs from the emitting thread to the JS thread.
+// The producer queues a slab and schedules at most one drain at a time; the
+// drain takes everything that piled up (up to max_batch), so batches grow on
+// their own exactly when JS falls behind and shrink back to one when it
+// keeps up. Storage is fixed at construction; nothing allocates per chunk.
+// The lock is held only for a few pointer moves, or while a kBlock producer
+// waits.
+class ChunkDeliveryQueue {
+ public:
+  explicit ChunkDeliveryQueue(size_t capacity) : slots_(std::max<size_t>(1, capacity)) {}
+
+  ChunkDeliveryQueue(const ChunkDeliveryQueue&) = delete;
+  ChunkDeliveryQueue& operator=(const ChunkDeliveryQueue&) = delete;
+
+  size_t capacity() const { return slots_.size(); }
+
+  void Configure(const DeliveryOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    options_ = options;
+    options_.max_queued =
+        std::clamp<uint32_t>(options_.max_queued, 1, static_cast<uint32_t>(slots_.size()));
+    options_.max_batch = std::max<uint32_t>(1, options_.max_batch);
+  }
+
+  DeliveryOptions options() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return options_;
+  }
+
+  // Producer. Queues `slab`, or hands back in `*rejected` a slab the caller
+  // must recycle: the new one when it was dropped, or the evicted oldest.
+  void Push(ChunkSlab* slab, ChunkSlab** rejected) {
+    *rejected = nullptr;
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (count_ >= options_.max_queued) {
+      switch (options_.policy) {
+        case QueueFullPolicy::kDropNewest:
+          ++stats_.dropped_queue_full;
+          *rejected = slab;
+          return;
+        case QueueFullPolicy::kDropOldest:
+          *rejected = slots_[head_];
+          head_ = (head_ + 1) % slots_.size();
+          --count_;
+          ++stats_.dropped_evicted;
+          break;
+        case QueueFullPolicy::kBlock:
+          if (!space_.wait_for(lock, std::chrono::milliseconds(options_.block_ms),
+                               [this]() { return count_ < options_.max_queued; })) {
+            ++stats_.dropped_block_timeout;
+            *rejected = slab;
+            return;
+          }
+          break;
+      }
+    }
+
+    slots_[(head_ + count_) % slots_.size()] = slab;
+    ++count_;
+    stats_.high_water = std::max<uint32_t>(stats_.high_water, static_cast<uint32_t>(count_));
+  }
+
+  void CountNoCallback() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.dropped_no_callback;
+  }
+
+  void CountPoolExhausted() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.dropped_pool_exhausted;
+  }
+
+  void CountDispatchFailure() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.dispatch_failures;
+  }
+
+  // Producer. True when the caller must schedule a drain on the JS thread;
+  // false when one is already pending.
+  bool ClaimDrain() { return !drain_pending_.exchange(true, std::memory_order_acq_rel); }
+  void CancelDrain() { drain_pending_.store(false, std::memory_order_release); }
+
+  // JS thread. Clears the pending flag first, so a chunk queued while this
+  // batch is delivered schedules the next drain.
+  size_t PopBatch(ChunkSlab** out, size_t max_out, bool* more) {
+    drain_pending_.store(false, std::memory_order_release);
+    size_t taken = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const size_t limit = std::min<size_t>(max_out, options_.max_batch);
+      while (count_ > 0 && taken < limit) {
+        out[taken++] = slots_[head_];
+        head_ = (head_ + 1) % slots_.size();
+        --count_;
+      }
+      if (taken > 0) {
+        ++stats_.batches;
+        stats_.batched_chunks += taken;
+        stats_.largest_batch = std::max<uint32_t>(stats_.largest_batch, static_cast<uint32_t>(taken));
+      }
+      *more = count_ > 0;
+    }
+    space_.notify_one();
+    return taken;
+  }
+
+  // JS thread, capture stopped. Hands every queued slab to `release`, e.g.
+  // before the pool they came from is replaced.
+  template <typename ReleaseFn>
+  void Flush(ReleaseFn release) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (; count_ > 0; --count_) {
+      release(slots_[head_]);
+      head_ = (head_ + 1) % slots_.size();
+    }
+  }
+
+  void ResetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = DeliveryStats();
+  }
+
+  DeliveryStats GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DeliveryStats stats = stats_;
+    stats.queued = static_cast<uint32_t>(count_);
+    return stats;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::condition_variable space_;
+  DeliveryOptions options_;
+  std::vector<ChunkSlab*> slots_;
+  size_t head_ = 0;
+  size_t count_ = 0;
+  DeliveryStats stats_;
+  std::atomic<bool> drain_pending_{false};
+};
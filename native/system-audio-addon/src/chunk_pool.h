@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "capture_config.h"
+#include "spsc_ring_buffer.h"
+
+class ChunkPool;
+
+// A preallocated PCM slab plus the metadata that travels with it to JS. In
+// the float formats the same storage holds `sample_count` floats, and in
+// Opus mode one encoded packet of `encoded_bytes`; a silence marker uses
+// none of it.
+struct ChunkSlab {
+  std::vector<int16_t> samples;
+  size_t sample_count = 0;
+  PcmSampleFormat sample_format = PcmSampleFormat::kInt16;
+  bool encoded = false;
+  size_t encoded_bytes = 0;
+  bool silence = false;
+  uint32_t frame_count = 0;
+  uint32_t sample_rate = 48000;
+  uint32_t channels = 2;
+  uint64_t sequence = 0;
+  uint64_t sample_position = 0;
+  uint64_t timestamp_ms = 0;
+  uint64_t capture_time_ns = 0;
+  uint64_t emit_time_ns = 0;
+
+  uint32_t index = 0;
+  // Set while the slab is lent out, so the pool outlives every JS buffer that
+  // still points into one of its slabs.
+  std::shared_ptr<ChunkPool> owner;
+};
+
+struct ChunkPoolStats {
+  uint32_t size = 0;
+  uint32_t in_use = 0;
+  uint32_t high_water = 0;
+  uint64_t exhausted = 0;
+};
+
+// Fixed set of PCM slabs shared between the capture thread and the JS thread.
+// The thread that emits chunks (the capture thread, or the encoder thread in
+// Opus mode) is the only caller of Acquire() and Recycle(); slabs
+// handed to JS come back through Release() from the buffer finalizer. The free
+// list is an SPSC ring, so neither side takes a lock or allocates.
+class ChunkPool : public std::enable_shared_from_this<ChunkPool> {
+ public:
+  static std::shared_ptr<ChunkPool> Create(uint32_t slab_count, size_t slab_samples) {
+    return std::shared_ptr<ChunkPool>(new ChunkPool(slab_count, slab_samples));
+  }
+
+  ChunkPool(const ChunkPool&) = delete;
+  ChunkPool& operator=(const ChunkPool&) = delete;
+
+  size_t slab_samples() const { return slab_samples_; }
+
+  // Capture thread. Returns nullptr when every slab is lent out.
+  ChunkSlab* Acquire() {
+    uint32_t index = 0;
+    if (!spare_.empty()) {
+      index = spare_.back();
+      spare_.pop_back();
+    } else if (free_slabs_.Read(&index, 1) != 1) {
+      exhausted_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    const uint32_t in_use = in_use_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (in_use > high_water_.load(std::memory_order_relaxed)) {
+      high_water_.store(in_use, std::memory_order_relaxed);
+    }
+
+    ChunkSlab* slab = &slabs_[index];
+    slab->sample_count = 0;
+    slab->sample_format = PcmSampleFormat::kInt16;
+    slab->encoded = false;
+    slab->encoded_bytes = 0;
+    slab->silence = false;
+    slab->owner = shared_from_this();
+    return slab;
+  }
+
+  // Capture thread. Takes back a slab that never reached JS.
+  void Recycle(ChunkSlab* slab) {
+    if (!slab) return;
+    std::shared_ptr<ChunkPool> keep_alive = std::move(slab->owner);
+    spare_.push_back(slab->index);
+    in_use_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // JS thread. Returns a slab once its buffer has been finalized.
+  static void Release(ChunkSlab* slab) {
+    if (!slab) return;
+    std::shared_ptr<ChunkPool> pool = std::move(slab->owner);
+    if (!pool) return;
+    pool->free_slabs_.Push(slab->index);
+    pool->in_use_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  ChunkPoolStats GetStats() const {
+    ChunkPoolStats stats;
+    stats.size = static_cast<uint32_t>(slabs_.size());
+    stats.in_use = in_use_.load(std::memory_order_relaxed);
+    stats.high_water = high_water_.load(std::memory_order_relaxed);
+    stats.exhausted = exhausted_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+ private:
+  ChunkPool(uint32_t slab_count, size_t slab_samples)
+      : slabs_(std::max<uint32_t>(1, slab_count)), slab_samples_(slab_samples) {
+    free_slabs_.Reset(slabs_.size());
+    spare_.reserve(slabs_.size());
+    for (uint32_t index = 0; index < slabs_.size(); ++index) {
+      slabs_[index].samples.resize(slab_samples_);
+      slabs_[index].index = index;
+      free_slabs_.Push(index);
+    }
+  }
+
+  std::vector<ChunkSlab> slabs_;
+  size_t slab_samples_ = 0;
+
+  // Producer: JS thread (Release). Consumer: capture thread (Acquire).
+  SpscRingBuffer<uint32_t> free_slabs_;
+  // Capture-thread-only stack for slabs returned by Recycle().
+  std::vector<uint32_t> spare_;
+
+  std::atomic<uint32_t> in_use_{0};
+  std::atomic<uint32_t> high_water_{0};
+  std::atomic<uint64_t> exhausted_{0};
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Maps output frame positions back to when their input was captured. The
+// capture thread adds one anchor per device packet (the output position the
+// packet starts at, plus its device and read timestamps); a chunk's first
+// frame is then timed from the newest anchor at or before it. Resampler
+// delay is ignored: it is a fraction of a millisecond at every quality.
+class ChunkTimeline {
+ public:
+  void Reset(uint32_t output_sample_rate) {
+    sample_rate_ = output_sample_rate;
+    size_ = 0;
+    next_ = 0;
+  }
+
+  void AddPacket(uint64_t output_frame, uint64_t device_time_ns, uint64_t read_time_ns) {
+    anchors_[next_] = Anchor{output_frame, device_time_ns, read_time_ns};
+    next_ = (next_ + 1) % anchors_.size();
+    if (size_ < anchors_.size()) ++size_;
+  }
+
+  // Device time of `output_frame` (0 when the backend gave none) and the
+  // time the capture thread read the packet that holds it.
+  void Locate(uint64_t output_frame, uint64_t* device_time_ns, uint64_t* read_time_ns) const {
+    *device_time_ns = 0;
+    *read_time_ns = 0;
+    if (size_ == 0) return;
+
+    // Fall back to the oldest anchor when the frame predates all of them.
+    const Anchor* anchor = &anchors_[(next_ + anchors_.size() - size_) % anchors_.size()];
+    for (size_t age = 1; age <= size_; ++age) {
+      const Anchor& candidate = anchors_[(next_ + anchors_.size() - age) % anchors_.size()];
+      if (candidate.output_frame <= output_frame) {
+        anchor = &candidate;
+        break;
+      }
+    }
+
+    *read_time_ns = anchor->read_time_ns;
+    if (anchor->device_time_ns != 0 && sample_rate_ != 0) {
+      const int64_t offset_frames =
+          static_cast<int64_t>(output_frame) - static_cast<int64_t>(anchor->output_frame);
+      *device_time_ns = static_cast<uint64_t>(static_cast<int64_t>(anchor->device_time_ns) +
+                                              offset_frames * 1000000000 / sample_rate_);
+    }
+  }
+
+ private:
+  struct Anchor {
+    uint64_t output_frame = 0;
+    uint64_t device_time_ns = 0;
+    uint64_t read_time_ns = 0;
+  };
+
+  // Enough packets to span a 60 ms chunk built from 5 ms device packets.
+  std::array<Anchor, 16> anchors_{};
+  size_t size_ = 0;
+  size_t next_ = 0;
+  uint32_t sample_rate_ = 0;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+// Where the thread that owns a capture backend is in its life.
+enum class DeviceState {
+  // No device thread, or one that has closed its backend and is exiting.
+  kClosed,
+  kOpening,
+  // Open and stopped, waiting to be started or closed.
+  kStandby,
+  kStarting,
+  kRunning,
+};
+
+// The handshake between the thread that controls a capture and the device
+// thread that runs its backend. Backends open, start, stop and close on the
+// thread that reads them (WASAPI wants its COM apartment there), so the
+// control thread asks for each step and waits for its outcome: errors come
+// back synchronously, and a device held open in standby between runs only
+// has to start its stream.
+class DeviceLifecycle {
+ public:
+  // Control thread, before starting a device thread.
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = DeviceState::kOpening;
+    start_requested_ = false;
+    close_requested_ = false;
+    start_succeeded_ = false;
+  }
+
+  // Device thread. Reports how Open() went: standby on success, closed on
+  // failure.
+  void Opened(bool succeeded) {
+    SetState(succeeded ? DeviceState::kStandby : DeviceState::kClosed);
+  }
+
+  // Device thread, in standby. Blocks until the device should start (true)
+  // or close (false).
+  bool WaitForStart() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]() { return start_requested_ || close_requested_; });
+    if (close_requested_) return false;
+    start_requested_ = false;
+    state_ = DeviceState::kStarting;
+    return true;
+  }
+
+  // Device thread. Reports how starting the stream went; a device that
+  // failed to start is back in standby.
+  void Started(bool succeeded) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      start_succeeded_ = succeeded;
+      state_ = succeeded ? DeviceState::kRunning : DeviceState::kStandby;
+    }
+    changed_.notify_all();
+  }
+
+  // Device thread, once a run has fully wound down: back to standby, or
+  // closed when asked to close or the source ended.
+  void Stopped() { SetState(DeviceState::kStandby); }
+  void Closed() { SetState(DeviceState::kClosed); }
+
+  // Control thread. Waits for the outcome of the open; true once the
+  // device is in standby.
+  bool WaitOpened() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]() { return state_ != DeviceState::kOpening; });
+    return state_ == DeviceState::kStandby;
+  }
+
+  // Control thread. Starts a device in standby and waits for the outcome.
+  bool Start() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (state_ != DeviceState::kStandby) return false;
+    start_requested_ = true;
+    start_succeeded_ = false;
+    changed_.notify_all();
+    changed_.wait(lock, [this]() {
+      return (!start_requested_ && state_ != DeviceState::kStarting) ||
+             state_ == DeviceState::kClosed;
+    });
+    return start_succeeded_;
+  }
+
+  // Control thread. Makes the device thread close once the current run, if
+  // any, ends; the caller still has to end the run.
+  void RequestClose() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      close_requested_ = true;
+    }
+    changed_.notify_all();
+  }
+
+  // Control thread, after ending a run. Waits until the device is back in
+  // standby or closed, and returns which.
+  DeviceState WaitStopped() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]() {
+      return state_ == DeviceState::kStandby || state_ == DeviceState::kClosed;
+    });
+    return state_;
+  }
+
+  DeviceState state() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_;
+  }
+
+ private:
+  void SetState(DeviceState state) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      state_ = state;
+    }
+    changed_.notify_all();
+  }
+
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  DeviceState state_ = DeviceState::kClosed;
+  bool start_requested_ = false;
+  bool close_requested_ = false;
+  bool start_succeeded_ = false;
+};
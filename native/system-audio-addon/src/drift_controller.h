@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+struct DriftStats {
+  // Rate correction applied right now, and the part of it that tracks the
+  // steady clock offset, in ppm of the output rate. Positive means the
+  // stream is being shortened because the consumer's clock runs slow.
+  double correction_ppm = 0.0;
+  double estimate_ppm = 0.0;
+  double reported_queue_ms = 0.0;
+  uint64_t reports = 0;
+};
+
+// Estimates the drift between the capture clock and the consumer's playout
+// clock from how full the consumer's queue is, and turns it into the ratio
+// for an AdaptiveResampler. A PI loop: the integral term converges on the
+// clock offset, the proportional term walks the queue back to its target,
+// both clamped to `max_ppm` so the pitch change stays inaudible.
+//
+// ReportQueueLevel() may be called from any thread; Update() belongs to the
+// conversion thread.
+class DriftController {
+ public:
+  void Configure(double target_queue_ms, double max_ppm) {
+    target_queue_ms_ = target_queue_ms;
+    max_correction_ = max_ppm * 1e-6;
+    error_s_ = 0.0;
+    integral_ = 0.0;
+    proportional_ = 0.0;
+    last_report_ns_ = 0;
+    seen_reports_ = reports_.load(std::memory_order_acquire);
+    correction_ppm_.store(0, std::memory_order_relaxed);
+    estimate_ppm_.store(0, std::memory_order_relaxed);
+  }
+
+  // `queued_ms` is the consumer's queue depth, ideally averaged over the
+  // interval since its last report so chunk arrival does not show up as
+  // sawtooth noise.
+  void ReportQueueLevel(double queued_ms) {
+    if (!std::isfinite(queued_ms) || queued_ms < 0.0) return;
+    uint64_t bits = 0;
+    std::memcpy(&bits, &queued_ms, sizeof(bits));
+    reported_bits_.store(bits, std::memory_order_relaxed);
+    reports_.fetch_add(1, std::memory_order_release);
+  }
+
+  // Folds in the latest report, if any, and returns the input frames to
+  // consume per output frame.
+  double Update(uint64_t now_ns) {
+    const uint64_t reports = reports_.load(std::memory_order_acquire);
+    if (reports != seen_reports_) {
+      seen_reports_ = reports;
+      const double error_s = (ReportedQueueMs() - target_queue_ms_) / 1000.0;
+      if (last_report_ns_ == 0) {
+        error_s_ = error_s;
+      } else {
+        const double dt_s =
+            std::min(kMaxStepS, static_cast<double>(now_ns - last_report_ns_) / 1e9);
+        error_s_ += (error_s - error_s_) * std::min(1.0, dt_s / kErrorSmoothingS);
+        integral_ = std::clamp(integral_ + kIntegralGain * error_s_ * dt_s, -max_correction_,
+                               max_correction_);
+      }
+      last_report_ns_ = now_ns;
+      proportional_ = kProportionalGain * error_s_;
+    } else if (last_report_ns_ != 0 && now_ns - last_report_ns_ > kStaleReportNs) {
+      // The consumer went quiet: keep following the estimated offset, but
+      // stop steering towards a queue level nobody is reporting.
+      proportional_ = 0.0;
+    }
+
+    const double correction =
+        std::clamp(integral_ + proportional_, -max_correction_, max_correction_);
+    correction_ppm_.store(static_cast<int64_t>(std::lround(correction * 1e9)),
+                          std::memory_order_relaxed);
+    estimate_ppm_.store(static_cast<int64_t>(std::lround(integral_ * 1e9)),
+                        std::memory_order_relaxed);
+    return 1.0 + correction;
+  }
+
+  // Any thread.
+  DriftStats GetStats() const {
+    DriftStats stats;
+    stats.correction_ppm =
+        static_cast<double>(correction_ppm_.load(std::memory_order_relaxed)) / 1000.0;
+    stats.estimate_ppm =
+        static_cast<double>(estimate_ppm_.load(std::memory_order_relaxed)) / 1000.0;
+    stats.reports = reports_.load(std::memory_order_relaxed);
+    stats.reported_queue_ms = stats.reports == 0 ? 0.0 : ReportedQueueMs();
+    return stats;
+  }
+
+ private:
+  // A well damped (zeta 0.7) loop with a natural period of two minutes,
+  // fed a queue error smoothed over a couple of seconds: a few hundred ppm
+  // of offset is absorbed within the clamp, and report jitter of a few
+  // milliseconds moves the rate by tens of ppm at most.
+  static constexpr double kNaturalFrequency = 2.0 * 3.14159265358979323846 / 120.0;
+  static constexpr double kIntegralGain = kNaturalFrequency * kNaturalFrequency;
+  static constexpr double kProportionalGain = 2.0 * 0.7 * kNaturalFrequency;
+  static constexpr double kErrorSmoothingS = 2.0;
+  static constexpr double kMaxStepS = 1.0;
+  static constexpr uint64_t kStaleReportNs = 2000000000;
+
+  double ReportedQueueMs() const {
+    const uint64_t bits = reported_bits_.load(std::memory_order_relaxed);
+    double value = 0.0;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  double target_queue_ms_ = 0.0;
+  double max_correction_ = 0.0;
+  double error_s_ = 0.0;
+  double integral_ = 0.0;
+  double proportional_ = 0.0;
+  uint64_t last_report_ns_ = 0;
+  uint64_t seen_reports_ = 0;
+
+  std::atomic<uint64_t> reported_bits_{0};
+  std::atomic<uint64_t> reports_{0};
+  // Milli-ppm, for the stats readers.
+  std::atomic<int64_t> correction_ppm_{0};
+  std::atomic<int64_t> estimate_ppm_{0};
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct LatencySummary {
+  uint64_t count = 0;
+  double p50_us = 0.0;
+  double p99_us = 0.0;
+  double p999_us = 0.0;
+  double max_us = 0.0;
+};
+
+// HDR-style log-linear histogram of microsecond latencies: 16 linear
+// sub-buckets per power of two, so every recorded value is reported within
+// ~6% up to about 19 hours. Record() is a couple of relaxed atomic adds and
+// may be called from any number of threads; a summary taken while recording
+// is in flight is off by at most the samples being recorded. Reset() is
+// equally unsynchronized, which is fine for statistics.
+class LatencyHistogram {
+ public:
+  void Record(uint64_t latency_ns) {
+    const uint64_t value_us = latency_ns / 1000;
+    counts_[BucketIndex(value_us)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t max = max_us_.load(std::memory_order_relaxed);
+    while (value_us > max &&
+           !max_us_.compare_exchange_weak(max, value_us, std::memory_order_relaxed)) {
+    }
+  }
+
+  // Records `end_ns - start_ns`, ignoring an unknown (zero) start or stamps
+  // from clocks that disagree.
+  void RecordInterval(uint64_t start_ns, uint64_t end_ns) {
+    if (start_ns != 0 && end_ns >= start_ns) Record(end_ns - start_ns);
+  }
+
+  void Reset() {
+    for (auto& count : counts_) count.store(0, std::memory_order_relaxed);
+    max_us_.store(0, std::memory_order_relaxed);
+  }
+
+  LatencySummary Summarize() const {
+    std::array<uint64_t, kBucketCount> counts;
+    uint64_t total = 0;
+    for (size_t index = 0; index < kBucketCount; ++index) {
+      counts[index] = counts_[index].load(std::memory_order_relaxed);
+      total += counts[index];
+    }
+
+    LatencySummary summary;
+    summary.count = total;
+    if (total == 0) return summary;
+
+    const uint64_t max_us = max_us_.load(std::memory_order_relaxed);
+    summary.max_us = static_cast<double>(max_us);
+    summary.p50_us = Percentile(counts, total, 0.5, max_us);
+    summary.p99_us = Percentile(counts, total, 0.99, max_us);
+    summary.p999_us = Percentile(counts, total, 0.999, max_us);
+    return summary;
+  }
+
+ private:
+  static constexpr uint32_t kSubBucketBits = 4;
+  static constexpr uint64_t kSubBuckets = uint64_t{1} << kSubBucketBits;
+  static constexpr size_t kOctaves = 33;
+  static constexpr size_t kBucketCount = kOctaves * kSubBuckets;
+
+  static uint32_t HighestBit(uint64_t value) {
+    uint32_t bit = 0;
+    while (value >>= 1) ++bit;
+    return bit;
+  }
+
+  // Octave 0 holds 0-15 exactly; octave n >= 1 covers [2^(n+3), 2^(n+4)) in
+  // 16 equal steps.
+  static size_t BucketIndex(uint64_t value) {
+    if (value < kSubBuckets) return static_cast<size_t>(value);
+    const uint32_t top = HighestBit(value);
+    const size_t octave = top - kSubBucketBits + 1;
+    if (octave >= kOctaves) return kBucketCount - 1;
+    const uint64_t sub = (value >> (top - kSubBucketBits)) & (kSubBuckets - 1);
+    return octave * kSubBuckets + static_cast<size_t>(sub);
+  }
+
+  // Largest value that lands in `index`.
+  static uint64_t BucketUpperBound(size_t index) {
+    const size_t octave = index / kSubBuckets;
+    const uint64_t sub = index % kSubBuckets;
+    if (octave == 0) return sub;
+    const uint32_t shift = static_cast<uint32_t>(octave - 1);
+    return (((kSubBuckets | sub) + 1) << shift) - 1;
+  }
+
+  static double Percentile(const std::array<uint64_t, kBucketCount>& counts,
+                           uint64_t total,
+                           double quantile,
+                           uint64_t max_us) {
+    uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(total) + 0.5);
+    rank = rank == 0 ? 1 : rank;
+    uint64_t seen = 0;
+    for (size_t index = 0; index < kBucketCount; ++index) {
+      seen += counts[index];
+      if (seen >= rank) {
+        const uint64_t bound = BucketUpperBound(index);
+        return static_cast<double>(bound < max_us ? bound : max_us);
+      }
+    }
+    return static_cast<double>(max_us);
+  }
+
+  std::array<std::atomic<uint64_t>, kBucketCount> counts_{};
+  std::atomic<uint64_t> max_us_{0};
+};
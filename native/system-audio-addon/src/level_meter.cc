@@ -0,0 +1,288 @@
+#include "level_meter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include "simd_support.h"
+
+namespace {
+
+// Float lane sums are folded into the double totals this often, which keeps
+// them exact to well under 0.01 dB.
+constexpr size_t kFoldVectors = 512;
+
+void MeasureScalar(const int16_t* samples,
+                   size_t frames,
+                   uint32_t channels,
+                   int32_t* peak,
+                   double* energy) {
+  for (size_t frame = 0; frame < frames; ++frame) {
+    const int16_t* source = samples + frame * channels;
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+      const int32_t value = source[channel];
+      peak[channel] = std::max(peak[channel], value < 0 ? -value : value);
+      energy[channel] += static_cast<double>(value) * value;
+    }
+  }
+}
+
+void MeasureFloatScalar(const float* samples,
+                        size_t frames,
+                        uint32_t channels,
+                        float* peak,
+                        double* energy) {
+  for (size_t frame = 0; frame < frames; ++frame) {
+    const float* source = samples + frame * channels;
+    for (uint32_t channel = 0; channel < channels; ++channel) {
+      const float value = source[channel];
+      peak[channel] = std::max(peak[channel], std::abs(value));
+      energy[channel] += static_cast<double>(value) * value;
+    }
+  }
+}
+
+}  // namespace
+
+void MeasureInt16Levels(const int16_t* samples,
+                        size_t frames,
+                        uint32_t channels,
+                        int32_t* peak,
+                        double* energy) {
+  if (channels == 0) return;
+  size_t done = 0;
+
+#if defined(SYSTEM_AUDIO_SIMD_X86) || defined(SYSTEM_AUDIO_SIMD_NEON)
+  // With 1, 2, 4 or 8 channels, lane i of an 8-sample vector always holds
+  // channel i % channels.
+  if (8 % channels == 0) {
+    const size_t count = frames * channels;
+    size_t index = 0;
+    int16_t lane_max[8];
+    int16_t lane_min[8];
+    float lane_energy[8];
+#if defined(SYSTEM_AUDIO_SIMD_X86)
+    __m128i maximum = _mm_set1_epi16(INT16_MIN);
+    __m128i minimum = _mm_set1_epi16(INT16_MAX);
+    while (index + 8 <= count) {
+      __m128 energy_low = _mm_setzero_ps();
+      __m128 energy_high = _mm_setzero_ps();
+      for (size_t vectors = 0; vectors < kFoldVectors && index + 8 <= count;
+           ++vectors, index += 8) {
+        const __m128i packed =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + index));
+        maximum = _mm_max_epi16(maximum, packed);
+        minimum = _mm_min_epi16(minimum, packed);
+        const __m128 low =
+            _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16));
+        const __m128 high =
+            _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16));
+        energy_low = _mm_add_ps(energy_low, _mm_mul_ps(low, low));
+        energy_high = _mm_add_ps(energy_high, _mm_mul_ps(high, high));
+      }
+      _mm_storeu_ps(lane_energy, energy_low);
+      _mm_storeu_ps(lane_energy + 4, energy_high);
+      for (uint32_t lane = 0; lane < 8; ++lane) energy[lane % channels] += lane_energy[lane];
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_max), maximum);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lane_min), minimum);
+#else
+    int16x8_t maximum = vdupq_n_s16(INT16_MIN);
+    int16x8_t minimum = vdupq_n_s16(INT16_MAX);
+    while (index + 8 <= count) {
+      float32x4_t energy_low = vdupq_n_f32(0.0f);
+      float32x4_t energy_high = vdupq_n_f32(0.0f);
+      for (size_t vectors = 0; vectors < kFoldVectors && index + 8 <= count;
+           ++vectors, index += 8) {
+        const int16x8_t packed = vld1q_s16(samples + index);
+        maximum = vmaxq_s16(maximum, packed);
+        minimum = vminq_s16(minimum, packed);
+        const float32x4_t low = vcvtq_f32_s32(vmovl_s16(vget_low_s16(packed)));
+        const float32x4_t high = vcvtq_f32_s32(vmovl_s16(vget_high_s16(packed)));
+        energy_low = vmlaq_f32(energy_low, low, low);
+        energy_high = vmlaq_f32(energy_high, high, high);
+      }
+      vst1q_f32(lane_energy, energy_low);
+      vst1q_f32(lane_energy + 4, energy_high);
+      for (uint32_t lane = 0; lane < 8; ++lane) energy[lane % channels] += lane_energy[lane];
+    }
+    vst1q_s16(lane_max, maximum);
+    vst1q_s16(lane_min, minimum);
+#endif
+    if (index > 0) {
+      for (uint32_t lane = 0; lane < 8; ++lane) {
+        const int32_t magnitude = std::max<int32_t>(lane_max[lane], -int32_t{lane_min[lane]});
+        peak[lane % channels] = std::max(peak[lane % channels], magnitude);
+      }
+    }
+    // Whole vectors cover whole frames here, so the tail starts on a frame.
+    done = index / channels;
+  }
+#endif
+
+  MeasureScalar(samples + done * channels, frames - done, channels, peak, energy);
+}
+
+void MeasureFloatLevels(const float* samples,
+                        size_t frames,
+                        uint32_t channels,
+                        float* peak,
+                        double* energy) {
+  if (channels == 0) return;
+  size_t done = 0;
+
+#if defined(SYSTEM_AUDIO_SIMD_X86) || defined(SYSTEM_AUDIO_SIMD_NEON)
+  // Two 4-lane vectors per step, so as with int16, lane i of the pair
+  // always holds channel i % channels for 1, 2, 4 or 8 channels.
+  if (8 % channels == 0) {
+    const size_t count = frames * channels;
+    size_t index = 0;
+    float lane_peak[8];
+    float lane_energy[8];
+#if defined(SYSTEM_AUDIO_SIMD_X86)
+    const __m128 magnitude_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak_low = _mm_setzero_ps();
+    __m128 peak_high = _mm_setzero_ps();
+    while (index + 8 <= count) {
+      __m128 energy_low = _mm_setzero_ps();
+      __m128 energy_high = _mm_setzero_ps();
+      for (size_t vectors = 0; vectors < kFoldVectors && index + 8 <= count;
+           ++vectors, index += 8) {
+        const __m128 low = _mm_loadu_ps(samples + index);
+        const __m128 high = _mm_loadu_ps(samples + index + 4);
+        peak_low = _mm_max_ps(peak_low, _mm_and_ps(low, magnitude_mask));
+        peak_high = _mm_max_ps(peak_high, _mm_and_ps(high, magnitude_mask));
+        energy_low = _mm_add_ps(energy_low, _mm_mul_ps(low, low));
+        energy_high = _mm_add_ps(energy_high, _mm_mul_ps(high, high));
+      }
+      _mm_storeu_ps(lane_energy, energy_low);
+      _mm_storeu_ps(lane_energy + 4, energy_high);
+      for (uint32_t lane = 0; lane < 8; ++lane) energy[lane % channels] += lane_energy[lane];
+    }
+    _mm_storeu_ps(lane_peak, peak_low);
+    _mm_storeu_ps(lane_peak + 4, peak_high);
+#else
+    float32x4_t peak_low = vdupq_n_f32(0.0f);
+    float32x4_t peak_high = vdupq_n_f32(0.0f);
+    while (index + 8 <= count) {
+      float32x4_t energy_low = vdupq_n_f32(0.0f);
+      float32x4_t energy_high = vdupq_n_f32(0.0f);
+      for (size_t vectors = 0; vectors < kFoldVectors && index + 8 <= count;
+           ++vectors, index += 8) {
+        const float32x4_t low = vld1q_f32(samples + index);
+        const float32x4_t high = vld1q_f32(samples + index + 4);
+        peak_low = vmaxq_f32(peak_low, vabsq_f32(low));
+        peak_high = vmaxq_f32(peak_high, vabsq_f32(high));
+        energy_low = vmlaq_f32(energy_low, low, low);
+        energy_high = vmlaq_f32(energy_high, high, high);
+      }
+      vst1q_f32(lane_energy, energy_low);
+      vst1q_f32(lane_energy + 4, energy_high);
+      for (uint32_t lane = 0; lane < 8; ++lane) energy[lane % channels] += lane_energy[lane];
+    }
+    vst1q_f32(lane_peak, peak_low);
+    vst1q_f32(lane_peak + 4, peak_high);
+#endif
+    if (index > 0) {
+      for (uint32_t lane = 0; lane < 8; ++lane) {
+        peak[lane % channels] = std::max(peak[lane % channels], lane_peak[lane]);
+      }
+    }
+    done = index / channels;
+  }
+#endif
+
+  MeasureFloatScalar(samples + done * channels, frames - done, channels, peak, energy);
+}
+
+void LevelMeter::Configure(uint32_t channels, uint32_t window_frames) {
+  channels_ = channels;
+  metered_channels_ = std::min(channels, kMaxMeterChannels);
+  window_frames_ = std::max<uint32_t>(window_frames, 1);
+  frames_ = 0;
+  std::fill(std::begin(peak_), std::end(peak_), 0);
+  std::fill(std::begin(energy_), std::end(energy_), 0.0);
+  reading_ = LevelReading();
+  reading_.channels = metered_channels_;
+}
+
+double LevelMeter::Measure(const int16_t* samples, size_t frames) {
+  if (channels_ == 0) return 0.0;
+
+  int32_t peak[kMaxMeterChannels] = {};
+  double energy[kMaxMeterChannels] = {};
+  double total = 0.0;
+  if (channels_ <= kMaxMeterChannels) {
+    MeasureInt16Levels(samples, frames, channels_, peak, energy);
+    for (uint32_t channel = 0; channel < channels_; ++channel) total += energy[channel];
+  } else {
+    // Too wide to meter per channel; silence detection still needs the sum.
+    for (size_t index = 0; index < frames * channels_; ++index) {
+      const double value = samples[index];
+      total += value * value;
+      if (index % channels_ < kMaxMeterChannels) {
+        const uint32_t channel = static_cast<uint32_t>(index % channels_);
+        peak[channel] = std::max(peak[channel], static_cast<int32_t>(std::abs(value)));
+        energy[channel] += value * value;
+      }
+    }
+  }
+
+  Accumulate(peak, energy, frames);
+  return total;
+}
+
+double LevelMeter::Measure(const float* samples, size_t frames) {
+  if (channels_ == 0) return 0.0;
+
+  // The scale FloatToInt16() quantizes with.
+  constexpr double kScale = 32767.0;
+  int32_t peak[kMaxMeterChannels] = {};
+  double energy[kMaxMeterChannels] = {};
+  double total = 0.0;
+  if (channels_ <= kMaxMeterChannels) {
+    float float_peak[kMaxMeterChannels] = {};
+    MeasureFloatLevels(samples, frames, channels_, float_peak, energy);
+    for (uint32_t channel = 0; channel < channels_; ++channel) {
+      peak[channel] =
+          static_cast<int32_t>(std::min(float_peak[channel] * kScale, 32768.0) + 0.5);
+      energy[channel] *= kScale * kScale;
+      total += energy[channel];
+    }
+  } else {
+    // Too wide to meter per channel; silence detection still needs the sum.
+    for (size_t index = 0; index < frames * channels_; ++index) {
+      const double value = samples[index] * kScale;
+      total += value * value;
+      if (index % channels_ < kMaxMeterChannels) {
+        const uint32_t channel = static_cast<uint32_t>(index % channels_);
+        const int32_t magnitude =
+            static_cast<int32_t>(std::min(std::abs(value), 32768.0) + 0.5);
+        peak[channel] = std::max(peak[channel], magnitude);
+        energy[channel] += value * value;
+      }
+    }
+  }
+
+  Accumulate(peak, energy, frames);
+  return total;
+}
+
+void LevelMeter::Accumulate(const int32_t* peak, const double* energy, size_t frames) {
+  for (uint32_t channel = 0; channel < metered_channels_; ++channel) {
+    peak_[channel] = std::max(peak_[channel], peak[channel]);
+    energy_[channel] += energy[channel];
+  }
+  frames_ += frames;
+
+  if (frames_ >= window_frames_) {
+    reading_.window_frames = static_cast<uint32_t>(frames_);
+    for (uint32_t channel = 0; channel < metered_channels_; ++channel) {
+      reading_.peak[channel] = static_cast<float>(peak_[channel] / 32768.0);
+      reading_.rms[channel] = static_cast<float>(std::sqrt(energy_[channel] / frames_) / 32768.0);
+      peak_[channel] = 0;
+      energy_[channel] = 0.0;
+    }
+    frames_ = 0;
+  }
+}
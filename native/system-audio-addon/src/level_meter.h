@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint32_t kMaxMeterChannels = 8;
+
+// Per-channel levels over the last completed meter window, as linear
+// fractions of full scale. Channels past kMaxMeterChannels are not metered.
+struct LevelReading {
+  uint32_t channels = 0;
+  uint32_t window_frames = 0;
+  float peak[kMaxMeterChannels] = {};
+  float rms[kMaxMeterChannels] = {};
+};
+
+// Per-channel peak magnitude and sum of squares over interleaved int16
+// samples. Vectorized when the channel count divides eight.
+void MeasureInt16Levels(const int16_t* samples,
+                        size_t frames,
+                        uint32_t channels,
+                        int32_t* peak,
+                        double* energy);
+
+// The same over interleaved float samples: peak magnitude and sum of
+// squares in full-scale units.
+void MeasureFloatLevels(const float* samples,
+                        size_t frames,
+                        uint32_t channels,
+                        float* peak,
+                        double* energy);
+
+// Accumulates chunks of output PCM into fixed windows of at least
+// `window_frames` frames and keeps the levels of the last full one.
+class LevelMeter {
+ public:
+  void Configure(uint32_t channels, uint32_t window_frames);
+
+  // Adds `frames` interleaved frames and returns their energy summed over
+  // all channels, which silence detection reuses.
+  double Measure(const int16_t* samples, size_t frames);
+  // Float samples, measured in the same int16 units as the overload above
+  // so thresholds and readings do not depend on the output format.
+  double Measure(const float* samples, size_t frames);
+
+  const LevelReading& reading() const { return reading_; }
+
+ private:
+  // Folds one measurement into the current window.
+  void Accumulate(const int32_t* peak, const double* energy, size_t frames);
+
+  uint32_t channels_ = 0;
+  uint32_t metered_channels_ = 0;
+  uint32_t window_frames_ = 0;
+  uint64_t frames_ = 0;
+  int32_t peak_[kMaxMeterChannels] = {};
+  double energy_[kMaxMeterChannels] = {};
+  LevelReading reading_;
+};
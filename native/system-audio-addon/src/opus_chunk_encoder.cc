@@ -0,0 +1,264 @@
+#include "opus_chunk_encoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+#if defined(SYSTEM_AUDIO_WITH_OPUS)
+#include <opus.h>
+#endif
+
+#include "audio_chunk.h"
+#include "capture_backend.h"
+
+namespace {
+
+// Chunks the encoder may lag behind the capture thread before dropping.
+constexpr size_t kQueuedFrames = 16;
+
+}  // namespace
+
+void* CreateOpusEncoder(uint32_t sample_rate,
+                        uint32_t channels,
+                        const OpusEncoderConfig& config,
+                        std::string* error) {
+#if defined(SYSTEM_AUDIO_WITH_OPUS)
+  const uint32_t rate = sample_rate;
+  if (rate != 8000 && rate != 12000 && rate != 16000 && rate != 24000 && rate != 48000) {
+    if (error) *error = "Opus encoding needs an 8, 12, 16, 24 or 48 kHz output rate.";
+    return nullptr;
+  }
+  if (channels != 1 && channels != 2) {
+    if (error) *error = "Opus encoding supports mono or stereo output only.";
+    return nullptr;
+  }
+
+  int status = OPUS_OK;
+  OpusEncoder* encoder = opus_encoder_create(static_cast<opus_int32>(rate),
+                                             static_cast<int>(channels),
+                                             OPUS_APPLICATION_AUDIO, &status);
+  if (status != OPUS_OK || !encoder) {
+    if (error) *error = std::string("opus_encoder_create failed: ") + opus_strerror(status);
+    return nullptr;
+  }
+
+  opus_encoder_ctl(encoder, OPUS_SET_BITRATE(static_cast<opus_int32>(config.bitrate)));
+  opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(static_cast<opus_int32>(
+                                std::min<uint32_t>(config.complexity, 10))));
+  opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+  opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(config.fec ? 1 : 0));
+  opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(static_cast<opus_int32>(
+                                config.fec ? std::min<uint32_t>(config.expected_loss_percent, 100)
+                                           : 0)));
+  opus_encoder_ctl(encoder, OPUS_SET_DTX(config.dtx ? 1 : 0));
+  return encoder;
+#else
+  (void)sample_rate;
+  (void)channels;
+  (void)config;
+  if (error) *error = "This build of the system audio addon has no Opus support.";
+  return nullptr;
+#endif
+}
+
+void DestroyOpusEncoder(void* encoder) {
+#if defined(SYSTEM_AUDIO_WITH_OPUS)
+  if (encoder) opus_encoder_destroy(static_cast<OpusEncoder*>(encoder));
+#else
+  (void)encoder;
+#endif
+}
+
+OpusChunkEncoder::OpusChunkEncoder() = default;
+
+OpusChunkEncoder::~OpusChunkEncoder() {
+  Stop();
+}
+
+bool OpusChunkEncoder::Start(const CaptureConfig& config,
+                             PacketCallback on_packet,
+                             std::string* error) {
+  Stop();
+  if (config.pcm_format != PcmSampleFormat::kInt16) {
+    if (error) *error = "Opus encoding takes int16 PCM; use sampleFormat 's16'.";
+    return false;
+  }
+
+#if defined(SYSTEM_AUDIO_WITH_OPUS)
+  const uint32_t frame_ms = config.frame_ms;
+  if (frame_ms != 5 && frame_ms != 10 && frame_ms != 20 && frame_ms != 40 && frame_ms != 60) {
+    if (error) *error = "Opus encoding needs a frameMs of 5, 10, 20, 40 or 60.";
+    return false;
+  }
+  const uint32_t rate = config.target_sample_rate;
+  OpusEncoder* encoder = static_cast<OpusEncoder*>(
+      CreateOpusEncoder(rate, config.target_channels, config.opus, error));
+  if (!encoder) {
+    return false;
+  }
+
+  encoder_ = encoder;
+  on_packet_ = std::move(on_packet);
+  sample_rate_ = rate;
+  channels_ = config.target_channels;
+  frame_samples_ = ChunkSampleCount(config);
+  pcm_queue_.Reset(frame_samples_ * kQueuedFrames, frame_samples_);
+  frame_queue_.Reset(kQueuedFrames, 1);
+
+  encoded_packets_.store(0);
+  encoded_bytes_.store(0);
+  dropped_frames_.store(0);
+  encode_ns_total_.store(0);
+  encode_ns_max_.store(0);
+
+  stop_requested_ = false;
+  try {
+    worker_ = std::thread([this]() { WorkerMain(); });
+  } catch (const std::exception& ex) {
+    opus_encoder_destroy(encoder);
+    encoder_ = nullptr;
+    if (error) *error = ex.what();
+    return false;
+  }
+  return true;
+#else
+  (void)config;
+  (void)on_packet;
+  if (error) *error = "This build of the system audio addon has no Opus support.";
+  return false;
+#endif
+}
+
+void OpusChunkEncoder::Stop() {
+  if (worker_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      stop_requested_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+  }
+
+#if defined(SYSTEM_AUDIO_WITH_OPUS)
+  if (encoder_) {
+    opus_encoder_destroy(static_cast<OpusEncoder*>(encoder_));
+    encoder_ = nullptr;
+  }
+#endif
+  on_packet_ = nullptr;
+}
+
+bool OpusChunkEncoder::Submit(const AudioChunk& chunk) {
+  const bool marker = chunk.encoding == ChunkEncoding::kSilence;
+  if (!encoder_ || frame_queue_.WriteAvailable() == 0 ||
+      (!marker && (chunk.sample_count != frame_samples_ ||
+                   pcm_queue_.WriteAvailable() < frame_samples_))) {
+    dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  if (!marker) {
+    pcm_queue_.Write(chunk.samples, frame_samples_);
+  }
+  frame_queue_.Push(FrameInfo{chunk.sequence, chunk.sample_position, chunk.timestamp_ms,
+                              chunk.capture_time_ns, chunk.read_time_ns,
+                              marker ? chunk.frame_count : 0});
+  {
+    // Taking the lock orders the push before a worker that is about to wait,
+    // so the notification cannot be lost.
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+  }
+  wake_.notify_one();
+  return true;
+}
+
+OpusEncoderStats OpusChunkEncoder::GetStats() const {
+  OpusEncoderStats stats;
+  stats.encoded_packets = encoded_packets_.load(std::memory_order_relaxed);
+  stats.encoded_bytes = encoded_bytes_.load(std::memory_order_relaxed);
+  stats.dropped_frames = dropped_frames_.load(std::memory_order_relaxed);
+  if (stats.encoded_packets > 0) {
+    stats.encode_time_avg_us =
+        static_cast<double>(encode_ns_total_.load(std::memory_order_relaxed)) / 1000.0 /
+        static_cast<double>(stats.encoded_packets);
+  }
+  stats.encode_time_max_us =
+      static_cast<double>(encode_ns_max_.load(std::memory_order_relaxed)) / 1000.0;
+  return stats;
+}
+
+void OpusChunkEncoder::WorkerMain() {
+#if defined(SYSTEM_AUDIO_WITH_OPUS)
+  OpusEncoder* encoder = static_cast<OpusEncoder*>(encoder_);
+  const int frame_size = static_cast<int>(frame_samples_ / channels_);
+  std::vector<uint8_t> packet(kOpusMaxPacketBytes);
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_.wait(lock, [this]() { return stop_requested_ || frame_queue_.ReadAvailable() > 0; });
+      if (stop_requested_) {
+        return;
+      }
+    }
+
+    FrameInfo info;
+    while (frame_queue_.Read(&info, 1) == 1) {
+      if (info.silent_frames != 0) {
+        AudioChunk marker;
+        marker.encoding = ChunkEncoding::kSilence;
+        marker.frame_count = info.silent_frames;
+        marker.sample_rate = sample_rate_;
+        marker.channels = channels_;
+        marker.sequence = info.sequence;
+        marker.sample_position = info.sample_position;
+        marker.timestamp_ms = info.timestamp_ms;
+        marker.capture_time_ns = info.capture_time_ns;
+        marker.read_time_ns = info.read_time_ns;
+        marker.emit_time_ns = MonotonicNowNs();
+        on_packet_(marker);
+        continue;
+      }
+
+      const int16_t* pcm = pcm_queue_.Peek(frame_samples_);
+      if (!pcm) break;
+
+      const auto started = std::chrono::steady_clock::now();
+      const opus_int32 bytes = opus_encode(encoder, pcm, frame_size, packet.data(),
+                                           static_cast<opus_int32>(packet.size()));
+      const auto elapsed_ns = static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - started)
+              .count());
+      pcm_queue_.Consume(frame_samples_);
+
+      encode_ns_total_.fetch_add(elapsed_ns, std::memory_order_relaxed);
+      if (elapsed_ns > encode_ns_max_.load(std::memory_order_relaxed)) {
+        encode_ns_max_.store(elapsed_ns, std::memory_order_relaxed);
+      }
+
+      if (bytes < 0) {
+        dropped_frames_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      encoded_packets_.fetch_add(1, std::memory_order_relaxed);
+      encoded_bytes_.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed);
+
+      AudioChunk encoded;
+      encoded.encoding = ChunkEncoding::kOpus;
+      encoded.payload = packet.data();
+      encoded.payload_bytes = static_cast<size_t>(bytes);
+      encoded.frame_count = static_cast<uint32_t>(frame_size);
+      encoded.sample_rate = sample_rate_;
+      encoded.channels = channels_;
+      encoded.sequence = info.sequence;
+      encoded.sample_position = info.sample_position;
+      encoded.timestamp_ms = info.timestamp_ms;
+      encoded.capture_time_ns = info.capture_time_ns;
+      encoded.read_time_ns = info.read_time_ns;
+      encoded.emit_time_ns = MonotonicNowNs();
+      on_packet_(encoded);
+    }
+  }
+#endif
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_config.h"
+#include "spsc_ring_buffer.h"
+
+struct AudioChunk;
+
+// Largest packet one Opus frame can encode to (RFC 6716 recommends sizing
+// output buffers at 4000 bytes).
+constexpr size_t kOpusMaxPacketBytes = 4000;
+
+struct OpusEncoderStats {
+  uint64_t encoded_packets = 0;
+  uint64_t encoded_bytes = 0;
+  uint64_t dropped_frames = 0;
+  double encode_time_avg_us = 0.0;
+  double encode_time_max_us = 0.0;
+};
+
+// Creates an OpusEncoder* for `sample_rate` and `channels` with `config`
+// applied, or returns nullptr with `error` set (always, in a build without
+// Opus). Free it with DestroyOpusEncoder().
+void* CreateOpusEncoder(uint32_t sample_rate,
+                        uint32_t channels,
+                        const OpusEncoderConfig& config,
+                        std::string* error);
+void DestroyOpusEncoder(void* encoder);
+
+// Encodes fixed-size PCM chunks to Opus on its own worker thread, so the
+// capture thread only copies a chunk into a queue. Each chunk is one Opus
+// frame, so frame_ms must be 2.5-60 ms in Opus steps (integer ms: 5, 10,
+// 20, 40 or 60) and the rate one Opus supports.
+class OpusChunkEncoder {
+ public:
+  using PacketCallback = std::function<void(const AudioChunk& packet)>;
+
+  OpusChunkEncoder();
+  ~OpusChunkEncoder();
+
+  OpusChunkEncoder(const OpusChunkEncoder&) = delete;
+  OpusChunkEncoder& operator=(const OpusChunkEncoder&) = delete;
+
+  bool Start(const CaptureConfig& config, PacketCallback on_packet, std::string* error);
+  void Stop();
+
+  // Capture thread. Queues one PCM chunk; returns false and counts a drop
+  // when the encoder has fallen a full queue behind. Silence markers pass
+  // through unencoded, in order with the packets around them.
+  bool Submit(const AudioChunk& chunk);
+
+  OpusEncoderStats GetStats() const;
+
+ private:
+  struct FrameInfo {
+    uint64_t sequence;
+    uint64_t sample_position;
+    uint64_t timestamp_ms;
+    uint64_t capture_time_ns;
+    uint64_t read_time_ns;
+    // Non-zero for a silence marker, which has no PCM queued.
+    uint32_t silent_frames;
+  };
+
+  void WorkerMain();
+
+  void* encoder_ = nullptr;  // OpusEncoder*, kept opaque to callers.
+  PacketCallback on_packet_;
+  uint32_t sample_rate_ = 0;
+  uint32_t channels_ = 0;
+  size_t frame_samples_ = 0;
+
+  SpscRingBuffer<int16_t> pcm_queue_;
+  SpscRingBuffer<FrameInfo> frame_queue_;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool stop_requested_ = false;
+  std::thread worker_;
+
+  std::atomic<uint64_t> encoded_packets_{0};
+  std::atomic<uint64_t> encoded_bytes_{0};
+  std::atomic<uint64_t> dropped_frames_{0};
+  std::atomic<uint64_t> encode_ns_total_{0};
+  std::atomic<uint64_t> encode_ns_max_{0};
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Releases fixed-duration packets either on a real-time schedule or one per
+// wait as fast as the consumer asks, for backends that have no device clock.
+class PacketPacer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  void Start(Clock::duration packet_duration, bool realtime) {
+    packet_duration_ = packet_duration;
+    realtime_ = realtime;
+    next_due_ = Clock::now();
+    due_packets_ = 0;
+    skipped_ = false;
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    woken_ = false;
+  }
+
+  void Wait(uint32_t timeout_ms) {
+    if (!realtime_) {
+      due_packets_ = 1;
+      return;
+    }
+
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    {
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_.wait_until(lock, std::min(next_due_, deadline), [this]() { return woken_; });
+      woken_ = false;
+    }
+
+    const Clock::time_point now = Clock::now();
+    // After a long stall (debugger, suspended VM) resume from now instead of
+    // bursting out every missed packet.
+    if (now - next_due_ > kMaxBacklog) {
+      next_due_ = now;
+      skipped_ = true;
+    }
+    while (next_due_ <= now) {
+      ++due_packets_;
+      next_due_ += packet_duration_;
+    }
+  }
+
+  // True when another packet may be produced now. `start` receives when
+  // the packet's first frame would have been captured by a real device, and
+  // `discontinuity` whether packets were skipped before it.
+  bool TakePacket(Clock::time_point* start, bool* discontinuity) {
+    if (due_packets_ == 0) return false;
+    *discontinuity = skipped_;
+    skipped_ = false;
+    if (realtime_) {
+      // The oldest due packet fell due `due_packets_` periods before next_due_.
+      *start = next_due_ - packet_duration_ * (due_packets_ + 1);
+    } else {
+      *start = Clock::now() - packet_duration_;
+    }
+    --due_packets_;
+    return true;
+  }
+
+  // Any thread. Ends the current Wait(), or the next one, early.
+  void Wake() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      woken_ = true;
+    }
+    wake_.notify_one();
+  }
+
+  static uint64_t ToNs(Clock::time_point time) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+  }
+
+ private:
+  static constexpr std::chrono::seconds kMaxBacklog{1};
+
+  Clock::duration packet_duration_{};
+  bool realtime_ = true;
+  Clock::time_point next_due_{};
+  uint32_t due_packets_ = 0;
+  bool skipped_ = false;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool woken_ = false;
+};
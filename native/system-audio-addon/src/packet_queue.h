@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "capture_backend.h"
+#include "spsc_ring_buffer.h"
+
+// Raw device packets on their way from the thread that reads the device to
+// the thread that converts them. The device side only copies: it can hand
+// the packet back to the device straight away, and however slow conversion
+// or delivery get, the endpoint buffer is never held. Storage is allocated
+// by Reset(); pushing never allocates, locks or blocks unless the consumer
+// is asleep and needs waking, or the queue was told to wait for room.
+class PacketQueue {
+ public:
+  // Packets are queued in pieces of at most this many frames, which bounds
+  // the contiguous span the consumer has to peek.
+  static constexpr uint32_t kMaxPieceFrames = 1024;
+
+  struct Piece {
+    uint32_t frames = 0;
+    bool silent = false;
+    // The device reported lost frames just before this piece.
+    bool discontinuity = false;
+    // Frames dropped just before this piece because the queue was full.
+    uint64_t skipped_frames = 0;
+    // Frames the device lost just before this piece, going by its position
+    // counter or, failing that, the jump in its timestamps.
+    uint64_t lost_frames = 0;
+    uint64_t device_time_ns = 0;
+    uint64_t read_time_ns = 0;
+  };
+
+  // Not thread-safe: only call while neither side is using the queue.
+  // `wait_when_full` makes Push() wait for room instead of skipping input,
+  // for sources with no clock of their own that should run exactly as fast
+  // as the consumer.
+  void Reset(uint32_t sample_rate,
+             size_t block_align,
+             uint32_t capacity_ms,
+             size_t max_pieces,
+             bool wait_when_full) {
+    sample_rate_ = sample_rate;
+    block_align_ = block_align;
+    wait_when_full_ = wait_when_full;
+    const size_t capacity_bytes =
+        std::max<size_t>(static_cast<size_t>(sample_rate) * capacity_ms / 1000 * block_align,
+                         2 * kMaxPieceFrames * block_align);
+    bytes_.Reset(capacity_bytes, kMaxPieceFrames * block_align);
+    pieces_.Reset(max_pieces);
+    pending_skipped_frames_ = 0;
+    pending_lost_frames_ = 0;
+    pending_discontinuity_ = false;
+    next_device_position_ = 0;
+    next_device_time_ns_ = 0;
+    closed_ = false;
+    abandoned_.store(false, std::memory_order_relaxed);
+    consumer_waiting_.store(false, std::memory_order_relaxed);
+    overruns_.store(0, std::memory_order_relaxed);
+    overrun_frames_.store(0, std::memory_order_relaxed);
+  }
+
+  // Producer. Copies `packet`; a piece that does not fit is skipped whole
+  // and counted, and the next one that fits carries the gap.
+  void Push(const CapturePacket& packet, uint64_t read_time_ns) {
+    if (packet.discontinuity) pending_discontinuity_ = true;
+    pending_lost_frames_ += LostFrames(packet);
+    const uint8_t* data = packet.silent ? nullptr : packet.data;
+    for (uint32_t done = 0; done < packet.frames;) {
+      const uint32_t count = std::min(kMaxPieceFrames, packet.frames - done);
+      const size_t bytes = data ? count * block_align_ : 0;
+      while (wait_when_full_ && !Fits(bytes)) {
+        if (abandoned_.load(std::memory_order_relaxed)) return;
+        WakeConsumer();
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+      }
+      if (!Fits(bytes)) {
+        pending_skipped_frames_ += count;
+        overruns_.fetch_add(1, std::memory_order_relaxed);
+        overrun_frames_.fetch_add(count, std::memory_order_relaxed);
+      } else {
+        Piece piece;
+        piece.frames = count;
+        piece.silent = data == nullptr;
+        piece.discontinuity = pending_discontinuity_;
+        piece.skipped_frames = pending_skipped_frames_;
+        piece.lost_frames = pending_lost_frames_;
+        piece.device_time_ns =
+            packet.device_time_ns == 0
+                ? 0
+                : packet.device_time_ns + uint64_t{done} * 1000000000 / sample_rate_;
+        piece.read_time_ns = read_time_ns;
+        if (data) bytes_.Write(data + done * block_align_, bytes);
+        pieces_.Push(piece);
+        pending_discontinuity_ = false;
+        pending_skipped_frames_ = 0;
+        pending_lost_frames_ = 0;
+      }
+      done += count;
+    }
+    WakeConsumer();
+  }
+
+  // Producer, once no more packets will come. The consumer drains what is
+  // queued and then Wait() returns false.
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+      closed_ = true;
+    }
+    wake_.notify_one();
+  }
+
+  // Consumer. Blocks until a piece is queued; false once the queue is
+  // closed and empty.
+  bool Wait() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    consumer_waiting_.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in WakeConsumer(): either the producer sees the
+    // flag, or this sees its piece.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wake_.wait(lock, [this]() { return pieces_.ReadAvailable() > 0 || closed_; });
+    consumer_waiting_.store(false, std::memory_order_relaxed);
+    return pieces_.ReadAvailable() > 0;
+  }
+
+  // Consumer, when it stops taking pieces before the queue is closed. A
+  // producer waiting for room gives up instead of waiting forever.
+  void Abandon() { abandoned_.store(true, std::memory_order_relaxed); }
+
+  // Consumer. The next piece and its samples (nullptr for a silent piece),
+  // valid until Pop().
+  bool Front(Piece* piece, const uint8_t** data) {
+    if (pieces_.ReadAvailable() == 0) return false;
+    *piece = *pieces_.Peek(1);
+    *data = piece->silent ? nullptr : bytes_.Peek(piece->frames * block_align_);
+    return true;
+  }
+
+  void Pop(const Piece& piece) {
+    if (!piece.silent) bytes_.Consume(piece.frames * block_align_);
+    pieces_.Consume(1);
+  }
+
+  // Any thread.
+  uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+  uint64_t overrun_frames() const { return overrun_frames_.load(std::memory_order_relaxed); }
+
+ private:
+  // How far `packet` starts past where the previous one ended. Position
+  // counters are exact and always trusted; timestamps jitter, so they are
+  // only consulted when the device flagged the packet.
+  uint64_t LostFrames(const CapturePacket& packet) {
+    uint64_t lost = 0;
+    if (packet.has_device_position) {
+      if (next_device_position_ != 0 && packet.device_position > next_device_position_) {
+        lost = packet.device_position - next_device_position_;
+      }
+      next_device_position_ = packet.device_position + packet.frames;
+    } else if (packet.discontinuity && next_device_time_ns_ != 0 &&
+               packet.device_time_ns > next_device_time_ns_) {
+      lost = static_cast<uint64_t>(static_cast<double>(packet.device_time_ns -
+                                                       next_device_time_ns_) *
+                                   sample_rate_ / 1e9);
+    }
+    next_device_time_ns_ =
+        packet.device_time_ns == 0
+            ? 0
+            : packet.device_time_ns + uint64_t{packet.frames} * 1000000000 / sample_rate_;
+    return lost;
+  }
+
+  bool Fits(size_t bytes) {
+    return pieces_.WriteAvailable() > 0 && bytes_.WriteAvailable() >= bytes;
+  }
+
+  void WakeConsumer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!consumer_waiting_.load(std::memory_order_relaxed)) return;
+    {
+      // Orders the push before a consumer that is about to wait.
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_.notify_one();
+  }
+
+  uint32_t sample_rate_ = 0;
+  size_t block_align_ = 0;
+  bool wait_when_full_ = false;
+  SpscRingBuffer<uint8_t> bytes_;
+  SpscRingBuffer<Piece> pieces_;
+
+  // Producer only.
+  uint64_t pending_skipped_frames_ = 0;
+  uint64_t pending_lost_frames_ = 0;
+  bool pending_discontinuity_ = false;
+  // Where the next packet should start if nothing is lost; 0 until known.
+  uint64_t next_device_position_ = 0;
+  uint64_t next_device_time_ns_ = 0;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  bool closed_ = false;
+  std::atomic<bool> consumer_waiting_{false};
+  std::atomic<bool> abandoned_{false};
+
+  std::atomic<uint64_t> overruns_{0};
+  std::atomic<uint64_t> overrun_frames_{0};
+};
+
+// Folds a dequeued piece into the consumer's counters.
+inline void CountPiece(const PacketQueue::Piece& piece, CaptureCounters* counters) {
+  counters->captured_input_frames += piece.frames + piece.skipped_frames;
+  if (piece.silent) counters->silent_input_frames += piece.frames;
+  if (piece.discontinuity) ++counters->discontinuities;
+}
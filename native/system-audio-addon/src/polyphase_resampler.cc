@@ -0,0 +1,277 @@
+#include "polyphase_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "simd_support.h"
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr uint32_t kMaxPhases = 1024;
+constexpr uint32_t kMaxTapsPerPhase = 1024;
+
+struct QualitySettings {
+  uint32_t taps_per_phase;
+  double kaiser_beta;
+  double passband_rolloff;
+};
+
+// The rolloff is the -6 dB point as a fraction of the lower Nyquist; each is
+// chosen so the transition band ends at that Nyquist, and anything that
+// would alias or image is down by the full stopband. Low latency delays by
+// 16 input frames, is flat to 0.7 x Nyquist and rejects >= 70 dB; high
+// fidelity delays by 32 frames, is flat to 0.8 x Nyquist and rejects
+// >= 96 dB. test/polyphase_resampler_test.cc holds them to that.
+QualitySettings SettingsFor(ResamplerQuality quality) {
+  switch (quality) {
+    case ResamplerQuality::kLowLatency:
+      return {32, 7.0, 0.84};
+    case ResamplerQuality::kHighFidelity:
+    default:
+      return {64, 10.0, 0.90};
+  }
+}
+
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  const double half_x = x / 2.0;
+  for (int k = 1; k < 64; ++k) {
+    term *= (half_x / k) * (half_x / k);
+    sum += term;
+    if (term < sum * 1e-12) break;
+  }
+  return sum;
+}
+
+float DotProductScalar(const float* a, const float* b, size_t count) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+#if defined(SYSTEM_AUDIO_SIMD_X86)
+float DotProductSse2(const float* a, const float* b, size_t count) {
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  __m128 sum = _mm_add_ps(sum0, sum1);
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+  float result = _mm_cvtss_f32(sum);
+  for (; i < count; ++i) {
+    result += a[i] * b[i];
+  }
+  return result;
+}
+
+SYSTEM_AUDIO_TARGET_AVX2 float DotProductAvx2(const float* a, const float* b, size_t count) {
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    sum0 = _mm256_add_ps(sum0,
+                         _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(
+        sum1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+  }
+  for (; i + 8 <= count; i += 8) {
+    sum0 = _mm256_add_ps(sum0,
+                         _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+  }
+  const __m256 sum = _mm256_add_ps(sum0, sum1);
+  __m128 folded = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  folded = _mm_add_ps(folded, _mm_movehl_ps(folded, folded));
+  folded = _mm_add_ss(folded, _mm_shuffle_ps(folded, folded, 0x55));
+  float result = _mm_cvtss_f32(folded);
+  for (; i < count; ++i) {
+    result += a[i] * b[i];
+  }
+  return result;
+}
+#endif
+
+#if defined(SYSTEM_AUDIO_SIMD_NEON)
+float DotProductNeon(const float* a, const float* b, size_t count) {
+  float32x4_t sum0 = vdupq_n_f32(0.0f);
+  float32x4_t sum1 = vdupq_n_f32(0.0f);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    sum0 = vmlaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum1 = vmlaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  const float32x4_t sum = vaddq_f32(sum0, sum1);
+  float32x2_t folded = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+  float result = vget_lane_f32(vpadd_f32(folded, folded), 0);
+  for (; i < count; ++i) {
+    result += a[i] * b[i];
+  }
+  return result;
+}
+#endif
+
+}  // namespace
+
+bool PolyphaseResampler::Configure(uint32_t input_rate,
+                                   uint32_t output_rate,
+                                   uint32_t channels,
+                                   ResamplerQuality quality,
+                                   std::string* error) {
+  if (input_rate == 0 || output_rate == 0 || channels == 0) {
+    if (error) *error = "Resampler needs non-zero rates and channel count.";
+    return false;
+  }
+
+  const uint32_t divisor = std::gcd(input_rate, output_rate);
+  const uint32_t interpolation = output_rate / divisor;
+  const uint32_t decimation = input_rate / divisor;
+  if (interpolation > kMaxPhases) {
+    if (error) {
+      *error = "Unsupported resampling ratio " + std::to_string(input_rate) + " -> " +
+               std::to_string(output_rate) + " Hz.";
+    }
+    return false;
+  }
+
+  const QualitySettings settings = SettingsFor(quality);
+
+  // When decimating, the cutoff drops by L/M, so widen the filter by the same
+  // factor to keep the transition band. Taps are a multiple of 8 so the SIMD
+  // loops never need a scalar tail.
+  const uint32_t widen = (decimation + interpolation - 1) / interpolation;
+  uint32_t taps = settings.taps_per_phase * std::max<uint32_t>(1, widen);
+  taps = std::min(kMaxTapsPerPhase, (taps + 7) & ~7u);
+
+  interpolation_ = interpolation;
+  decimation_ = decimation;
+  channels_ = channels;
+  taps_ = taps;
+
+  // Prototype low-pass at the upsampled rate (L x input), normalized so the
+  // cutoff sits just below the lower of the two Nyquist frequencies.
+  const size_t prototype_length = static_cast<size_t>(taps_) * interpolation_;
+  const double cutoff = 0.5 * settings.passband_rolloff /
+                        static_cast<double>(std::max(interpolation_, decimation_));
+  const double center = (static_cast<double>(prototype_length) - 1.0) / 2.0;
+  const double beta_norm = BesselI0(settings.kaiser_beta);
+
+  std::vector<double> prototype(prototype_length);
+  for (size_t n = 0; n < prototype_length; ++n) {
+    const double t = static_cast<double>(n) - center;
+    const double x = 2.0 * cutoff * t;
+    const double sinc = std::abs(x) < 1e-12 ? 1.0 : std::sin(kPi * x) / (kPi * x);
+    const double ratio = t / (center + 0.5);
+    const double window =
+        BesselI0(settings.kaiser_beta * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) /
+        beta_norm;
+    prototype[n] = 2.0 * cutoff * sinc * window;
+  }
+
+  // Split into phases. Each row is normalized to unity DC gain, which also
+  // applies the factor L an interpolator needs.
+  filter_bank_.assign(static_cast<size_t>(interpolation_) * taps_, 0.0f);
+  for (uint32_t phase = 0; phase < interpolation_; ++phase) {
+    float* row = filter_bank_.data() + static_cast<size_t>(phase) * taps_;
+    double sum = 0.0;
+    for (uint32_t tap = 0; tap < taps_; ++tap) {
+      sum += prototype[phase + static_cast<size_t>(tap) * interpolation_];
+    }
+    const double gain = std::abs(sum) > 1e-12 ? 1.0 / sum : 1.0;
+    for (uint32_t tap = 0; tap < taps_; ++tap) {
+      // Coefficient for x[n - tap] lands at the end of the row, so the row
+      // lines up with the oldest-to-newest history window.
+      row[taps_ - 1 - tap] = static_cast<float>(
+          prototype[phase + static_cast<size_t>(tap) * interpolation_] * gain);
+    }
+  }
+
+  dot_product_ = DotProductScalar;
+#if defined(SYSTEM_AUDIO_SIMD_X86)
+  dot_product_ = CpuSupportsAvx2() ? DotProductAvx2 : DotProductSse2;
+#elif defined(SYSTEM_AUDIO_SIMD_NEON)
+  dot_product_ = DotProductNeon;
+#endif
+
+  history_.assign(static_cast<size_t>(channels_) * taps_ * 2, 0.0f);
+  Reset();
+  return true;
+}
+
+void PolyphaseResampler::Reset() {
+  std::fill(history_.begin(), history_.end(), 0.0f);
+  history_position_ = 0;
+  phase_ = 0;
+}
+
+size_t PolyphaseResampler::MaxOutputFrames(size_t input_frames) const {
+  if (decimation_ == 0) return 0;
+  return (input_frames * interpolation_ + decimation_ - 1) / decimation_ + 1;
+}
+
+size_t PolyphaseResampler::Process(const float* input,
+                                   size_t input_frames,
+                                   float* output,
+                                   size_t output_capacity) {
+  if (!input || !output || taps_ == 0) return 0;
+
+  const size_t history_stride = static_cast<size_t>(taps_) * 2;
+  size_t produced = 0;
+
+  for (size_t frame = 0; frame < input_frames; ++frame) {
+    const float* samples = input + frame * channels_;
+    for (uint32_t channel = 0; channel < channels_; ++channel) {
+      float* history = history_.data() + channel * history_stride;
+      history[history_position_] = samples[channel];
+      history[history_position_ + taps_] = samples[channel];
+    }
+    history_position_ = history_position_ + 1 == taps_ ? 0 : history_position_ + 1;
+
+    while (phase_ < interpolation_) {
+      if (produced < output_capacity) {
+        const float* row = filter_bank_.data() + static_cast<size_t>(phase_) * taps_;
+        float* out = output + produced * channels_;
+        for (uint32_t channel = 0; channel < channels_; ++channel) {
+          const float* window =
+              history_.data() + channel * history_stride + history_position_;
+          out[channel] = dot_product_(window, row, taps_);
+        }
+        ++produced;
+      }
+      phase_ += decimation_;
+    }
+    phase_ -= interpolation_;
+  }
+
+  return produced;
+}
+
+const char* ResamplerQualityName(ResamplerQuality quality) {
+  switch (quality) {
+    case ResamplerQuality::kLowLatency:
+      return "low-latency";
+    case ResamplerQuality::kHighFidelity:
+    default:
+      return "high-fidelity";
+  }
+}
+
+bool ParseResamplerQuality(const std::string& name, ResamplerQuality* quality) {
+  if (!quality) return false;
+  if (name == "low-latency") {
+    *quality = ResamplerQuality::kLowLatency;
+    return true;
+  }
+  if (name == "high-fidelity") {
+    *quality = ResamplerQuality::kHighFidelity;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class ResamplerQuality {
+  kLowLatency,
+  kHighFidelity,
+};
+
+// Rational-ratio polyphase resampler built from a Kaiser-windowed sinc
+// prototype. The filter bank is computed once in Configure(); Process() only
+// runs one SIMD dot product per output sample and channel and never
+// allocates.
+class PolyphaseResampler {
+ public:
+  PolyphaseResampler() = default;
+
+  bool Configure(uint32_t input_rate,
+                 uint32_t output_rate,
+                 uint32_t channels,
+                 ResamplerQuality quality,
+                 std::string* error);
+  void Reset();
+
+  // Upper bound on frames produced by one Process() call for `input_frames`.
+  size_t MaxOutputFrames(size_t input_frames) const;
+
+  // Consumes interleaved float frames and writes interleaved output frames.
+  // Returns the number of frames written; size `output` with MaxOutputFrames.
+  size_t Process(const float* input,
+                 size_t input_frames,
+                 float* output,
+                 size_t output_capacity);
+
+  uint32_t interpolation() const { return interpolation_; }
+  uint32_t decimation() const { return decimation_; }
+  uint32_t taps_per_phase() const { return taps_; }
+  // Group delay of the filter, in input frames.
+  uint32_t latency_frames() const { return taps_ / 2; }
+
+ private:
+  using DotProductFn = float (*)(const float* a, const float* b, size_t count);
+
+  uint32_t interpolation_ = 1;
+  uint32_t decimation_ = 1;
+  uint32_t channels_ = 0;
+  uint32_t taps_ = 0;
+
+  // phases x taps, each row ordered oldest-to-newest input sample.
+  std::vector<float> filter_bank_;
+  // Per channel, `taps_` samples stored twice so the window is contiguous.
+  std::vector<float> history_;
+  uint32_t history_position_ = 0;
+  uint32_t phase_ = 0;
+
+  DotProductFn dot_product_ = nullptr;
+};
+
+const char* ResamplerQualityName(ResamplerQuality quality);
+bool ParseResamplerQuality(const std::string& name, ResamplerQuality* quality);
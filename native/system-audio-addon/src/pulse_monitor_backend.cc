@@ -0,0 +1,140 @@
+#include "pulse_monitor_backend.h"
+
+#include <pulse/channelmap.h>
+#include <pulse/error.h>
+#include <pulse/sample.h>
+
+#include <algorithm>
+
+#include "channel_mixer.h"
+
+namespace {
+
+// Monitor of whatever sink is currently the default, resolved by the server.
+constexpr const char* kDefaultMonitorSource = "@DEFAULT_MONITOR@";
+
+std::string PulseErrorToString(const char* stage, int code) {
+  return std::string(stage) + " failed: " + pa_strerror(code);
+}
+
+}  // namespace
+
+PulseMonitorBackend::PulseMonitorBackend() = default;
+
+PulseMonitorBackend::~PulseMonitorBackend() {
+  Close();
+}
+
+bool PulseMonitorBackend::Open(const CaptureConfig& config,
+                               InputFormatInfo* format,
+                               std::string* error) {
+  // The server converts the monitor to the requested spec, so ask for the
+  // output rate and layout directly and let the pipeline skip its own
+  // resampling and mixing.
+  pa_sample_spec spec;
+  spec.format = PA_SAMPLE_FLOAT32LE;
+  spec.rate = config.target_sample_rate;
+  spec.channels = static_cast<uint8_t>(config.target_channels);
+  if (!pa_sample_spec_valid(&spec)) {
+    if (error) *error = "PulseAudio rejects the requested sample rate or channel count.";
+    return false;
+  }
+
+  // WAVEEX order keeps channel positions in dwChannelMask bit order, which
+  // is what the mixer expects.
+  pa_channel_map channel_map;
+  const pa_channel_map* map =
+      pa_channel_map_init_auto(&channel_map, spec.channels, PA_CHANNEL_MAP_WAVEEX);
+
+  sample_rate_ = spec.rate;
+  packet_frames_ = std::max<uint32_t>(
+      1, static_cast<uint32_t>(static_cast<uint64_t>(spec.rate) * config.source.packet_ms / 1000));
+  packet_.resize(static_cast<size_t>(packet_frames_) * pa_frame_size(&spec));
+
+  // A fragment of one packet makes the server deliver in packet-sized pieces
+  // instead of its default ~2 s record fragments.
+  pa_buffer_attr buffer_attr;
+  buffer_attr.maxlength = static_cast<uint32_t>(-1);
+  buffer_attr.tlength = static_cast<uint32_t>(-1);
+  buffer_attr.prebuf = static_cast<uint32_t>(-1);
+  buffer_attr.minreq = static_cast<uint32_t>(-1);
+  buffer_attr.fragsize = static_cast<uint32_t>(packet_.size());
+
+  const char* device =
+      config.source.device.empty() ? kDefaultMonitorSource : config.source.device.c_str();
+
+  int code = 0;
+  stream_ = pa_simple_new(nullptr, "MiraxShare", PA_STREAM_RECORD, device, "System audio",
+                          &spec, map, &buffer_attr, &code);
+  if (!stream_) {
+    if (error) *error = PulseErrorToString("pa_simple_new", code);
+    return false;
+  }
+
+  format->sample_format = SampleFormat::kFloat32;
+  format->sample_rate = spec.rate;
+  format->channels = spec.channels;
+  format->bits_per_sample = 32;
+  format->valid_bits_per_sample = 32;
+  format->channel_mask = DefaultChannelMask(spec.channels);
+  return true;
+}
+
+bool PulseMonitorBackend::Start(std::string* error) {
+  // A simple stream records from the moment it is created, so a device
+  // held open in standby has a backlog of audio nobody asked for.
+  packet_ready_ = false;
+  int code = 0;
+  if (pa_simple_flush(stream_, &code) < 0) {
+    if (error) *error = PulseErrorToString("pa_simple_flush", code);
+    return false;
+  }
+  return true;
+}
+
+bool PulseMonitorBackend::WaitForData(uint32_t /*timeout_ms*/, std::string* error) {
+  // pa_simple_read blocks for exactly one packet, which bounds how long
+  // Stop() waits to the packet duration.
+  int code = 0;
+  if (pa_simple_read(stream_, packet_.data(), packet_.size(), &code) < 0) {
+    if (error) *error = PulseErrorToString("pa_simple_read", code);
+    return false;
+  }
+  packet_ready_ = true;
+
+  // The packet's last frame was captured `latency` before now (the data
+  // still queued behind it), and its first frame one packet before that.
+  packet_device_time_ns_ = 0;
+  const pa_usec_t latency_us = pa_simple_get_latency(stream_, &code);
+  if (latency_us != static_cast<pa_usec_t>(-1)) {
+    const uint64_t packet_ns = static_cast<uint64_t>(packet_frames_) * 1000000000 / sample_rate_;
+    const uint64_t behind_ns = static_cast<uint64_t>(latency_us) * 1000 + packet_ns;
+    const uint64_t now_ns = MonotonicNowNs();
+    packet_device_time_ns_ = now_ns > behind_ns ? now_ns - behind_ns : 0;
+  }
+  return true;
+}
+
+PacketStatus PulseMonitorBackend::ReadPacket(CapturePacket* packet, std::string* /*error*/) {
+  if (!packet_ready_) {
+    return PacketStatus::kEmpty;
+  }
+  packet_ready_ = false;
+  packet->frames = packet_frames_;
+  packet->device_time_ns = packet_device_time_ns_;
+  packet->silent = false;
+  packet->data = packet_.data();
+  return PacketStatus::kPacket;
+}
+
+bool PulseMonitorBackend::ReleasePacket(const CapturePacket& /*packet*/, std::string* /*error*/) {
+  return true;
+}
+
+void PulseMonitorBackend::Close() {
+  if (stream_) {
+    pa_simple_free(stream_);
+    stream_ = nullptr;
+  }
+  packet_ready_ = false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <pulse/simple.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "capture_backend.h"
+
+// Records the monitor source of the default sink through the PulseAudio
+// simple API, which PipeWire's pulse server implements as well.
+class PulseMonitorBackend : public CaptureBackend {
+ public:
+  PulseMonitorBackend();
+  ~PulseMonitorBackend() override;
+
+  const char* name() const override { return "pulse"; }
+
+  bool Open(const CaptureConfig& config,
+            InputFormatInfo* format,
+            std::string* error) override;
+  bool Start(std::string* error) override;
+  bool WaitForData(uint32_t timeout_ms, std::string* error) override;
+  PacketStatus ReadPacket(CapturePacket* packet, std::string* error) override;
+  bool ReleasePacket(const CapturePacket& packet, std::string* error) override;
+  // Wake() is left out: a read blocks for one packet at most.
+  void Stop() override {}
+  void Close() override;
+
+ private:
+  pa_simple* stream_ = nullptr;
+  uint32_t packet_frames_ = 0;
+  uint32_t sample_rate_ = 0;
+  std::vector<uint8_t> packet_;
+  bool packet_ready_ = false;
+  uint64_t packet_device_time_ns_ = 0;
+};
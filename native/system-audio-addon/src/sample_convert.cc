@@ -0,0 +1,499 @@
+#include "sample_convert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd_support.h"
+
+namespace {
+
+// Packets are converted through a stack block of this many samples when the
+// int16 path has to go through float.
+constexpr size_t kBlockSamples = 1024;
+
+constexpr float kInt16Scale = 1.0f / 32768.0f;
+constexpr float kInt24Scale = 1.0f / 8388608.0f;
+constexpr float kInt32Scale = 1.0f / 2147483648.0f;
+
+template <SampleFormat F>
+struct FormatTraits;
+
+template <>
+struct FormatTraits<SampleFormat::kFloat32> {
+  static constexpr size_t kBytes = 4;
+  static float Load(const uint8_t* sample) {
+    float value;
+    std::memcpy(&value, sample, sizeof(value));
+    return value;
+  }
+};
+
+template <>
+struct FormatTraits<SampleFormat::kInt16> {
+  static constexpr size_t kBytes = 2;
+  static float Load(const uint8_t* sample) {
+    int16_t value;
+    std::memcpy(&value, sample, sizeof(value));
+    return static_cast<float>(value) * kInt16Scale;
+  }
+};
+
+template <>
+struct FormatTraits<SampleFormat::kInt24> {
+  static constexpr size_t kBytes = 3;
+  static float Load(const uint8_t* sample) {
+    const int32_t value = static_cast<int32_t>((static_cast<uint32_t>(sample[0]) << 8) |
+                                               (static_cast<uint32_t>(sample[1]) << 16) |
+                                               (static_cast<uint32_t>(sample[2]) << 24));
+    return static_cast<float>(value >> 8) * kInt24Scale;
+  }
+};
+
+template <>
+struct FormatTraits<SampleFormat::kInt24In32> {
+  static constexpr size_t kBytes = 4;
+  static float Load(const uint8_t* sample) {
+    int32_t value;
+    std::memcpy(&value, sample, sizeof(value));
+    return static_cast<float>(value >> 8) * kInt24Scale;
+  }
+};
+
+template <>
+struct FormatTraits<SampleFormat::kInt32> {
+  static constexpr size_t kBytes = 4;
+  static float Load(const uint8_t* sample) {
+    int32_t value;
+    std::memcpy(&value, sample, sizeof(value));
+    return static_cast<float>(value) * kInt32Scale;
+  }
+};
+
+// Contiguous (same channel layout) conversion to float. The generic version
+// covers packed 24-bit; the others are vectorized where the ISA allows.
+template <SampleFormat F>
+void DecodeContiguous(const uint8_t* input, size_t count, float* output) {
+  for (size_t i = 0; i < count; ++i) {
+    output[i] = FormatTraits<F>::Load(input + i * FormatTraits<F>::kBytes);
+  }
+}
+
+template <>
+void DecodeContiguous<SampleFormat::kFloat32>(const uint8_t* input,
+                                              size_t count,
+                                              float* output) {
+  std::memcpy(output, input, count * sizeof(float));
+}
+
+template <>
+void DecodeContiguous<SampleFormat::kInt16>(const uint8_t* input,
+                                            size_t count,
+                                            float* output) {
+  size_t i = 0;
+#if defined(SYSTEM_AUDIO_SIMD_X86)
+  const __m128 scale = _mm_set1_ps(kInt16Scale);
+  for (; i + 8 <= count; i += 8) {
+    const __m128i packed =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 2));
+    const __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+    const __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(packed, packed), 16);
+    _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+    _mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+  }
+#elif defined(SYSTEM_AUDIO_SIMD_NEON)
+  const float32x4_t scale = vdupq_n_f32(kInt16Scale);
+  for (; i + 8 <= count; i += 8) {
+    const int16x8_t packed = vld1q_s16(reinterpret_cast<const int16_t*>(input + i * 2));
+    vst1q_f32(output + i,
+              vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(packed))), scale));
+    vst1q_f32(output + i + 4,
+              vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(packed))), scale));
+  }
+#endif
+  for (; i < count; ++i) {
+    output[i] = FormatTraits<SampleFormat::kInt16>::Load(input + i * 2);
+  }
+}
+
+// 32-bit integer containers share one kernel: kShift drops the padding byte
+// of left-justified 24-bit samples.
+template <int kShift>
+void DecodeInt32Contiguous(const uint8_t* input, size_t count, float scale, float* output) {
+  size_t i = 0;
+#if defined(SYSTEM_AUDIO_SIMD_X86)
+  const __m128 scale_vec = _mm_set1_ps(scale);
+  for (; i + 4 <= count; i += 4) {
+    __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i * 4));
+    if constexpr (kShift > 0) value = _mm_srai_epi32(value, kShift);
+    _mm_storeu_ps(output + i, _mm_mul_ps(_mm_cvtepi32_ps(value), scale_vec));
+  }
+#elif defined(SYSTEM_AUDIO_SIMD_NEON)
+  const float32x4_t scale_vec = vdupq_n_f32(scale);
+  for (; i + 4 <= count; i += 4) {
+    int32x4_t value = vld1q_s32(reinterpret_cast<const int32_t*>(input + i * 4));
+    if constexpr (kShift > 0) value = vshrq_n_s32(value, kShift);
+    vst1q_f32(output + i, vmulq_f32(vcvtq_f32_s32(value), scale_vec));
+  }
+#endif
+  for (; i < count; ++i) {
+    int32_t value;
+    std::memcpy(&value, input + i * 4, sizeof(value));
+    output[i] = static_cast<float>(value >> kShift) * scale;
+  }
+}
+
+template <>
+void DecodeContiguous<SampleFormat::kInt24In32>(const uint8_t* input,
+                                                size_t count,
+                                                float* output) {
+  DecodeInt32Contiguous<8>(input, count, kInt24Scale, output);
+}
+
+template <>
+void DecodeContiguous<SampleFormat::kInt32>(const uint8_t* input,
+                                            size_t count,
+                                            float* output) {
+  DecodeInt32Contiguous<0>(input, count, kInt32Scale, output);
+}
+
+// InCh/OutCh of 0 mean "known only at runtime".
+template <SampleFormat F, uint32_t InCh, uint32_t OutCh>
+void DecodeToFloat(const uint8_t* input,
+                   size_t frames,
+                   uint32_t input_channels,
+                   uint32_t output_channels,
+                   float* output) {
+  const uint32_t in_channels = InCh ? InCh : input_channels;
+  const uint32_t out_channels = OutCh ? OutCh : output_channels;
+  if (in_channels == 0 || out_channels == 0) return;
+
+  if (in_channels == out_channels) {
+    DecodeContiguous<F>(input, frames * in_channels, output);
+    return;
+  }
+
+  constexpr size_t kBytes = FormatTraits<F>::kBytes;
+  const size_t stride = static_cast<size_t>(in_channels) * kBytes;
+  for (size_t frame = 0; frame < frames; ++frame) {
+    const uint8_t* source = input + frame * stride;
+    float* destination = output + frame * out_channels;
+    for (uint32_t channel = 0; channel < out_channels; ++channel) {
+      const uint32_t source_channel = std::min(channel, in_channels - 1);
+      destination[channel] = FormatTraits<F>::Load(source + source_channel * kBytes);
+    }
+  }
+}
+
+template <uint32_t InCh, uint32_t OutCh>
+void CopyInt16(const uint8_t* input,
+               size_t frames,
+               uint32_t input_channels,
+               uint32_t output_channels,
+               int16_t* output) {
+  const uint32_t in_channels = InCh ? InCh : input_channels;
+  const uint32_t out_channels = OutCh ? OutCh : output_channels;
+  if (in_channels == 0 || out_channels == 0) return;
+
+  if (in_channels == out_channels) {
+    std::memcpy(output, input, frames * in_channels * sizeof(int16_t));
+    return;
+  }
+
+  const auto* source = reinterpret_cast<const int16_t*>(input);
+  for (size_t frame = 0; frame < frames; ++frame) {
+    for (uint32_t channel = 0; channel < out_channels; ++channel) {
+      output[frame * out_channels + channel] =
+          source[frame * in_channels + std::min(channel, in_channels - 1)];
+    }
+  }
+}
+
+template <SampleFormat F, uint32_t InCh, uint32_t OutCh>
+void DecodeToInt16ViaFloat(const uint8_t* input,
+                           size_t frames,
+                           uint32_t input_channels,
+                           uint32_t output_channels,
+                           int16_t* output,
+                           TpdfDither* dither) {
+  const uint32_t in_channels = InCh ? InCh : input_channels;
+  const uint32_t out_channels = OutCh ? OutCh : output_channels;
+  if (in_channels == 0 || out_channels == 0) return;
+
+  float block[kBlockSamples];
+  const size_t block_frames = std::max<size_t>(1, kBlockSamples / out_channels);
+  const size_t stride = static_cast<size_t>(in_channels) * FormatTraits<F>::kBytes;
+  for (size_t done = 0; done < frames; done += block_frames) {
+    const size_t count = std::min(block_frames, frames - done);
+    DecodeToFloat<F, InCh, OutCh>(input + done * stride, count, in_channels,
+                                  out_channels, block);
+    FloatToInt16(block, count * out_channels, output + done * out_channels, dither);
+  }
+}
+
+template <SampleFormat F, uint32_t InCh, uint32_t OutCh>
+void DecodeToInt16(const uint8_t* input,
+                   size_t frames,
+                   uint32_t input_channels,
+                   uint32_t output_channels,
+                   int16_t* output,
+                   TpdfDither* dither) {
+  if constexpr (F == SampleFormat::kInt16) {
+    CopyInt16<InCh, OutCh>(input, frames, input_channels, output_channels, output);
+  } else {
+    DecodeToInt16ViaFloat<F, InCh, OutCh>(input, frames, input_channels, output_channels,
+                                          output, dither);
+  }
+}
+
+template <SampleFormat F, uint32_t InCh>
+FloatDecodeFn PickFloatDecoder(uint32_t output_channels) {
+  switch (output_channels) {
+    case 1:
+      return &DecodeToFloat<F, InCh, 1>;
+    case 2:
+      return &DecodeToFloat<F, InCh, 2>;
+    default:
+      return &DecodeToFloat<F, InCh, 0>;
+  }
+}
+
+template <SampleFormat F>
+FloatDecodeFn PickFloatDecoder(uint32_t input_channels, uint32_t output_channels) {
+  switch (input_channels) {
+    case 1:
+      return PickFloatDecoder<F, 1>(output_channels);
+    case 2:
+      return PickFloatDecoder<F, 2>(output_channels);
+    case 6:
+      return PickFloatDecoder<F, 6>(output_channels);
+    case 8:
+      return PickFloatDecoder<F, 8>(output_channels);
+    default:
+      return PickFloatDecoder<F, 0>(output_channels);
+  }
+}
+
+template <SampleFormat F, uint32_t InCh>
+Int16DecodeFn PickInt16Decoder(uint32_t output_channels) {
+  switch (output_channels) {
+    case 1:
+      return &DecodeToInt16<F, InCh, 1>;
+    case 2:
+      return &DecodeToInt16<F, InCh, 2>;
+    default:
+      return &DecodeToInt16<F, InCh, 0>;
+  }
+}
+
+template <SampleFormat F>
+Int16DecodeFn PickInt16Decoder(uint32_t input_channels, uint32_t output_channels) {
+  switch (input_channels) {
+    case 1:
+      return PickInt16Decoder<F, 1>(output_channels);
+    case 2:
+      return PickInt16Decoder<F, 2>(output_channels);
+    case 6:
+      return PickInt16Decoder<F, 6>(output_channels);
+    case 8:
+      return PickInt16Decoder<F, 8>(output_channels);
+    default:
+      return PickInt16Decoder<F, 0>(output_channels);
+  }
+}
+
+// A uniform draw in [0, 1) from the top 24 bits of an xorshift32 state,
+// which converts exactly on every ISA.
+constexpr float kUniformScale = 1.0f / 16777216.0f;
+
+// xorshift32; two draws make one triangular sample in (-1, 1) LSB.
+inline float NextTpdf(TpdfDither* dither) {
+  auto next = [dither]() {
+    uint32_t x = dither->state[0];
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    dither->state[0] = x;
+    return static_cast<float>(x >> 8) * kUniformScale;
+  };
+  return next() - next();
+}
+
+// The same generator on four lanes at once.
+#if defined(SYSTEM_AUDIO_SIMD_X86)
+inline __m128 NextUniform4(__m128i* state) {
+  __m128i x = *state;
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+  x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+  *state = x;
+  return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), _mm_set1_ps(kUniformScale));
+}
+
+inline __m128 NextTpdf4(__m128i* state) {
+  const __m128 first = NextUniform4(state);
+  return _mm_sub_ps(first, NextUniform4(state));
+}
+#elif defined(SYSTEM_AUDIO_SIMD_NEON)
+inline float32x4_t NextUniform4(uint32x4_t* state) {
+  uint32x4_t x = *state;
+  x = veorq_u32(x, vshlq_n_u32(x, 13));
+  x = veorq_u32(x, vshrq_n_u32(x, 17));
+  x = veorq_u32(x, vshlq_n_u32(x, 5));
+  *state = x;
+  return vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(x, 8)), kUniformScale);
+}
+
+inline float32x4_t NextTpdf4(uint32x4_t* state) {
+  const float32x4_t first = NextUniform4(state);
+  return vsubq_f32(first, NextUniform4(state));
+}
+#endif
+
+}  // namespace
+
+FloatDecodeFn SelectFloatDecoder(SampleFormat format,
+                                 uint32_t input_channels,
+                                 uint32_t output_channels) {
+  switch (format) {
+    case SampleFormat::kFloat32:
+      return PickFloatDecoder<SampleFormat::kFloat32>(input_channels, output_channels);
+    case SampleFormat::kInt16:
+      return PickFloatDecoder<SampleFormat::kInt16>(input_channels, output_channels);
+    case SampleFormat::kInt24:
+      return &DecodeToFloat<SampleFormat::kInt24, 0, 0>;
+    case SampleFormat::kInt24In32:
+      return PickFloatDecoder<SampleFormat::kInt24In32>(input_channels, output_channels);
+    case SampleFormat::kInt32:
+      return PickFloatDecoder<SampleFormat::kInt32>(input_channels, output_channels);
+    default:
+      return nullptr;
+  }
+}
+
+Int16DecodeFn SelectInt16Decoder(SampleFormat format,
+                                 uint32_t input_channels,
+                                 uint32_t output_channels) {
+  switch (format) {
+    case SampleFormat::kFloat32:
+      return PickInt16Decoder<SampleFormat::kFloat32>(input_channels, output_channels);
+    case SampleFormat::kInt16:
+      return PickInt16Decoder<SampleFormat::kInt16>(input_channels, output_channels);
+    case SampleFormat::kInt24:
+      return &DecodeToInt16<SampleFormat::kInt24, 0, 0>;
+    case SampleFormat::kInt24In32:
+      return PickInt16Decoder<SampleFormat::kInt24In32>(input_channels, output_channels);
+    case SampleFormat::kInt32:
+      return PickInt16Decoder<SampleFormat::kInt32>(input_channels, output_channels);
+    default:
+      return nullptr;
+  }
+}
+
+size_t BytesPerSample(SampleFormat format) {
+  switch (format) {
+    case SampleFormat::kInt16:
+      return 2;
+    case SampleFormat::kInt24:
+      return 3;
+    case SampleFormat::kFloat32:
+    case SampleFormat::kInt24In32:
+    case SampleFormat::kInt32:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+void FloatToInt16(const float* input, size_t count, int16_t* output, TpdfDither* dither) {
+  constexpr float kScale = 32767.0f;
+  const bool use_dither = dither && dither->enabled;
+
+  size_t i = 0;
+#if defined(SYSTEM_AUDIO_SIMD_X86)
+  const __m128 scale = _mm_set1_ps(kScale);
+  const __m128 lower = _mm_set1_ps(-1.0f);
+  const __m128 upper = _mm_set1_ps(1.0f);
+  if (use_dither) {
+    // Packing saturates, which is the clamp the scalar path applies after
+    // adding the noise.
+    __m128i state_a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dither->state));
+    __m128i state_b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dither->state + 4));
+    for (; i + 8 <= count; i += 8) {
+      const __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i), lower), upper);
+      const __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i + 4), lower), upper);
+      const __m128 noisy_a = _mm_add_ps(_mm_mul_ps(a, scale), NextTpdf4(&state_a));
+      const __m128 noisy_b = _mm_add_ps(_mm_mul_ps(b, scale), NextTpdf4(&state_b));
+      const __m128i packed =
+          _mm_packs_epi32(_mm_cvtps_epi32(noisy_a), _mm_cvtps_epi32(noisy_b));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dither->state), state_a);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dither->state + 4), state_b);
+  } else {
+    for (; i + 8 <= count; i += 8) {
+      const __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i), lower), upper);
+      const __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(input + i + 4), lower), upper);
+      const __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(a, scale)),
+                                             _mm_cvtps_epi32(_mm_mul_ps(b, scale)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), packed);
+    }
+  }
+#elif defined(SYSTEM_AUDIO_SIMD_NEON)
+  const float32x4_t scale = vdupq_n_f32(kScale);
+  if (use_dither) {
+    const float32x4_t lower = vdupq_n_f32(-1.0f);
+    const float32x4_t upper = vdupq_n_f32(1.0f);
+    uint32x4_t state_a = vld1q_u32(dither->state);
+    uint32x4_t state_b = vld1q_u32(dither->state + 4);
+    for (; i + 8 <= count; i += 8) {
+      const float32x4_t a = vminq_f32(vmaxq_f32(vld1q_f32(input + i), lower), upper);
+      const float32x4_t b = vminq_f32(vmaxq_f32(vld1q_f32(input + i + 4), lower), upper);
+      const int32x4_t noisy_a = vcvtnq_s32_f32(vmlaq_f32(NextTpdf4(&state_a), a, scale));
+      const int32x4_t noisy_b = vcvtnq_s32_f32(vmlaq_f32(NextTpdf4(&state_b), b, scale));
+      vst1q_s16(output + i, vcombine_s16(vqmovn_s32(noisy_a), vqmovn_s32(noisy_b)));
+    }
+    vst1q_u32(dither->state, state_a);
+    vst1q_u32(dither->state + 4, state_b);
+  } else {
+    for (; i + 8 <= count; i += 8) {
+      const int32x4_t a = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(input + i), scale));
+      const int32x4_t b = vcvtnq_s32_f32(vmulq_f32(vld1q_f32(input + i + 4), scale));
+      vst1q_s16(output + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+  }
+#endif
+
+  for (; i < count; ++i) {
+    float scaled = std::clamp(input[i], -1.0f, 1.0f) * kScale;
+    if (use_dither) scaled += NextTpdf(dither);
+    output[i] = static_cast<int16_t>(std::lrintf(std::clamp(scaled, -32768.0f, 32767.0f)));
+  }
+}
+
+void DeinterleaveFloat(const float* input, size_t frames, uint32_t channels, float* planes) {
+  if (channels == 2) {
+    float* left = planes;
+    float* right = planes + frames;
+    for (size_t frame = 0; frame < frames; ++frame) {
+      left[frame] = input[2 * frame];
+      right[frame] = input[2 * frame + 1];
+    }
+    return;
+  }
+  for (uint32_t channel = 0; channel < channels; ++channel) {
+    float* plane = planes + channel * frames;
+    for (size_t frame = 0; frame < frames; ++frame) {
+      plane[frame] = input[frame * channels + channel];
+    }
+  }
+}
+
+void InterleaveFloat(const float* planes, size_t frames, uint32_t channels, float* output) {
+  for (uint32_t channel = 0; channel < channels; ++channel) {
+    const float* plane = planes + channel * frames;
+    for (size_t frame = 0; frame < frames; ++frame) {
+      output[frame * channels + channel] = plane[frame];
+    }
+  }
+}
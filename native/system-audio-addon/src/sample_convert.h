@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class SampleFormat {
+  kUnknown,
+  kFloat32,
+  kInt16,
+  kInt24,        // Packed 3-byte samples.
+  kInt24In32,    // 24 valid bits left-justified in a 32-bit container.
+  kInt32,
+};
+
+struct InputFormatInfo {
+  SampleFormat sample_format = SampleFormat::kUnknown;
+  uint32_t sample_rate = 0;
+  uint16_t channels = 0;
+  uint16_t bits_per_sample = 0;
+  uint16_t valid_bits_per_sample = 0;
+  // WAVEFORMATEXTENSIBLE speaker mask; see channel_mixer.h.
+  uint32_t channel_mask = 0;
+};
+
+// Triangular-PDF dither of +/-1 LSB applied before quantizing to int16.
+// Eight independent xorshift32 generators, one per lane of the two vectors
+// the SIMD quantizer handles per step, so it draws eight samples' noise at
+// once without one long dependency chain; the scalar tail uses lane 0.
+struct TpdfDither {
+  bool enabled = false;
+  uint32_t state[8] = {0x9e3779b9u, 0x7f4a7c15u, 0x85ebca6bu, 0xc2b2ae35u,
+                       0x27d4eb2fu, 0x165667b1u, 0xd3a2646cu, 0xfd7046c5u};
+};
+
+// Whole-packet converters from interleaved device samples to interleaved
+// output frames. Output channel c reads input channel min(c, inputs - 1).
+// Specialized at compile time for the common format/channel combinations;
+// the channel arguments only matter for the generic fallbacks.
+using FloatDecodeFn = void (*)(const uint8_t* input,
+                               size_t frames,
+                               uint32_t input_channels,
+                               uint32_t output_channels,
+                               float* output);
+using Int16DecodeFn = void (*)(const uint8_t* input,
+                               size_t frames,
+                               uint32_t input_channels,
+                               uint32_t output_channels,
+                               int16_t* output,
+                               TpdfDither* dither);
+
+FloatDecodeFn SelectFloatDecoder(SampleFormat format,
+                                 uint32_t input_channels,
+                                 uint32_t output_channels);
+Int16DecodeFn SelectInt16Decoder(SampleFormat format,
+                                 uint32_t input_channels,
+                                 uint32_t output_channels);
+
+size_t BytesPerSample(SampleFormat format);
+
+// Quantizes `count` float samples in [-1, 1] to int16, saturating.
+void FloatToInt16(const float* input, size_t count, int16_t* output, TpdfDither* dither);
+
+// Between interleaved frames and one contiguous plane of `frames` samples
+// per channel, channel after channel.
+void DeinterleaveFloat(const float* input, size_t frames, uint32_t channels, float* planes);
+void InterleaveFloat(const float* planes, size_t frames, uint32_t channels, float* output);
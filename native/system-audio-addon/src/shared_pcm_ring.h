@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// SPSC PCM ring laid out in caller-owned shared memory (a SharedArrayBuffer)
+// so JavaScript can read it with Atomics while the capture thread writes.
+// The layout must match src/audio/sharedPcmRing.js:
+//
+//   bytes [0, 64)   int32 header, indexed by SharedRingSlot
+//   bytes [64, ...) samples in the header's SharedRingFormat: int16 frames
+//                   interleaved, or one float32 plane of capacity_frames per
+//                   channel, so the worklet copies a channel with set()
+//
+// Frame indices are free-running uint32 counters stored as int32, so
+// `write - read` is the occupancy even after they wrap. Capacity is a power
+// of two so `index % capacity` stays continuous across that wrap.
+enum SharedRingSlot : uint32_t {
+  kSharedRingMagic = 0,
+  kSharedRingVersion = 1,
+  kSharedRingCapacityFrames = 2,
+  kSharedRingChannels = 3,
+  kSharedRingSampleRate = 4,
+  kSharedRingWriteFrame = 5,
+  kSharedRingReadFrame = 6,
+  kSharedRingWriteSequence = 7,
+  kSharedRingOverrunFrames = 8,
+  kSharedRingUnderrunFrames = 9,
+  kSharedRingSampleFormat = 10,
+  kSharedRingHeaderSlots = 16,
+};
+
+enum SharedRingFormat : int32_t {
+  kSharedRingInt16 = 0,
+  kSharedRingFloat32Planar = 1,
+};
+
+constexpr int32_t kSharedRingMagicValue = 0x474e4952;  // "RING"
+constexpr int32_t kSharedRingVersionValue = 2;
+constexpr size_t kSharedRingHeaderBytes = kSharedRingHeaderSlots * sizeof(int32_t);
+
+struct SharedRingStats {
+  uint32_t capacity_frames = 0;
+  uint32_t occupancy_frames = 0;
+  uint32_t overrun_frames = 0;
+  uint32_t underrun_frames = 0;
+  uint32_t write_sequence = 0;
+};
+
+// Producer side. The reader owns kSharedRingReadFrame and
+// kSharedRingUnderrunFrames; everything else is written here.
+class SharedPcmRingWriter {
+ public:
+  // Validates a header that JS initialized; returns false if the region is
+  // too small or the header does not describe this layout.
+  bool Attach(void* memory, size_t byte_length) {
+    if (!memory || byte_length < kSharedRingHeaderBytes) return false;
+    auto* header = static_cast<int32_t*>(memory);
+    if (header[kSharedRingMagic] != kSharedRingMagicValue ||
+        header[kSharedRingVersion] != kSharedRingVersionValue) {
+      return false;
+    }
+    const int32_t capacity = header[kSharedRingCapacityFrames];
+    const int32_t channels = header[kSharedRingChannels];
+    const int32_t format = header[kSharedRingSampleFormat];
+    if (format != kSharedRingInt16 && format != kSharedRingFloat32Planar) return false;
+    const size_t sample_bytes = format == kSharedRingInt16 ? sizeof(int16_t) : sizeof(float);
+    if (capacity <= 0 || (capacity & (capacity - 1)) != 0 || channels <= 0 ||
+        kSharedRingHeaderBytes + static_cast<size_t>(capacity) * channels * sample_bytes >
+            byte_length) {
+      return false;
+    }
+
+    header_ = header;
+    samples_ = static_cast<uint8_t*>(memory) + kSharedRingHeaderBytes;
+    capacity_frames_ = static_cast<uint32_t>(capacity);
+    channels_ = static_cast<uint32_t>(channels);
+    format_ = static_cast<SharedRingFormat>(format);
+    return true;
+  }
+
+  uint32_t channels() const { return channels_; }
+  SharedRingFormat format() const { return format_; }
+
+  void SetSampleRate(uint32_t sample_rate) {
+    Slot(kSharedRingSampleRate).store(static_cast<int32_t>(sample_rate),
+                                      std::memory_order_relaxed);
+  }
+
+  // Writes a whole chunk or nothing: when the reader is too far behind the
+  // chunk is dropped and counted as overrun, so the reader never sees a
+  // partial chunk. `samples` is interleaved int16 or, for a float ring, one
+  // plane of `frames` per channel; null writes silence.
+  bool Write(const void* samples, uint32_t frames) {
+    const uint32_t write =
+        static_cast<uint32_t>(Slot(kSharedRingWriteFrame).load(std::memory_order_relaxed));
+    const uint32_t read =
+        static_cast<uint32_t>(Slot(kSharedRingReadFrame).load(std::memory_order_acquire));
+    if (capacity_frames_ - (write - read) < frames) {
+      Slot(kSharedRingOverrunFrames).fetch_add(static_cast<int32_t>(frames),
+                                               std::memory_order_relaxed);
+      return false;
+    }
+
+    const uint32_t start = write % capacity_frames_;
+    const uint32_t first = std::min(frames, capacity_frames_ - start);
+    if (format_ == kSharedRingInt16) {
+      auto* ring = reinterpret_cast<int16_t*>(samples_);
+      const auto* chunk = static_cast<const int16_t*>(samples);
+      CopyRun(ring + static_cast<size_t>(start) * channels_, chunk, first * channels_);
+      if (first < frames) {
+        CopyRun(ring, chunk ? chunk + static_cast<size_t>(first) * channels_ : nullptr,
+                (frames - first) * channels_);
+      }
+    } else {
+      for (uint32_t channel = 0; channel < channels_; ++channel) {
+        float* plane = reinterpret_cast<float*>(samples_) +
+                       static_cast<size_t>(channel) * capacity_frames_;
+        const float* chunk =
+            samples ? static_cast<const float*>(samples) + static_cast<size_t>(channel) * frames
+                    : nullptr;
+        CopyRun(plane + start, chunk, first);
+        if (first < frames) {
+          CopyRun(plane, chunk ? chunk + first : nullptr, frames - first);
+        }
+      }
+    }
+
+    Slot(kSharedRingWriteFrame).store(static_cast<int32_t>(write + frames),
+                                      std::memory_order_release);
+    Slot(kSharedRingWriteSequence).fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  SharedRingStats GetStats() const {
+    SharedRingStats stats;
+    if (!header_) return stats;
+    const uint32_t write =
+        static_cast<uint32_t>(Slot(kSharedRingWriteFrame).load(std::memory_order_acquire));
+    const uint32_t read =
+        static_cast<uint32_t>(Slot(kSharedRingReadFrame).load(std::memory_order_acquire));
+    stats.capacity_frames = capacity_frames_;
+    stats.occupancy_frames = write - read;
+    stats.overrun_frames =
+        static_cast<uint32_t>(Slot(kSharedRingOverrunFrames).load(std::memory_order_relaxed));
+    stats.underrun_frames =
+        static_cast<uint32_t>(Slot(kSharedRingUnderrunFrames).load(std::memory_order_relaxed));
+    stats.write_sequence =
+        static_cast<uint32_t>(Slot(kSharedRingWriteSequence).load(std::memory_order_relaxed));
+    return stats;
+  }
+
+ private:
+  // Header slots are plain int32 in the shared buffer, the same cells JS
+  // accesses through Atomics; std::atomic<int32_t> is lock-free and has the
+  // same size and alignment on every platform we build for.
+  std::atomic<int32_t>& Slot(uint32_t slot) const {
+    return *reinterpret_cast<std::atomic<int32_t>*>(header_ + slot);
+  }
+
+  template <typename T>
+  static void CopyRun(T* destination, const T* samples, size_t count) {
+    if (samples) {
+      std::memcpy(destination, samples, count * sizeof(T));
+    } else {
+      std::memset(destination, 0, count * sizeof(T));
+    }
+  }
+
+  int32_t* header_ = nullptr;
+  uint8_t* samples_ = nullptr;
+  uint32_t capacity_frames_ = 0;
+  uint32_t channels_ = 0;
+  SharedRingFormat format_ = kSharedRingInt16;
+};
+
+static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t),
+              "Shared ring header slots must be plain 32-bit cells.");
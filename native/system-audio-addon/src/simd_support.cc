@@ -0,0 +1,36 @@
+#include "simd_support.h"
+
+#if defined(SYSTEM_AUDIO_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+bool DetectAvx2() {
+#if defined(SYSTEM_AUDIO_SIMD_X86) && defined(_MSC_VER)
+  int registers[4] = {};
+  __cpuid(registers, 0);
+  if (registers[0] < 7) return false;
+
+  __cpuid(registers, 1);
+  const bool has_osxsave = (registers[2] & (1 << 27)) != 0;
+  const bool has_avx = (registers[2] & (1 << 28)) != 0;
+  if (!has_osxsave || !has_avx) return false;
+  if ((_xgetbv(0) & 0x6) != 0x6) return false;
+
+  __cpuidex(registers, 7, 0);
+  return (registers[1] & (1 << 5)) != 0;
+#elif defined(SYSTEM_AUDIO_SIMD_X86)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+}  // namespace
+
+bool CpuSupportsAvx2() {
+  static const bool supported = DetectAvx2();
+  return supported;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SYSTEM_AUDIO_SIMD_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define SYSTEM_AUDIO_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only emit AVX2 instructions inside functions that opt in;
+// MSVC accepts the intrinsics anywhere.
+#if defined(SYSTEM_AUDIO_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SYSTEM_AUDIO_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SYSTEM_AUDIO_TARGET_AVX2
+#endif
+
+// True when AVX2 kernels can run on this CPU (and the OS saves YMM state).
+bool CpuSupportsAvx2();
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+constexpr size_t kCacheLineSize = 64;
+
+// Lock-free single-producer/single-consumer ring buffer for trivially copyable
+// items. Storage is allocated once by Reset(), so Write/Peek/Consume never
+// allocate. The first `max_view` slots are mirrored past the end of the
+// storage, which lets the consumer peek up to `max_view` items as one
+// contiguous span even when they wrap around.
+template <typename T>
+class SpscRingBuffer {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "SpscRingBuffer requires trivially copyable items.");
+
+ public:
+  SpscRingBuffer() = default;
+  SpscRingBuffer(size_t capacity, size_t max_view) { Reset(capacity, max_view); }
+
+  SpscRingBuffer(const SpscRingBuffer&) = delete;
+  SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+  // Not thread-safe: only call while neither side is using the buffer.
+  void Reset(size_t capacity, size_t max_view = 0) {
+    capacity_ = std::max<size_t>(1, capacity);
+    max_view_ = std::min(max_view, capacity_);
+    storage_.assign(capacity_ + max_view_, T{});
+    Clear();
+  }
+
+  // Not thread-safe: only call while neither side is using the buffer.
+  void Clear() {
+    write_index_.store(0, std::memory_order_relaxed);
+    read_index_.store(0, std::memory_order_relaxed);
+    cached_read_index_ = 0;
+    cached_write_index_ = 0;
+  }
+
+  size_t capacity() const { return capacity_; }
+  size_t max_view() const { return max_view_; }
+
+  // Approximate when called from a thread that is neither side.
+  size_t Size() const {
+    const size_t write = write_index_.load(std::memory_order_acquire);
+    const size_t read = read_index_.load(std::memory_order_acquire);
+    return write - read;
+  }
+
+  // Producer side.
+  size_t WriteAvailable() {
+    const size_t write = write_index_.load(std::memory_order_relaxed);
+    if (write - cached_read_index_ >= capacity_) {
+      cached_read_index_ = read_index_.load(std::memory_order_acquire);
+    }
+    return capacity_ - (write - cached_read_index_);
+  }
+
+  // Copies up to `count` items and returns how many fit.
+  size_t Write(const T* items, size_t count) {
+    if (!items || count == 0 || storage_.empty()) return 0;
+
+    const size_t write = write_index_.load(std::memory_order_relaxed);
+    if (capacity_ - (write - cached_read_index_) < count) {
+      cached_read_index_ = read_index_.load(std::memory_order_acquire);
+    }
+    count = std::min(count, capacity_ - (write - cached_read_index_));
+    if (count == 0) return 0;
+
+    const size_t position = write % capacity_;
+    const size_t first = std::min(count, capacity_ - position);
+    CopyIn(position, items, first);
+    if (first < count) {
+      CopyIn(0, items + first, count - first);
+    }
+
+    write_index_.store(write + count, std::memory_order_release);
+    return count;
+  }
+
+  bool Push(const T& item) { return Write(&item, 1) == 1; }
+
+  // Consumer side.
+  size_t ReadAvailable() {
+    const size_t read = read_index_.load(std::memory_order_relaxed);
+    cached_write_index_ = write_index_.load(std::memory_order_acquire);
+    return cached_write_index_ - read;
+  }
+
+  // Returns a contiguous view of the next `count` items, or nullptr when fewer
+  // are buffered or the view would need more than `max_view` mirrored slots.
+  // The view stays valid until Consume().
+  const T* Peek(size_t count) {
+    if (count == 0 || storage_.empty()) return nullptr;
+
+    const size_t read = read_index_.load(std::memory_order_relaxed);
+    if (cached_write_index_ - read < count) {
+      cached_write_index_ = write_index_.load(std::memory_order_acquire);
+      if (cached_write_index_ - read < count) return nullptr;
+    }
+
+    const size_t position = read % capacity_;
+    if (position + count > capacity_ && count > max_view_) return nullptr;
+    return storage_.data() + position;
+  }
+
+  // Copies up to `count` items out and returns how many were read.
+  size_t Read(T* out, size_t count) {
+    if (!out || count == 0) return 0;
+    count = std::min(count, ReadAvailable());
+    if (count == 0) return 0;
+
+    const size_t read = read_index_.load(std::memory_order_relaxed);
+    const size_t position = read % capacity_;
+    const size_t first = std::min(count, capacity_ - position);
+    std::memcpy(out, storage_.data() + position, first * sizeof(T));
+    if (first < count) {
+      std::memcpy(out + first, storage_.data(), (count - first) * sizeof(T));
+    }
+
+    read_index_.store(read + count, std::memory_order_release);
+    return count;
+  }
+
+  void Consume(size_t count) {
+    const size_t read = read_index_.load(std::memory_order_relaxed);
+    read_index_.store(read + count, std::memory_order_release);
+  }
+
+ private:
+  void CopyIn(size_t position, const T* items, size_t count) {
+    std::memcpy(storage_.data() + position, items, count * sizeof(T));
+    if (position < max_view_) {
+      const size_t mirrored = std::min(count, max_view_ - position);
+      std::memcpy(storage_.data() + capacity_ + position, items, mirrored * sizeof(T));
+    }
+  }
+
+  std::vector<T> storage_;
+  size_t capacity_ = 0;
+  size_t max_view_ = 0;
+
+  alignas(kCacheLineSize) std::atomic<size_t> write_index_{0};
+  size_t cached_read_index_ = 0;
+
+  alignas(kCacheLineSize) std::atomic<size_t> read_index_{0};
+  size_t cached_write_index_ = 0;
+};
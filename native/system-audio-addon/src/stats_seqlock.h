@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+// Publishes a trivially copyable snapshot from one writer thread to any
+// number of readers. The writer never waits; a reader that overlaps a
+// Store() retries until it copies a snapshot no Store() touched, so every
+// field it returns was published together.
+//
+// The payload lives in relaxed atomic words rather than plain memory so the
+// racing copy is well defined; the sequence number and fences do the
+// ordering.
+template <typename T>
+class StatsSeqlock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "StatsSeqlock copies its payload byte for byte.");
+
+ public:
+  StatsSeqlock() { Store(T()); }
+
+  // Writer thread only.
+  void Store(const T& value) {
+    uint64_t words[kWords] = {};
+    std::memcpy(words, &value, sizeof(T));
+
+    const uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t index = 0; index < kWords; ++index) {
+      words_[index].store(words[index], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Any thread.
+  T Load() const {
+    uint64_t words[kWords];
+    for (;;) {
+      const uint32_t before = sequence_.load(std::memory_order_acquire);
+      if ((before & 1) == 0) {
+        for (size_t index = 0; index < kWords; ++index) {
+          words[index] = words_[index].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == before) break;
+      }
+      std::this_thread::yield();
+    }
+
+    T value;
+    std::memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+ private:
+  static constexpr size_t kWords = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  std::atomic<uint32_t> sequence_{0};
+  std::atomic<uint64_t> words_[kWords];
+};
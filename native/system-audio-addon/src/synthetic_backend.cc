@@ -0,0 +1,157 @@
+#include "synthetic_backend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "channel_mixer.h"
+
+namespace {
+
+constexpr double kTwoPi = 6.283185307179586476925286766559;
+
+// Writes one sample in the device format; the inverse of the decoders in
+// sample_convert.cc.
+void EncodeSample(float value, SampleFormat format, uint8_t* out) {
+  value = std::clamp(value, -1.0f, 1.0f);
+  switch (format) {
+    case SampleFormat::kFloat32:
+      std::memcpy(out, &value, sizeof(value));
+      break;
+    case SampleFormat::kInt16: {
+      const int16_t sample = static_cast<int16_t>(std::lrint(value * 32767.0f));
+      std::memcpy(out, &sample, sizeof(sample));
+      break;
+    }
+    case SampleFormat::kInt24: {
+      const int32_t sample = static_cast<int32_t>(std::lrint(value * 8388607.0f));
+      out[0] = static_cast<uint8_t>(sample);
+      out[1] = static_cast<uint8_t>(sample >> 8);
+      out[2] = static_cast<uint8_t>(sample >> 16);
+      break;
+    }
+    case SampleFormat::kInt24In32: {
+      const int32_t sample =
+          static_cast<int32_t>(static_cast<uint32_t>(std::lrint(value * 8388607.0f)) << 8);
+      std::memcpy(out, &sample, sizeof(sample));
+      break;
+    }
+    case SampleFormat::kInt32: {
+      const int32_t sample = static_cast<int32_t>(std::lrint(value * 2147483647.0));
+      std::memcpy(out, &sample, sizeof(sample));
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+}  // namespace
+
+bool SyntheticBackend::Open(const CaptureConfig& config,
+                            InputFormatInfo* format,
+                            std::string* error) {
+  source_ = config.source;
+
+  if (source_.signal == "tone") {
+    signal_ = Signal::kTone;
+  } else if (source_.signal == "noise") {
+    signal_ = Signal::kNoise;
+  } else if (source_.signal == "silence") {
+    signal_ = Signal::kSilence;
+  } else {
+    if (error) *error = "Unknown synthetic signal '" + source_.signal + "'.";
+    return false;
+  }
+
+  bytes_per_sample_ = BytesPerSample(source_.sample_format);
+  if (bytes_per_sample_ == 0 || source_.channels == 0 || source_.sample_rate == 0) {
+    if (error) *error = "Synthetic source needs a sample rate, channel count and format.";
+    return false;
+  }
+
+  packet_frames_ =
+      std::max<uint32_t>(1, static_cast<uint32_t>(
+                                static_cast<uint64_t>(source_.sample_rate) * source_.packet_ms / 1000));
+  packet_.assign(static_cast<size_t>(packet_frames_) * source_.channels * bytes_per_sample_, 0);
+  phase_ = 0.0;
+  phase_step_ = kTwoPi * source_.tone_hz / source_.sample_rate;
+
+  format->sample_format = source_.sample_format;
+  format->sample_rate = source_.sample_rate;
+  format->channels = static_cast<uint16_t>(source_.channels);
+  format->bits_per_sample = static_cast<uint16_t>(
+      source_.sample_format == SampleFormat::kInt24In32 ? 32 : bytes_per_sample_ * 8);
+  format->valid_bits_per_sample =
+      source_.sample_format == SampleFormat::kInt24In32 ? 24 : format->bits_per_sample;
+  format->channel_mask = DefaultChannelMask(source_.channels);
+  return true;
+}
+
+bool SyntheticBackend::Start(std::string* /*error*/) {
+  pacer_.Start(std::chrono::duration_cast<PacketPacer::Clock::duration>(
+                   std::chrono::duration<double>(static_cast<double>(packet_frames_) /
+                                                 source_.sample_rate)),
+               source_.realtime);
+  return true;
+}
+
+bool SyntheticBackend::WaitForData(uint32_t timeout_ms, std::string* /*error*/) {
+  pacer_.Wait(timeout_ms);
+  return true;
+}
+
+PacketStatus SyntheticBackend::ReadPacket(CapturePacket* packet, std::string* /*error*/) {
+  PacketPacer::Clock::time_point start;
+  bool discontinuity = false;
+  if (!pacer_.TakePacket(&start, &discontinuity)) {
+    return PacketStatus::kEmpty;
+  }
+
+  packet->frames = packet_frames_;
+  packet->device_time_ns = PacketPacer::ToNs(start);
+  packet->discontinuity = discontinuity;
+  if (signal_ == Signal::kSilence) {
+    packet->silent = true;
+    packet->data = nullptr;
+    return PacketStatus::kPacket;
+  }
+
+  Generate(packet_frames_);
+  packet->silent = false;
+  packet->data = packet_.data();
+  return PacketStatus::kPacket;
+}
+
+bool SyntheticBackend::ReleasePacket(const CapturePacket& /*packet*/, std::string* /*error*/) {
+  return true;
+}
+
+void SyntheticBackend::Close() {
+  packet_.clear();
+  packet_.shrink_to_fit();
+}
+
+void SyntheticBackend::Generate(uint32_t frames) {
+  const float amplitude = static_cast<float>(source_.amplitude);
+  const size_t frame_bytes = bytes_per_sample_ * source_.channels;
+  for (uint32_t frame = 0; frame < frames; ++frame) {
+    float value;
+    if (signal_ == Signal::kTone) {
+      value = amplitude * static_cast<float>(std::sin(phase_));
+      phase_ += phase_step_;
+      if (phase_ >= kTwoPi) phase_ -= kTwoPi;
+    } else {
+      noise_state_ ^= noise_state_ << 13;
+      noise_state_ ^= noise_state_ >> 17;
+      noise_state_ ^= noise_state_ << 5;
+      value = amplitude * (static_cast<float>(noise_state_) * (2.0f / 4294967296.0f) - 1.0f);
+    }
+
+    uint8_t* out = packet_.data() + frame * frame_bytes;
+    for (uint32_t channel = 0; channel < source_.channels; ++channel) {
+      EncodeSample(value, source_.sample_format, out + channel * bytes_per_sample_);
+    }
+  }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "capture_backend.h"
+#include "packet_pacer.h"
+
+// Generates a tone, white noise or digital silence in any device format the
+// pipeline accepts, so conversion, resampling and delivery can be exercised
+// without an audio device.
+class SyntheticBackend : public CaptureBackend {
+ public:
+  const char* name() const override { return "synthetic"; }
+  bool realtime() const override { return source_.realtime; }
+
+  bool Open(const CaptureConfig& config,
+            InputFormatInfo* format,
+            std::string* error) override;
+  bool Start(std::string* error) override;
+  bool WaitForData(uint32_t timeout_ms, std::string* error) override;
+  PacketStatus ReadPacket(CapturePacket* packet, std::string* error) override;
+  bool ReleasePacket(const CapturePacket& packet, std::string* error) override;
+  void Wake() override { pacer_.Wake(); }
+  void Stop() override {}
+  void Close() override;
+
+ private:
+  enum class Signal { kTone, kNoise, kSilence };
+
+  void Generate(uint32_t frames);
+
+  SourceConfig source_;
+  Signal signal_ = Signal::kTone;
+  size_t bytes_per_sample_ = 0;
+  uint32_t packet_frames_ = 0;
+  double phase_ = 0.0;
+  double phase_step_ = 0.0;
+  uint32_t noise_state_ = 0x2545f491u;
+  std::vector<uint8_t> packet_;
+  PacketPacer pacer_;
+};
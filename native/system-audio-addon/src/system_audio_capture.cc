@@ -0,0 +1,230 @@
+#include "system_audio_capture.h"
+
+#include <utility>
+
+SystemAudioCapture::SystemAudioCapture(CaptureBackendFactory backend_factory)
+    : SystemAudioCapture(std::make_shared<CaptureHub>(std::move(backend_factory))) {}
+
+SystemAudioCapture::SystemAudioCapture(std::shared_ptr<CaptureHub> hub) : hub_(std::move(hub)) {}
+
+SystemAudioCapture::~SystemAudioCapture() {
+  Release();
+}
+
+bool SystemAudioCapture::Prepare(const CaptureConfig& requested, std::string* error) {
+  const CaptureConfig config = NormalizeCaptureConfig(requested);
+  std::lock_guard<std::mutex> control_lock(control_mutex_);
+  if (!hub_->Prepare(config, error)) {
+    return false;
+  }
+  // Preparing again keeps the one hold.
+  if (prepared_) {
+    hub_->Release();
+  }
+  prepared_ = true;
+  std::lock_guard<std::mutex> lock(info_mutex_);
+  if (!session_ || !hub_->IsRunning(*session_)) {
+    config_ = config;
+  }
+  return true;
+}
+
+void SystemAudioCapture::Release() {
+  std::lock_guard<std::mutex> control_lock(control_mutex_);
+  EndCapture();
+  if (prepared_) {
+    prepared_ = false;
+    hub_->Release();
+  }
+}
+
+bool SystemAudioCapture::Start(const CaptureConfig& requested, std::string* error) {
+  std::lock_guard<std::mutex> control_lock(control_mutex_);
+  if (IsRunning()) {
+    if (error) *error = "System audio capture is already running.";
+    return false;
+  }
+  // A previous capture may have ended on its own (end of file, device
+  // error); its session holds the device until it is removed.
+  EndCapture();
+
+  const CaptureConfig config = NormalizeCaptureConfig(requested);
+  // The hub converts to int16 PCM and Opus is encoded here, so the
+  // recording tee sees the chunks before encoding. Encoder settings are
+  // validated before the device starts, so a bad option fails start().
+  const bool opus = config.encoding == ChunkEncoding::kOpus;
+  CaptureConfig session_config = config;
+  if (opus) {
+    session_config.encoding = ChunkEncoding::kPcm;
+    session_config.pcm_format = PcmSampleFormat::kInt16;
+    if (!opus_encoder_.Start(
+            config, [this](const AudioChunk& packet) { DeliverChunk(packet); }, error)) {
+      return false;
+    }
+  }
+
+  emitted_chunks_.store(0);
+  dropped_no_callback_.store(0);
+  dropped_encoder_busy_.store(0);
+  capture_to_emit_.Reset();
+  {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    config_ = config;
+    session_.reset();
+  }
+
+  std::shared_ptr<CaptureSession> session = hub_->AddSession(
+      session_config, [this, opus](const AudioChunk& chunk) { EmitChunk(chunk, opus); }, error);
+  if (!session) {
+    opus_encoder_.Stop();
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(info_mutex_);
+  session_ = std::move(session);
+  return true;
+}
+
+void SystemAudioCapture::Stop() {
+  std::lock_guard<std::mutex> control_lock(control_mutex_);
+  EndCapture();
+}
+
+void SystemAudioCapture::EndCapture() {
+  std::shared_ptr<CaptureSession> session;
+  {
+    std::lock_guard<std::mutex> lock(info_mutex_);
+    session = session_;
+  }
+  // Does nothing for a session already removed. Once it returns, no chunk
+  // reaches EmitChunk() any more.
+  hub_->RemoveSession(session);
+  opus_encoder_.Stop();
+  EndRecording();
+}
+
+bool SystemAudioCapture::IsRunning() const {
+  std::lock_guard<std::mutex> lock(info_mutex_);
+  return session_ && hub_->IsRunning(*session_);
+}
+
+void SystemAudioCapture::SetChunkCallback(ChunkCallback callback) {
+  std::lock_guard<std::mutex> lock(callback_mutex_);
+  chunk_callback_ = std::move(callback);
+}
+
+void SystemAudioCapture::ReportQueueLevel(double queued_ms) {
+  std::lock_guard<std::mutex> lock(info_mutex_);
+  if (session_) {
+    hub_->ReportQueueLevel(*session_, queued_ms);
+  }
+}
+
+bool SystemAudioCapture::StartRecording(const std::string& path,
+                                        const RecordingOptions& options,
+                                        std::string* error) {
+  std::lock_guard<std::mutex> control_lock(control_mutex_);
+  if (!IsRunning()) {
+    if (error) *error = "Start capture before recording.";
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    if (recording_) {
+      if (error) *error = "A recording is already in progress.";
+      return false;
+    }
+  }
+
+  const uint32_t chunk_frames =
+      static_cast<uint32_t>(ChunkSampleCount(config_) / config_.target_channels);
+  if (!recorder_.Start(path, options, config_.target_sample_rate, config_.target_channels,
+                       chunk_frames, error)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(callback_mutex_);
+  recording_ = true;
+  return true;
+}
+
+void SystemAudioCapture::StopRecording() {
+  std::lock_guard<std::mutex> control_lock(control_mutex_);
+  EndRecording();
+}
+
+void SystemAudioCapture::EndRecording() {
+  {
+    // Once this is released the conversion thread no longer submits.
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    recording_ = false;
+  }
+  recorder_.Stop();
+}
+
+void SystemAudioCapture::ResetLatencyStats() {
+  capture_to_emit_.Reset();
+  hub_->ResetLatencyStats();
+}
+
+CaptureStats SystemAudioCapture::GetStats() const {
+  // Held throughout: a control call on another thread may replace config_.
+  std::lock_guard<std::mutex> info_lock(info_mutex_);
+  CaptureStats stats = session_ ? hub_->GetSessionStats(*session_) : hub_->GetDeviceStats();
+  if (!session_) {
+    stats.running = false;
+  }
+  stats.output_sample_rate = config_.target_sample_rate;
+  stats.output_channels = config_.target_channels;
+  stats.chunk_frame_ms = config_.frame_ms;
+  stats.encoding = ChunkEncodingName(config_.encoding);
+  stats.sample_format = PcmSampleFormatName(config_.pcm_format);
+  stats.emitted_chunks = emitted_chunks_.load(std::memory_order_relaxed);
+  stats.dropped_no_callback = dropped_no_callback_.load(std::memory_order_relaxed);
+  stats.dropped_encoder_busy = dropped_encoder_busy_.load(std::memory_order_relaxed);
+  stats.dropped_chunks = stats.dropped_no_callback + stats.dropped_encoder_busy;
+  stats.capture_to_emit = capture_to_emit_.Summarize();
+  if (config_.encoding == ChunkEncoding::kOpus) {
+    const OpusEncoderStats encoder_stats = opus_encoder_.GetStats();
+    stats.encoded_packets = encoder_stats.encoded_packets;
+    stats.encoded_bytes = encoder_stats.encoded_bytes;
+    stats.encoder_dropped_frames = encoder_stats.dropped_frames;
+    stats.encode_time_avg_us = encoder_stats.encode_time_avg_us;
+    stats.encode_time_max_us = encoder_stats.encode_time_max_us;
+  }
+  return stats;
+}
+
+void SystemAudioCapture::EmitChunk(const AudioChunk& chunk, bool opus) {
+  {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    if (recording_) {
+      recorder_.Submit(chunk);
+    }
+    if (!chunk_callback_) {
+      dropped_no_callback_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  if (opus) {
+    // The packet reaches the callback from the encoder thread.
+    if (!opus_encoder_.Submit(chunk)) {
+      dropped_encoder_busy_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  } else {
+    DeliverChunk(chunk);
+  }
+  emitted_chunks_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SystemAudioCapture::DeliverChunk(const AudioChunk& chunk) {
+  ChunkCallback callback_copy;
+  {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    callback_copy = chunk_callback_;
+  }
+  if (callback_copy) {
+    capture_to_emit_.RecordInterval(chunk.read_time_ns, chunk.emit_time_ns);
+    callback_copy(chunk);
+  }
+}
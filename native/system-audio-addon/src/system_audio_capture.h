@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "audio_chunk.h"
+#include "audio_recorder.h"
+#include "capture_backend.h"
+#include "capture_config.h"
+#include "capture_hub.h"
+#include "latency_histogram.h"
+#include "opus_chunk_encoder.h"
+
+// One capture with a single replaceable callback and an optional recording
+// tee, run as a session on a CaptureHub. The hub owns the device and its
+// thread and converts on a thread per conversion group; this class only
+// encodes Opus, records and delivers. Given a shared hub, it captures from
+// the same device stream as the hub's other sessions. Nothing here depends
+// on the platform; device specifics live in the backend.
+//
+// The device can be prepared ahead of time: Prepare() opens it and leaves
+// it stopped on its thread, so Start() only has to start the stream, and
+// Stop() goes back to that standby until Release(). The hub keeps a shared
+// device open while other sessions use it.
+//
+// Control calls (Prepare, Release, Start, Stop and the recording calls) may
+// come from any thread and are serialized; Start() and Stop() block on the
+// device, so a JS caller runs them off its own thread. GetStats() and the
+// reporting calls never wait on the device.
+class SystemAudioCapture {
+ public:
+  // Captures through a hub of its own.
+  explicit SystemAudioCapture(CaptureBackendFactory backend_factory = CreateCaptureBackend);
+  // Captures as one session on `hub`.
+  explicit SystemAudioCapture(std::shared_ptr<CaptureHub> hub);
+  ~SystemAudioCapture();
+
+  SystemAudioCapture(const SystemAudioCapture&) = delete;
+  SystemAudioCapture& operator=(const SystemAudioCapture&) = delete;
+
+  // Opens the device `config.source` names and holds it in standby.
+  bool Prepare(const CaptureConfig& config, std::string* error);
+  // Stops any capture and gives back this capture's hold on the prepared
+  // device; the hub closes it unless another owner prepared it too.
+  void Release();
+  // Starts capturing, from standby when the prepared device matches
+  // `config`. Returns once the first packet has arrived (or an idle
+  // loopback has had time to send one), or with the error that stopped it.
+  bool Start(const CaptureConfig& config, std::string* error);
+  void Stop();
+  bool IsRunning() const;
+
+  void SetChunkCallback(ChunkCallback callback);
+  CaptureStats GetStats() const;
+  void ResetLatencyStats();
+  // Queue depth reported by the consumer, for drift compensation. Any
+  // thread.
+  void ReportQueueLevel(double queued_ms);
+
+  // Tees every chunk, before any Opus encoding, into a file written on its
+  // own thread. Needs a running capture; Stop() ends the recording too.
+  bool StartRecording(const std::string& path,
+                      const RecordingOptions& options,
+                      std::string* error);
+  void StopRecording();
+  RecordingStats GetRecordingStats() const { return recorder_.GetStats(); }
+
+ private:
+  // Under control_mutex_.
+  void EndCapture();
+  void EndRecording();
+  // The group's conversion thread.
+  void EmitChunk(const AudioChunk& chunk, bool opus);
+  // The conversion thread, or the encoder thread in Opus mode.
+  void DeliverChunk(const AudioChunk& chunk);
+
+  const std::shared_ptr<CaptureHub> hub_;
+  std::mutex control_mutex_;
+  // Under control_mutex_: whether this capture holds a hub Prepare().
+  bool prepared_ = false;
+  // Guards config_ and session_ against GetStats() while a control call
+  // replaces them. The last session is kept once stopped for its final
+  // stats.
+  mutable std::mutex info_mutex_;
+  CaptureConfig config_;
+  std::shared_ptr<CaptureSession> session_;
+
+  mutable std::mutex callback_mutex_;
+  ChunkCallback chunk_callback_;
+  // Fed under callback_mutex_ while `recording_`.
+  bool recording_ = false;
+  AudioRecorder recorder_;
+
+  // Reset by Start() before the session exists.
+  std::atomic<uint64_t> emitted_chunks_{0};
+  std::atomic<uint64_t> dropped_no_callback_{0};
+  std::atomic<uint64_t> dropped_encoder_busy_{0};
+  // From the chunk holding a packet's first frame to the callback, Opus
+  // encoding included.
+  LatencyHistogram capture_to_emit_;
+
+  OpusChunkEncoder opus_encoder_;
+};
@@ -0,0 +1,348 @@
+#include "thread_scheduling.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+
+#include <avrt.h>
+#elif defined(__linux__)
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace {
+
+#if defined(_WIN32)
+
+std::string Win32ErrorString(const char* operation, DWORD code) {
+  return std::string(operation) + " failed (" + std::to_string(code) + ")";
+}
+
+#elif defined(__linux__)
+
+constexpr int kProAudioFifoPriority = 10;
+constexpr int kRealtimeFifoPriority = 20;
+// What PulseAudio and PipeWire ask for when real-time is refused.
+constexpr int kFallbackNice = -11;
+
+// Minimal RealtimeKit client over libdbus, loaded at run time so the addon
+// neither links nor requires it. rtkit is how desktop Linux hands SCHED_FIFO
+// to processes without RLIMIT_RTPRIO.
+class RtkitClient {
+ public:
+  ~RtkitClient() {
+    if (connection_) {
+      connection_close_(connection_);
+      connection_unref_(connection_);
+    }
+    if (library_) dlclose(library_);
+  }
+
+  bool Connect(std::string* error) {
+    library_ = dlopen("libdbus-1.so.3", RTLD_NOW | RTLD_LOCAL);
+    if (!library_) {
+      *error = "libdbus-1 is not available";
+      return false;
+    }
+    if (!Load(&error_init_, "dbus_error_init") || !Load(&error_free_, "dbus_error_free") ||
+        !Load(&bus_get_private_, "dbus_bus_get_private") ||
+        !Load(&set_exit_on_disconnect_, "dbus_connection_set_exit_on_disconnect") ||
+        !Load(&connection_close_, "dbus_connection_close") ||
+        !Load(&connection_unref_, "dbus_connection_unref") ||
+        !Load(&new_method_call_, "dbus_message_new_method_call") ||
+        !Load(&append_args_, "dbus_message_append_args") ||
+        !Load(&send_with_reply_, "dbus_connection_send_with_reply_and_block") ||
+        !Load(&message_unref_, "dbus_message_unref") ||
+        !Load(&iter_init_, "dbus_message_iter_init") ||
+        !Load(&iter_get_arg_type_, "dbus_message_iter_get_arg_type") ||
+        !Load(&iter_recurse_, "dbus_message_iter_recurse") ||
+        !Load(&iter_get_basic_, "dbus_message_iter_get_basic")) {
+      *error = "libdbus-1 is missing expected symbols";
+      return false;
+    }
+
+    DBusError dbus_error;
+    error_init_(&dbus_error);
+    void* connection = bus_get_private_(kBusSystem, &dbus_error);
+    if (!connection) {
+      *error = ErrorText(&dbus_error, "cannot connect to the system bus");
+      return false;
+    }
+    // A bus connection exits the process when it drops unless told not to.
+    set_exit_on_disconnect_(connection, 0);
+    connection_ = connection;
+    return true;
+  }
+
+  bool GetIntProperty(const char* property, int64_t* value, std::string* error) {
+    const char* interface_name = kInterface;
+    void* message =
+        new_method_call_(kService, kObject, "org.freedesktop.DBus.Properties", "Get");
+    if (!message) {
+      *error = "out of memory";
+      return false;
+    }
+    append_args_(message, kTypeString, &interface_name, kTypeString, &property, kTypeInvalid);
+    void* reply = Call(message, error);
+    if (!reply) return false;
+
+    bool found = false;
+    Iterator top;
+    Iterator variant;
+    if (iter_init_(reply, &top) && iter_get_arg_type_(&top) == kTypeVariant) {
+      iter_recurse_(&top, &variant);
+      const int type = iter_get_arg_type_(&variant);
+      if (type == kTypeInt32) {
+        int32_t value32 = 0;
+        iter_get_basic_(&variant, &value32);
+        *value = value32;
+        found = true;
+      } else if (type == kTypeInt64) {
+        iter_get_basic_(&variant, value);
+        found = true;
+      }
+    }
+    message_unref_(reply);
+    if (!found) *error = std::string("unexpected reply for ") + property;
+    return found;
+  }
+
+  bool MakeThreadRealtime(uint64_t thread_id, uint32_t priority, std::string* error) {
+    void* message = new_method_call_(kService, kObject, kInterface, "MakeThreadRealtime");
+    if (!message) {
+      *error = "out of memory";
+      return false;
+    }
+    append_args_(message, kTypeUint64, &thread_id, kTypeUint32, &priority, kTypeInvalid);
+    void* reply = Call(message, error);
+    if (!reply) return false;
+    message_unref_(reply);
+    return true;
+  }
+
+  bool MakeThreadHighPriority(uint64_t thread_id, int32_t nice, std::string* error) {
+    void* message = new_method_call_(kService, kObject, kInterface, "MakeThreadHighPriority");
+    if (!message) {
+      *error = "out of memory";
+      return false;
+    }
+    append_args_(message, kTypeUint64, &thread_id, kTypeInt32, &nice, kTypeInvalid);
+    void* reply = Call(message, error);
+    if (!reply) return false;
+    message_unref_(reply);
+    return true;
+  }
+
+ private:
+  // Layout-compatible with libdbus's public DBusError.
+  struct DBusError {
+    const char* name;
+    const char* message;
+    unsigned int flags;
+    void* padding;
+  };
+  // Opaque to callers; larger than libdbus's DBusMessageIter on any ABI.
+  struct Iterator {
+    alignas(void*) unsigned char storage[128];
+  };
+
+  static constexpr int kBusSystem = 1;
+  static constexpr int kTypeInvalid = 0;
+  static constexpr int kTypeInt32 = 'i';
+  static constexpr int kTypeInt64 = 'x';
+  static constexpr int kTypeUint32 = 'u';
+  static constexpr int kTypeUint64 = 't';
+  static constexpr int kTypeString = 's';
+  static constexpr int kTypeVariant = 'v';
+  static constexpr int kCallTimeoutMs = 1000;
+  static constexpr const char* kService = "org.freedesktop.RealtimeKit1";
+  static constexpr const char* kObject = "/org/freedesktop/RealtimeKit1";
+  static constexpr const char* kInterface = "org.freedesktop.RealtimeKit1";
+
+  template <typename Function>
+  bool Load(Function** function, const char* name) {
+    *function = reinterpret_cast<Function*>(dlsym(library_, name));
+    return *function != nullptr;
+  }
+
+  std::string ErrorText(DBusError* dbus_error, const char* fallback) {
+    std::string text = dbus_error->message ? dbus_error->message : fallback;
+    error_free_(dbus_error);
+    return text;
+  }
+
+  // Sends `message`, releasing it, and returns the reply or nullptr.
+  void* Call(void* message, std::string* error) {
+    DBusError dbus_error;
+    error_init_(&dbus_error);
+    void* reply = send_with_reply_(connection_, message, kCallTimeoutMs, &dbus_error);
+    message_unref_(message);
+    if (!reply) *error = ErrorText(&dbus_error, "no reply from rtkit");
+    return reply;
+  }
+
+  void* library_ = nullptr;
+  void* connection_ = nullptr;
+
+  void (*error_init_)(DBusError*) = nullptr;
+  void (*error_free_)(DBusError*) = nullptr;
+  void* (*bus_get_private_)(int, DBusError*) = nullptr;
+  void (*set_exit_on_disconnect_)(void*, uint32_t) = nullptr;
+  void (*connection_close_)(void*) = nullptr;
+  void (*connection_unref_)(void*) = nullptr;
+  void* (*new_method_call_)(const char*, const char*, const char*, const char*) = nullptr;
+  uint32_t (*append_args_)(void*, int, ...) = nullptr;
+  void* (*send_with_reply_)(void*, void*, int, DBusError*) = nullptr;
+  void (*message_unref_)(void*) = nullptr;
+  uint32_t (*iter_init_)(void*, Iterator*) = nullptr;
+  int (*iter_get_arg_type_)(Iterator*) = nullptr;
+  void (*iter_recurse_)(Iterator*, Iterator*) = nullptr;
+  void (*iter_get_basic_)(Iterator*, void*) = nullptr;
+};
+
+// rtkit only grants SCHED_FIFO to processes that cap their real-time CPU
+// time at or below its own limit, so the watchdog can demote a runaway
+// thread instead of the machine locking up.
+bool LimitRealtimeCpuTime(RtkitClient& rtkit, std::string* error) {
+  int64_t max_us = 0;
+  if (!rtkit.GetIntProperty("RTTimeUSecMax", &max_us, error)) return false;
+  rlimit limit;
+  if (getrlimit(RLIMIT_RTTIME, &limit) == 0 && limit.rlim_max != RLIM_INFINITY &&
+      limit.rlim_max <= static_cast<rlim_t>(max_us)) {
+    return true;
+  }
+  limit.rlim_cur = static_cast<rlim_t>(max_us);
+  limit.rlim_max = static_cast<rlim_t>(max_us);
+  if (setrlimit(RLIMIT_RTTIME, &limit) != 0) {
+    *error = std::string("RLIMIT_RTTIME: ") + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+void ApplyLinuxScheduling(SchedulingPolicy policy, SchedulingResult* result) {
+  const int priority =
+      policy == SchedulingPolicy::kRealtime ? kRealtimeFifoPriority : kProAudioFifoPriority;
+  const uint64_t thread_id = static_cast<uint64_t>(syscall(SYS_gettid));
+
+  // Children forked from this thread start at normal priority again.
+  sched_param param{};
+  param.sched_priority = priority;
+  const int fifo_error =
+      pthread_setschedparam(pthread_self(), SCHED_FIFO | SCHED_RESET_ON_FORK, &param);
+  if (fifo_error == 0) {
+    result->mechanism = "sched-fifo";
+    result->priority = priority;
+    return;
+  }
+  result->error = std::string("SCHED_FIFO: ") + std::strerror(fifo_error);
+
+  RtkitClient rtkit;
+  std::string rtkit_error;
+  bool rtkit_connected = rtkit.Connect(&rtkit_error);
+  if (rtkit_connected) {
+    int64_t max_priority = priority;
+    rtkit.GetIntProperty("MaxRealtimePriority", &max_priority, &rtkit_error);
+    const uint32_t granted = static_cast<uint32_t>(
+        std::max<int64_t>(1, std::min<int64_t>(priority, max_priority)));
+    if (LimitRealtimeCpuTime(rtkit, &rtkit_error) &&
+        rtkit.MakeThreadRealtime(thread_id, granted, &rtkit_error)) {
+      result->mechanism = "rtkit";
+      result->priority = static_cast<int>(granted);
+      return;
+    }
+  }
+  result->error += "; rtkit: " + rtkit_error;
+
+  if (setpriority(PRIO_PROCESS, static_cast<id_t>(thread_id), kFallbackNice) == 0) {
+    result->mechanism = "nice";
+    result->priority = kFallbackNice;
+    return;
+  }
+  result->error += std::string("; nice: ") + std::strerror(errno);
+  std::string nice_error;
+  if (rtkit_connected && rtkit.MakeThreadHighPriority(thread_id, kFallbackNice, &nice_error)) {
+    result->mechanism = "nice";
+    result->priority = kFallbackNice;
+  }
+}
+
+#endif
+
+}  // namespace
+
+const char* SchedulingPolicyName(SchedulingPolicy policy) {
+  switch (policy) {
+    case SchedulingPolicy::kProAudio:
+      return "pro-audio";
+    case SchedulingPolicy::kRealtime:
+      return "realtime";
+    case SchedulingPolicy::kNormal:
+    default:
+      return "normal";
+  }
+}
+
+bool ParseSchedulingPolicy(const std::string& name, SchedulingPolicy* policy) {
+  if (!policy) return false;
+  for (SchedulingPolicy candidate :
+       {SchedulingPolicy::kNormal, SchedulingPolicy::kProAudio, SchedulingPolicy::kRealtime}) {
+    if (name == SchedulingPolicyName(candidate)) {
+      *policy = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+ScopedThreadScheduling::ScopedThreadScheduling(SchedulingPolicy policy) {
+  result_.policy = policy;
+  if (policy == SchedulingPolicy::kNormal) return;
+
+#if defined(_WIN32)
+  DWORD task_index = 0;
+  HANDLE handle = AvSetMmThreadCharacteristicsW(L"Pro Audio", &task_index);
+  if (handle) {
+    mmcss_handle_ = handle;
+    result_.mechanism = "mmcss";
+    result_.priority = AVRT_PRIORITY_NORMAL;
+    if (policy == SchedulingPolicy::kRealtime) {
+      if (AvSetMmThreadPriority(handle, AVRT_PRIORITY_CRITICAL)) {
+        result_.priority = AVRT_PRIORITY_CRITICAL;
+      } else {
+        result_.error = Win32ErrorString("AvSetMmThreadPriority", GetLastError());
+      }
+    }
+    return;
+  }
+
+  // MMCSS is off (the service can be disabled); plain thread priorities
+  // still beat normal ones.
+  result_.error = Win32ErrorString("AvSetMmThreadCharacteristics", GetLastError());
+  const int priority = policy == SchedulingPolicy::kRealtime ? THREAD_PRIORITY_TIME_CRITICAL
+                                                              : THREAD_PRIORITY_HIGHEST;
+  if (SetThreadPriority(GetCurrentThread(), priority)) {
+    result_.mechanism = "thread-priority";
+    result_.priority = priority;
+  }
+#elif defined(__linux__)
+  ApplyLinuxScheduling(policy, &result_);
+#else
+  result_.error = "Thread scheduling is not supported on this platform.";
+#endif
+}
+
+ScopedThreadScheduling::~ScopedThreadScheduling() {
+#if defined(_WIN32)
+  // MMCSS tracks registrations per task; the thread is about to end, but
+  // leaving it registered leaks the slot until process exit.
+  if (mmcss_handle_) AvRevertMmThreadCharacteristics(static_cast<HANDLE>(mmcss_handle_));
+#endif
+}
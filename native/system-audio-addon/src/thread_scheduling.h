@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "latency_histogram.h"
+
+// How hard the thread that reads the device asks the OS for CPU time.
+enum class SchedulingPolicy {
+  // Whatever the thread inherited.
+  kNormal,
+  // The platform's audio class: MMCSS "Pro Audio" on Windows, a low
+  // SCHED_FIFO priority on Linux.
+  kProAudio,
+  // As above at the highest priority an unprivileged audio thread usually
+  // gets: MMCSS critical priority, a higher SCHED_FIFO priority.
+  kRealtime,
+};
+
+const char* SchedulingPolicyName(SchedulingPolicy policy);
+bool ParseSchedulingPolicy(const std::string& name, SchedulingPolicy* policy);
+
+// What a ScopedThreadScheduling actually got.
+struct SchedulingResult {
+  SchedulingPolicy policy = SchedulingPolicy::kNormal;
+  // "mmcss", "thread-priority", "sched-fifo", "rtkit", "nice" or "none".
+  std::string mechanism = "none";
+  // MMCSS/Win32 thread priority, SCHED_FIFO priority or nice value.
+  int priority = 0;
+  // Why a better mechanism was not available; empty when the first choice
+  // worked.
+  std::string error;
+};
+
+// Raises the calling thread to `policy` for the object's lifetime. Never
+// fails: when a mechanism is not permitted the next weaker one is tried,
+// down to leaving the thread as it was, and result() says which one took.
+// Construct and destroy on the same thread.
+class ScopedThreadScheduling {
+ public:
+  explicit ScopedThreadScheduling(SchedulingPolicy policy);
+  ~ScopedThreadScheduling();
+
+  ScopedThreadScheduling(const ScopedThreadScheduling&) = delete;
+  ScopedThreadScheduling& operator=(const ScopedThreadScheduling&) = delete;
+
+  const SchedulingResult& result() const { return result_; }
+
+ private:
+  SchedulingResult result_;
+  // AvSetMmThreadCharacteristics() handle, reverted on destruction.
+  void* mmcss_handle_ = nullptr;
+};
+
+// How far each wakeup of the device loop strays from when it was due. A
+// wakeup is due once the audio drained by the previous one has played, so
+// the deviation of each interval from that duration is the loop's jitter:
+// an event-driven loop at normal priority under load shows it directly.
+// Rounds that drained nothing (timeouts, a paused loopback stream) start
+// the next measurement over instead of counting as late.
+class WakeupJitterMeter {
+ public:
+  // Device thread only.
+  void Start(uint32_t sample_rate) {
+    sample_rate_ = sample_rate;
+    last_wakeup_ns_ = 0;
+    drained_frames_ = 0;
+  }
+
+  void OnWakeup(uint64_t now_ns) {
+    if (last_wakeup_ns_ != 0 && drained_frames_ != 0 && sample_rate_ != 0) {
+      const uint64_t due_ns = drained_frames_ * 1000000000ull / sample_rate_;
+      const uint64_t interval_ns = now_ns - last_wakeup_ns_;
+      histogram_.Record(interval_ns > due_ns ? interval_ns - due_ns : due_ns - interval_ns);
+    }
+    last_wakeup_ns_ = now_ns;
+    drained_frames_ = 0;
+  }
+
+  void OnPacket(uint32_t frames) { drained_frames_ += frames; }
+
+  // Any thread.
+  LatencySummary Summarize() const { return histogram_.Summarize(); }
+  void Reset() { histogram_.Reset(); }
+
+ private:
+  uint32_t sample_rate_ = 0;
+  uint64_t last_wakeup_ns_ = 0;
+  uint64_t drained_frames_ = 0;
+  LatencyHistogram histogram_;
+};
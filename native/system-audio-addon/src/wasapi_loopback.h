@@ -1,75 +1,45 @@
 #pragma once
 
-#include <atomic>
-#include <cstddef>
-#include <cstdint>
-#include <functional>
-#include <mutex>
-#include <string>
-#include <thread>
+#include <windows.h>
 
-struct CaptureConfig {
-  uint32_t target_sample_rate = 48000;
-  uint32_t target_channels = 2;
-  uint32_t frame_ms = 20;
-};
+#include <audioclient.h>
+#include <mmdeviceapi.h>
+#include <wrl/client.h>
 
-struct CaptureStats {
-  uint64_t captured_input_frames = 0;
-  uint64_t emitted_output_frames = 0;
-  uint64_t emitted_chunks = 0;
-  uint64_t dropped_chunks = 0;
-  uint64_t silent_input_frames = 0;
-  uint32_t input_sample_rate = 0;
-  uint32_t output_sample_rate = 0;
-  uint32_t output_channels = 0;
-  uint32_t chunk_frame_ms = 0;
-  bool running = false;
-  std::string last_error;
-};
+#include <cstdint>
+#include <string>
 
-using ChunkCallback = std::function<void(const int16_t* samples,
-                                         size_t sample_count,
-                                         uint32_t sample_rate,
-                                         uint32_t channels,
-                                         uint64_t sequence,
-                                         uint64_t timestamp_ms)>;
+#include "capture_backend.h"
 
-class WasapiLoopbackCapture {
+// Shared-mode WASAPI loopback of the default render endpoint.
+class WasapiLoopbackBackend : public CaptureBackend {
  public:
-  WasapiLoopbackCapture();
-  ~WasapiLoopbackCapture();
-
-  bool Start(const CaptureConfig& config, std::string* error);
-  void Stop();
-  bool IsRunning() const;
-
-  void SetChunkCallback(ChunkCallback callback);
-  CaptureStats GetStats() const;
+  WasapiLoopbackBackend();
+  ~WasapiLoopbackBackend() override;
+
+  const char* name() const override { return "wasapi"; }
+
+  bool Open(const CaptureConfig& config,
+            InputFormatInfo* format,
+            std::string* error) override;
+  bool Start(std::string* error) override;
+  bool WaitForData(uint32_t timeout_ms, std::string* error) override;
+  void Wake() override;
+  PacketStatus ReadPacket(CapturePacket* packet, std::string* error) override;
+  bool ReleasePacket(const CapturePacket& packet, std::string* error) override;
+  void Stop() override;
+  void Close() override;
 
  private:
-  void CaptureThreadMain();
-  void SetError(const std::string& message);
-
-  CaptureConfig config_;
-  std::thread capture_thread_;
-  std::atomic<bool> running_{false};
-
-  mutable std::mutex callback_mutex_;
-  ChunkCallback chunk_callback_;
-
-  mutable std::mutex error_mutex_;
-  std::string last_error_;
-
-  std::atomic<uint64_t> captured_input_frames_{0};
-  std::atomic<uint64_t> emitted_output_frames_{0};
-  std::atomic<uint64_t> emitted_chunks_{0};
-  std::atomic<uint64_t> dropped_chunks_{0};
-  std::atomic<uint64_t> silent_input_frames_{0};
-  std::atomic<uint32_t> input_sample_rate_{0};
-  std::atomic<uint64_t> chunk_sequence_{0};
-
-  double resample_accumulator_ = 0.0;
-  float last_left_sample_ = 0.0f;
-  float last_right_sample_ = 0.0f;
+  bool should_uninitialize_com_ = false;
+  bool started_ = false;
+  bool first_packet_ = true;
+  Microsoft::WRL::ComPtr<IAudioClient> audio_client_;
+  Microsoft::WRL::ComPtr<IAudioCaptureClient> capture_client_;
+  WAVEFORMATEX* mix_format_ = nullptr;
+  WAVEFORMATEX* closest_format_ = nullptr;
+  HANDLE capture_event_ = nullptr;
+  // Set by Wake(); WaitForData() waits on it alongside capture_event_. Lives
+  // as long as the backend, since Wake() may race Close().
+  HANDLE wake_event_ = nullptr;
 };
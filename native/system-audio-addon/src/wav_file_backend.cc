@@ -0,0 +1,195 @@
+#include "wav_file_backend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "channel_mixer.h"
+
+namespace {
+
+constexpr uint16_t kWaveFormatPcm = 0x0001;
+constexpr uint16_t kWaveFormatIeeeFloat = 0x0003;
+constexpr uint16_t kWaveFormatExtensible = 0xfffe;
+
+uint16_t ReadLe16(const uint8_t* bytes) {
+  return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+uint32_t ReadLe32(const uint8_t* bytes) {
+  return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+         (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+}  // namespace
+
+bool WavFileBackend::Open(const CaptureConfig& config,
+                          InputFormatInfo* format,
+                          std::string* error) {
+  const SourceConfig& source = config.source;
+  if (source.wav_path.empty()) {
+    if (error) *error = "WAV source needs a file path.";
+    return false;
+  }
+
+  file_.open(source.wav_path, std::ios::binary);
+  if (!file_) {
+    if (error) *error = "Could not open WAV file '" + source.wav_path + "'.";
+    return false;
+  }
+
+  if (!ParseHeader(format, error)) {
+    return false;
+  }
+
+  loop_ = source.loop;
+  realtime_ = source.realtime;
+  sample_rate_ = format->sample_rate;
+  block_align_ = BytesPerSample(format->sample_format) * format->channels;
+  packet_frames_ = std::max<uint32_t>(
+      1, static_cast<uint32_t>(static_cast<uint64_t>(sample_rate_) * source.packet_ms / 1000));
+  packet_.resize(packet_frames_ * block_align_);
+  next_frame_ = 0;
+  return true;
+}
+
+bool WavFileBackend::ParseHeader(InputFormatInfo* format, std::string* error) {
+  uint8_t riff[12];
+  if (!file_.read(reinterpret_cast<char*>(riff), sizeof(riff)) ||
+      std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0) {
+    if (error) *error = "Not a RIFF/WAVE file.";
+    return false;
+  }
+
+  bool have_format = false;
+  uint16_t format_tag = 0;
+  uint16_t channels = 0;
+  uint32_t sample_rate = 0;
+  uint16_t bits = 0;
+  uint16_t valid_bits = 0;
+  uint32_t channel_mask = 0;
+
+  uint8_t header[8];
+  while (file_.read(reinterpret_cast<char*>(header), sizeof(header))) {
+    const uint32_t chunk_size = ReadLe32(header + 4);
+    // Chunks are padded to an even size.
+    const uint64_t next_chunk =
+        static_cast<uint64_t>(file_.tellg()) + chunk_size + (chunk_size & 1);
+
+    if (std::memcmp(header, "fmt ", 4) == 0) {
+      uint8_t fmt[40] = {};
+      const size_t length = std::min<size_t>(chunk_size, sizeof(fmt));
+      if (chunk_size < 16 || !file_.read(reinterpret_cast<char*>(fmt), length)) {
+        if (error) *error = "WAV file has a truncated fmt chunk.";
+        return false;
+      }
+      format_tag = ReadLe16(fmt);
+      channels = ReadLe16(fmt + 2);
+      sample_rate = ReadLe32(fmt + 4);
+      bits = ReadLe16(fmt + 14);
+      valid_bits = bits;
+      if (format_tag == kWaveFormatExtensible && chunk_size >= 40) {
+        valid_bits = ReadLe16(fmt + 18);
+        channel_mask = ReadLe32(fmt + 20);
+        // The first two bytes of the sub-format GUID carry the plain tag.
+        format_tag = ReadLe16(fmt + 24);
+      }
+      have_format = true;
+    } else if (std::memcmp(header, "data", 4) == 0) {
+      if (!have_format) {
+        if (error) *error = "WAV data chunk precedes its fmt chunk.";
+        return false;
+      }
+      data_offset_ = static_cast<uint64_t>(file_.tellg());
+
+      format->sample_rate = sample_rate;
+      format->channels = channels;
+      format->bits_per_sample = bits;
+      format->valid_bits_per_sample = valid_bits;
+      format->channel_mask = channel_mask != 0 ? channel_mask : DefaultChannelMask(channels);
+      format->sample_format = SampleFormat::kUnknown;
+      if (format_tag == kWaveFormatIeeeFloat && bits == 32) {
+        format->sample_format = SampleFormat::kFloat32;
+      } else if (format_tag == kWaveFormatPcm) {
+        if (bits == 16) {
+          format->sample_format = SampleFormat::kInt16;
+        } else if (bits == 24) {
+          format->sample_format = SampleFormat::kInt24;
+        } else if (bits == 32) {
+          format->sample_format =
+              valid_bits == 24 ? SampleFormat::kInt24In32 : SampleFormat::kInt32;
+        }
+      }
+
+      const size_t block_align = BytesPerSample(format->sample_format) * channels;
+      if (block_align == 0 || sample_rate == 0) {
+        if (error) *error = "Unsupported WAV sample format.";
+        return false;
+      }
+      data_frames_ = chunk_size / block_align;
+      return true;
+    }
+
+    file_.seekg(static_cast<std::streamoff>(next_chunk));
+  }
+
+  if (error) *error = "WAV file has no data chunk.";
+  return false;
+}
+
+bool WavFileBackend::Start(std::string* /*error*/) {
+  pacer_.Start(std::chrono::duration_cast<PacketPacer::Clock::duration>(
+                   std::chrono::duration<double>(static_cast<double>(packet_frames_) /
+                                                 sample_rate_)),
+               realtime_);
+  return true;
+}
+
+bool WavFileBackend::WaitForData(uint32_t timeout_ms, std::string* /*error*/) {
+  pacer_.Wait(timeout_ms);
+  return true;
+}
+
+PacketStatus WavFileBackend::ReadPacket(CapturePacket* packet, std::string* error) {
+  if (next_frame_ >= data_frames_) {
+    if (!loop_ || data_frames_ == 0) {
+      return PacketStatus::kEndOfStream;
+    }
+    next_frame_ = 0;
+  }
+
+  PacketPacer::Clock::time_point start;
+  bool discontinuity = false;
+  if (!pacer_.TakePacket(&start, &discontinuity)) {
+    return PacketStatus::kEmpty;
+  }
+
+  const uint32_t frames =
+      static_cast<uint32_t>(std::min<uint64_t>(packet_frames_, data_frames_ - next_frame_));
+  file_.clear();
+  file_.seekg(static_cast<std::streamoff>(data_offset_ + next_frame_ * block_align_));
+  if (!file_.read(reinterpret_cast<char*>(packet_.data()),
+                  static_cast<std::streamsize>(frames * block_align_))) {
+    if (error) *error = "Read error in WAV data chunk.";
+    return PacketStatus::kError;
+  }
+
+  next_frame_ += frames;
+  packet->frames = frames;
+  packet->device_time_ns = PacketPacer::ToNs(start);
+  packet->discontinuity = discontinuity;
+  packet->silent = false;
+  packet->data = packet_.data();
+  return PacketStatus::kPacket;
+}
+
+bool WavFileBackend::ReleasePacket(const CapturePacket& /*packet*/, std::string* /*error*/) {
+  return true;
+}
+
+void WavFileBackend::Close() {
+  if (file_.is_open()) {
+    file_.close();
+  }
+  packet_.clear();
+}
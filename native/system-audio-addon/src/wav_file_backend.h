@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "capture_backend.h"
+#include "packet_pacer.h"
+
+// Replays the PCM or IEEE float data chunk of a RIFF/WAVE file as device
+// packets, optionally looping, so captures can be reproduced exactly.
+class WavFileBackend : public CaptureBackend {
+ public:
+  const char* name() const override { return "wav"; }
+  bool realtime() const override { return realtime_; }
+
+  bool Open(const CaptureConfig& config,
+            InputFormatInfo* format,
+            std::string* error) override;
+  bool Start(std::string* error) override;
+  bool WaitForData(uint32_t timeout_ms, std::string* error) override;
+  PacketStatus ReadPacket(CapturePacket* packet, std::string* error) override;
+  bool ReleasePacket(const CapturePacket& packet, std::string* error) override;
+  void Wake() override { pacer_.Wake(); }
+  void Stop() override {}
+  void Close() override;
+
+ private:
+  bool ParseHeader(InputFormatInfo* format, std::string* error);
+
+  std::ifstream file_;
+  bool loop_ = false;
+  bool realtime_ = true;
+  uint32_t packet_frames_ = 0;
+  size_t block_align_ = 0;
+  uint64_t data_offset_ = 0;
+  uint64_t data_frames_ = 0;
+  uint64_t next_frame_ = 0;
+  uint32_t sample_rate_ = 0;
+  std::vector<uint8_t> packet_;
+  PacketPacer pacer_;
+};
@@ -0,0 +1,199 @@
+// Checks PolyphaseResampler's two quality tiers at the conversions capture
+// actually runs: 44.1 kHz -> 48 kHz and 48 kHz -> 16 kHz. Tones are swept
+// across the input band and everything the output holds besides the tone
+// itself, i.e. aliases of tones above the output Nyquist and images above
+// the input Nyquist, must sit below each tier's stopband. The passband must
+// stay flat, and throughput is printed per core.
+//
+//   npm run test:native -- polyphase
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "polyphase_resampler.h"
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr float kAmplitude = 0.5f;
+// Streamed in device-sized packets, the way the converter feeds it.
+constexpr size_t kPacketFrames = 441;
+
+int g_failures = 0;
+// Keeps the throughput loop's output observable.
+volatile float g_sink = 0.0f;
+
+void Check(bool condition, const char* message) {
+  if (!condition) {
+    ++g_failures;
+    std::printf("  FAIL %s\n", message);
+  }
+}
+
+struct Tier {
+  ResamplerQuality quality;
+  // Worst spurious output allowed, relative to the tone, in dB.
+  double min_rejection_db;
+  // Fraction of the lower Nyquist up to which the gain stays within
+  // kFlatnessDb.
+  double flat_fraction;
+};
+
+constexpr double kFlatnessDb = 0.1;
+
+const Tier kTiers[] = {
+    {ResamplerQuality::kLowLatency, 70.0, 0.7},
+    {ResamplerQuality::kHighFidelity, 96.0, 0.8},
+};
+
+struct ToneResult {
+  // Level of the tone in the output, relative to the input, in dB.
+  double gain_db;
+  // Level of everything else in the output, relative to the input tone.
+  double spurious_db;
+};
+
+double ToDb(double power_ratio) { return 10.0 * std::log10(std::max(power_ratio, 1e-30)); }
+
+// Resamples half a second of a mono tone and splits the settled half of the
+// output into a least-squares fit of the tone and the residual. A tone above
+// the output Nyquist has no place in the output, so all of it is residual.
+ToneResult MeasureTone(uint32_t input_rate,
+                       uint32_t output_rate,
+                       ResamplerQuality quality,
+                       double frequency) {
+  PolyphaseResampler resampler;
+  std::string error;
+  resampler.Configure(input_rate, output_rate, 1, quality, &error);
+
+  const size_t input_frames = input_rate / 2;
+  std::vector<float> input(input_frames);
+  for (size_t index = 0; index < input_frames; ++index) {
+    input[index] = kAmplitude * static_cast<float>(std::sin(2.0 * kPi * frequency * index /
+                                                            input_rate));
+  }
+  std::vector<float> output(resampler.MaxOutputFrames(input_frames) + output_rate / 100);
+  size_t produced = 0;
+  for (size_t offset = 0; offset < input_frames; offset += kPacketFrames) {
+    const size_t count = std::min(kPacketFrames, input_frames - offset);
+    produced += resampler.Process(input.data() + offset, count, output.data() + produced,
+                                  output.size() - produced);
+  }
+
+  // Skip the first quarter, well past the filter's delay, and stop short of
+  // the end.
+  const size_t first = produced / 4;
+  const size_t length = produced / 2;
+  const bool in_band = frequency < output_rate / 2.0;
+  double cc = 0.0, ss = 0.0, cs = 0.0, yc = 0.0, ys = 0.0;
+  for (size_t index = first; index < first + length; ++index) {
+    const double phase = 2.0 * kPi * frequency * index / output_rate;
+    const double c = std::cos(phase);
+    const double s = std::sin(phase);
+    cc += c * c;
+    ss += s * s;
+    cs += c * s;
+    yc += output[index] * c;
+    ys += output[index] * s;
+  }
+  double a = 0.0;
+  double b = 0.0;
+  const double determinant = cc * ss - cs * cs;
+  if (in_band && std::abs(determinant) > 1e-9) {
+    a = (yc * ss - ys * cs) / determinant;
+    b = (ys * cc - yc * cs) / determinant;
+  }
+  double residual = 0.0;
+  for (size_t index = first; index < first + length; ++index) {
+    const double phase = 2.0 * kPi * frequency * index / output_rate;
+    const double value = output[index] - a * std::cos(phase) - b * std::sin(phase);
+    residual += value * value;
+  }
+
+  const double tone_power = kAmplitude * kAmplitude / 2.0;
+  ToneResult result;
+  result.gain_db = ToDb((a * a + b * b) / 2.0 / tone_power);
+  result.spurious_db = ToDb(residual / static_cast<double>(length) / tone_power);
+  return result;
+}
+
+void TestConversion(uint32_t input_rate, uint32_t output_rate) {
+  const double input_nyquist = input_rate / 2.0;
+  const double lower_nyquist = std::min(input_rate, output_rate) / 2.0;
+  for (const Tier& tier : kTiers) {
+    std::printf("%u -> %u Hz, %s\n", input_rate, output_rate,
+                ResamplerQualityName(tier.quality));
+
+    // Every tone up to the input Nyquist, more densely from just below the
+    // lower Nyquist, where the transition band ends.
+    std::vector<double> tones;
+    for (double frequency = 100.0; frequency < input_nyquist; frequency += input_nyquist / 200) {
+      tones.push_back(frequency);
+    }
+    const double dense_end = std::min(input_nyquist, lower_nyquist * 1.1);
+    for (double frequency = lower_nyquist * 0.95; frequency < dense_end;
+         frequency += lower_nyquist / 400) {
+      tones.push_back(frequency);
+    }
+
+    double worst_db = -300.0;
+    double worst_frequency = 0.0;
+    double worst_flat_db = 0.0;
+    for (double frequency : tones) {
+      const ToneResult result = MeasureTone(input_rate, output_rate, tier.quality, frequency);
+      if (result.spurious_db > worst_db) {
+        worst_db = result.spurious_db;
+        worst_frequency = frequency;
+      }
+      if (frequency <= lower_nyquist * tier.flat_fraction) {
+        worst_flat_db = std::max(worst_flat_db, std::abs(result.gain_db));
+      }
+    }
+    std::printf("  rejection %.1f dB (worst at %.0f Hz), passband within %.3f dB\n",
+                -worst_db, worst_frequency, worst_flat_db);
+    Check(-worst_db >= tier.min_rejection_db, "aliases and images stay below the stopband");
+    Check(worst_flat_db <= kFlatnessDb, "the passband is flat");
+
+    // Stereo, as captured; one thread, so this is per core.
+    constexpr uint32_t kChannels = 2;
+    PolyphaseResampler resampler;
+    std::string error;
+    resampler.Configure(input_rate, output_rate, kChannels, tier.quality, &error);
+    std::vector<float> input(kPacketFrames * kChannels);
+    for (size_t index = 0; index < input.size(); ++index) {
+      input[index] = kAmplitude * static_cast<float>(std::sin(0.01 * index));
+    }
+    std::vector<float> output(resampler.MaxOutputFrames(kPacketFrames) * kChannels);
+    const size_t packets = 20 * input_rate / kPacketFrames;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t packet = 0; packet < packets; ++packet) {
+      const size_t produced = resampler.Process(input.data(), kPacketFrames, output.data(),
+                                                output.size() / kChannels);
+      if (produced > 0) g_sink = g_sink + output[0];
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double frames_per_second = packets * kPacketFrames / seconds;
+    std::printf("  %.1f M input frames/s per core (%u taps, %.0fx realtime)\n",
+                frames_per_second / 1e6, resampler.taps_per_phase(),
+                frames_per_second / input_rate);
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestConversion(44100, 48000);
+  TestConversion(48000, 16000);
+  if (g_failures > 0) {
+    std::printf("%d check(s) failed\n", g_failures);
+    return 1;
+  }
+  std::printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,143 @@
+// Checks SharedPcmRingWriter, the producer side of the SharedArrayBuffer ring
+// the renderer's worklet reads: headers it must refuse, int16 frames and
+// float32 planes written across the end of the storage, silence, and whole
+// chunks dropped as overrun when the reader is behind.
+//
+//   npm run test:native -- shared_pcm
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "shared_pcm_ring.h"
+
+namespace {
+
+int g_failures = 0;
+
+void Check(bool condition, const char* message) {
+  if (!condition) {
+    ++g_failures;
+    std::printf("  FAIL %s\n", message);
+  }
+}
+
+constexpr uint32_t kCapacity = 8;
+constexpr uint32_t kChannels = 2;
+
+// A ring as src/audio/sharedPcmRing.js initializes it, in int32 cells so the
+// header is aligned the way a SharedArrayBuffer is.
+std::vector<int32_t> MakeRing(int32_t format, size_t sample_bytes) {
+  const size_t bytes = kSharedRingHeaderBytes + kCapacity * kChannels * sample_bytes;
+  std::vector<int32_t> memory(bytes / sizeof(int32_t), 0);
+  memory[kSharedRingMagic] = kSharedRingMagicValue;
+  memory[kSharedRingVersion] = kSharedRingVersionValue;
+  memory[kSharedRingCapacityFrames] = kCapacity;
+  memory[kSharedRingChannels] = kChannels;
+  memory[kSharedRingSampleFormat] = format;
+  return memory;
+}
+
+template <typename T>
+const T* Samples(const std::vector<int32_t>& memory) {
+  return reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(memory.data()) +
+                                    kSharedRingHeaderBytes);
+}
+
+size_t Bytes(const std::vector<int32_t>& memory) { return memory.size() * sizeof(int32_t); }
+
+void TestAttach() {
+  std::printf("attach\n");
+  SharedPcmRingWriter writer;
+  std::vector<int32_t> ring = MakeRing(kSharedRingInt16, sizeof(int16_t));
+  Check(writer.Attach(ring.data(), Bytes(ring)), "a valid int16 ring attaches");
+  Check(!writer.Attach(ring.data(), Bytes(ring) - 1), "a buffer too short is refused");
+
+  std::vector<int32_t> wrong_version = ring;
+  wrong_version[kSharedRingVersion] = 1;
+  Check(!writer.Attach(wrong_version.data(), Bytes(wrong_version)), "version 1 is refused");
+
+  std::vector<int32_t> wrong_format = ring;
+  wrong_format[kSharedRingSampleFormat] = 7;
+  Check(!writer.Attach(wrong_format.data(), Bytes(wrong_format)), "unknown format is refused");
+
+  // Float samples are twice the size, so the int16-sized buffer cannot hold them.
+  std::vector<int32_t> short_float = ring;
+  short_float[kSharedRingSampleFormat] = kSharedRingFloat32Planar;
+  Check(!writer.Attach(short_float.data(), Bytes(short_float)), "float ring sized for int16");
+}
+
+void TestInt16Wrap() {
+  std::printf("int16 wrap\n");
+  std::vector<int32_t> ring = MakeRing(kSharedRingInt16, sizeof(int16_t));
+  SharedPcmRingWriter writer;
+  Check(writer.Attach(ring.data(), Bytes(ring)), "attach");
+
+  // The reader has consumed six frames, so the next write starts at slot 6
+  // and wraps after two frames.
+  ring[kSharedRingWriteFrame] = 6;
+  ring[kSharedRingReadFrame] = 6;
+  const int16_t chunk[] = {1, -1, 2, -2, 3, -3, 4, -4};
+  Check(writer.Write(chunk, 4), "write across the end");
+  const int16_t* samples = Samples<int16_t>(ring);
+  Check(samples[12] == 1 && samples[13] == -1 && samples[14] == 2 && samples[15] == -2,
+        "frames before the end");
+  Check(samples[0] == 3 && samples[1] == -3 && samples[2] == 4 && samples[3] == -4,
+        "frames after the end");
+  Check(ring[kSharedRingWriteFrame] == 10, "write frame advanced");
+  Check(ring[kSharedRingWriteSequence] == 1, "write sequence counted");
+
+  Check(writer.Write(nullptr, 2), "silence");
+  Check(samples[4] == 0 && samples[7] == 0, "silence writes zeros");
+}
+
+void TestFloatPlanarWrap() {
+  std::printf("float32 planar wrap\n");
+  std::vector<int32_t> ring = MakeRing(kSharedRingFloat32Planar, sizeof(float));
+  SharedPcmRingWriter writer;
+  Check(writer.Attach(ring.data(), Bytes(ring)), "attach");
+  Check(writer.format() == kSharedRingFloat32Planar, "format read from the header");
+
+  ring[kSharedRingWriteFrame] = 6;
+  ring[kSharedRingReadFrame] = 6;
+  // One plane of four frames per channel, as the capture delivers them.
+  const float chunk[] = {0.1f, 0.2f, 0.3f, 0.4f, -0.1f, -0.2f, -0.3f, -0.4f};
+  Check(writer.Write(chunk, 4), "write across the end");
+  const float* left = Samples<float>(ring);
+  const float* right = left + kCapacity;
+  Check(left[6] == 0.1f && left[7] == 0.2f && left[0] == 0.3f && left[1] == 0.4f,
+        "left plane wraps");
+  Check(right[6] == -0.1f && right[7] == -0.2f && right[0] == -0.3f && right[1] == -0.4f,
+        "right plane wraps");
+}
+
+void TestOverrun() {
+  std::printf("overrun\n");
+  std::vector<int32_t> ring = MakeRing(kSharedRingFloat32Planar, sizeof(float));
+  SharedPcmRingWriter writer;
+  Check(writer.Attach(ring.data(), Bytes(ring)), "attach");
+
+  std::vector<float> chunk(6 * kChannels, 0.5f);
+  Check(writer.Write(chunk.data(), 6), "first chunk fits");
+  Check(!writer.Write(chunk.data(), 6), "second chunk does not");
+  const SharedRingStats stats = writer.GetStats();
+  Check(stats.occupancy_frames == 6, "only the first chunk is in the ring");
+  Check(stats.overrun_frames == 6, "the whole second chunk counts as overrun");
+  Check(stats.write_sequence == 1, "the dropped chunk is not sequenced");
+}
+
+}  // namespace
+
+int main() {
+  TestAttach();
+  TestInt16Wrap();
+  TestFloatPlanarWrap();
+  TestOverrun();
+  if (g_failures > 0) {
+    std::printf("%d check(s) failed\n", g_failures);
+    return 1;
+  }
+  std::printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,243 @@
+// Checks SpscRingBuffer, the pending-sample ring the capture loop cuts
+// chunks from: writes that wrap through the mirrored tail, contiguous peeks
+// across the end of the storage up to `max_view` items and no further,
+// chunk-sized and partial consumption, and a producer and consumer on two
+// threads.
+//
+//   npm run test:native -- spsc
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring_buffer.h"
+
+namespace {
+
+int g_failures = 0;
+
+void Check(bool condition, const char* message) {
+  if (!condition) {
+    ++g_failures;
+    std::printf("  FAIL %s\n", message);
+  }
+}
+
+// `count` consecutive values from `first`, so a view shows where it came from.
+std::vector<int32_t> Sequence(int32_t first, size_t count) {
+  std::vector<int32_t> values(count);
+  for (size_t index = 0; index < count; ++index) {
+    values[index] = first + static_cast<int32_t>(index);
+  }
+  return values;
+}
+
+bool IsSequence(const int32_t* values, int32_t first, size_t count) {
+  if (!values) return false;
+  for (size_t index = 0; index < count; ++index) {
+    if (values[index] != first + static_cast<int32_t>(index)) return false;
+  }
+  return true;
+}
+
+void TestReset() {
+  std::printf("reset\n");
+  SpscRingBuffer<int32_t> ring(8, 20);
+  Check(ring.capacity() == 8, "capacity as asked");
+  Check(ring.max_view() == 8, "max_view is clamped to the capacity");
+  ring.Reset(0);
+  Check(ring.capacity() == 1 && ring.max_view() == 0, "a zero capacity becomes one slot");
+
+  ring.Reset(4, 2);
+  const std::vector<int32_t> values = Sequence(1, 3);
+  Check(ring.Write(values.data(), 3) == 3, "write before clear");
+  ring.Clear();
+  Check(ring.Size() == 0 && ring.ReadAvailable() == 0, "clear empties the ring");
+  Check(ring.WriteAvailable() == 4, "clear frees every slot");
+}
+
+void TestWriteLimits() {
+  std::printf("write limits\n");
+  SpscRingBuffer<int32_t> ring(8, 4);
+  const std::vector<int32_t> values = Sequence(0, 12);
+  Check(ring.Write(nullptr, 4) == 0, "a null write stores nothing");
+  Check(ring.Write(values.data(), 0) == 0, "an empty write stores nothing");
+  Check(ring.Write(values.data(), 12) == 8, "a write stops at the capacity");
+  Check(ring.WriteAvailable() == 0, "full");
+  Check(!ring.Push(99), "push into a full ring fails");
+  ring.Consume(3);
+  Check(ring.WriteAvailable() == 3, "consumed slots are writable again");
+  Check(ring.Write(values.data() + 8, 4) == 3, "a write fills exactly the freed slots");
+  Check(ring.Size() == 8, "full again");
+
+  int32_t out[8] = {};
+  Check(ring.Read(out, 8) == 8, "read everything back");
+  Check(IsSequence(out, 3, 8), "reads come back in order across the wrap");
+  Check(ring.Read(out, 1) == 0, "nothing left to read");
+}
+
+// Writes that start inside the first `max_view` slots are mirrored past the
+// end, including the part of a write that wraps to the start.
+void TestMirroredTail() {
+  std::printf("mirrored tail\n");
+  SpscRingBuffer<int32_t> ring(10, 6);
+
+  // Move the indices to 7 so the next write wraps.
+  const std::vector<int32_t> filler = Sequence(-7, 7);
+  Check(ring.Write(filler.data(), 7) == 7, "fill");
+  ring.Consume(7);
+
+  // Slots 7, 8, 9, then 0, 1, 2 through the wrap.
+  const std::vector<int32_t> values = Sequence(100, 6);
+  Check(ring.Write(values.data(), 6) == 6, "a write that wraps");
+  const int32_t* view = ring.Peek(6);
+  Check(view != nullptr, "a six-item view across the end is within max_view");
+  Check(IsSequence(view, 100, 6), "the wrapped part reads through the mirror");
+  ring.Consume(6);
+
+  // Fill the whole ring from slot 3: slots 3..5 are mirrored as they are
+  // written, slots 0..2 after the wrap.
+  const std::vector<int32_t> more = Sequence(200, 10);
+  Check(ring.Write(more.data(), 10) == 10, "a full-ring write from slot 3");
+  for (int32_t first = 200; first < 210; first += 2) {
+    const int32_t* pair = ring.Peek(2);
+    Check(IsSequence(pair, first, 2), "every pair is contiguous, including across the end");
+    ring.Consume(2);
+  }
+}
+
+void TestViewEdges() {
+  std::printf("view edges\n");
+  SpscRingBuffer<int32_t> ring(16, 4);
+  const std::vector<int32_t> filler = Sequence(0, 13);
+  ring.Write(filler.data(), 13);
+  ring.Consume(13);
+
+  // The read position is 13: three items to the end, the rest wrapped.
+  const std::vector<int32_t> values = Sequence(50, 12);
+  Check(ring.Write(values.data(), 12) == 12, "write across the end");
+  Check(ring.Peek(0) == nullptr, "a zero-item peek has no view");
+  Check(IsSequence(ring.Peek(3), 50, 3), "a view that ends exactly at the end");
+  Check(IsSequence(ring.Peek(4), 50, 4), "a wrapping view of exactly max_view items");
+  Check(ring.Peek(5) == nullptr, "a wrapping view longer than max_view");
+  Check(ring.Peek(13) == nullptr, "more than is buffered");
+
+  // From slot 0 a view never wraps, so it may exceed max_view.
+  ring.Consume(3);
+  Check(IsSequence(ring.Peek(9), 53, 9), "an unwrapped view longer than max_view");
+  ring.Consume(9);
+  Check(ring.Size() == 0, "drained");
+
+  // Without a mirror only unwrapped views exist.
+  SpscRingBuffer<int32_t> plain(8, 0);
+  plain.Write(filler.data(), 6);
+  plain.Consume(6);
+  plain.Write(values.data(), 4);
+  Check(IsSequence(plain.Peek(2), 50, 2), "unwrapped view without a mirror");
+  Check(plain.Peek(3) == nullptr, "no wrapped view without a mirror");
+  int32_t out[4] = {};
+  Check(plain.Read(out, 4) == 4 && IsSequence(out, 50, 4), "read still copies across the end");
+}
+
+// The capture loop's pattern: write whatever the device delivered, then cut
+// every whole chunk and leave the remainder for the next packet.
+void TestChunkConsumption() {
+  std::printf("chunk consumption\n");
+  constexpr size_t kChunk = 6;
+  SpscRingBuffer<int32_t> ring(kChunk * 4, kChunk);
+  int32_t next_in = 0;
+  int32_t next_out = 0;
+  size_t chunks = 0;
+  bool ordered = true;
+
+  // Packet sizes that are not multiples of the chunk, so partial chunks wait
+  // across writes and the read position walks every slot of the ring.
+  for (size_t packet : {5u, 7u, 1u, 11u, 6u, 4u, 13u, 2u, 9u, 8u, 3u, 17u}) {
+    const std::vector<int32_t> values = Sequence(next_in, packet);
+    Check(ring.Write(values.data(), packet) == packet, "the packet fits");
+    next_in += static_cast<int32_t>(packet);
+
+    while (const int32_t* chunk = ring.Peek(kChunk)) {
+      ordered = ordered && IsSequence(chunk, next_out, kChunk);
+      ring.Consume(kChunk);
+      next_out += static_cast<int32_t>(kChunk);
+      ++chunks;
+    }
+    Check(ring.Size() < kChunk, "only a partial chunk is left behind");
+    Check(ring.Size() == static_cast<size_t>(next_in - next_out), "the partial chunk waits");
+  }
+  Check(ordered, "every chunk is contiguous and in order");
+  Check(chunks == static_cast<size_t>(next_out) / kChunk, "every whole chunk was cut");
+
+  // A consumer may take less than it peeked; the rest stays at the front.
+  const std::vector<int32_t> values = Sequence(next_in, kChunk);
+  ring.Write(values.data(), kChunk);
+  const int32_t* view = ring.Peek(kChunk);
+  Check(view != nullptr, "a whole chunk");
+  ring.Consume(2);
+  Check(IsSequence(ring.Peek(1), next_out + 2, 1), "partial consume keeps the rest in order");
+}
+
+// One producer and one consumer on their own threads, the sharing the ring
+// is built for.
+void TestConcurrent() {
+  std::printf("two threads\n");
+  constexpr size_t kChunk = 64;
+  constexpr int32_t kTotal = 2000000;
+  SpscRingBuffer<int32_t> ring(kChunk * 5, kChunk);
+
+  std::thread producer([&ring]() {
+    std::vector<int32_t> block(37);
+    int32_t next = 0;
+    while (next < kTotal) {
+      const size_t count = std::min<size_t>(block.size(), static_cast<size_t>(kTotal - next));
+      for (size_t index = 0; index < count; ++index) {
+        block[index] = next + static_cast<int32_t>(index);
+      }
+      size_t written = 0;
+      while (written < count) {
+        written += ring.Write(block.data() + written, count - written);
+        if (written < count) std::this_thread::yield();
+      }
+      next += static_cast<int32_t>(count);
+    }
+  });
+
+  int32_t expected = 0;
+  bool ordered = true;
+  while (expected + static_cast<int32_t>(kChunk) <= kTotal) {
+    const int32_t* chunk = ring.Peek(kChunk);
+    if (!chunk) {
+      std::this_thread::yield();
+      continue;
+    }
+    ordered = ordered && IsSequence(chunk, expected, kChunk);
+    ring.Consume(kChunk);
+    expected += static_cast<int32_t>(kChunk);
+  }
+  producer.join();
+  int32_t tail[kChunk] = {};
+  const size_t left = ring.Read(tail, kChunk);
+  ordered = ordered && IsSequence(tail, expected, left);
+  Check(ordered, "the consumer sees every item once, in order");
+  Check(expected + static_cast<int32_t>(left) == kTotal, "nothing is lost");
+}
+
+}  // namespace
+
+int main() {
+  TestReset();
+  TestWriteLimits();
+  TestMirroredTail();
+  TestViewEdges();
+  TestChunkConsumption();
+  TestConcurrent();
+  if (g_failures > 0) {
+    std::printf("%d check(s) failed\n", g_failures);
+    return 1;
+  }
+  std::printf("all checks passed\n");
+  return 0;
+}
@@ -0,0 +1,471 @@
+// Checks the device lifecycle of SystemAudioCapture and CaptureHub against a
+// fake device whose open is slow, the way WASAPI activation and
+// initialization are: a prepared device must start without reopening, stop
+// back into standby, and report start failures from the start call itself,
+// including a device that fails before its first packet. Stop must not wait
+// out a device wait. prepare() and prepareSessions() hold the standby
+// independently. A capture and a session on one hub share the device,
+// and a stalled session holds up neither stats, the others nor sessions
+// joining while it is removed.
+//
+//   npm run test:native
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "capture_hub.h"
+#include "synthetic_backend.h"
+#include "system_audio_capture.h"
+
+namespace {
+
+constexpr int kOpenDelayMs = 150;
+
+int g_failures = 0;
+
+void Check(bool condition, const char* message) {
+  if (!condition) {
+    ++g_failures;
+    std::printf("  FAIL %s\n", message);
+  }
+}
+
+// What the fake device was asked to do, shared with the test because the
+// capture owns the backend.
+struct DeviceLog {
+  std::atomic<int> opens{0};
+  std::atomic<int> starts{0};
+  std::atomic<int> stops{0};
+  std::atomic<int> closes{0};
+  std::atomic<bool> fail_open{false};
+  std::atomic<bool> fail_start{false};
+  std::atomic<bool> fail_read{false};
+  // Every call has to come from the thread that opened the device.
+  std::mutex mutex;
+  std::thread::id device_thread;
+  bool wrong_thread = false;
+
+  void Called() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (device_thread != std::this_thread::get_id()) wrong_thread = true;
+  }
+};
+
+// A synthetic tone behind an open that takes kOpenDelayMs.
+class FakeDevice : public SyntheticBackend {
+ public:
+  explicit FakeDevice(DeviceLog* log) : log_(log) {}
+
+  const char* name() const override { return "fake"; }
+
+  bool Open(const CaptureConfig& config, InputFormatInfo* format, std::string* error) override {
+    {
+      std::lock_guard<std::mutex> lock(log_->mutex);
+      log_->device_thread = std::this_thread::get_id();
+    }
+    log_->opens.fetch_add(1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(kOpenDelayMs));
+    if (log_->fail_open.load()) {
+      if (error) *error = "fake open failed";
+      return false;
+    }
+    return SyntheticBackend::Open(config, format, error);
+  }
+
+  bool Start(std::string* error) override {
+    log_->Called();
+    log_->starts.fetch_add(1);
+    if (log_->fail_start.load()) {
+      if (error) *error = "fake start failed";
+      return false;
+    }
+    return SyntheticBackend::Start(error);
+  }
+
+  PacketStatus ReadPacket(CapturePacket* packet, std::string* error) override {
+    if (log_->fail_read.load()) {
+      if (error) *error = "fake read failed";
+      return PacketStatus::kError;
+    }
+    return SyntheticBackend::ReadPacket(packet, error);
+  }
+
+  void Stop() override {
+    log_->Called();
+    log_->stops.fetch_add(1);
+  }
+
+  void Close() override {
+    log_->Called();
+    log_->closes.fetch_add(1);
+    SyntheticBackend::Close();
+  }
+
+ private:
+  DeviceLog* const log_;
+};
+
+CaptureBackendFactory FakeFactory(DeviceLog* log) {
+  return [log](const CaptureConfig&, std::string*) -> std::unique_ptr<CaptureBackend> {
+    return std::make_unique<FakeDevice>(log);
+  };
+}
+
+CaptureConfig FakeConfig(double tone_hz = 440.0, uint32_t packet_ms = 10) {
+  CaptureConfig config;
+  config.source.backend = "fake";
+  config.source.tone_hz = tone_hz;
+  config.source.packet_ms = packet_ms;
+  return config;
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point started) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started)
+      .count();
+}
+
+// Counts chunks and lets the test wait for the next one.
+class ChunkCounter {
+ public:
+  ChunkCallback callback() {
+    return [this](const AudioChunk&) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++chunks_;
+      }
+      arrived_.notify_all();
+    };
+  }
+
+  bool WaitForChunks(int count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return arrived_.wait_for(lock, std::chrono::seconds(2),
+                             [this, count]() { return chunks_ >= count; });
+  }
+
+  int chunks() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunks_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable arrived_;
+  int chunks_ = 0;
+};
+
+void TestColdStart() {
+  std::printf("cold start\n");
+  DeviceLog log;
+  SystemAudioCapture capture(FakeFactory(&log));
+  ChunkCounter counter;
+  capture.SetChunkCallback(counter.callback());
+
+  std::string error;
+  Check(capture.Start(FakeConfig(), &error), "start opens and starts the device");
+  Check(log.opens == 1 && log.starts == 1, "one open and one start");
+  Check(counter.WaitForChunks(1), "a chunk arrives");
+  const CaptureStats stats = capture.GetStats();
+  Check(!stats.warm_start && !stats.standby, "a cold start is neither warm nor standby");
+  Check(stats.start_to_first_chunk_ms >= kOpenDelayMs,
+        "start-to-first-chunk latency includes the open");
+
+  capture.Stop();
+  Check(log.stops == 1 && log.closes == 1, "stop without prepare closes the device");
+  Check(!capture.GetStats().running, "stopped");
+  Check(!log.wrong_thread, "every backend call ran on the device thread");
+}
+
+void TestWarmStart() {
+  std::printf("warm start\n");
+  DeviceLog log;
+  SystemAudioCapture capture(FakeFactory(&log));
+  ChunkCounter counter;
+  capture.SetChunkCallback(counter.callback());
+
+  std::string error;
+  Check(capture.Prepare(FakeConfig(), &error), "prepare opens the device");
+  Check(log.opens == 1 && log.starts == 0, "prepare opens without starting");
+  Check(capture.GetStats().standby, "prepared device reports standby");
+
+  for (int run = 1; run <= 2; ++run) {
+    const auto started = std::chrono::steady_clock::now();
+    Check(capture.Start(FakeConfig(), &error), "start from standby");
+    const double start_ms = MillisecondsSince(started);
+    Check(start_ms < kOpenDelayMs, "start from standby does not wait for an open");
+    Check(log.opens == 1 && log.starts == run, "start from standby does not reopen");
+    Check(counter.WaitForChunks(counter.chunks() + 1), "a chunk arrives");
+    const CaptureStats stats = capture.GetStats();
+    Check(stats.warm_start, "start from standby is warm");
+    Check(stats.start_to_first_chunk_ms > 0.0 && stats.start_to_first_chunk_ms < kOpenDelayMs,
+          "start-to-first-chunk latency excludes the open");
+    std::printf("  run %d: start %.2f ms, first chunk %.2f ms\n", run, start_ms,
+                stats.start_to_first_chunk_ms);
+
+    capture.Stop();
+    Check(log.stops == run && log.closes == 0, "stop returns to standby");
+    Check(capture.GetStats().standby && !capture.IsRunning(), "standby after stop");
+  }
+
+  // Another source cannot use the prepared device.
+  Check(capture.Start(FakeConfig(880.0), &error), "start with another source");
+  Check(log.opens == 2 && log.closes == 1, "another source reopens");
+  Check(!capture.GetStats().warm_start, "another source is a cold start");
+  capture.Stop();
+  Check(log.closes == 1, "the new device stays prepared");
+
+  capture.Release();
+  Check(log.closes == 2, "release closes the device");
+  Check(!capture.GetStats().standby, "no standby after release");
+  Check(!log.wrong_thread, "every backend call ran on the device thread");
+}
+
+void TestStartErrors() {
+  std::printf("start errors\n");
+  DeviceLog log;
+  SystemAudioCapture capture(FakeFactory(&log));
+  ChunkCounter counter;
+  capture.SetChunkCallback(counter.callback());
+
+  std::string error;
+  log.fail_open = true;
+  Check(!capture.Start(FakeConfig(), &error), "a failed open fails start");
+  Check(error == "fake open failed", "start returns the open error");
+  Check(!capture.IsRunning(), "not running after a failed open");
+  Check(!capture.Prepare(FakeConfig(), &error), "a failed open fails prepare");
+  Check(log.closes == 2, "a failed open closes the device");
+
+  log.fail_open = false;
+  log.fail_start = true;
+  error.clear();
+  Check(capture.Prepare(FakeConfig(), &error), "prepare");
+  Check(!capture.Start(FakeConfig(), &error), "a failed stream start fails start");
+  Check(error == "fake start failed", "start returns the start error");
+  Check(!capture.IsRunning() && capture.GetStats().standby,
+        "a prepared device stays in standby after a failed start");
+
+  log.fail_start = false;
+  Check(capture.Start(FakeConfig(), &error), "start after the device recovers");
+  Check(log.opens == 3, "recovering does not reopen");
+  Check(counter.WaitForChunks(1), "a chunk arrives");
+  capture.Stop();
+
+  // Start waits for the first packet, so a device that fails reading it
+  // fails the start rather than a later stats poll.
+  log.fail_read = true;
+  error.clear();
+  Check(!capture.Start(FakeConfig(), &error), "a failed first read fails start");
+  Check(error == "fake read failed", "start returns the read error");
+  Check(!capture.IsRunning(), "not running after a failed first read");
+  Check(log.closes == 3, "a device that failed reading is closed");
+  log.fail_read = false;
+  capture.Release();
+}
+
+void TestPromptStop() {
+  std::printf("prompt stop\n");
+  DeviceLog log;
+  SystemAudioCapture capture(FakeFactory(&log));
+  ChunkCounter counter;
+  capture.SetChunkCallback(counter.callback());
+
+  // Half-second packets keep the device thread in its wait; stopping has to
+  // wake it rather than wait for the next packet or the wait timeout.
+  std::string error;
+  Check(capture.Prepare(FakeConfig(440.0, 500), &error), "prepare");
+  Check(capture.Start(FakeConfig(440.0, 500), &error), "start");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  auto started = std::chrono::steady_clock::now();
+  capture.Stop();
+  const double stop_ms = MillisecondsSince(started);
+  Check(stop_ms < 50.0, "stop into standby wakes the device wait");
+
+  Check(capture.Start(FakeConfig(440.0, 500), &error), "start again");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  started = std::chrono::steady_clock::now();
+  capture.Release();
+  const double release_ms = MillisecondsSince(started);
+  Check(release_ms < 50.0, "release wakes the device wait");
+  std::printf("  stop %.2f ms, release %.2f ms\n", stop_ms, release_ms);
+}
+
+void TestHubStandby() {
+  std::printf("shared capture standby\n");
+  DeviceLog log;
+  ChunkCounter counter;
+  CaptureHub hub(FakeFactory(&log));
+
+  std::string error;
+  Check(hub.Prepare(FakeConfig(), &error), "prepare opens the shared device");
+  Check(log.opens == 1 && log.starts == 0, "prepare opens without starting");
+
+  for (int run = 1; run <= 2; ++run) {
+    std::shared_ptr<CaptureSession> session =
+        hub.AddSession(FakeConfig(), counter.callback(), &error);
+    Check(session != nullptr, "the first session starts the prepared device");
+    Check(log.opens == 1 && log.starts == run, "the first session does not reopen");
+    Check(counter.WaitForChunks(counter.chunks() + 1), "a chunk arrives");
+    const CaptureStats stats = hub.GetSessionStats(*session);
+    Check(stats.warm_start && stats.standby, "the session started warm");
+    Check(stats.start_to_first_chunk_ms > 0.0 && stats.start_to_first_chunk_ms < kOpenDelayMs,
+          "session start-to-first-chunk latency excludes the open");
+    hub.RemoveSession(session);
+    Check(log.stops == run && log.closes == 0, "the last session returns to standby");
+  }
+
+  hub.Release();
+  Check(log.closes == 1, "release closes the shared device");
+  Check(!log.wrong_thread, "every backend call ran on the device thread");
+}
+
+// prepare() and prepareSessions() each hold the standby of the one device:
+// releasing either leaves it open for the other.
+void TestStandbyHolds() {
+  std::printf("standby holds\n");
+  DeviceLog log;
+  auto hub = std::make_shared<CaptureHub>(FakeFactory(&log));
+  SystemAudioCapture capture(hub);
+
+  std::string error;
+  Check(capture.Prepare(FakeConfig(), &error), "the capture prepares the device");
+  Check(capture.Prepare(FakeConfig(), &error), "preparing again keeps the one hold");
+  Check(hub->Prepare(FakeConfig(), &error), "the sessions prepare the same device");
+  Check(log.opens == 1, "one open for both holds");
+
+  capture.Release();
+  Check(log.closes == 0, "the sessions' hold keeps the device open");
+  Check(hub->GetDeviceStats().standby, "still in standby");
+  capture.Release();
+  Check(log.closes == 0, "releasing twice gives back nothing more");
+
+  ChunkCounter counter;
+  std::shared_ptr<CaptureSession> session =
+      hub->AddSession(FakeConfig(), counter.callback(), &error);
+  Check(session && hub->GetSessionStats(*session).warm_start, "a session starts warm");
+  hub->RemoveSession(session);
+  Check(log.stops == 1 && log.closes == 0, "the session returns the device to standby");
+
+  hub->Release();
+  Check(log.closes == 1, "the last hold closes the device");
+  Check(!hub->GetDeviceStats().standby, "no standby once every hold is given back");
+}
+
+// start() and createSession() run on one hub, so they share the device.
+void TestSharedDevice() {
+  std::printf("capture and session share the device\n");
+  DeviceLog log;
+  auto hub = std::make_shared<CaptureHub>(FakeFactory(&log));
+  SystemAudioCapture capture(hub);
+  ChunkCounter capture_counter;
+  ChunkCounter session_counter;
+  capture.SetChunkCallback(capture_counter.callback());
+
+  std::string error;
+  Check(capture.Start(FakeConfig(), &error), "the capture starts the device");
+  CaptureConfig mono = FakeConfig();
+  mono.target_sample_rate = 16000;
+  mono.target_channels = 1;
+  std::shared_ptr<CaptureSession> session =
+      hub->AddSession(mono, session_counter.callback(), &error);
+  Check(session != nullptr, "a session joins the running capture");
+  Check(log.opens == 1 && log.starts == 1, "one device open and start for both");
+  Check(capture_counter.WaitForChunks(2) && session_counter.WaitForChunks(2),
+        "both receive chunks");
+  Check(!hub->AddSession(FakeConfig(880.0), session_counter.callback(), &error),
+        "another source cannot join the running device");
+
+  capture.Stop();
+  Check(log.stops == 0 && log.closes == 0, "the session keeps the device running");
+  Check(!capture.IsRunning() && hub->IsRunning(*session), "only the capture stopped");
+  const int delivered = session_counter.chunks();
+  Check(session_counter.WaitForChunks(delivered + 1), "the session still receives chunks");
+
+  hub->RemoveSession(session);
+  Check(log.closes == 1, "the last consumer closes the device");
+  Check(!log.wrong_thread, "every backend call ran on the device thread");
+}
+
+// Two sessions in one conversion group: while one session's callback is
+// stalled, stats, the other session's removal and a new session must not
+// wait for it, even while the stalled session itself is being removed.
+void TestStalledSession() {
+  std::printf("stalled session\n");
+  DeviceLog log;
+  CaptureHub hub(FakeFactory(&log));
+  std::atomic<bool> stall{false};
+  std::atomic<bool> stalled{false};
+  ChunkCounter counter;
+
+  std::string error;
+  std::shared_ptr<CaptureSession> slow = hub.AddSession(
+      FakeConfig(),
+      [&stall, &stalled](const AudioChunk&) {
+        if (!stall.load()) return;
+        stalled.store(true);
+        while (stall.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      },
+      &error);
+  std::shared_ptr<CaptureSession> other = hub.AddSession(FakeConfig(), counter.callback(), &error);
+  Check(slow && other, "two sessions with one conversion");
+  Check(counter.WaitForChunks(1), "a chunk arrives");
+
+  stall.store(true);
+  while (!stalled.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  const auto started = std::chrono::steady_clock::now();
+  const CaptureStats stats = hub.GetSessionStats(*other);
+  hub.RemoveSession(other);
+  const double elapsed_ms = MillisecondsSince(started);
+  Check(stats.shared_sessions == 2, "the sessions share a conversion");
+  Check(elapsed_ms < 50.0, "stats and removal do not wait for a stalled callback");
+  std::printf("  stats and removal %.2f ms\n", elapsed_ms);
+
+  // Removing the stalled session waits for its callback, but not while
+  // holding up sessions joining or leaving.
+  std::atomic<bool> removed{false};
+  std::thread remover([&hub, &slow, &removed]() {
+    hub.RemoveSession(slow);
+    removed.store(true);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const auto joined = std::chrono::steady_clock::now();
+  ChunkCounter late_counter;
+  std::shared_ptr<CaptureSession> late =
+      hub.AddSession(FakeConfig(), late_counter.callback(), &error);
+  const double join_ms = MillisecondsSince(joined);
+  Check(late != nullptr, "a session joins while another is being removed");
+  Check(join_ms < 50.0, "joining does not wait for a stalled removal");
+  Check(!removed.load(), "removal waits out the stalled callback");
+  std::printf("  join during a stalled removal %.2f ms\n", join_ms);
+
+  stall.store(false);
+  remover.join();
+  Check(!hub.IsRunning(*slow), "the removed session stopped");
+  Check(late_counter.WaitForChunks(1), "the new session receives chunks");
+  hub.RemoveSession(late);
+  Check(log.closes == 1, "the last session closes the device");
+}
+
+}  // namespace
+
+int main() {
+  TestColdStart();
+  TestWarmStart();
+  TestStartErrors();
+  TestPromptStop();
+  TestHubStandby();
+  TestStandbyHolds();
+  TestSharedDevice();
+  TestStalledSession();
+  if (g_failures > 0) {
+    std::printf("%d check(s) failed\n", g_failures);
+    return 1;
+  }
+  std::printf("all checks passed\n");
+  return 0;
+}
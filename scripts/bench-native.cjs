@@ -0,0 +1,41 @@
+const fs = require('fs');
+const path = require('path');
+const { spawnSync } = require('child_process');
+
+// Builds and runs the capture DSP benchmarks. native/system-audio-addon/bench
+// is a CMake project on Google Benchmark that links the platform-neutral
+// addon sources directly, so it needs neither node-gyp nor Electron headers
+// nor an audio device. Arguments are passed to the benchmark binary, e.g.
+// --benchmark_filter=resample.
+
+const rootDir = path.resolve(__dirname, '..');
+const benchDir = path.join(rootDir, 'native', 'system-audio-addon', 'bench');
+const buildDir = path.join(rootDir, 'native', 'system-audio-addon', 'build', 'bench');
+const binaryName = process.platform === 'win32' ? 'pipeline_bench.exe' : 'pipeline_bench';
+
+function run(command, args) {
+  const result = spawnSync(command, args, { cwd: rootDir, stdio: 'inherit', shell: false });
+  if (result.error) {
+    console.error(`Failed to run ${command}: ${result.error.message}`);
+    process.exit(1);
+  }
+  if (result.status !== 0) {
+    process.exit(result.status || 1);
+  }
+}
+
+// Multi-config generators (Visual Studio) put the binary in a per-config
+// directory.
+function binaryPath() {
+  const configPath = path.join(buildDir, 'Release', binaryName);
+  return fs.existsSync(configPath) ? configPath : path.join(buildDir, binaryName);
+}
+
+function main() {
+  console.log(`Building ${path.relative(rootDir, buildDir)} with CMake...`);
+  run('cmake', ['-S', benchDir, '-B', buildDir, '-DCMAKE_BUILD_TYPE=Release']);
+  run('cmake', ['--build', buildDir, '--config', 'Release', '--parallel']);
+  run(binaryPath(), process.argv.slice(2));
+}
+
+main();
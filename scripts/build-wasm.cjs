@@ -0,0 +1,57 @@
+const fs = require('fs');
+const path = require('path');
+const { spawnSync } = require('child_process');
+
+// Builds the AudioWorklet jitter buffer to WebAssembly with Emscripten. The
+// module is freestanding (static storage, no imports), so the worklet can
+// instantiate it synchronously without the Emscripten JS glue. Set EMCC to
+// point at a specific emcc; otherwise it is looked up on PATH, as set up by
+// emsdk_env.
+
+const rootDir = path.resolve(__dirname, '..');
+const sourceDir = path.join(rootDir, 'native', 'jitter-buffer', 'src');
+const outputDir = path.join(rootDir, 'electron', 'native');
+const outputPath = path.join(outputDir, 'jitter_buffer.wasm');
+
+const sources = ['jitter_buffer.cc', 'wasm_exports.cc'];
+
+function main() {
+  const compiler = process.env.EMCC || 'emcc';
+  fs.mkdirSync(outputDir, { recursive: true });
+
+  console.log(`Building ${path.relative(rootDir, outputPath)} with ${compiler}...`);
+  const result = spawnSync(
+    compiler,
+    [
+      '-std=c++17',
+      '-O3',
+      '-DNDEBUG',
+      '-msimd128',
+      '-fno-exceptions',
+      '-fno-rtti',
+      '--no-entry',
+      '-sSTANDALONE_WASM',
+      '-sINITIAL_MEMORY=2MB',
+      '-sSTACK_SIZE=64KB',
+      '-sALLOW_MEMORY_GROWTH=0',
+      ...sources.map((source) => path.join(sourceDir, source)),
+      '-o',
+      outputPath,
+    ],
+    // emcc is a batch file on Windows.
+    { cwd: sourceDir, stdio: 'inherit', shell: process.platform === 'win32' }
+  );
+
+  if (result.error) {
+    console.error(`Failed to run ${compiler}: ${result.error.message}`);
+    console.error('Install emsdk and activate it, or set EMCC.');
+    process.exit(1);
+  }
+  if (result.status !== 0) {
+    process.exit(result.status || 1);
+  }
+
+  console.log(`Jitter buffer written to ${outputPath}`);
+}
+
+main();
@@ -0,0 +1,305 @@
+const fs = require('fs');
+const path = require('path');
+const vm = require('vm');
+
+// Drives the system audio worklet outside the browser, faster than real
+// time: the worklet source runs in a VM context with the few AudioWorklet
+// globals it uses stubbed, backed by the WebAssembly jitter buffer from
+// `npm run build:wasm`. `--js` tests the JavaScript fallback queue instead.
+
+const rootDir = path.resolve(__dirname, '..');
+const workletPath = path.join(rootDir, 'src', 'audio', 'systemAudioWorklet.js');
+const wasmPath = path.join(rootDir, 'electron', 'native', 'jitter_buffer.wasm');
+
+const SAMPLE_RATE = 48000;
+const QUANTUM = 128;
+const CHUNK_FRAMES = 960;
+
+const jsOnly = process.argv.includes('--js');
+let failures = 0;
+
+function check(condition, message) {
+  if (!condition) {
+    failures += 1;
+    console.error(`  FAIL ${message}`);
+  }
+}
+
+function loadProcessorClass() {
+  let processorClass = null;
+  const context = vm.createContext({
+    sampleRate: SAMPLE_RATE,
+    WebAssembly,
+    Atomics,
+    Math,
+    AudioWorkletProcessor: class {
+      constructor() {
+        this.port = { onmessage: null, postMessage: () => {} };
+      }
+    },
+    registerProcessor: (_name, cls) => {
+      processorClass = cls;
+    },
+  });
+  vm.runInContext(fs.readFileSync(workletPath, 'utf8'), context, { filename: workletPath });
+  return processorClass;
+}
+
+function loadModule() {
+  if (jsOnly) return null;
+  if (!fs.existsSync(wasmPath)) {
+    console.error(`Jitter buffer not found: ${wasmPath}`);
+    console.error('Run `npm run build:wasm` first, or pass --js to test the JavaScript fallback.');
+    process.exit(1);
+  }
+  return new WebAssembly.Module(fs.readFileSync(wasmPath));
+}
+
+const Processor = loadProcessorClass();
+const wasmModule = loadModule();
+
+function createPlayer(maxQueueMs = 500, sharedRingBuffer = null, jitterBufferModule = wasmModule) {
+  const processor = new Processor({
+    processorOptions: { channels: 2, maxQueueMs, jitterBufferModule, sharedRingBuffer },
+  });
+  if (jitterBufferModule && !processor.jitterBuffer) {
+    throw new Error('Worklet did not instantiate the jitter buffer.');
+  }
+
+  const left = new Float32Array(QUANTUM);
+  const right = new Float32Array(QUANTUM);
+  const outputs = [[left, right]];
+  return {
+    processor,
+    left,
+    right,
+    send(data) {
+      processor.port.onmessage({ data });
+    },
+    pushChunk(samples, frameCount) {
+      this.send({
+        type: 'chunk',
+        pcm: samples.buffer,
+        frameCount,
+        sampleRate: SAMPLE_RATE,
+        channels: 2,
+      });
+    },
+    render() {
+      processor.process([], outputs);
+    },
+  };
+}
+
+// Left carries a ramp and right its negation, so every output frame says
+// exactly which input frame it came from.
+function rampChunk(start) {
+  const samples = new Int16Array(CHUNK_FRAMES * 2);
+  for (let i = 0; i < CHUNK_FRAMES; i += 1) {
+    const value = ((start + i) % 20000) - 10000;
+    samples[i * 2] = value;
+    samples[i * 2 + 1] = -value;
+  }
+  return samples;
+}
+
+function testContinuity() {
+  const player = createPlayer();
+  let produced = 0;
+  let expected = 0;
+  let mismatches = 0;
+  for (let quantum = 0; quantum < 20000; quantum += 1) {
+    while (player.processor.queuedFrames < 2 * CHUNK_FRAMES) {
+      player.pushChunk(rampChunk(produced), CHUNK_FRAMES);
+      produced += CHUNK_FRAMES;
+    }
+    player.render();
+    for (let i = 0; i < QUANTUM; i += 1) {
+      const value = (expected % 20000) - 10000;
+      expected += 1;
+      const left = Math.round(player.left[i] * 32768);
+      const right = Math.round(player.right[i] * 32768);
+      if (left !== value || right !== -value) {
+        mismatches += 1;
+      }
+    }
+  }
+  check(mismatches === 0, `continuity: ${mismatches} frames out of order or corrupted`);
+  check(player.processor.framesUnderrun === 0, 'continuity: unexpected underrun');
+  check(player.processor.framesDropped === 0, 'continuity: unexpected drop');
+}
+
+function testUnderrun() {
+  const player = createPlayer();
+  const chunk = new Int16Array(CHUNK_FRAMES * 2).fill(16384);
+  player.pushChunk(chunk, CHUNK_FRAMES);
+
+  let previous = 0.5;
+  let largestStep = 0;
+  for (let quantum = 0; quantum < 10; quantum += 1) {
+    player.render();
+    for (let i = 0; i < QUANTUM; i += 1) {
+      largestStep = Math.max(largestStep, Math.abs(player.left[i] - previous));
+      previous = player.left[i];
+    }
+  }
+  check(player.processor.framesUnderrun === 10 * QUANTUM - CHUNK_FRAMES, 'underrun: frame count');
+  check(previous === 0, 'underrun: output did not settle to silence');
+
+  player.pushChunk(chunk, CHUNK_FRAMES);
+  player.render();
+  for (let i = 0; i < QUANTUM; i += 1) {
+    largestStep = Math.max(largestStep, Math.abs(player.left[i] - previous));
+    previous = player.left[i];
+  }
+  if (wasmModule) {
+    check(player.processor.framesConcealed > 0, 'underrun: nothing concealed');
+    check(largestStep < 0.02, `underrun: ${largestStep.toFixed(3)} step at the gap edges`);
+  }
+}
+
+function testTrim() {
+  const player = createPlayer(200);
+  for (let produced = 0; produced < SAMPLE_RATE; produced += CHUNK_FRAMES) {
+    player.pushChunk(rampChunk(produced), CHUNK_FRAMES);
+  }
+  player.render();
+  const maxQueueFrames = 0.2 * SAMPLE_RATE;
+  check(player.processor.queuedFrames <= maxQueueFrames, 'trim: queue still above maxQueueMs');
+  check(player.processor.framesDropped > 0, 'trim: nothing dropped');
+}
+
+function testSilenceDebt() {
+  const player = createPlayer();
+  player.send({ type: 'silence', frameCount: 4800, sampleRate: SAMPLE_RATE });
+  // Play the marker and then as long again with nothing queued, as happens
+  // while the next marker is still being accumulated.
+  for (let quantum = 0; quantum < 75; quantum += 1) player.render();
+  player.send({ type: 'silence', frameCount: 4800, sampleRate: SAMPLE_RATE });
+  check(player.processor.framesUnderrun === 0, 'silence: gaps during silence counted as underrun');
+  check(player.processor.queuedFrames < QUANTUM, 'silence: late marker delayed playout');
+  check(player.processor.framesSilent >= 4800, 'silence: silent frames not counted');
+}
+
+// Planar float32 form of rampChunk(), scaled so the output reads back as
+// the same int16 values.
+function rampPlanes(start) {
+  const interleaved = rampChunk(start);
+  const planes = new Float32Array(CHUNK_FRAMES * 2);
+  for (let i = 0; i < CHUNK_FRAMES; i += 1) {
+    planes[i] = interleaved[i * 2] / 32768;
+    planes[CHUNK_FRAMES + i] = interleaved[i * 2 + 1] / 32768;
+  }
+  return planes;
+}
+
+// The shared ring: an int16 ring is drained into the jitter buffer every
+// quantum, a float ring is copied plane by plane. Frames come out in order,
+// and underruns reach the ring for the writer.
+async function testRing(sampleFormat) {
+  const { createSharedPcmRing, writeSharedPcmRing, getSharedPcmRingStats } = await import(
+    '../src/audio/sharedPcmRing.js'
+  );
+  const ring = createSharedPcmRing({
+    capacityFrames: SAMPLE_RATE,
+    channels: 2,
+    sampleRate: SAMPLE_RATE,
+    sampleFormat,
+  });
+  const isFloat = sampleFormat === 'f32-planar';
+  const player = createPlayer(500, ring.buffer, isFloat ? null : wasmModule);
+  const makeChunk = isFloat ? rampPlanes : rampChunk;
+  let produced = 0;
+  let expected = 0;
+  let mismatches = 0;
+  for (let quantum = 0; quantum < 5000; quantum += 1) {
+    while (
+      getSharedPcmRingStats(ring).occupancyFrames + player.processor.queuedFrames <
+      2 * CHUNK_FRAMES
+    ) {
+      writeSharedPcmRing(ring, makeChunk(produced), CHUNK_FRAMES);
+      produced += CHUNK_FRAMES;
+    }
+    player.render();
+    for (let i = 0; i < QUANTUM; i += 1) {
+      const value = (expected % 20000) - 10000;
+      expected += 1;
+      if (
+        Math.round(player.left[i] * 32768) !== value ||
+        Math.round(player.right[i] * 32768) !== -value
+      ) {
+        mismatches += 1;
+      }
+    }
+  }
+  check(mismatches === 0, `ring ${sampleFormat}: ${mismatches} frames out of order or corrupted`);
+  check(player.processor.framesUnderrun === 0, `ring ${sampleFormat}: unexpected underrun`);
+
+  for (let quantum = 0; quantum < 40; quantum += 1) player.render();
+  check(player.processor.framesUnderrun > 0, `ring ${sampleFormat}: no underrun once stopped`);
+  check(
+    getSharedPcmRingStats(ring).underrunFrames === player.processor.framesUnderrun,
+    `ring ${sampleFormat}: underruns not published to the ring`
+  );
+}
+
+// Ten minutes of chunks arriving with +-5 ms of jitter from a clock 200 ppm
+// fast, rendered as fast as possible.
+function testSoak() {
+  const player = createPlayer();
+  const chunkSeconds = CHUNK_FRAMES / SAMPLE_RATE;
+  const quanta = Math.round((600 * SAMPLE_RATE) / QUANTUM);
+  let seed = 1;
+  const jitter = () => {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    return (seed / 0x7fffffff - 0.5) * 0.01;
+  };
+
+  let produced = 0;
+  let nominal = 0.04;
+  let nextArrival = nominal;
+  const started = process.hrtime.bigint();
+  for (let quantum = 0; quantum < quanta; quantum += 1) {
+    const now = (quantum * QUANTUM) / SAMPLE_RATE;
+    while (nextArrival <= now) {
+      player.pushChunk(rampChunk(produced), CHUNK_FRAMES);
+      produced += CHUNK_FRAMES;
+      nominal += chunkSeconds * (1 - 200e-6);
+      nextArrival = Math.max(nextArrival, nominal + jitter());
+    }
+    player.render();
+  }
+  const elapsedMs = Number(process.hrtime.bigint() - started) / 1e6;
+
+  const { framesUnderrun, framesDropped, framesConcealed } = player.processor;
+  const speed = (600 * 1000) / elapsedMs;
+  const perQuantumUs = (elapsedMs * 1000) / quanta;
+  console.log(
+    `  soak: 600 s in ${elapsedMs.toFixed(0)} ms (${speed.toFixed(0)}x real time), ` +
+      `${perQuantumUs.toFixed(2)} us/quantum, underrun ${framesUnderrun}, ` +
+      `dropped ${framesDropped}, concealed ${framesConcealed || 0}`
+  );
+  check(player.processor.queuedFrames <= 0.5 * SAMPLE_RATE, 'soak: queue grew past maxQueueMs');
+}
+
+async function main() {
+  console.log(`Testing the ${wasmModule ? 'WebAssembly' : 'JavaScript'} jitter buffer...`);
+  testContinuity();
+  testUnderrun();
+  testTrim();
+  testSilenceDebt();
+  await testRing('s16');
+  await testRing('f32-planar');
+  testSoak();
+
+  if (failures > 0) {
+    console.error(`${failures} check(s) failed.`);
+    process.exit(1);
+  }
+  console.log('All checks passed.');
+}
+
+main().catch((error) => {
+  console.error(error);
+  process.exit(1);
+});
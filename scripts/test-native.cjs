@@ -0,0 +1,81 @@
+const fs = require('fs');
+const path = require('path');
+const { spawnSync } = require('child_process');
+
+// Builds and runs the native tests under native/system-audio-addon/test with
+// the host C++ compiler. Like the benchmarks, they link the platform-neutral
+// addon sources directly and drive fake or synthetic devices, so they need
+// neither node-gyp nor an audio device.
+
+const rootDir = path.resolve(__dirname, '..');
+const addonDir = path.join(rootDir, 'native', 'system-audio-addon');
+const bindingPath = path.join(addonDir, 'binding.gyp');
+const testDir = path.join(addonDir, 'test');
+const outputDir = path.join(addonDir, 'build', 'test');
+
+function run(command, args) {
+  const result = spawnSync(command, args, { cwd: addonDir, stdio: 'inherit', shell: false });
+  if (result.error) {
+    console.error(`Failed to run ${command}: ${result.error.message}`);
+    return false;
+  }
+  return result.status === 0;
+}
+
+function neutralSources() {
+  // The addon's own source list minus addon.cc, which needs Node; platform
+  // backends are listed under conditions, so they are not picked up.
+  const binding = JSON.parse(fs.readFileSync(bindingPath, 'utf8'));
+  const target = binding.targets.find((entry) => entry.target_name === 'system_audio');
+  return target.sources
+    .filter((source) => source !== 'src/addon.cc')
+    .map((source) => path.join(addonDir, source));
+}
+
+function platformLibraries() {
+  if (process.platform === 'win32') return ['-lavrt'];
+  if (process.platform === 'linux') return ['-ldl'];
+  return [];
+}
+
+function main() {
+  const compiler = process.env.CXX || (process.platform === 'win32' ? 'clang++' : 'c++');
+  const filter = process.argv[2] || '';
+  const tests = fs
+    .readdirSync(testDir)
+    .filter((name) => name.endsWith('_test.cc') && name.includes(filter))
+    .sort();
+  fs.mkdirSync(outputDir, { recursive: true });
+
+  let failed = 0;
+  for (const test of tests) {
+    const name = path.basename(test, '.cc');
+    const outputPath = path.join(
+      outputDir,
+      process.platform === 'win32' ? `${name}.exe` : name
+    );
+    console.log(`Building ${path.relative(rootDir, outputPath)} with ${compiler}...`);
+    const built = run(compiler, [
+      '-std=c++17',
+      '-O1',
+      '-g',
+      '-pthread',
+      `-I${path.join(addonDir, 'src')}`,
+      path.join(testDir, test),
+      ...neutralSources(),
+      ...platformLibraries(),
+      '-o',
+      outputPath,
+    ]);
+    if (!built || !run(outputPath, [])) {
+      console.error(`${name} failed`);
+      failed += 1;
+    }
+  }
+
+  if (failed > 0) {
+    process.exit(1);
+  }
+}
+
+main();
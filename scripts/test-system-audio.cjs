@@ -1,10 +1,10 @@
 const fs = require('fs');
 const path = require('path');
+const { Worker, isMainThread } = require('worker_threads');
 
 const rootDir = path.resolve(__dirname, '..');
 const nativeDir = path.join(rootDir, 'electron', 'native');
 const artifactDir = path.join(rootDir, 'artifacts');
-const wavPath = path.join(artifactDir, 'system-audio-test.wav');
 
 function resolveAddonPath() {
   const pointerPath = path.join(nativeDir, 'system_audio.current.json');
@@ -48,67 +48,113 @@ if (!fs.existsSync(addonPath)) {
   process.exit(1);
 }
 
-const addon = require(addonPath);
-const chunks = [];
-let totalSamples = 0;
-let sampleRate = 48000;
-let channels = 2;
-
-function writeWav(filePath, pcmInt16, wavSampleRate, wavChannels) {
-  const bytesPerSample = 2;
-  const blockAlign = wavChannels * bytesPerSample;
-  const byteRate = wavSampleRate * blockAlign;
-  const dataSize = pcmInt16.length * bytesPerSample;
-  const buffer = Buffer.alloc(44 + dataSize);
-
-  buffer.write('RIFF', 0);
-  buffer.writeUInt32LE(36 + dataSize, 4);
-  buffer.write('WAVE', 8);
-  buffer.write('fmt ', 12);
-  buffer.writeUInt32LE(16, 16);
-  buffer.writeUInt16LE(1, 20);
-  buffer.writeUInt16LE(wavChannels, 22);
-  buffer.writeUInt32LE(wavSampleRate, 24);
-  buffer.writeUInt32LE(byteRate, 28);
-  buffer.writeUInt16LE(blockAlign, 32);
-  buffer.writeUInt16LE(16, 34);
-  buffer.write('data', 36);
-  buffer.writeUInt32LE(dataSize, 40);
-
-  for (let i = 0; i < pcmInt16.length; i += 1) {
-    buffer.writeInt16LE(pcmInt16[i], 44 + i * 2);
+// `--synthetic` or `--wav <file>` drive the pipeline from a generated tone or
+// a recording instead of the loopback device.
+function parseSourceArgs(argv) {
+  const wavIndex = argv.indexOf('--wav');
+  if (wavIndex !== -1 && argv[wavIndex + 1]) {
+    return { backend: 'wav', path: path.resolve(argv[wavIndex + 1]), loop: true };
+  }
+  if (argv.includes('--synthetic')) {
+    return { backend: 'synthetic', signal: 'tone', toneHz: 440, amplitude: 0.5 };
   }
+  return undefined;
+}
 
-  fs.mkdirSync(path.dirname(filePath), { recursive: true });
-  fs.writeFileSync(filePath, buffer);
+// `--ogg` records Ogg Opus instead of WAV; `--seconds <n>` sets the length.
+function parseRecordingArgs(argv) {
+  const secondsIndex = argv.indexOf('--seconds');
+  const seconds = secondsIndex !== -1 ? Number(argv[secondsIndex + 1]) : 10;
+  const format = argv.includes('--ogg') ? 'ogg-opus' : 'wav';
+  const fileName = format === 'wav' ? 'system-audio-test.wav' : 'system-audio-test.opus';
+  return {
+    seconds: Number.isFinite(seconds) && seconds > 0 ? seconds : 10,
+    format,
+    filePath: path.join(artifactDir, fileName),
+  };
 }
 
-addon.setChunkCallback((chunk) => {
-  if (!chunk || !chunk.pcm) return;
-  sampleRate = chunk.sampleRate || sampleRate;
-  channels = chunk.channels || channels;
-  const chunkSamples = new Int16Array(chunk.pcm.buffer, chunk.pcm.byteOffset, chunk.pcm.byteLength / 2);
-  chunks.push(Int16Array.from(chunkSamples));
-  totalSamples += chunkSamples.length;
-});
-
-console.log('Capturing 10 seconds of system audio loopback...');
-addon.start({ targetSampleRate: 48000, channels: 2, frameMs: 20 });
-
-setTimeout(() => {
-  addon.stop();
-  addon.setChunkCallback(() => {});
-  const stats = addon.getStats();
-
-  const merged = new Int16Array(totalSamples);
-  let offset = 0;
-  for (const chunk of chunks) {
-    merged.set(chunk, offset);
-    offset += chunk.length;
+const source = parseSourceArgs(process.argv.slice(2));
+const recording = parseRecordingArgs(process.argv.slice(2));
+// `--shared-ring` reads PCM from a SharedArrayBuffer the capture thread
+// writes directly, the way the Electron renderer's preload feeds its
+// worklet, instead of through the chunk callback.
+const useSharedRing = process.argv.includes('--shared-ring');
+const addon = require(addonPath);
+let deliveredFrames = 0;
+
+// Mirrors the reader in src/audio/systemAudioWorklet.js. The addon records
+// the file itself; the ring is only drained so its transport is exercised.
+function drainSharedRing(ring) {
+  const { header } = ring;
+  const write = Atomics.load(header, 5) >>> 0;
+  const read = Atomics.load(header, 6) >>> 0;
+  const available = (write - read) >>> 0;
+  if (available === 0) return;
+  deliveredFrames += available;
+  Atomics.store(header, 6, (read + available) | 0);
+}
+
+async function main() {
+  let ring = null;
+  let drainTimer = null;
+  if (useSharedRing) {
+    const { createSharedPcmRing } = await import('../src/audio/sharedPcmRing.js');
+    ring = createSharedPcmRing({ capacityFrames: 48000, channels: 2, sampleRate: 48000 });
+    // The addon sizes the ring from the view, so pass one over the whole buffer.
+    addon.attachSharedRing(new Int32Array(ring.buffer));
+    drainTimer = setInterval(() => drainSharedRing(ring), 10);
+  } else {
+    addon.setChunkCallback((chunk) => {
+      if (chunk?.frameCount) deliveredFrames += chunk.frameCount;
+    });
+  }
+
+  const sourceName = source ? source.backend : 'system audio loopback';
+  console.log(`Recording ${recording.seconds} seconds from the ${sourceName} source...`);
+  // Resolves once the device has delivered its first packet.
+  await addon.start({ targetSampleRate: 48000, channels: 2, frameMs: 20, source });
+  fs.mkdirSync(artifactDir, { recursive: true });
+  await addon.startRecording(recording.filePath, { format: recording.format });
+  await new Promise((resolve) => setTimeout(resolve, recording.seconds * 1000));
+
+  const recorded = await addon.stopRecording();
+  const stats = await addon.stop();
+  if (ring) {
+    clearInterval(drainTimer);
+    drainSharedRing(ring);
+    addon.detachSharedRing();
+  } else {
+    addon.setChunkCallback(() => {});
   }
 
-  writeWav(wavPath, merged, sampleRate, channels);
-  console.log(`WAV written: ${wavPath}`);
+  if (recorded.error) {
+    console.error(`Recording failed: ${recorded.error}`);
+  }
+  console.log(`Recording written: ${recorded.path}`, recorded);
+  console.log(`Frames delivered to JS: ${deliveredFrames}`);
   console.log('Capture stats:', stats);
-  process.exit(0);
-}, 10000);
+  process.exit(recorded.error ? 1 : 0);
+}
+
+function runInWorker() {
+  const worker = new Worker(__filename, { argv: process.argv.slice(2) });
+  worker.on('error', (error) => {
+    console.error(error);
+    process.exitCode = 1;
+  });
+  worker.on('exit', (code) => {
+    process.exitCode = process.exitCode || code;
+  });
+}
+
+// `--worker` runs the whole test in a worker_thread, the way Electron main
+// hosts the addon.
+if (isMainThread && process.argv.includes('--worker')) {
+  runInWorker();
+} else {
+  main().catch((error) => {
+    console.error(error);
+    process.exit(1);
+  });
+}
@@ -0,0 +1,136 @@
+// SPSC PCM ring in a SharedArrayBuffer. One side writes with
+// writeSharedPcmRing(), the other (the system audio worklet) reads the same
+// memory with Atomics, so chunks reach the audio thread without a
+// postMessage per chunk.
+//
+// Layout, shared with native/system-audio-addon/src/shared_pcm_ring.h and
+// the reader inlined in systemAudioWorklet.js:
+//   bytes [0, 64)   Int32 header, indexed by SLOT
+//   bytes [64, ...) 's16': capacityFrames interleaved Int16 frames;
+//                   'f32-planar': one Float32 plane of capacityFrames per
+//                   channel, so the worklet copies a channel with set()
+// Frame indices are free-running uint32 counters; `write - read` (>>> 0) is
+// the occupancy even after they wrap. Capacity is a power of two so
+// `index % capacity` stays continuous across that wrap.
+
+export const SHARED_RING_MAGIC = 0x474e4952;
+export const SHARED_RING_VERSION = 2;
+export const SHARED_RING_HEADER_BYTES = 64;
+
+export const SLOT = Object.freeze({
+  magic: 0,
+  version: 1,
+  capacityFrames: 2,
+  channels: 3,
+  sampleRate: 4,
+  writeFrame: 5,
+  readFrame: 6,
+  writeSequence: 7,
+  overrunFrames: 8,
+  underrunFrames: 9,
+  sampleFormat: 10,
+});
+
+// Values of the sampleFormat slot.
+export const RING_FORMAT = Object.freeze({
+  s16: 0,
+  'f32-planar': 1,
+});
+
+// SharedArrayBuffer is only usable, and only shareable with the worklet, in a
+// cross-origin isolated page; Electron serves the renderer with COOP/COEP.
+export function isSharedRingSupported() {
+  return (
+    globalThis.crossOriginIsolated === true &&
+    typeof SharedArrayBuffer === 'function' &&
+    typeof Atomics === 'object'
+  );
+}
+
+export function createSharedPcmRing({
+  capacityFrames: requestedFrames,
+  channels,
+  sampleRate,
+  sampleFormat = 's16',
+}) {
+  let capacityFrames = 1;
+  while (capacityFrames < requestedFrames) capacityFrames *= 2;
+
+  const sampleBytes = sampleFormat === 'f32-planar' ? 4 : 2;
+  const buffer = new SharedArrayBuffer(
+    SHARED_RING_HEADER_BYTES + capacityFrames * channels * sampleBytes
+  );
+  const header = new Int32Array(buffer, 0, SHARED_RING_HEADER_BYTES / 4);
+  header[SLOT.sampleFormat] = RING_FORMAT[sampleFormat];
+  const ring = wrapSharedPcmRing(buffer);
+  ring.header[SLOT.magic] = SHARED_RING_MAGIC;
+  ring.header[SLOT.version] = SHARED_RING_VERSION;
+  ring.header[SLOT.capacityFrames] = capacityFrames;
+  ring.header[SLOT.channels] = channels;
+  ring.header[SLOT.sampleRate] = sampleRate;
+  return ring;
+}
+
+export function wrapSharedPcmRing(buffer) {
+  const header = new Int32Array(buffer, 0, SHARED_RING_HEADER_BYTES / 4);
+  const isFloat = header[SLOT.sampleFormat] === RING_FORMAT['f32-planar'];
+  return {
+    buffer,
+    header,
+    sampleFormat: isFloat ? 'f32-planar' : 's16',
+    samples: isFloat
+      ? new Float32Array(buffer, SHARED_RING_HEADER_BYTES)
+      : new Int16Array(buffer, SHARED_RING_HEADER_BYTES),
+  };
+}
+
+// Writes a whole chunk or nothing; a chunk that does not fit is counted as
+// overrun so the reader never sees half of one. `samples` is in the ring's
+// format: interleaved Int16, or one Float32 plane of frameCount per channel.
+export function writeSharedPcmRing(ring, samples, frameCount) {
+  const { header } = ring;
+  const capacity = header[SLOT.capacityFrames];
+  const channels = header[SLOT.channels];
+  const write = Atomics.load(header, SLOT.writeFrame) >>> 0;
+  const read = Atomics.load(header, SLOT.readFrame) >>> 0;
+
+  if (capacity - ((write - read) >>> 0) < frameCount) {
+    Atomics.add(header, SLOT.overrunFrames, frameCount);
+    return false;
+  }
+
+  const start = write % capacity;
+  const first = Math.min(frameCount, capacity - start);
+  if (ring.sampleFormat === 'f32-planar') {
+    for (let channel = 0; channel < channels; channel += 1) {
+      const plane = samples.subarray(channel * frameCount, (channel + 1) * frameCount);
+      const base = channel * capacity;
+      ring.samples.set(plane.subarray(0, first), base + start);
+      if (first < frameCount) {
+        ring.samples.set(plane.subarray(first), base);
+      }
+    }
+  } else {
+    ring.samples.set(samples.subarray(0, first * channels), start * channels);
+    if (first < frameCount) {
+      ring.samples.set(samples.subarray(first * channels, frameCount * channels), 0);
+    }
+  }
+
+  Atomics.store(header, SLOT.writeFrame, (write + frameCount) | 0);
+  Atomics.add(header, SLOT.writeSequence, 1);
+  return true;
+}
+
+export function getSharedPcmRingStats(ring) {
+  const { header } = ring;
+  const write = Atomics.load(header, SLOT.writeFrame) >>> 0;
+  const read = Atomics.load(header, SLOT.readFrame) >>> 0;
+  return {
+    capacityFrames: header[SLOT.capacityFrames],
+    occupancyFrames: (write - read) >>> 0,
+    overrunFrames: Atomics.load(header, SLOT.overrunFrames) >>> 0,
+    underrunFrames: Atomics.load(header, SLOT.underrunFrames) >>> 0,
+    writeSequence: Atomics.load(header, SLOT.writeSequence) >>> 0,
+  };
+}
@@ -1,3 +1,64 @@
+// Header slots of the shared PCM ring; must match src/audio/sharedPcmRing.js.
+// Worklet modules are loaded as standalone files, so the layout is repeated
+// here instead of imported.
+const RING_HEADER_BYTES = 64;
+const RING_CAPACITY_FRAMES = 2;
+const RING_CHANNELS = 3;
+const RING_WRITE_FRAME = 5;
+const RING_READ_FRAME = 6;
+const RING_OVERRUN_FRAMES = 8;
+const RING_UNDERRUN_FRAMES = 9;
+const RING_SAMPLE_FORMAT = 10;
+const RING_FORMAT_F32_PLANAR = 1;
+
+// Queue-level reports for native drift compensation go out about every
+// 100 ms, averaged over the quanta in between so chunk arrival does not
+// show up as sawtooth.
+const LEVEL_REPORT_QUANTA = 38;
+
+// Interleaves a planar float32 chunk (one plane per channel, in order).
+function interleavePlanes(samples, frameCount, channels) {
+  const interleaved = new Float32Array(frameCount * channels);
+  for (let channel = 0; channel < channels; channel += 1) {
+    const plane = samples.subarray(channel * frameCount, (channel + 1) * frameCount);
+    for (let frame = 0; frame < frameCount; frame += 1) {
+      interleaved[frame * channels + channel] = plane[frame];
+    }
+  }
+  return interleaved;
+}
+
+// Instantiates the WebAssembly jitter buffer (native/jitter-buffer) and maps
+// its input area and output planes. The module is built freestanding; any
+// imports a toolchain adds anyway are stubbed, since none are ever called.
+function createWasmJitterBuffer(module, maxQueueFrames) {
+  const imports = {};
+  for (const entry of WebAssembly.Module.imports(module)) {
+    if (entry.kind !== 'function') continue;
+    imports[entry.module] = imports[entry.module] || {};
+    imports[entry.module][entry.name] = () => 0;
+  }
+
+  const { exports } = new WebAssembly.Instance(module, imports);
+  if (typeof exports._initialize === 'function') {
+    exports._initialize();
+  }
+  exports.jb_configure(maxQueueFrames);
+
+  // Memory never grows, so these views stay valid.
+  const memory = exports.memory.buffer;
+  const maxRenderFrames = exports.jb_max_render_frames();
+  return {
+    exports,
+    input: new Int16Array(memory, exports.jb_input_buffer(), exports.jb_input_samples()),
+    outputLeft: new Float32Array(memory, exports.jb_output_left(), maxRenderFrames),
+    outputRight: new Float32Array(memory, exports.jb_output_right(), maxRenderFrames),
+    maxRenderFrames,
+    quantumLeft: null,
+    quantumRight: null,
+  };
+}
+
 class SystemAudioWorkletProcessor extends AudioWorkletProcessor {
   constructor(options) {
     super();
@@ -14,8 +75,51 @@ class SystemAudioWorkletProcessor extends AudioWorkletProcessor {
     this.framesRendered = 0;
     this.framesUnderrun = 0;
     this.framesDropped = 0;
+    this.framesSilent = 0;
     this.statsCounter = 0;
 
+    // Silence markers arrive once a stretch of silence has already passed,
+    // so the underrun frames played out meanwhile are owed against the next
+    // marker instead of delaying the audio that follows it.
+    this.playingSilence = false;
+    this.silenceDebtFrames = 0;
+
+    this.reportQueueLevel = processorOptions.reportQueueLevel === true;
+    this.levelFrameSum = 0;
+    this.levelQuanta = 0;
+
+    this.ring = null;
+    if (processorOptions.sharedRingBuffer) {
+      const buffer = processorOptions.sharedRingBuffer;
+      const header = new Int32Array(buffer, 0, RING_HEADER_BYTES / 4);
+      const isFloat = header[RING_SAMPLE_FORMAT] === RING_FORMAT_F32_PLANAR;
+      this.ring = {
+        header,
+        isFloat,
+        samples: isFloat
+          ? new Float32Array(buffer, RING_HEADER_BYTES)
+          : new Int16Array(buffer, RING_HEADER_BYTES),
+      };
+    }
+
+    // Queue and render in WebAssembly when the module was handed over, so
+    // process() neither allocates nor converts per sample. The ring, if any,
+    // is drained into it every quantum and only decouples the writer. It
+    // holds int16, so a float ring is read directly.
+    this.jitterBuffer = null;
+    this.framesConcealed = 0;
+    this.ringUnderrunMark = 0;
+    if (processorOptions.jitterBufferModule && !this.ring?.isFloat) {
+      try {
+        this.jitterBuffer = createWasmJitterBuffer(
+          processorOptions.jitterBufferModule,
+          Math.floor((this.maxQueueMs / 1000) * sampleRate)
+        );
+      } catch (_err) {
+        this.jitterBuffer = null;
+      }
+    }
+
     this.port.onmessage = (event) => {
       const data = event.data;
       if (!data) return;
@@ -24,6 +128,10 @@ class SystemAudioWorkletProcessor extends AudioWorkletProcessor {
         this.enqueueChunk(data);
       }
 
+      if (data.type === 'silence') {
+        this.enqueueSilence(data);
+      }
+
       if (data.type === 'flush') {
         this.flushQueue();
       }
@@ -31,10 +139,19 @@ class SystemAudioWorkletProcessor extends AudioWorkletProcessor {
   }
 
   flushQueue() {
+    if (this.jitterBuffer) {
+      this.jitterBuffer.exports.jb_flush();
+    }
+    if (this.ring) {
+      const { header } = this.ring;
+      Atomics.store(header, RING_READ_FRAME, Atomics.load(header, RING_WRITE_FRAME));
+    }
     this.queue = [];
     this.currentChunk = null;
     this.currentFrameOffset = 0;
     this.queuedFrames = 0;
+    this.playingSilence = false;
+    this.silenceDebtFrames = 0;
   }
 
   resampleChunk(sourceSamples, sourceFrameCount, sourceChannels, sourceRate) {
@@ -46,7 +163,8 @@ class SystemAudioWorkletProcessor extends AudioWorkletProcessor {
     }
 
     const destinationFrameCount = Math.max(1, Math.round((sourceFrameCount * sampleRate) / sourceRate));
-    const destinationSamples = new Int16Array(destinationFrameCount * this.channels);
+    // Int16Array or Float32Array, like the source.
+    const destinationSamples = new sourceSamples.constructor(destinationFrameCount * this.channels);
 
     const sourceChannelCount = Math.max(1, sourceChannels);
 
@@ -74,19 +192,88 @@ class SystemAudioWorkletProcessor extends AudioWorkletProcessor {
   enqueueChunk(data) {
     if (!data.pcm || !data.frameCount) return;
 
-    const sourceSamples = new Int16Array(data.pcm);
     const sourceFrameCount = data.frameCount;
     const sourceChannels = data.channels || this.channels;
     const sourceRate = data.sampleRate || sampleRate;
+    const format = data.sampleFormat || 's16';
+    const isFloat = format === 'f32-planar' || format === 'f32-interleaved';
 
+    let sourceSamples = isFloat
+      ? new Float32Array(data.pcm, 0, sourceFrameCount * sourceChannels)
+      : new Int16Array(data.pcm);
+
+    // Planar chunks in the context's rate and layout are queued as they
+    // came; rendering copies a run of each plane with one set().
+    if (
+      format === 'f32-planar' &&
+      !this.jitterBuffer &&
+      sourceRate === sampleRate &&
+      sourceChannels === this.channels
+    ) {
+      const planes = [];
+      for (let channel = 0; channel < sourceChannels; channel += 1) {
+        planes.push(
+          sourceSamples.subarray(channel * sourceFrameCount, (channel + 1) * sourceFrameCount)
+        );
+      }
+      this.silenceDebtFrames = 0;
+      this.pushEntry({ samples: sourceSamples, planes, frameCount: sourceFrameCount });
+      return;
+    }
+
+    if (format === 'f32-planar') {
+      sourceSamples = interleavePlanes(sourceSamples, sourceFrameCount, sourceChannels);
+    }
     const normalized = this.resampleChunk(sourceSamples, sourceFrameCount, sourceChannels, sourceRate);
 
-    this.queue.push({
+    // The jitter buffer is only handed over for int16 chunks.
+    if (this.jitterBuffer) {
+      this.pushToJitterBuffer(normalized.samples, normalized.frameCount);
+      return;
+    }
+
+    this.silenceDebtFrames = 0;
+    this.pushEntry({
       samples: normalized.samples,
       frameCount: normalized.frameCount,
       channels: this.channels,
+      scale: isFloat ? 1 : 1 / 32768,
     });
-    this.queuedFrames += normalized.frameCount;
+  }
+
+  enqueueSilence(data) {
+    if (!data.frameCount) return;
+
+    const sourceRate = data.sampleRate || sampleRate;
+    let frameCount = Math.round((data.frameCount * sampleRate) / sourceRate);
+    if (this.jitterBuffer) {
+      this.jitterBuffer.exports.jb_push_silence(frameCount);
+      this.queuedFrames = this.jitterBuffer.exports.jb_queued_frames();
+      return;
+    }
+
+    const owed = Math.min(this.silenceDebtFrames, frameCount);
+    this.silenceDebtFrames -= owed;
+    frameCount -= owed;
+    if (frameCount <= 0) return;
+
+    this.pushEntry({ samples: null, frameCount, channels: this.channels });
+  }
+
+  pushToJitterBuffer(samples, frameCount) {
+    const { exports, input } = this.jitterBuffer;
+    const framesPerPush = Math.floor(input.length / this.channels);
+    for (let offset = 0; offset < frameCount; offset += framesPerPush) {
+      const frames = Math.min(framesPerPush, frameCount - offset);
+      input.set(samples.subarray(offset * this.channels, (offset + frames) * this.channels));
+      exports.jb_push(frames, this.channels);
+    }
+    this.queuedFrames = exports.jb_queued_frames();
+  }
+
+  pushEntry(entry) {
+    this.queue.push(entry);
+    this.queuedFrames += entry.frameCount;
 
     const maxQueueFrames = Math.floor((this.maxQueueMs / 1000) * sampleRate);
     while (this.queuedFrames > maxQueueFrames && this.queue.length > 1) {
@@ -96,37 +283,159 @@ class SystemAudioWorkletProcessor extends AudioWorkletProcessor {
     }
   }
 
-  nextFrame() {
-    if (!this.currentChunk) {
-      this.currentChunk = this.queue.shift() || null;
-      this.currentFrameOffset = 0;
+  // Renders one quantum from the message queue, a run of frames per chunk.
+  renderFromQueue(leftChannel, rightChannel) {
+    const wanted = leftChannel.length;
+    let rendered = 0;
+
+    while (rendered < wanted) {
+      if (!this.currentChunk) {
+        this.currentChunk = this.queue.shift() || null;
+        this.currentFrameOffset = 0;
+        if (!this.currentChunk) break;
+        this.playingSilence = this.currentChunk.samples === null;
+      }
+
+      const chunk = this.currentChunk;
+      const run = Math.min(wanted - rendered, chunk.frameCount - this.currentFrameOffset);
+      if (chunk.samples === null) {
+        leftChannel.fill(0, rendered, rendered + run);
+        rightChannel.fill(0, rendered, rendered + run);
+        this.framesSilent += run;
+      } else if (chunk.planes) {
+        const { planes } = chunk;
+        const end = this.currentFrameOffset + run;
+        leftChannel.set(planes[0].subarray(this.currentFrameOffset, end), rendered);
+        rightChannel.set(
+          planes[planes.length > 1 ? 1 : 0].subarray(this.currentFrameOffset, end),
+          rendered
+        );
+      } else {
+        const { samples, channels: chunkChannels, scale } = chunk;
+        let base = this.currentFrameOffset * chunkChannels;
+        for (let i = rendered; i < rendered + run; i += 1) {
+          const left = samples[base] * scale;
+          leftChannel[i] = left;
+          rightChannel[i] = chunkChannels > 1 ? samples[base + 1] * scale : left;
+          base += chunkChannels;
+        }
+      }
+
+      rendered += run;
+      this.currentFrameOffset += run;
+      this.queuedFrames -= run;
+      if (this.currentFrameOffset >= chunk.frameCount) {
+        this.currentChunk = null;
+        this.currentFrameOffset = 0;
+      }
     }
 
-    if (!this.currentChunk) {
-      this.framesUnderrun += 1;
-      return [0, 0];
+    if (rendered < wanted) {
+      leftChannel.fill(0, rendered);
+      rightChannel.fill(0, rendered);
+      if (this.playingSilence) {
+        this.silenceDebtFrames += wanted - rendered;
+      } else {
+        this.framesUnderrun += wanted - rendered;
+      }
     }
+    this.framesRendered += wanted;
+  }
 
-    const frameIndex = this.currentFrameOffset;
-    const base = frameIndex * this.currentChunk.channels;
+  renderFromJitterBuffer(leftChannel, rightChannel) {
+    const jitterBuffer = this.jitterBuffer;
+    const { exports } = jitterBuffer;
+    const frames = Math.min(leftChannel.length, jitterBuffer.maxRenderFrames);
+    exports.jb_render(frames);
 
-    const leftInt = this.currentChunk.samples[base] || 0;
-    const rightInt =
-      this.currentChunk.channels > 1
-        ? this.currentChunk.samples[base + 1] || leftInt
-        : leftInt;
+    // Views sized to the quantum are made once, not per call.
+    if (!jitterBuffer.quantumLeft || jitterBuffer.quantumLeft.length !== frames) {
+      jitterBuffer.quantumLeft = jitterBuffer.outputLeft.subarray(0, frames);
+      jitterBuffer.quantumRight = jitterBuffer.outputRight.subarray(0, frames);
+    }
+    leftChannel.set(jitterBuffer.quantumLeft);
+    rightChannel.set(jitterBuffer.quantumRight);
+
+    this.queuedFrames = exports.jb_queued_frames();
+    this.playingSilence = exports.jb_playing_silence() !== 0;
+    this.framesRendered = exports.jb_frames_rendered();
+    this.framesUnderrun = exports.jb_frames_underrun();
+    this.framesConcealed = exports.jb_frames_concealed();
+    this.framesDropped = exports.jb_frames_dropped();
+    this.framesSilent = exports.jb_frames_silent();
+  }
+
+  // Moves everything the ring holds into the jitter buffer, which trims an
+  // overlong queue and conceals underruns itself.
+  drainRingToJitterBuffer() {
+    const { header, samples } = this.ring;
+    const { exports, input } = this.jitterBuffer;
+    const capacity = header[RING_CAPACITY_FRAMES];
+    const ringChannels = header[RING_CHANNELS];
+    const framesPerPush = Math.floor(input.length / ringChannels);
+    const write = Atomics.load(header, RING_WRITE_FRAME) >>> 0;
+    let read = Atomics.load(header, RING_READ_FRAME) >>> 0;
+
+    while (read !== write) {
+      const start = read % capacity;
+      const frames = Math.min((write - read) >>> 0, capacity - start, framesPerPush);
+      input.set(samples.subarray(start * ringChannels, (start + frames) * ringChannels));
+      exports.jb_push(frames, ringChannels);
+      read = (read + frames) >>> 0;
+    }
+    Atomics.store(header, RING_READ_FRAME, read | 0);
+  }
+
+  // Renders one quantum straight from the shared ring. Frames past
+  // maxQueueMs are skipped so latency cannot grow without bound.
+  renderFromRing(leftChannel, rightChannel) {
+    const { header, samples } = this.ring;
+    const capacity = header[RING_CAPACITY_FRAMES];
+    const ringChannels = header[RING_CHANNELS];
+    const write = Atomics.load(header, RING_WRITE_FRAME) >>> 0;
+    let read = Atomics.load(header, RING_READ_FRAME) >>> 0;
 
-    const left = leftInt / 32768;
-    const right = rightInt / 32768;
+    let available = (write - read) >>> 0;
+    const maxQueueFrames = Math.floor((this.maxQueueMs / 1000) * sampleRate);
+    if (available > maxQueueFrames) {
+      const skipped = available - maxQueueFrames;
+      read = (read + skipped) >>> 0;
+      available = maxQueueFrames;
+      this.framesDropped += skipped;
+    }
 
-    this.currentFrameOffset += 1;
-    this.queuedFrames -= 1;
-    if (this.currentFrameOffset >= this.currentChunk.frameCount) {
-      this.currentChunk = null;
-      this.currentFrameOffset = 0;
+    const wanted = leftChannel.length;
+    const count = Math.min(available, wanted);
+    if (this.ring.isFloat) {
+      // Each channel is a plane: at most two set() calls, split at the end
+      // of the storage.
+      const start = read % capacity;
+      const first = Math.min(count, capacity - start);
+      const rightBase = ringChannels > 1 ? capacity : 0;
+      leftChannel.set(samples.subarray(start, start + first));
+      rightChannel.set(samples.subarray(rightBase + start, rightBase + start + first));
+      if (first < count) {
+        leftChannel.set(samples.subarray(0, count - first), first);
+        rightChannel.set(samples.subarray(rightBase, rightBase + count - first), first);
+      }
+    } else {
+      for (let i = 0; i < count; i += 1) {
+        const base = ((read + i) % capacity) * ringChannels;
+        const left = samples[base] / 32768;
+        leftChannel[i] = left;
+        rightChannel[i] = ringChannels > 1 ? samples[base + 1] / 32768 : left;
+      }
     }
+    leftChannel.fill(0, count);
+    rightChannel.fill(0, count);
 
-    return [left, right];
+    Atomics.store(header, RING_READ_FRAME, (read + count) | 0);
+    if (count < wanted) {
+      this.framesUnderrun += wanted - count;
+      Atomics.add(header, RING_UNDERRUN_FRAMES, wanted - count);
+    }
+    this.queuedFrames = available - count;
+    this.framesRendered += wanted;
   }
 
   process(_inputs, outputs) {
@@ -138,11 +447,33 @@ class SystemAudioWorkletProcessor extends AudioWorkletProcessor {
     const leftChannel = output[0];
     const rightChannel = output[1] || output[0];
 
-    for (let i = 0; i < leftChannel.length; i += 1) {
-      const [left, right] = this.nextFrame();
-      leftChannel[i] = left;
-      rightChannel[i] = right;
-      this.framesRendered += 1;
+    if (this.ring && this.jitterBuffer) {
+      this.drainRingToJitterBuffer();
+      this.renderFromJitterBuffer(leftChannel, rightChannel);
+      // The writer reads underruns from the ring to settle silence.
+      const underrun = this.framesUnderrun - this.ringUnderrunMark;
+      if (underrun > 0) Atomics.add(this.ring.header, RING_UNDERRUN_FRAMES, underrun);
+      this.ringUnderrunMark = this.framesUnderrun;
+    } else if (this.ring) {
+      this.renderFromRing(leftChannel, rightChannel);
+    } else if (this.jitterBuffer) {
+      this.renderFromJitterBuffer(leftChannel, rightChannel);
+    } else {
+      this.renderFromQueue(leftChannel, rightChannel);
+    }
+
+    // An empty queue during silence says nothing about clock drift.
+    if (this.reportQueueLevel && !this.playingSilence) {
+      this.levelFrameSum += this.queuedFrames;
+      this.levelQuanta += 1;
+      if (this.levelQuanta >= LEVEL_REPORT_QUANTA) {
+        this.port.postMessage({
+          type: 'level',
+          queueMs: (this.levelFrameSum / this.levelQuanta / sampleRate) * 1000,
+        });
+        this.levelFrameSum = 0;
+        this.levelQuanta = 0;
+      }
     }
 
     this.statsCounter += 1;
@@ -154,6 +485,12 @@ class SystemAudioWorkletProcessor extends AudioWorkletProcessor {
         framesRendered: this.framesRendered,
         framesUnderrun: this.framesUnderrun,
         framesDropped: this.framesDropped,
+        framesSilent: this.framesSilent,
+        framesConcealed: this.framesConcealed,
+        jitterBuffer: this.jitterBuffer ? 'wasm' : this.ring ? 'none' : 'js',
+        ringOverrunFrames: this.ring
+          ? Atomics.load(this.ring.header, RING_OVERRUN_FRAMES) >>> 0
+          : 0,
       });
     }
 
@@ -1,22 +1,183 @@
+import {
+  createSharedPcmRing,
+  getSharedPcmRingStats,
+  isSharedRingSupported,
+  writeSharedPcmRing,
+} from '../audio/sharedPcmRing.js';
+
 const WORKLET_MODULE_URL = new URL('../audio/systemAudioWorklet.js', import.meta.url);
 
+let nextRingId = 1;
+
+// Whether the preload loaded the addon, so the capture thread can write
+// into the worklet's ring itself.
+function hasNativeRing() {
+  return (
+    isSharedRingSupported() && window.electronAPI?.systemAudioRing?.isAvailable?.() === true
+  );
+}
+
+// Where capture runs: in this renderer, writing into `nativeRingBuffer`, or
+// in main's worker, which sends every chunk here.
+function getCaptureApi(nativeRingBuffer) {
+  const api = window.electronAPI;
+  if (!nativeRingBuffer) {
+    return {
+      start: (options) => api.startSystemAudio(options),
+      stop: () => api.stopSystemAudio(),
+      getStats: () => api.getSystemAudioStats(),
+      reportQueueLevel: (queueMs) => api.reportSystemAudioQueueLevel(queueMs),
+    };
+  }
+  return {
+    start: (options) => {
+      const id = nextRingId;
+      nextRingId += 1;
+      const started = api.systemAudioRing.start(id, options);
+      // The preload waits for the buffer, which only postMessage can carry.
+      window.postMessage({ type: 'system-audio:ring', id, buffer: nativeRingBuffer }, '*');
+      return started;
+    },
+    stop: () => api.systemAudioRing.stop(),
+    getStats: () => api.systemAudioRing.getStats(),
+    reportQueueLevel: (queueMs) => api.systemAudioRing.reportQueueLevel(queueMs),
+  };
+}
+
 function toArrayBuffer(value) {
   if (value instanceof ArrayBuffer) {
     return value;
   }
 
   if (ArrayBuffer.isView(value)) {
+    // IPC hands us a fresh view per chunk; reuse its buffer when the view
+    // covers all of it instead of copying again.
+    if (value.byteOffset === 0 && value.byteLength === value.buffer.byteLength) {
+      return value.buffer;
+    }
     return value.buffer.slice(value.byteOffset, value.byteOffset + value.byteLength);
   }
 
   return null;
 }
 
+// Converts decoder output to the interleaved int16 layout the worklet reads.
+function audioDataToInt16(audioData) {
+  const frameCount = audioData.numberOfFrames;
+  const channelCount = audioData.numberOfChannels;
+  const interleaved = new Int16Array(frameCount * channelCount);
+  const plane = new Float32Array(frameCount);
+
+  for (let channel = 0; channel < channelCount; channel += 1) {
+    audioData.copyTo(plane, { planeIndex: channel, format: 'f32-planar' });
+    for (let frame = 0; frame < frameCount; frame += 1) {
+      const sample = Math.max(-1, Math.min(1, plane[frame]));
+      interleaved[frame * channelCount + channel] = Math.round(sample * 32767);
+    }
+  }
+
+  return interleaved;
+}
+
+function createOpusChunkDecoder({ sampleRate, channels, onPcm, onSilence }) {
+  if (typeof AudioDecoder !== 'function' || typeof EncodedAudioChunk !== 'function') {
+    throw new Error('WebCodecs AudioDecoder is required for Opus system audio.');
+  }
+
+  const decoder = new AudioDecoder({
+    output: (audioData) => {
+      try {
+        onPcm({
+          pcm: audioDataToInt16(audioData).buffer,
+          frameCount: audioData.numberOfFrames,
+          sampleRate: audioData.sampleRate,
+          channels: audioData.numberOfChannels,
+        });
+      } finally {
+        audioData.close();
+      }
+    },
+    error: () => {
+      // A corrupt packet resets the decoder; later packets decode again.
+    },
+  });
+  decoder.configure({ codec: 'opus', sampleRate, numberOfChannels: channels });
+
+  return {
+    decode(chunk) {
+      if (decoder.state !== 'configured') {
+        decoder.configure({ codec: 'opus', sampleRate, numberOfChannels: channels });
+      }
+      decoder.decode(
+        new EncodedAudioChunk({
+          type: 'key',
+          timestamp: Math.round((chunk.timestampMs || 0) * 1000),
+          data: chunk.packet,
+        })
+      );
+    },
+    // Markers carry no packet, so they wait for the packets ahead of them to
+    // come out of the decoder to keep their place in the stream.
+    silence(chunk) {
+      if (decoder.state !== 'configured' || decoder.decodeQueueSize === 0) {
+        onSilence(chunk);
+        return;
+      }
+      decoder.flush().then(
+        () => onSilence(chunk),
+        () => onSilence(chunk)
+      );
+    },
+    close() {
+      if (decoder.state !== 'closed') {
+        decoder.close();
+      }
+    },
+  };
+}
+
+async function loadJitterBufferModule() {
+  if (typeof window.electronAPI.getJitterBufferWasm !== 'function') return null;
+  try {
+    const bytes = await window.electronAPI.getJitterBufferWasm();
+    return bytes ? await WebAssembly.compile(bytes) : null;
+  } catch (_err) {
+    return null;
+  }
+}
+
+// Opens the loopback device ahead of time so a later
+// createElectronSystemAudioTrack() with the same scheduling and transport
+// only has to start the stream. Best effort: resolves false when the device
+// cannot be opened now, and start will try again.
+export async function prepareElectronSystemAudio({
+  schedulingPolicy = 'pro-audio',
+  transport = 'message',
+} = {}) {
+  try {
+    if (transport === 'shared-ring' && hasNativeRing()) {
+      return await window.electronAPI.systemAudioRing.prepare({ schedulingPolicy });
+    }
+    if (typeof window.electronAPI?.prepareSystemAudio !== 'function') return false;
+    return await window.electronAPI.prepareSystemAudio({ schedulingPolicy });
+  } catch (_err) {
+    return false;
+  }
+}
+
 export async function createElectronSystemAudioTrack({
   targetSampleRate = 48000,
   channels = 2,
   frameMs = 20,
+  resamplerQuality = 'high-fidelity',
+  encoding = 'pcm',
+  sampleFormat = 's16',
+  opus,
+  transport = 'message',
   maxQueueMs = 500,
+  driftCompensation = true,
+  silenceSuppression = true,
+  schedulingPolicy = 'pro-audio',
   onStats,
 } = {}) {
   if (!window.electronAPI?.isElectron) {
@@ -34,6 +195,43 @@ export async function createElectronSystemAudioTrack({
 
   await audioContext.audioWorklet.addModule(WORKLET_MODULE_URL);
 
+  // 'shared-ring' hands PCM to the worklet through a SharedArrayBuffer ring
+  // it reads on the audio thread; unless the page is cross-origin isolated it
+  // falls back to one postMessage per chunk. When the preload has the addon,
+  // its capture thread writes PCM into the ring; otherwise chunks still come
+  // from main and are written here.
+  // 'f32-planar' and 'f32-interleaved' have the addon send float32 PCM sized
+  // in whole render quanta, which the worklet copies into its outputs with
+  // set() instead of converting. The ring keeps float as planes, so it asks
+  // for 'f32-planar' either way. Opus stays int16.
+  const useRing = transport === 'shared-ring' && isSharedRingSupported();
+  const wantsFloat = encoding === 'pcm' && ['f32-planar', 'f32-interleaved'].includes(sampleFormat);
+  const pcmSampleFormat = !wantsFloat ? 's16' : useRing ? 'f32-planar' : sampleFormat;
+
+  const sharedRing = useRing
+    ? createSharedPcmRing({
+        capacityFrames: Math.ceil((maxQueueMs / 1000) * targetSampleRate * 2),
+        channels,
+        sampleRate: targetSampleRate,
+        sampleFormat: pcmSampleFormat,
+      })
+    : null;
+  const nativeRing = sharedRing !== null && encoding === 'pcm' && hasNativeRing();
+  const capture = getCaptureApi(nativeRing ? sharedRing.buffer : null);
+
+  // The worklet queues and renders in WebAssembly when the module was built
+  // (npm run build:wasm), draining the ring into it if there is one, and
+  // falls back to JavaScript. The WebAssembly queue holds int16, so float
+  // chunks skip it.
+  const jitterBufferModule = pcmSampleFormat !== 's16' ? null : await loadJitterBufferModule();
+
+  // The worklet reports how full its queue is and the addon trims its
+  // output rate to keep it near a small target, so the capture and playout
+  // clocks drifting apart neither underruns nor builds up latency.
+  const reportQueueLevel =
+    driftCompensation !== false &&
+    (nativeRing || typeof window.electronAPI.reportSystemAudioQueueLevel === 'function');
+
   const workletNode = new AudioWorkletNode(audioContext, 'system-audio-worklet', {
     numberOfInputs: 0,
     numberOfOutputs: 1,
@@ -41,6 +239,9 @@ export async function createElectronSystemAudioTrack({
     processorOptions: {
       channels,
       maxQueueMs,
+      sharedRingBuffer: sharedRing ? sharedRing.buffer : null,
+      jitterBufferModule,
+      reportQueueLevel,
     },
   });
 
@@ -48,45 +249,180 @@ export async function createElectronSystemAudioTrack({
   workletNode.connect(destination);
 
   let workletStats = {
+    transport: nativeRing ? 'native-ring' : sharedRing ? 'shared-ring' : 'message',
     queueMs: 0,
     framesRendered: 0,
     framesUnderrun: 0,
     framesDropped: 0,
+    framesSilent: 0,
+    framesConcealed: 0,
+    jitterBuffer: jitterBufferModule ? 'wasm' : sharedRing ? 'none' : 'js',
+    ringOccupancyFrames: 0,
+    ringOverrunFrames: 0,
   };
 
   workletNode.port.onmessage = (event) => {
     const data = event.data;
+    if (data?.type === 'level') {
+      capture.reportQueueLevel(data.queueMs);
+      return;
+    }
     if (!data || data.type !== 'stats') return;
     workletStats = {
+      transport: workletStats.transport,
       queueMs: data.queueMs || 0,
       framesRendered: data.framesRendered || 0,
       framesUnderrun: data.framesUnderrun || 0,
       framesDropped: data.framesDropped || 0,
+      framesSilent: data.framesSilent || 0,
+      framesConcealed: data.framesConcealed || 0,
+      jitterBuffer: data.jitterBuffer || workletStats.jitterBuffer,
+      ringOccupancyFrames: sharedRing ? getSharedPcmRingStats(sharedRing).occupancyFrames : 0,
+      ringOverrunFrames: data.ringOverrunFrames || 0,
     };
   };
 
-  const unsubscribeChunk = window.electronAPI.onAudioChunk((chunk) => {
-    if (!chunk?.pcm) return;
+  // Ring underruns seen while the ring held only silence are owed against
+  // the next silence marker, which covers time that has already passed.
+  let ringUnderrunMark = 0;
+  let ringPlayingSilence = false;
+  const RingSamples = sharedRing?.sampleFormat === 'f32-planar' ? Float32Array : Int16Array;
+  let ringZeros = new RingSamples(0);
 
-    const pcm = toArrayBuffer(chunk.pcm);
-    if (!pcm) return;
+  const postPcmChunk = ({
+    pcm,
+    frameCount,
+    sampleRate,
+    channels: chunkChannels,
+    sampleFormat: chunkFormat = 's16',
+  }) => {
+    // The ring carries frames in its own format and the context's rate and
+    // channels only; anything else takes the message path, where the worklet
+    // converts it.
+    if (
+      sharedRing &&
+      chunkFormat === sharedRing.sampleFormat &&
+      sampleRate === audioContext.sampleRate &&
+      chunkChannels === channels
+    ) {
+      writeSharedPcmRing(sharedRing, new RingSamples(pcm, 0, frameCount * channels), frameCount);
+      ringUnderrunMark = getSharedPcmRingStats(sharedRing).underrunFrames;
+      ringPlayingSilence = false;
+      return;
+    }
 
     workletNode.port.postMessage(
       {
         type: 'chunk',
         pcm,
-        frameCount: chunk.frameCount,
-        sampleRate: chunk.sampleRate,
-        channels: chunk.channels,
+        sampleFormat: chunkFormat,
+        frameCount,
+        sampleRate,
+        channels: chunkChannels,
       },
       [pcm]
     );
-  });
+  };
+
+  const postSilence = ({ frameCount, sampleRate }) => {
+    if (!frameCount) return;
+
+    if (sharedRing && sampleRate === audioContext.sampleRate) {
+      const underrunFrames = getSharedPcmRingStats(sharedRing).underrunFrames;
+      const owed = ringPlayingSilence
+        ? Math.min((underrunFrames - ringUnderrunMark) >>> 0, frameCount)
+        : 0;
+      ringUnderrunMark = ringPlayingSilence ? (ringUnderrunMark + owed) >>> 0 : underrunFrames;
+      ringPlayingSilence = true;
+
+      const zeroFrames = frameCount - owed;
+      if (zeroFrames === 0) return;
+      if (ringZeros.length < zeroFrames * channels) {
+        ringZeros = new RingSamples(zeroFrames * channels);
+      }
+      writeSharedPcmRing(sharedRing, ringZeros, zeroFrames);
+      return;
+    }
+
+    workletNode.port.postMessage({ type: 'silence', frameCount, sampleRate });
+  };
+
+  // Opus packets are decoded here with WebCodecs, so only compressed bytes
+  // cross the IPC boundary.
+  const opusDecoder =
+    encoding === 'opus'
+      ? createOpusChunkDecoder({
+          sampleRate: targetSampleRate,
+          channels,
+          onPcm: postPcmChunk,
+          onSilence: postSilence,
+        })
+      : null;
+
+  // Chunks lost on the way here (a full delivery queue, a failed dispatch)
+  // leave a hole in samplePosition. Playing silence for it keeps later audio
+  // on the capture timeline; a hole longer than the playout queue is left
+  // alone, since the worklet would only drop the silence again.
+  let nextSamplePosition = null;
+  const fillPositionGap = (chunk) => {
+    if (typeof chunk?.samplePosition !== 'number') return;
+    const gapFrames =
+      nextSamplePosition === null ? 0 : chunk.samplePosition - nextSamplePosition;
+    if (gapFrames > 0 && gapFrames <= (maxQueueMs / 1000) * chunk.sampleRate) {
+      const gap = { frameCount: gapFrames, sampleRate: chunk.sampleRate };
+      if (opusDecoder) {
+        opusDecoder.silence(gap);
+      } else {
+        postSilence(gap);
+      }
+    }
+    nextSamplePosition = chunk.samplePosition + (chunk.frameCount || 0);
+  };
+
+  const handleChunk = (chunk) => {
+    fillPositionGap(chunk);
+    if (chunk?.encoding === 'silence') {
+      if (opusDecoder) {
+        opusDecoder.silence(chunk);
+      } else {
+        postSilence(chunk);
+      }
+      return;
+    }
+
+    if (chunk?.encoding === 'opus') {
+      if (opusDecoder && chunk.packet) {
+        opusDecoder.decode(chunk);
+      }
+      return;
+    }
+
+    if (!chunk?.pcm) return;
+
+    const pcm = toArrayBuffer(chunk.pcm);
+    if (!pcm) return;
+
+    postPcmChunk({
+      pcm,
+      frameCount: chunk.frameCount,
+      sampleRate: chunk.sampleRate,
+      channels: chunk.channels,
+      sampleFormat: chunk.sampleFormat,
+    });
+  };
+  const unsubscribeChunk = nativeRing ? () => {} : window.electronAPI.onAudioChunk(handleChunk);
 
-  const nativeStats = await window.electronAPI.startSystemAudio({
+  const nativeStats = await capture.start({
     targetSampleRate,
     channels,
     frameMs,
+    resamplerQuality,
+    encoding,
+    sampleFormat: pcmSampleFormat,
+    opus,
+    driftCompensation: reportQueueLevel ? driftCompensation : false,
+    silenceSuppression,
+    schedulingPolicy,
   });
 
   if (audioContext.state !== 'running') {
@@ -96,7 +432,8 @@ export async function createElectronSystemAudioTrack({
   const track = destination.stream.getAudioTracks()[0];
   if (!track) {
     unsubscribeChunk();
-    await window.electronAPI.stopSystemAudio();
+    opusDecoder?.close();
+    await capture.stop();
     await audioContext.close();
     throw new Error('Unable to create system audio MediaStreamTrack.');
   }
@@ -109,7 +446,7 @@ export async function createElectronSystemAudioTrack({
   if (typeof onStats === 'function') {
     statsTimer = window.setInterval(async () => {
       try {
-        const captureStats = await window.electronAPI.getSystemAudioStats();
+        const captureStats = await capture.getStats();
         onStats({
           capture: captureStats,
           worklet: workletStats,
@@ -132,6 +469,7 @@ export async function createElectronSystemAudioTrack({
 
     try {
       unsubscribeChunk();
+      opusDecoder?.close();
     } catch (_err) {
       // Ignore cleanup errors.
     }
@@ -144,7 +482,7 @@ export async function createElectronSystemAudioTrack({
     }
 
     try {
-      await window.electronAPI.stopSystemAudio();
+      await capture.stop();
     } catch (_err) {
       // Ignore stop errors.
     }
@@ -163,7 +501,7 @@ export async function createElectronSystemAudioTrack({
     nativeStats,
     stop,
     getStats: async () => {
-      const captureStats = await window.electronAPI.getSystemAudioStats();
+      const captureStats = await capture.getStats();
       return {
         capture: captureStats,
         worklet: workletStats,
@@ -17,7 +17,10 @@ import { WS_URL } from '../lib/config.js';
 import { useI18n } from '../lib/i18n.jsx';
 import { useUsername } from '../lib/userProfile.js';
 import UsernameModal from '../components/UsernameModal.jsx';
-import { createElectronSystemAudioTrack } from '../lib/systemAudioElectron.js';
+import {
+  createElectronSystemAudioTrack,
+  prepareElectronSystemAudio,
+} from '../lib/systemAudioElectron.js';
 
 function createRoomId() {
   const alphabet = 'ABCDEFGHJKMNPQRSTUVWXYZ23456789';
@@ -80,6 +83,8 @@ function Host() {
   useEffect(() => {
     if (!isElectronRuntime) return;
     loadCaptureSources();
+    // Sharing then only has to start the stream.
+    prepareElectronSystemAudio({ transport: 'shared-ring' });
   }, [isElectronRuntime]);
 
   useEffect(() => {
@@ -510,6 +515,7 @@ function Host() {
         channels: 2,
         frameMs: 20,
         maxQueueMs: 500,
+        transport: 'shared-ring',
         onStats: ({ capture, worklet }) => {
           const droppedChunks = Number(capture?.droppedChunks || 0);
           const underrunFrames = Number(worklet?.framesUnderrun || 0);